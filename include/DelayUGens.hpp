@@ -21,4 +21,7 @@
 
 void AddDelayUGenOps();
 
+// the [left right] outputs of a feedback delay network reverb. it has no word of its own yet.
+P<List> fdnOutputs(Thread& th, Arg in, Arg wet, Z mindelay, Z maxdelay, Z decayLo, Z decayMid, Z decayHi, Z seed);
+
 #endif /* defined(__taggeddoubles__DelayUGens__) */
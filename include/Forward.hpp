@@ -78,7 +78,14 @@ const double NaN = NAN;
 
 // Object flags
 enum ObjectFlags {
-    flag_NoEachOps = 1
+    flag_NoEachOps = 1,
+    flag_Pure = 2, // a Prim whose result depends only on its real number arguments
+    flag_EachOp = 4, // set on every EachOp, so testing for one needs no virtual call
+    flag_Pooled = 8, // allocated by poolAllocObject
+    flag_Counted = 16, // counted in the pool's live objects of its type, whose slot is in scratch
+    flag_Float32 = 32, // an itemTypeZ Array whose elements are stored as float
+    flag_Constant = 64, // an itemTypeZ Array whose elements all have the same value
+    flag_Silent = 128 // an itemTypeZ Array whose elements are all zero. always also flag_Constant
 };
 
 // List item types
@@ -103,6 +110,10 @@ const int kMaxArgs = 16;
 
 typedef void (*PrimFun)(Thread& th, Prim*);
 
+// a primitive that ends by applying a value may also provide a TailPrimFun, which
+// does the same work but returns that value instead of applying it.
+typedef V (*TailPrimFun)(Thread& th, Prim*);
+
 //==============================================================================
 // Error Functions
 //==============================================================================
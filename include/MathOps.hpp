@@ -166,6 +166,44 @@ struct BinaryOpLinkZGen : public Gen
 	virtual void pull(Thread& th) override;
 };
 
+// A chain of elementwise signal math, such as `a 2 * b + sin`, evaluated by a single
+// Gen. The chain is kept as a postfix program over its leaf inputs. Each block is
+// computed in tiles of kTileSize frames whose intermediate values stay in stack
+// buffers, so the chain makes one pass and one output array per block instead of
+// one of each per operation. Its length is the shortest of its inputs', as it is
+// for the chain of BinaryOpZGens and UnaryOpZGens that it replaces.
+struct FusedOpZGen : public Gen
+{
+	enum { kMaxInputs = 8, kMaxSteps = 24, kMaxDepth = 6, kTileSize = 64 };
+
+	// exactly one of mUnary, mBinary or an mInput >= 0 is set.
+	struct Step
+	{
+		UnaryOp* mUnary;
+		BinaryOp* mBinary;
+		int mInput;
+	};
+
+	std::vector<ZIn> mInputs;
+	std::vector<Step> mSteps;
+
+	FusedOpZGen(Thread& th, std::vector<V> const& inSources, std::vector<Step> const& inSteps);
+
+	virtual const char* TypeName() const override { return "FusedOpZGen"; }
+
+	virtual void pull(Thread& th) override;
+
+private:
+	void run(int n, Z* const* in, const int* stride, Z* out);
+	// whether the chain's output for these inputs is all zeros, so run can be skipped.
+	bool isSilent(Z* const* in, const int* stride) const;
+};
+
+// make the signal for an elementwise op, fused with the unevaluated math signals
+// among its arguments when vm.fuseon is set.
+V makeUnaryOpZList(Thread& th, UnaryOp* op, Arg a);
+V makeBinaryOpZList(Thread& th, BinaryOp* op, Arg a, Arg b);
+
 
 struct ScanOpZGen : public Gen
 {
@@ -43,6 +43,8 @@
 #include <string.h>
 #include <string>
 #include <vector>
+#include <atomic>
+#include <memory>
 #include "MathFuns.hpp"
 #include "PlatformLock.hpp"
 
@@ -61,12 +63,14 @@ bool Equals(Thread& th, Arg a, Arg b);
 
 class Ref : public Object
 {
+protected:
 	Z z;
 	O o;
     mutable SpinLockType mSpinLock = SPINLOCK_INIT;
 public:
 
 	Ref(V inV) : z(inV.f), o(inV.o()) { if (o) o->retain(); }
+	virtual ~Ref() { if (o) o->release(); }
 
 	virtual const char* TypeName() const override { return "Ref"; }
 
@@ -85,6 +89,8 @@ public:
 	}
 
 	virtual void set(Arg inV);
+	// what the set prim calls. a WindowRef wraps lists here.
+	virtual void set(Thread& th, Arg inV) { set(inV); }
 	virtual V deref() const override;
 	virtual Z derefz() const override { return deref().asFloat(); }
 	virtual Z asFloat() const override
@@ -97,7 +103,7 @@ public:
 		V v = deref();
 		// race condition window.
 		// may overwrite an intervening set from another thread, but better than holding a lock.
-		set(v.chase(th, n));
+		set(th, v.chase(th, n));
 		return this;
 	}
 
@@ -124,6 +130,38 @@ public:
 	}
 };
 
+//==============================================================================
+// WindowRef - Ref that keeps only the most recent items of its list reachable
+//==============================================================================
+
+class WindowGen;
+
+// a list set into a WindowRef is read through a WindowGen, which moves the head the
+// Ref holds forward as the list is forced. at least mWindow items stay reachable
+// from the head, and older blocks are dropped. other values are held as a Ref holds
+// them.
+class WindowRef : public Ref
+{
+	int64_t mWindow;
+	int64_t mHeld = 0; // items from the head to the end of what has been forced
+	P<WindowGen> mGen;
+public:
+
+	WindowRef(Thread& th, Arg inV, int64_t inWindow);
+	virtual ~WindowRef();
+
+	virtual const char* TypeName() const override { return "WindowRef"; }
+
+	using Ref::set;
+	virtual void set(Thread& th, Arg inV) override;
+
+	// called by the WindowGen after it produces a block of n items. returns the old
+	// head for the caller to release.
+	O produced(WindowGen* inGen, int64_t n);
+
+	int64_t window() const { return mWindow; }
+};
+
 //==============================================================================
 // ZRef - Mutable reference to a Z (sample) value
 //==============================================================================
@@ -236,6 +274,7 @@ public:
 	virtual void apply(Thread& th) override;
 	void run(Thread& th);
 	void runREPL(Thread& th);
+	void enterTailCall(Thread& th);
 };
 
 //==============================================================================
@@ -246,14 +285,15 @@ class Prim : public Object
 {
 public:
 	PrimFun prim;
+	TailPrimFun mTailFun; // used instead of prim when called in tail position. may be null.
 	V v;
 	const char* mName;
 	const char* mHelp;
 	uint16_t mTakes;
 	uint16_t mLeaves;
 
-	Prim(PrimFun _primFun, Arg _v, uint16_t takes, uint16_t leaves, const char* name, const char* help)
-		: Object(), prim(_primFun), v(_v), mName(name), mHelp(help), mTakes(takes), mLeaves(leaves) {}
+	Prim(PrimFun _primFun, Arg _v, uint16_t takes, uint16_t leaves, const char* name, const char* help, TailPrimFun _tailFun = nullptr)
+		: Object(), prim(_primFun), mTailFun(_tailFun), v(_v), mName(name), mHelp(help), mTakes(takes), mLeaves(leaves) {}
 
 	virtual const char* TypeName() const override { return "Prim"; }
 	virtual const char* OneLineHelp() const override { return mHelp; }
@@ -282,6 +322,9 @@ public:
 // EachOp - Each operation wrapper
 //==============================================================================
 
+// the number of EachOps in existence. see hasEachOps.
+extern std::atomic<int32_t> gLiveEachOps;
+
 class EachOp : public Object
 {
 public:
@@ -289,13 +332,15 @@ public:
 	int32_t mask;
 
 	EachOp(Arg inV, int inMask)
-		: v(inV), mask(inMask) {}
-
+		: v(inV), mask(inMask)
+	{
+		flags |= flag_EachOp;
+		gLiveEachOps.fetch_add(1, std::memory_order_relaxed);
+	}
+	virtual ~EachOp() { gLiveEachOps.fetch_sub(1, std::memory_order_relaxed); }
 
 	virtual const char* TypeName() const override { return "EachOp"; }
 
-	virtual bool isEachOp() const override { return true; }
-
 	using Object::print;
 	virtual void print(Thread& th, std::string& out, int depth) override;
 };
@@ -554,25 +599,54 @@ struct VIn : In
 	bool link(Thread& th, List* inList);
 };
 
+// the most samples ZIn widens from float storage at a time.
+const int kFloat32WidenSize = 256;
+
 struct ZIn : In
 {
 	bool mOnce = true;
+	int mControlPeriod = 0; // see setControlPeriod
+	P<Array> mWiden; // float storage is widened into this. not shared by copies.
 
 	ZIn();
 	ZIn(Arg inValue);
+	ZIn(ZIn const& that) : In(that), mOnce(that.mOnce), mControlPeriod(that.mControlPeriod) {}
+	ZIn& operator=(ZIn const& that)
+	{
+		In::operator=(that);
+		mOnce = that.mOnce;
+		mControlPeriod = that.mControlPeriod;
+		return *this;
+	}
 
 	void set(Arg v);
+	// with a period over 1, operator() reads one value for every period frames of each
+	// block and hands it out as a scalar, so that the caller takes its scalar path.
+	// a gen sets this on its parameter inputs from vm.autokr.
+	void setControlPeriod(int period) { mControlPeriod = period; }
 	bool operator()(Thread& th, int& ioNum, int& outStride, Z*& outBuffer);
     bool onez(Thread& th, Z& z);
     bool peek(Thread& th, Z& z);
 	bool fill(Thread& th, int& ioNum, Z* outBuffer, int outStride);
 	bool fill(Thread& th, int& ioNum, float* outBuffer, int outStride);
 	bool mix(Thread& th, int& ioNum, Z* outBuffer);
+	// as above, and clears ioSilent if anything but zeros was added.
+	bool mix(Thread& th, int& ioNum, Z* outBuffer, bool& ioSilent);
+	// converts and adds into every outStride'th float, e.g. one channel of an interleaved device buffer.
+	bool mix(Thread& th, int& ioNum, float* outBuffer, int outStride);
 	bool bench(Thread& th, int& ioNum);
 	bool link(Thread& th, List* inList);
 
 	bool fillSegment(Thread& th, int inNum, Z* outBuffer);
 	void hop(Thread& th, int framesToAdvance);
+	// forces the lists that hold the next inNum frames, without reading them. see WorkPool.hpp.
+	void pullAhead(Thread& th, int inNum) const;
+
+	// whether a run from operator() is all zeros: a silent block or a literal 0.
+	static bool isSilent(int stride, const Z* buffer) { return stride == 0 && *buffer == 0.; }
+
+private:
+	Z* widen(const float* in, int n);
 };
 
 
@@ -686,6 +760,7 @@ class Array : public Object
 		void* p;
 		V* vv;
 		Z* zz;
+		float* ff;
 	};
 
 public:
@@ -696,6 +771,16 @@ public:
 		alloc(std::max(int64_t(1), inCap));
 	}
 
+	// a Z array that stores its elements as float, in half the memory. z() must not
+	// be used on it; readers widen the elements with f() or _atz.
+	Array(int inItemType, int64_t inCap, bool inFloat32) : mSize(0), mCap(0), p(0)
+	{
+		elemType = inItemType;
+		if (inFloat32 && inItemType == itemTypeZ)
+			flags |= flag_Float32;
+		alloc(std::max(int64_t(1), inCap));
+	}
+
 	virtual ~Array();
 
 	virtual const char* TypeName() const override { return "Array"; }
@@ -703,11 +788,22 @@ public:
 
 	bool isV() const { return elemType == itemTypeV; }
 	bool isZ() const { return elemType == itemTypeZ; }
+	bool isF() const { return flags & flag_Float32; }
+
+	// set by a generator that filled the whole block with one value. ZIn reads such
+	// an array as a stride 0 scalar. add and put clear it.
+	bool isConstant() const { return flags & flag_Constant; }
+	void setConstant() { flags |= flag_Constant; }
+	// set by a generator that filled the whole block with zeros.
+	bool isSilent() const { return flags & flag_Silent; }
+	void setSilent() { flags |= flag_Constant | flag_Silent; }
 
     V* v() { return vv; }
     Z* z() { return zz; }
+    float* f() { return ff; }
+    void* data() { return p; }
 
-	size_t elemSize() { return isV() ? sizeof(V) : sizeof(Z); }
+	size_t elemSize() const { return isV() ? sizeof(V) : isF() ? sizeof(float) : sizeof(Z); }
 	void alloc(int64_t inCap);
 
 	int64_t size() const { return mSize; }
@@ -768,11 +864,34 @@ public:
 // List - Lazy list with generator support
 //==============================================================================
 
+// a render thread frees this many nodes of a chain it drops, and defers the rest.
+const int64_t kListFreedInline = 64;
+
+// List::mForceState. a list made from a Gen starts unforced. the thread that moves it
+// to forcing pulls the gen without taking the list's lock, and marks it forced.
+enum {
+	kListUnforced = 0,
+	kListForcing = 1,
+	kListForced = 2
+};
+
+// how List::force calls finished, summed over all threads. see listForceCounts.
+struct ListForceCounts
+{
+	int64_t mForced = 0; // already forced. no lock taken.
+	int64_t mClaimed = 0; // pulled by the calling thread alone. no lock taken.
+	int64_t mContended = 0; // another thread was pulling. waited on the lock.
+};
+
+void listForceCounts(ListForceCounts& outCounts);
+void listForceCountsReset();
+
 class List : public Object
 {
 	P<List> mNext;
 public:
-    mutable SpinLockType mSpinLock = SPINLOCK_INIT;
+    mutable SpinLockType mSpinLock = SPINLOCK_INIT; // only taken when two threads force the list at once.
+	std::atomic<uint8_t> mForceState{kListForced};
 	P<Gen> mGen;
 	P<Array> mArray;
 
@@ -805,6 +924,8 @@ public:
 	bool isV() const { return elemType == itemTypeV; }
 	bool isZ() const { return elemType == itemTypeZ; }
 	bool isPacked() const { return !mNext && !mGen; }
+	// packed, and readable through raw z() or v() pointers.
+	bool isPackedWide() const { return isPacked() && !mArray->isF(); }
 
 	virtual int64_t length(Thread& th) override;
 
@@ -814,11 +935,14 @@ public:
 	Z* fulfillz(int n);
 	Z* fulfillz_link(int n, P<List> const& next);
 	Z* fulfillz(P<Array> const& inArray);
+	float* fulfillf(int n);
 	void link(Thread& th, List* inList);
 	void end();
 
 	List* pack(Thread& th);
 	List* packz(Thread& th);
+	// packs a Z list into float storage. pack and packz widen it again.
+	List* packf(Thread& th);
 	List* pack(Thread& th, int limit);
 	List* packSome(Thread& th, int64_t& limit);
 	void forceAll(Thread& th);
@@ -919,9 +1043,41 @@ struct Opcode
 	Opcode(int _op, Arg _v) : op(_op), v(_v) {}
 
 	int op;
+#ifdef SAPF_NAN_BOXING
+	// the workspace cache of an opPushWorkspaceVar or opCallWorkspaceVar, as an index
+	// into the table of caches, or 0. a NaN-boxed v has room only for the symbol.
+	uint32_t mCache = 0;
+#endif
 	V v;
 };
 
+//==============================================================================
+// WorkspaceCache - Inline cache for workspace variable opcodes
+//==============================================================================
+
+// incremented whenever a workspace binding is added or a GForm is created.
+// a cache entry is valid only while the stamp it was filled under is current.
+extern std::atomic<uint64_t> gWorkspaceVersion;
+
+// opPushWorkspaceVar and opCallWorkspaceVar keep the symbol in v.o and a pointer
+// to one of these in v.i, or with SAPF_NAN_BOXING its index in mCache. The cached value is held without a reference: bindings
+// are never removed from a GTable, so the value stays alive as long as the GForm
+// it was found through, and a hit requires that GForm to be the current workspace.
+// Entries are filled by one thread at a time and read with a sequence check so
+// that threads sharing the code never see a torn entry.
+struct WorkspaceCache
+{
+	std::atomic<uint32_t> mSeq{0}; // odd while a fill is in progress
+	std::atomic<uint64_t> mStamp{0};
+	std::atomic<GForm*> mForm{nullptr};
+	std::atomic<Object*> mObj{nullptr};
+	std::atomic<double> mReal{0.};
+	std::atomic_flag mFilling = ATOMIC_FLAG_INIT;
+
+	bool lookup(GForm* form, V& outValue);
+	void fill(GForm* form, uint64_t stamp, Arg value);
+};
+
 //==============================================================================
 // Code - Compiled bytecode
 //==============================================================================
@@ -931,6 +1087,7 @@ class Code : public Object
 public:
 	std::vector<Opcode> ops;
 	std::vector<V> keys;
+	std::unique_ptr<WorkspaceCache[]> mInlineCaches;
 
 	Code(int64_t capacity) : Object() { ops.reserve(capacity); }
 	virtual ~Code();
@@ -940,6 +1097,10 @@ public:
 	virtual bool isCode() const { return true; }
 
 	void shrinkToFit();
+	void optimize(Thread& th);
+	void markTailCall();
+	void fuseSuperinstructions();
+	void allocInlineCaches();
 
 	int64_t size() { return ops.size(); }
 
@@ -963,12 +1124,14 @@ public:
 inline V Array::_at(int64_t i)
 {
 	if (isV()) return vv[i];
+	else if (isF()) return V((Z)ff[i]);
 	else return V(zz[i]);
 }
 
 inline Z Array::_atz(int64_t i)
 {
-	if (isZ()) return zz[i];
+	if (isF()) return ff[i];
+	else if (isZ()) return zz[i];
 	else return vv[i].asFloat();
 }
 
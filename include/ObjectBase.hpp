@@ -38,6 +38,8 @@ public:
     Object();
     virtual ~Object();
 
+    virtual void firstRetain() const override;
+
     // Comparison
     virtual int Compare(Thread& th, Arg b)
     {
@@ -54,6 +56,9 @@ public:
     // Flags
     bool NoEachOps() const { return flags & flag_NoEachOps; }
     void SetNoEachOps() { flags |= flag_NoEachOps; }
+    bool IsPure() const { return flags & flag_Pure; }
+    void SetPure() { flags |= flag_Pure; }
+    bool isEachOp() const { return flags & flag_EachOp; }
 
     // Finiteness
     virtual bool isFinite() const { return finite; }
@@ -131,7 +136,6 @@ public:
     virtual bool isList() const { return false; }
     virtual bool isVList() const { return false; }
     virtual bool isZList() const { return false; }
-    virtual bool isEachOp() const { return false; }
 
     // Hashing and equality
     virtual int Hash() const { return (int)::Hash64((uintptr_t)this); }
@@ -25,6 +25,52 @@
 // V inline implementations
 //==============================================================================
 
+#ifdef SAPF_NAN_BOXING
+
+inline VObjRef& VObjRef::operator=(Object* p)
+{
+    uint64_t old = mBits;
+    if (p) {
+        p->retain();
+        mBits = kVBoxTag | (uint64_t)(uintptr_t)p;
+    } else if (old >= kVBoxTag) {
+        mBits = 0;
+    }
+    if (old >= kVBoxTag)
+        ((Object*)(uintptr_t)(old & kVBoxPtrMask))->release();
+    return *this;
+}
+
+inline V::V(V const& that) : i(that.i)
+{
+    if (o.isObject()) o.ptr()->retain();
+}
+
+inline V::~V()
+{
+    if (o.isObject()) o.ptr()->release();
+}
+
+inline V& V::operator=(V const& that)
+{
+    if (that.o.isObject()) that.o.ptr()->retain();
+    V old(std::move(*this));
+    i = that.i;
+    return *this;
+}
+
+inline V& V::operator=(V&& that) noexcept
+{
+    if (this != &that) {
+        V old(std::move(*this));
+        i = that.i;
+        that.i = 0;
+    }
+    return *this;
+}
+
+#endif
+
 inline O V::asObj() const
 {
     if (!o) wrongType("asObj : v", "Object", *this);
@@ -40,6 +86,7 @@ inline uint16_t V::takes() const { return o ? o->takes() : 0; }
 inline uint16_t V::leaves() const { return o ? o->leaves() : 1; }
 
 inline void V::SetNoEachOps() { if (o) o->SetNoEachOps(); }
+inline void V::SetPure() { if (o) o->SetPure(); }
 
 inline int64_t V::length(Thread& th) { return !o ? 1 : o->length(th); }
 inline Z V::atz(int64_t index) { return !o ? f : o->atz(index); }
@@ -91,6 +138,18 @@ inline bool V::isVList() const { return o && o->isVList(); }
 inline bool V::isZList() const { return o && o->isZList(); }
 inline bool V::isEachOp() const { return o && o->isEachOp(); }
 
+// whether any of the n values at args is an EachOp. every call of a Fun or Prim
+// that may automap asks this. EachOps only come from '@' and are rare, so while
+// none exist the answer takes a single load.
+inline bool hasEachOps(V const* args, size_t n)
+{
+	if (gLiveEachOps.load(std::memory_order_relaxed) == 0) return false;
+	for (size_t i = 0; i < n; ++i) {
+		if (args[i].isEachOp()) return true;
+	}
+	return false;
+}
+
 inline bool V::isZIn() const { return !o || o->isZIn(); }
 
 inline V V::chase(Thread& th, int64_t n) { return !o ? f : o->chase(th, n); }
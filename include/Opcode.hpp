@@ -50,11 +50,30 @@ enum {
 	opEach,
 	
 	opReturn,
+
+	// a call that is the last opcode of a function body. produced by Code::markTailCall.
+	// when the callee is a Fun, it runs in the caller's frame instead of a new one.
+	opTailCallImmediate,
+	opTailCallLocalVar,
+	opTailCallFunVar,
+	opTailCallWorkspaceVar,
+
+	// superinstructions. these are produced by Code::fuseSuperinstructions and
+	// cover two adjacent opcodes. the second opcode is left in place so that its
+	// operand can be read from opc[1] and so that decompiling still works.
+	opPushLocalVarCallImmediate,
+	opPushImmediateCallImmediate,
+	opCallLocalVarCallImmediate,
+	opCallLocalVarCallLocalVar,
 	
 	kNumOpcodes
 };
 
 extern const char* opcode_name[kNumOpcodes];
+
+// the opcode that the first half of a superinstruction was fused from, or the
+// ordinary call that a tail call was made from. returns op itself for ordinary opcodes.
+int baseOpcode(int op);
 	
 #endif
 
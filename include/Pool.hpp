@@ -0,0 +1,144 @@
+//    SAPF - Sound As Pure Form
+//    Copyright (C) 2019 James McCartney
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef __Pool_h__
+#define __Pool_h__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+// The block pool holds the memory of every RCObj and of Array storage.
+// Requests are rounded up to a size class: multiples of 16 bytes up to 256, then
+// powers of two up to kPoolMaxSize. Larger requests go straight to malloc.
+// Blocks of kPoolSlabMaxSize or less are cut from 64K slabs that are aligned to their
+// size, so the class of any such block can be found from its address.
+// Each thread caches blocks in two magazines per class, a loaded one and a previous
+// one, and trades whole magazines with a shared depot when both are full or empty.
+// A render thread (see poolEnterRenderThread) keeps its spare magazines to itself, so
+// in steady state it neither locks the depot nor calls malloc or free. It keeps a
+// bounded number of full ones, and the reclaimer gives the blocks past those to the depot.
+
+const size_t kPoolMaxSize = 131072;
+const size_t kPoolSlabMaxSize = 4096;
+
+// the block given for inSize bytes has poolRoundSize(inSize) usable bytes.
+size_t poolRoundSize(size_t inSize);
+
+void* poolAlloc(size_t inSize);
+// inSize must be the size that was passed to poolAlloc, or its poolRoundSize.
+void poolFree(void* p, size_t inSize);
+
+// RCObj's operator new and delete. objects larger than kPoolSlabMaxSize get a slab of
+// their own from the system, so they must not be made on a render thread.
+void* poolAllocObject(size_t inSize);
+void poolFreeObject(void* p, size_t inSize);
+// the bytes taken by an object from poolAllocObject.
+size_t poolObjectSize(const void* p);
+// true if p is the object that poolAllocObject returned last on this thread. the
+// Object constructor asks this to learn whether it is in the pool.
+bool poolTakeNewObject(const void* p);
+
+// live objects are counted per type name. an Object is counted once its dynamic type
+// is known, when it is first retained. the returned slot is kept by the object to
+// uncount it. finding the slot of a new type neither locks nor allocates, so render
+// threads may count types they have not seen.
+uint8_t poolCountObject(const char* inTypeName, size_t inSize);
+void poolUncountObject(uint8_t inSlot, size_t inSize);
+// the peaks of the live counts are sampled whenever a thread other than a render
+// thread takes new memory for the pool, and on every report. this takes a sample.
+void poolSampleTypes();
+
+// makes the calling thread a render thread, and on the first call fills its cache
+// with vm.poolPrefill blocks for each size a generator block needs.
+// it costs two thread local tests after the first call, one of them to merge the
+// objects other threads queued to it (see rcDrainQueue).
+void poolEnterRenderThread();
+bool poolIsRenderThread();
+
+// Work that must not run on a render thread, such as freeing the rest of a long list,
+// is handed to the reclaimer, a background thread started with the first render
+// thread. The queue is a fixed ring, so deferring neither locks nor allocates. The
+// reclaimer sleeps on a semaphore while the ring is empty, and poolDefer wakes it.
+// poolDefer returns false, and the caller does the work itself, when the ring is full.
+const size_t kPoolDeferredSize = 4096;
+
+bool poolDefer(void (*inFun)(void*), void* inArg);
+// hands over one reference to obj, which the reclaimer releases.
+bool poolDeferRelease(class RCObj* obj);
+// runs the deferred work on the calling thread. returns how many entries it ran.
+size_t poolReclaim();
+// poolEnterRenderThread starts the reclaimer. it is stopped and joined at exit, and
+// a stopped reclaimer leaves deferred work in the ring until it is started again.
+void poolStartReclaimer();
+void poolStopReclaimer();
+
+struct PoolClassStats
+{
+	size_t mSize;
+	int64_t mHits;      // from the thread's magazines
+	int64_t mRefills;   // from the depot
+	int64_t mMisses;    // cut from a slab, or from malloc
+	int64_t mFrees;
+	int64_t mCached;    // blocks in magazines and the depot
+};
+
+struct PoolStats
+{
+	std::vector<PoolClassStats> mClasses;
+	int64_t mLargeAllocs = 0; // requests over kPoolMaxSize
+	int64_t mHits = 0;
+	int64_t mRefills = 0;
+	int64_t mMisses = 0;
+	int64_t mRenderMisses = 0; // misses on render threads
+	int64_t mSlabs = 0;
+	int64_t mDeferred = 0; // handed to the reclaimer
+	int64_t mDeferFull = 0; // done in place because the ring was full
+};
+
+struct PoolTypeStats
+{
+	std::string mName;
+	int64_t mLive = 0;
+	int64_t mBytes = 0;
+	int64_t mPeakLive = 0;
+	int64_t mPeakBytes = 0;
+	int64_t mAllocs = 0; // since the counters were reset
+	int64_t mAllocBytes = 0;
+};
+
+struct PoolTypeSummary
+{
+	int64_t mLive = 0;
+	int64_t mBytes = 0;
+	int64_t mPeakBytes = 0; // of all types at once
+	int64_t mAllocs = 0;
+	int64_t mAllocBytes = 0;
+	double mSeconds = 0.; // since the counters were reset, for rates
+};
+
+void poolGetStats(PoolStats& outStats);
+// sorted by bytes, most first.
+void poolGetTypeStats(std::vector<PoolTypeStats>& outStats);
+void poolGetTypeStats(std::vector<PoolTypeStats>& outStats, PoolTypeSummary& outSummary);
+// also starts the allocation counts and peaks of each type again.
+void poolResetStats();
+void poolReport();
+void poolTypeReport(size_t maxEntries = 0);
+bool poolWriteTypeJSON(const char* path);
+
+#endif
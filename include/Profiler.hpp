@@ -0,0 +1,56 @@
+//    SAPF - Sound As Pure Form
+//    Copyright (C) 2019 James McCartney
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef __Profiler_h__
+#define __Profiler_h__
+
+#include "VM.hpp"
+
+// The profiler counts the calls of each FunDef and Prim while vm.profileon is set,
+// and measures their inclusive time (entry to return) and exclusive time (inclusive
+// time less the time of the calls they made). When it is off a call costs one test
+// of that flag.
+// A Fun entered by a tail call takes over its caller's record, so the rest of the
+// frame's time is charged to the callee. A recursive call adds to the inclusive time
+// of a FunDef only once, in its outermost call.
+// Each OS thread counts into its own table. Reports merge the tables.
+
+void profileEnter(Thread& th, Object* callee);
+void profileLeave();
+void profileTailCall(Thread& th, Object* callee);
+
+class ProfileScope
+{
+	bool mOn;
+public:
+	ProfileScope(Thread& th, Object* callee) : mOn(vm.profileon)
+	{
+		if (mOn) profileEnter(th, callee);
+	}
+	~ProfileScope()
+	{
+		if (mOn) profileLeave();
+	}
+};
+
+void profileReset();
+
+// prints the entries with the most exclusive time first. Funs are named by the
+// variable of th's workspace they are bound to.
+void profileReport(Thread& th, size_t maxEntries = 0);
+bool profileWriteJSON(Thread& th, const char* path);
+
+#endif
@@ -20,22 +20,120 @@
 #include <stdint.h>
 #include <atomic>
 #include "rc_ptr.hpp"
+#include "Pool.hpp"
+
+#ifdef SAPF_BIASED_RC
+
+// Biased reference counting. An object is biased to the thread that made it: that
+// thread counts its references in mBiased with plain loads and stores, and every
+// other thread counts in the atomic refcount, the shared count. A shared count can
+// go below zero when another thread drops a reference the owner counted.
+// When the owner's count reaches zero it merges: it sets kRCMerged and gives the
+// object up, so that from then on only the shared count is used. When a shared count
+// goes below zero the object is queued to its owner, which merges its biased count
+// into the shared count the next time it drains its queue (see rcDrainQueue). An
+// object that goes to zero on another thread before its owner retained it is queued
+// the same way.
+// The object is freed when the shared count of a merged object reaches zero.
+
+enum {
+	kRCMerged = 1,
+	kRCQueued = 2,
+	kRCShared = 4 // one reference in the shared count
+};
+
+struct RCThreadState
+{
+	uint32_t mId = 0; // 0 until the thread is registered. ids are never reused.
+	bool mUnbiased = false; // objects made on this thread start merged
+	std::atomic<int64_t> mRetains{0};
+	std::atomic<int64_t> mReleases{0};
+};
+
+inline thread_local RCThreadState tRCThread;
+
+uint32_t rcRegisterThread();
+
+inline uint32_t rcThreadId()
+{
+	uint32_t id = tRCThread.mId;
+	return id ? id : rcRegisterThread();
+}
+
+// objects made on the calling thread from now on are not biased to it. a render thread
+// calls this, since what it makes is mostly released elsewhere and it would otherwise
+// have to merge those objects itself.
+void rcUnbiasThread();
+
+// merges the objects other threads have queued to this thread. cheap when there are none.
+void rcDrainQueue();
+void rcGetCounts(int64_t& outRetains, int64_t& outReleases);
+
+// a thread parks while it waits, for input or for time to pass, so that what it owns
+// can be freed meanwhile: other threads merge its objects themselves instead of
+// queuing them. a parked thread must not retain or release anything. every place a
+// thread that may own objects blocks parks: the REPL's read, sleep, the platform
+// event and REPL loops and runAsync's join, an idle ALSA audio thread or worker, a
+// wait for a list another thread forces, and a wait for a work pool task.
+void rcPark();
+void rcUnpark();
+
+#else
+
+inline void rcUnbiasThread() {}
+inline void rcDrainQueue() {}
+inline void rcPark() {}
+inline void rcUnpark() {}
+
+#endif
+
+class RCParkScope
+{
+public:
+	RCParkScope() { rcPark(); }
+	~RCParkScope() { rcUnpark(); }
+};
 
 class RCObj
 {
 public:
+	// with SAPF_BIASED_RC this is the shared count, in units of kRCShared.
 	mutable std::atomic<int32_t> refcount;
+#ifdef SAPF_BIASED_RC
+	mutable std::atomic<int32_t> mBiased; // only written by the owner
+	mutable std::atomic<uint32_t> mOwner; // 0 once merged
+	RCObj* mNextQueued = nullptr; // in the owner's queue, while kRCQueued is set
+#endif
 
 public:
 	RCObj();
     RCObj(RCObj const&);
 	virtual ~RCObj();
+
+	// every RCObj is allocated from the block pool. see Pool.hpp.
+	static void* operator new(size_t inSize) { return poolAllocObject(inSize); }
+	static void operator delete(void* p, size_t inSize) { poolFreeObject(p, inSize); }
 	
 	void retain() const;
 	void release();
 	virtual void norefs();
+	// called when the refcount goes up from zero. the object is fully constructed by then.
+	// with SAPF_BIASED_RC only the owner's first retain calls it.
+	virtual void firstRetain() const;
 		
+#ifdef SAPF_BIASED_RC
+	// exact on the owner thread. elsewhere it may count references the owner has dropped.
+	int32_t getRefcount() const
+	{
+		int32_t shared = refcount.load(std::memory_order_acquire) >> 2;
+		return mOwner.load(std::memory_order_acquire) ? shared + mBiased.load(std::memory_order_relaxed) : shared;
+	}
+	void releaseMerge();
+	void releaseShared(int32_t word);
+	void mergeQueued();
+#else
 	int32_t getRefcount() const { return refcount; }
+#endif
 	
 	void negrefcount();
 	void alreadyDead();
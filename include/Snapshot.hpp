@@ -0,0 +1,57 @@
+//    SAPF - Sound As Pure Form
+//    Copyright (C) 2019 James McCartney
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef __Snapshot_h__
+#define __Snapshot_h__
+
+#include "VM.hpp"
+
+// A snapshot image holds the state that sapf otherwise rebuilds on every start:
+// the signal tables computed while the builtins are registered, and the workspace
+// left behind by the prelude (its GForms, Funs, FunDefs and Code).
+// Builtins are not stored. References to them are saved by name and relinked to
+// the running binary's builtins table when the image is loaded.
+// Images are native-endian and tied to the sapf version that wrote them.
+
+const uint32_t kSnapshotVersion = 1;
+
+uint64_t snapshotHash(const char* data, size_t size, uint64_t hash = 14695981039346656037ULL);
+
+// maps the image at path. fails if it is missing or was written by a different build.
+bool openSnapshot(const char* path);
+void closeSnapshot();
+
+// a copy of a packed signal that was bound in the builtins table when the open
+// snapshot was written, or null.
+P<List> snapshotBuiltinSignal(const char* name, int64_t size);
+
+// replaces th's workspace with the one in the open snapshot, provided it was written
+// from a prelude with the given hash against the same builtins.
+bool loadSnapshotWorkspace(Thread& th, uint64_t preludeHash);
+
+// writes the builtin signals, th's workspace, and the help lines added since udfHelpStart.
+bool writeSnapshot(Thread& th, const char* path, uint64_t preludeHash, size_t udfHelpStart);
+
+// The compiled code cache keeps the Fun that compiling a loaded source text produced,
+// keyed by a hash of the text, in vm.code_cache_dir. An entry is reused only if the
+// text, the builtins, the optimizer setting and the way each external name of the
+// code resolves are all unchanged.
+
+// the cached compilation of text, if there is a valid one.
+bool loadCachedCode(Thread& th, const char* text, P<Fun>& outFun);
+void saveCachedCode(Thread& th, const char* text, P<Fun> const& fun, std::vector<ExternalName> const& names);
+
+#endif
@@ -18,6 +18,8 @@
 #define __UGen_h__
 
 #include "Object.hpp"
+#include <thread>
+#include <type_traits>
 
 template <typename F>
 struct ZeroInputGen : public Gen
@@ -827,6 +829,89 @@ struct NFourInputUGen : public Gen
 };
 
 
+// one output of a generator with several, such as pan2 or ola. each output is a list of its own,
+// and one pull of the parent fills the current list of every output, so several threads may
+// force the siblings at once. they take turns on the parent's mPullLock. the one that pulls
+// claims the lists of its siblings, or where another thread has claimed one, waits for that
+// thread to reach the lock and leaves it a note that its list is filled. the parent links its
+// outputs through mNextSibling, from the first.
+class SiblingOut : public Gen
+{
+	std::atomic<int> mArrived{0}; // threads in pullShared that have not yet taken the lock
+	// the rest are guarded by the lock.
+	bool mFilled = false; // a sibling filled the list a waiting thread claimed
+	bool mClaimed = false;
+	List* mShared = nullptr; // the list a pull is filling for this output, if not its own
+public:
+	SiblingOut* mNextSibling = nullptr;
+
+	SiblingOut(Thread& th, bool inFinite) : Gen(th, itemTypeZ, inFinite) {}
+
+	// pulls the parent unless a sibling has filled this output's list already, and returns
+	// what the parent's pull returns, if anything: a true from ola or a sound file reader
+	// means it is finished.
+	template <class Parent>
+	bool pullShared(Thread& th, Parent* parent, SiblingOut* inFirst);
+
+private:
+	template <class Parent>
+	bool pullParent(Thread& th, Parent* parent)
+	{
+		if constexpr (std::is_void_v<decltype(parent->pull(th))>) {
+			parent->pull(th);
+			return false;
+		} else {
+			return parent->pull(th);
+		}
+	}
+};
+
+template <class Parent>
+bool SiblingOut::pullShared(Thread& th, Parent* parent, SiblingOut* inFirst)
+{
+	// List::force has read the list's gen by now, so from here a sibling may fill the list.
+	mArrived.fetch_add(1, std::memory_order_release);
+	SpinLocker lock(parent->mPullLock);
+	mArrived.fetch_sub(1, std::memory_order_relaxed);
+	if (mFilled) {
+		mFilled = false;
+		return false;
+	}
+	for (SiblingOut* sibling = inFirst; sibling; sibling = sibling->mNextSibling) {
+		sibling->mShared = nullptr;
+		if (sibling == this || sibling->done() || !sibling->mOut) continue;
+		List* list = sibling->mOut;
+		uint8_t state = kListUnforced;
+		sibling->mClaimed = list->mForceState.compare_exchange_strong(state, kListForcing, std::memory_order_acquire);
+		if (!sibling->mClaimed) {
+			while (sibling->mArrived.load(std::memory_order_acquire) == 0)
+				std::this_thread::yield();
+		}
+		sibling->mShared = list;
+	}
+	bool result;
+	try {
+		result = pullParent(th, parent);
+	} catch (...) {
+		for (SiblingOut* sibling = inFirst; sibling; sibling = sibling->mNextSibling) {
+			if (sibling->mShared && sibling->mClaimed)
+				sibling->mShared->mForceState.store(kListUnforced, std::memory_order_release);
+		}
+		throw;
+	}
+	for (SiblingOut* sibling = inFirst; sibling; sibling = sibling->mNextSibling) {
+		List* list = sibling->mShared;
+		if (!list) continue;
+		// a parent that finishes leaves the lists unfilled, for each output to end its own.
+		bool filled = sibling->mOut != list;
+		if (sibling->mClaimed)
+			list->mForceState.store(filled ? kListForced : kListUnforced, std::memory_order_release);
+		else if (filled)
+			sibling->mFilled = true;
+	}
+	return result;
+}
+
 void AddUGenOps();
 
 #endif
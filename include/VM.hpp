@@ -35,6 +35,8 @@
 #include <atomic>
 #include <climits>
 #include <mutex>
+#include <new>
+#include <utility>
 
 #define USE_REPLXX 1
 
@@ -79,6 +81,8 @@ const double kDefaultSampleRate = 96000.;
 const int kDefaultControlBlockSize = 128;
 const int kDefaultVBlockSize = 1;
 const int kDefaultZBlockSize = 512;
+const int kMinZBlockSize = 16;
+const int kMaxZBlockSize = 8192;
 
 struct Rate
 {
@@ -113,9 +117,11 @@ struct Rate
 		freqLimit = that.freqLimit;
 	}
 	
+	Rate& operator=(const Rate& that) = default;
+	
 	void set(double inSampleRate, int inBlockSize, int inDiv)
 	{
-		blockSize = inBlockSize / inDiv;
+		blockSize = std::max(1, inBlockSize / inDiv);
 		sampleRate = inSampleRate / inDiv;
 		nyquistRate = .5 * sampleRate;
 		invSampleRate = 1. / sampleRate;
@@ -132,8 +138,70 @@ struct Rate
 };
 
 const size_t kStackSize = 16384;
+const size_t kDefaultMaxCallDepth = 8192;
+
+// Fixed capacity contiguous storage for values, used for a Thread's operand stack
+// and its local variable frames. The slots are reserved once and constructed
+// lazily, so a push never reallocates and references to live slots stay valid
+// across calls. Running out of slots throws errStackOverflow.
+class VStack
+{
+	V* mBase;
+	V* mTop;
+	V* mEnd;
+	
+	void checkRoom(size_t n) const
+	{
+		if ((size_t)(mEnd - mTop) < n)
+			throw errStackOverflow;
+	}
+public:
+	explicit VStack(size_t inCapacity);
+	~VStack();
+	VStack(VStack const&) = delete;
+	VStack& operator=(VStack const&) = delete;
+
+	size_t size() const { return mTop - mBase; }
+	size_t capacity() const { return mEnd - mBase; }
+	
+	V* begin() { return mBase; }
+	V* end() { return mTop; }
+	V& back() { return mTop[-1]; }
+	V& operator[](size_t i) { return mBase[i]; }
+	
+	template <typename T>
+	void push_back(T&& v)
+	{
+		checkRoom(1);
+		new (mTop) V(std::forward<T>(v));
+		++mTop;
+	}
+	void pushNils(size_t n)
+	{
+		checkRoom(n);
+		for (V* newTop = mTop + n; mTop < newTop; ++mTop)
+			new (mTop) V();
+	}
+	// moves the top n values of another VStack onto this one.
+	void moveFrom(VStack& that, size_t n)
+	{
+		checkRoom(n);
+		V* src = that.mTop - n;
+		for (size_t i = 0; i < n; ++i, ++mTop)
+			new (mTop) V(std::move(src[i]));
+		that.popn(n);
+	}
+	void pop_back() { (--mTop)->~V(); }
+	void popn(size_t n) { popTo(size() - n); }
+	void popTo(size_t newSize)
+	{
+		for (V* newTop = mBase + newSize; mTop > newTop; )
+			(--mTop)->~V();
+	}
+};
 
 class CompileScope;
+struct ExternalName;
 
 const int kMaxTokenLen = 2048;
 
@@ -151,8 +219,9 @@ class Thread
 public:
 	size_t stackBase;
 	size_t localBase;
-	std::vector<V> stack;
-	std::vector<V> local;	
+	size_t callDepth;
+	VStack stack;
+	VStack local;
 	P<Fun> fun;
 	P<GForm> mWorkspace;
 
@@ -222,10 +291,9 @@ public:
 	}
 	
 	
-	void popLocals()
-	{ 
-		local.erase(local.end() - fun->NumLocals(), local.end());
-	}
+	void enterCall();
+	void leaveCall() { --callDepth; }
+	void popLocalsTo(size_t newLocalTop) { local.popTo(newLocalTop); }
 	
 	// stack ops
 	void push(Arg v) 
@@ -272,7 +340,7 @@ public:
 	{
 		if (stackDepth() < n) 
 			throw errStackUnderflow;
-		stack.erase(stack.end() - n, stack.end());
+		stack.popn(n);
 	}
 
 	void clearStack()
@@ -293,7 +361,8 @@ public:
 	void setLocalBase(size_t newLocalBase) { localBase = newLocalBase; }
 	void setLocalBase() { localBase = local.size(); }
 
-	bool compile(const char* inString, P<Fun>& fun, bool inTopLevel);
+	// outExternalNames, if given, receives the names that the code took from the workspace or the builtins.
+	bool compile(const char* inString, P<Fun>& fun, bool inTopLevel, std::vector<ExternalName>* outExternalNames = nullptr);
 	
 	V popValue();
 	int64_t popInt(const char* msg);
@@ -325,6 +394,7 @@ class VM
 public:
 	const char* prelude_file;
 	const char* log_file;
+	const char* code_cache_dir; // compiled code cache for loaded files. off when null.
 	
 	P<GTable> builtins;
 		
@@ -359,6 +429,29 @@ public:
 	V maxFun;
 	
 	bool traceon = false;
+	bool profileon = false; // see Profiler.hpp
+
+	// bytecode optimizer. see Code::optimize.
+	bool optimizeon = true;
+	bool optdump = false;
+	bool fuseon = true; // fuse chains of signal math. see FusedOpZGen.
+	int autokr = 0; // control period of the parameter inputs of gens made from now on, or 0. see ZIn::setControlPeriod.
+	int poolPrefill = 0; // blocks of each size a render thread starts with. see Pool.hpp.
+	double bindWindow = 0.; // seconds of an infinite signal a top level binding keeps, or 0 to keep all. see WindowRef.
+	bool fixedBlockSize = false; // set by --block-size or setBlockSize. otherwise the audio device's buffer size is adopted. see useDeviceBlockSize.
+	std::atomic<int64_t> optCodeBlocks{0};
+	std::atomic<int64_t> optOpsIn{0};
+	std::atomic<int64_t> optOpsOut{0};
+	std::atomic<int64_t> optFolded{0};
+	std::atomic<int64_t> optNonesRemoved{0};
+	std::atomic<int64_t> optSharedFuns{0};
+	size_t maxCallDepth = kDefaultMaxCallDepth;
+
+	// compiled code cache. see loadCachedCode.
+	std::atomic<int64_t> codeCacheHits{0};
+	std::atomic<int64_t> codeCacheMisses{0};
+	std::atomic<int64_t> codeCacheStale{0};
+	std::atomic<int64_t> codeCacheWrites{0};
 
 #if COLLECT_MINFO
 	std::atomic<int64_t> totalRetains;
@@ -406,6 +499,9 @@ public:
 	~VM();
 	
 	void setSampleRate(double inSampleRate);
+	void setBlockSize(int inBlockSize);
+	// called by an audio backend with the buffer size its device opened with.
+	void useDeviceBlockSize(Thread& th, int inFrames);
 	
 	V def(Arg key, Arg value);
 	V def(const char* name, Arg value);
@@ -416,11 +512,30 @@ public:
 
 extern VM vm;
 
+// called on entry to a Fun. fails with errStackOverflow rather than recursing
+// deeper than vm.maxCallDepth, which would eventually overflow the C stack.
+inline void Thread::enterCall()
+{
+	if (callDepth >= vm.maxCallDepth) {
+		post("maximum call depth of %qd exceeded\n", (int64_t)vm.maxCallDepth);
+		throw errStackOverflow;
+	}
+	++callDepth;
+}
+
 struct WorkspaceDef
 {
 	P<String> mName;
 };
 
+// a name that compiled code resolved outside of itself. code compiled in one workspace
+// is only valid in another if each of these still resolves the same way.
+struct ExternalName
+{
+	P<String> mName;
+	bool mInWorkspace; // else it was a builtin
+};
+
 struct LocalDef
 {
 	P<String> mName;
@@ -471,6 +586,7 @@ class TopCompileScope : public CompileScope
 {
 public :
 	std::vector<WorkspaceDef> mWorkspaceVars;
+	std::vector<ExternalName> mExternalNames;
 
 	TopCompileScope() {}
 	
@@ -479,6 +595,9 @@ public :
 	virtual int directLookup(Thread& th, P<String> const& inName, size_t& outIndex, V& outBuiltIn) override;
 	virtual int indirectLookup(Thread& th, P<String> const& inName, size_t& outIndex, V& outGlobal) override;
 	virtual int bindVar(Thread& th, P<String> const& inName, size_t& outIndex) override;
+
+private:
+	void noteExternalName(P<String> const& inName, bool inWorkspace);
 };
 
 class InnerCompileScope : public CompileScope
@@ -509,12 +628,53 @@ public :
 	virtual int innerBindVar(Thread& th, P<String> const& inName, size_t& outIndex) override;
 };
 
+#ifdef SAPF_BIASED_RC
+
+inline void RCObj::retain() const
+{
+#if COLLECT_MINFO
+	tRCThread.mRetains.store(tRCThread.mRetains.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+#endif
+	if (mOwner.load(std::memory_order_relaxed) == rcThreadId()) {
+		int32_t n = mBiased.load(std::memory_order_relaxed);
+		mBiased.store(n + 1, std::memory_order_relaxed);
+		if (n == 0)
+			firstRetain();
+	} else if (refcount.fetch_add(kRCShared, std::memory_order_relaxed) == kRCMerged) {
+		// made on an unbiased thread.
+		firstRetain();
+	}
+}
+
+inline void RCObj::release()
+{
+#if COLLECT_MINFO
+	tRCThread.mReleases.store(tRCThread.mReleases.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+#endif
+	if (mOwner.load(std::memory_order_relaxed) == rcThreadId()) {
+		int32_t n = mBiased.load(std::memory_order_relaxed);
+		if (n > 0) {
+			mBiased.store(n - 1, std::memory_order_relaxed);
+			if (n == 1)
+				releaseMerge();
+			return;
+		}
+		// the owner is dropping a reference another thread took.
+	}
+	int32_t word = refcount.fetch_sub(kRCShared, std::memory_order_acq_rel) - kRCShared;
+	if (word < kRCShared)
+		releaseShared(word);
+}
+
+#else
+
 inline void RCObj::retain() const
 { 
 #if COLLECT_MINFO
 	++vm.totalRetains;
 #endif
-	++refcount;
+	if (refcount++ == 0)
+		firstRetain();
 }
 
 inline void RCObj::release()
@@ -529,6 +689,8 @@ inline void RCObj::release()
 		negrefcount();
 }
 
+#endif
+
 
 class SaveStack
 {
@@ -542,6 +704,16 @@ public:
 	}
 };
 
+// lets th draw from r for a while, in place of its own random stream.
+class SaveRGen
+{
+	Thread& th;
+	RGen& r;
+public:
+	SaveRGen(Thread& _th, RGen& _r) : th(_th), r(_r) { std::swap(th.rgen, r); }
+	~SaveRGen() { std::swap(th.rgen, r); }
+};
+
 class ParenStack
 {
 	Thread& th;
@@ -565,7 +737,7 @@ public:
 
 
 uint64_t timeseed();
-void loadFile(Thread& th, const char* filename);
+bool loadFile(Thread& th, const char* filename);
 
 
 class UseRate
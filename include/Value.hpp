@@ -77,11 +77,81 @@ struct BinaryOpLink : public BinaryOp
 // - A double value (when o is null, value in f)
 //
 // This is the fundamental value type in SAPF.
+//
+// With SAPF_NAN_BOXING a V is 8 bytes instead of 16. A real is stored as itself,
+// and an Object pointer is stored in the low 48 bits of a negative quiet NaN with
+// bit 50 set, which arithmetic never makes. A real NaN of that form is made the
+// canonical NaN when it is stored, so any other bit pattern is a real.
 //==============================================================================
 
+#ifdef SAPF_NAN_BOXING
+
+const uint64_t kVBoxTag = 0xFFFC000000000000ULL;
+const uint64_t kVBoxPtrMask = 0x0000FFFFFFFFFFFFULL;
+const int64_t kVCanonicalNaN = 0x7FF8000000000000LL;
+
+// the object of a NaN-boxed V. it reads like the P<Object> of an unboxed V, and
+// assigning to it retains the new object and releases the old one.
+class VObjRef
+{
+    uint64_t mBits;
+    friend class V;
+
+    Object* ptr() const { return (Object*)(uintptr_t)(mBits & kVBoxPtrMask); }
+public:
+    bool isObject() const { return mBits >= kVBoxTag; }
+
+    Object* operator()() const { return isObject() ? ptr() : nullptr; }
+    Object* get() const { return (*this)(); }
+    Object* operator->() const { return ptr(); }
+    Object& operator*() const { return *ptr(); }
+    operator bool () const { return isObject(); }
+
+    bool operator==(Object* p) const { return (*this)() == p; }
+    bool operator!=(Object* p) const { return (*this)() != p; }
+
+    // assigning nullptr to the object of a real leaves the real.
+    VObjRef& operator=(Object* p);
+    VObjRef& operator=(VObjRef const& that) { return *this = that(); }
+    template <typename U> VObjRef& operator=(P<U> const& p) { return *this = (Object*)p(); }
+};
+
+#endif
+
 class V
 {
 public:
+#ifdef SAPF_NAN_BOXING
+    union {
+        double f;
+        int64_t i;
+        VObjRef o;
+    };
+
+    // Constructors
+    V() : i(0) {}
+    V(O _o) : i(0) { o = _o; }
+    V(double _f) : f(_f) { if (o.isObject()) i = kVCanonicalNaN; }
+    template <typename U> V(P<U> const& p) : i(0) { o = p(); }
+    V(V const& that);
+    V(V&& that) noexcept : i(that.i) { that.i = 0; }
+    ~V();
+
+    V& operator=(V const& that);
+    V& operator=(V&& that) noexcept;
+
+    // Setters
+    template <typename T>
+    void set(P<T> const& p) { o = p(); }
+    void set(O _o) { o = _o; }
+    void set(double _f) { *this = V(_f); }
+    void set(Arg v) { *this = v; }
+
+    // Basic type checks (no Object dependency)
+    bool isObject() const { return o.isObject(); }
+    bool isReal() const { return !o.isObject(); }
+    bool isZero() const { return isReal() && f == 0.; }
+#else
     P<Object> o;
     union {
         double f;
@@ -105,6 +175,7 @@ public:
     bool isObject() const { return o; }
     bool isReal() const { return !o; }
     bool isZero() const { return !o && f == 0.; }
+#endif
 
     // Methods requiring Object - declared here, defined in ObjectInlines.hpp
     O asObj() const;
@@ -115,6 +186,7 @@ public:
     bool done() const;
 
     void SetNoEachOps();
+    void SetPure();
 
     const char* TypeName() const;
     const char* OneLineHelp() const;
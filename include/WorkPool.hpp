@@ -0,0 +1,94 @@
+//    SAPF - Sound As Pure Form
+//    Copyright (C) 2019 James McCartney
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef __WorkPool_h__
+#define __WorkPool_h__
+
+#include "VM.hpp"
+#include <atomic>
+
+// The work pool pulls independent parts of a signal graph on worker threads, ahead of
+// the thread that consumes them. A task only forces lists. List::force lets one thread
+// pull each list, and the others wait for it, so every list is pulled exactly once
+// and the consumer reads the same blocks it would have pulled itself.
+// Each worker has a fixed deque. A task is queued round robin, a worker takes from
+// the front of its own deque and steals from the back of the others. Queueing and
+// taking hold only the deque's spinlock, so a render thread can submit.
+// workWait runs a task that no worker has taken yet on the waiting thread, so a task
+// is never lost when the pool is off, full or stopped.
+// The pool has no workers until workPoolSetSize is called.
+
+const int kWorkPoolMaxWorkers = 64;
+const int kWorkQueueSize = 256;
+
+class WorkTask
+{
+public:
+	virtual ~WorkTask() {}
+
+	// exceptions thrown here are dropped. the list they came from is left unforced, and
+	// the consumer's own pull throws them again.
+	virtual void run(Thread& th) = 0;
+
+	// the thread to run on wherever the task runs, or null for the worker's own thread
+	// with the submitter's rate, or the waiting thread.
+	Thread* mThread = nullptr;
+
+private:
+	friend struct WorkPool;
+	std::atomic<int> mState{0};
+	int mQueue = -1;
+	const Rate* mRate = nullptr;
+};
+
+// forces the lists that hold the next mFrames frames of each input.
+class PullAheadTask : public WorkTask
+{
+public:
+	ZIn* mInputs = nullptr;
+	size_t mNumInputs = 0;
+	int mFrames = 0;
+	// if set, the random stream the inputs draw from in place of the thread's, so that
+	// functions they apply draw the same values on whichever thread pulls them.
+	RGen* mRGen = nullptr;
+
+	virtual void run(Thread& th) override;
+};
+
+// starts or stops workers until there are numWorkers. 0 turns the pool off.
+// the workers' threads are copied from th.
+void workPoolSetSize(Thread& th, int numWorkers);
+int workPoolSize();
+
+// queues a task. a task must be waited for before it is submitted again, or destroyed.
+void workSubmit(Thread& th, WorkTask* task);
+// returns once the task has run, running it on th if no worker has taken it.
+void workWait(Thread& th, WorkTask* task);
+// as workWait, but a task no worker has taken is not run.
+void workCancel(WorkTask* task);
+
+struct WorkPoolStats
+{
+	int64_t mSubmitted = 0;
+	int64_t mRun = 0; // by the worker it was queued to
+	int64_t mStolen = 0; // by another worker
+	int64_t mWaited = 0; // by the thread that waited for it
+};
+
+void workPoolStats(WorkPoolStats& outStats);
+void workPoolResetStats();
+
+#endif
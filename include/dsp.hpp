@@ -62,7 +62,6 @@ private:
 
 extern FFT ffts[kMaxFFTLogSize+1];
 
-void initFFT();
 void fft (int n, double* ioReal, double* ioImag);
 void ifft(int n, double* ioReal, double* ioImag);
 
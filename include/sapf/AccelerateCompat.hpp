@@ -155,6 +155,24 @@ inline void vDSP_vdistD(const double* aa, int astride, const double* bb, int bst
 	sapf_loop_binary(aa, astride, bb, bstride, out, ostride, n, [](double a, double b) { return std::hypot(a, b); });
 }
 
+inline void vDSP_vspdp(const float* in, int istride, double* out, int ostride, int n)
+{
+	if (istride == 1 && ostride == 1) {
+		for (int i = 0; i < n; ++i) out[i] = in[i];
+	} else {
+		for (int i = 0; i < n; ++i) out[i * ostride] = in[i * istride];
+	}
+}
+
+inline void vDSP_vdpsp(const double* in, int istride, float* out, int ostride, int n)
+{
+	if (istride == 1 && ostride == 1) {
+		for (int i = 0; i < n; ++i) out[i] = (float)in[i];
+	} else {
+		for (int i = 0; i < n; ++i) out[i * ostride] = (float)in[i * istride];
+	}
+}
+
 inline void vDSP_hann_windowD(double* data, int n, int flag)
 {
 	const double denom = std::max(1, flag ? n : n - 1);
@@ -4,9 +4,16 @@
 
 struct SapfEngineConfig {
 	double sampleRate = kDefaultSampleRate;
+	int blockSize = 0; // signal block size, or 0 to start at kDefaultZBlockSize and adopt the audio device's buffer size
 	const char* preludeFile = nullptr;
 	const char* logFile = nullptr;
+	const char* snapshotFile = nullptr;
+	const char* codeCacheDir = nullptr;
+	bool profile = false;
+	const char* profileFile = nullptr; // JSON profile written by finishProfile
+	int poolPrefill = 0; // see Pool.hpp
 	bool enableManta = true;
+	size_t maxCallDepth = kDefaultMaxCallDepth;
 };
 
 class SapfEngine {
@@ -17,6 +24,7 @@ public:
 	void initialize();
 	void startMantaEventLoop() const;
 	void loadPrelude(Thread& th) const;
+	void finishProfile(Thread& th) const;
 
 	const char* versionString() const;
 	const char* logFile() const;
@@ -21,5 +21,8 @@
 
 P<String> getsym(const char* name);
 
+// true if s is the interned symbol for its text rather than an ordinary string.
+bool isSymbol(String* s);
+
 #endif
 
@@ -1,4 +1,5 @@
 #include "sapf/ReplRunner.hpp"
+#include "sapf/Engine.hpp"
 #include "sapf/platform/Platform.hpp"
 
 #include <stdio.h>
@@ -8,5 +9,6 @@ void RunSapfRepl(Thread& th, const char* logFile)
 {
     sapf::platform::runReplLoop([&th, logFile]() {
         th.repl(stdin, logFile);
+        GetSapfEngine().finishProfile(th);
     });
 }
@@ -9,6 +9,9 @@ int main(int argc, const char * argv[])
 	SapfEngineConfig config;
 	std::string inputFile;
 	std::string preludeFile;
+	std::string snapshotFile;
+	std::string codeCacheDir;
+	std::string profileFile;
 	bool startManta = false;
 	bool interactive = false;
 	bool quiet = false;
@@ -16,7 +19,17 @@ int main(int argc, const char * argv[])
 	CLI::App app{"sapf - A tool for the expression of sound as pure form"};
 	app.add_option("-r,--rate", config.sampleRate, "Sample rate (1000-768000)")
 		->check(CLI::Range(1000.0, 768000.0));
+	app.add_option("--block-size", config.blockSize, "Frames computed per signal block. By default the audio device's buffer size is used")
+		->check(CLI::Range(kMinZBlockSize, kMaxZBlockSize));
+	app.add_option("--max-depth", config.maxCallDepth, "Maximum function call depth")
+		->check(CLI::Range((size_t)16, (size_t)1 << 16));
 	app.add_option("-p,--prelude", preludeFile, "Prelude file to load");
+	app.add_option("--snapshot", snapshotFile, "Snapshot image of the builtins and prelude. Created when missing or out of date");
+	app.add_option("--code-cache", codeCacheDir, "Directory for compiled code of loaded files");
+	app.add_flag("--profile", config.profile, "Profile functions and primitives, and print a report on exit");
+	app.add_option("--profile-json", profileFile, "Profile functions and primitives, and write the report to a JSON file on exit");
+	app.add_option("--pool-prefill", config.poolPrefill, "Blocks of each size the audio thread's memory pool starts with, so that it does not call malloc while playing")
+		->check(CLI::Range(0, 1 << 16));
 	app.add_flag("-m,--manta", startManta, "Start Manta event loop");
 	app.add_flag("-i,--interactive", interactive, "Interactive mode (enter REPL after running file)");
 	app.add_flag("-q,--quiet", quiet, "Quiet mode (suppress banner)");
@@ -27,6 +40,15 @@ int main(int argc, const char * argv[])
 	if (!preludeFile.empty()) {
 		config.preludeFile = preludeFile.c_str();
 	}
+	if (!snapshotFile.empty()) {
+		config.snapshotFile = snapshotFile.c_str();
+	}
+	if (!codeCacheDir.empty()) {
+		config.codeCacheDir = codeCacheDir.c_str();
+	}
+	if (!profileFile.empty()) {
+		config.profileFile = profileFile.c_str();
+	}
 
 	if (!quiet) {
 		post("------------------------------------------------\n");
@@ -49,6 +71,7 @@ int main(int argc, const char * argv[])
 		loadFile(th, inputFile.c_str());
 
 		if (!interactive) {
+			engine.finishProfile(th);
 			return 0;
 		}
 	}
@@ -16,6 +16,9 @@
 
 #include "VM.hpp"
 #include "Parser.hpp"
+#include "Profiler.hpp"
+#include "Pool.hpp"
+#include "WorkPool.hpp"
 #include "clz.hpp"
 #include <string>
 #include <thread>
@@ -407,7 +410,7 @@ static void set_(Thread& th, Prim* prim)
 	V ref = th.pop();
 	if (ref.isRef()) {
 		V value = th.pop();
-		((Ref*)ref.o())->set(value);
+		((Ref*)ref.o())->set(th, value);
 	} else if (ref.isZRef()) {
 		Z value = th.popFloat("set : value");
 		((ZRef*)ref.o())->set(value);
@@ -453,6 +456,12 @@ static void get_(Thread& th, Prim* prim)
 	th.push(ref.deref());
 }
 
+static void setBindWindow_(Thread& th, Prim* prim)
+{
+	Z seconds = th.popFloat("setBindWindow : seconds");
+	vm.bindWindow = std::max(seconds, 0.);
+}
+
 ////////////////////////////////////////////////////////////////////////////////////////////////////////
 
 // printing ops
@@ -739,16 +748,17 @@ static void greater_(Thread& th, Prim* prim)
 	th.pushBool(Compare(th, a, b) > 0);
 }
 
-static void if_(Thread& th, Prim* prim)
+static V ifTail_(Thread& th, Prim* prim)
 {
 	V elseCode = th.pop();
 	V thenCode = th.pop();
 	V test = th.pop();
-	if (test.isTrue()) {
-		thenCode.apply(th);
-	} else {
-		elseCode.apply(th);
-	}
+	return test.isTrue() ? thenCode : elseCode;
+}
+
+static void if_(Thread& th, Prim* prim)
+{
+	ifTail_(th, prim).apply(th);
 }
 
 static void dip_(Thread& th, Prim* prim)
@@ -966,6 +976,15 @@ static void load_(Thread& th, Prim* prim)
 	loadFile(th, filename->s);
 }
 
+static void cachestats_(Thread& th, Prim* prim)
+{
+	post("compiled code cache %s\n", vm.code_cache_dir ? vm.code_cache_dir : "off");
+	post("  hits                %10lld\n", (int64_t)vm.codeCacheHits);
+	post("  misses              %10lld\n", (int64_t)vm.codeCacheMisses);
+	post("  stale               %10lld\n", (int64_t)vm.codeCacheStale);
+	post("  writes              %10lld\n", (int64_t)vm.codeCacheWrites);
+}
+
 static void compile_(Thread& th, Prim* prim)
 {
 	P<String> s = th.popString("compile : string");
@@ -979,10 +998,15 @@ static void compile_(Thread& th, Prim* prim)
 	}
 }
 
-static void y_combinator_call_(Thread& th, Prim* prim)
+static V y_combinator_tail_(Thread& th, Prim* prim)
 {
 	th.push(prim);
-	prim->v.apply(th);
+	return prim->v;
+}
+
+static void y_combinator_call_(Thread& th, Prim* prim)
+{
+	y_combinator_tail_(th, prim).apply(th);
 }
 
 static void Y_(Thread& th, Prim* prim)
@@ -992,7 +1016,7 @@ static void Y_(Thread& th, Prim* prim)
 		post("Y : fun. function must take at least one argument.\n");
 		throw errFailed;
 	}
-	th.push(new Prim(y_combinator_call_, f, f.takes()-1, f.leaves(), NULL, NULL));
+	th.push(new Prim(y_combinator_call_, f, f.takes()-1, f.leaves(), NULL, NULL, y_combinator_tail_));
 }
 
 
@@ -1018,21 +1042,89 @@ static void sleep_(Thread& th, Prim* prim)
 {
     Z t = th.popFloat("sleep : secs");
     
+    RCParkScope parked;
     usleep((useconds_t)floor(1e6 * t + .5));
 }
 
-#if COLLECT_MINFO
 static void minfo_(Thread& th, Prim* prim)
 {
+#if COLLECT_MINFO
 	post("signal generators %qd\n", vm.totalSignalGenerators.load());
 	post("stream generators %qd\n", vm.totalStreamGenerators.load());
 	post("objects live %qd\n", vm.totalObjectsAllocated.load() - vm.totalObjectsFreed.load());
 	post("objects allocated %qd\n", vm.totalObjectsAllocated.load());
 	post("objects freed %qd\n", vm.totalObjectsFreed.load());
+#ifdef SAPF_BIASED_RC
+	int64_t retains, releases;
+	rcGetCounts(retains, releases);
+	post("retains %qd\n", retains);
+	post("releases %qd\n", releases);
+#else
 	post("retains %qd\n", vm.totalRetains.load());
 	post("releases %qd\n", vm.totalReleases.load());
-}
 #endif
+#endif
+	poolTypeReport();
+}
+
+static void minfojson_(Thread& th, Prim* prim)
+{
+	P<String> path = th.popString("minfojson : path");
+	if (!poolWriteTypeJSON(path->s))
+		throw errFailed;
+}
+
+static void poolstats_(Thread& th, Prim* prim)
+{
+	poolReport();
+}
+
+static void poolclear_(Thread& th, Prim* prim)
+{
+	poolResetStats();
+}
+
+static void pooltypes_(Thread& th, Prim* prim)
+{
+	poolTypeReport();
+}
+
+static void forcestats_(Thread& th, Prim* prim)
+{
+	ListForceCounts counts;
+	listForceCounts(counts);
+	int64_t total = counts.mForced + counts.mClaimed + counts.mContended;
+	post("list forces %lld\n", (long long)total);
+	post("  already forced %lld, pulled alone %lld: %lld lock acquisitions saved\n",
+		(long long)counts.mForced, (long long)counts.mClaimed, (long long)(counts.mForced + counts.mClaimed));
+	post("  waited for another thread %lld\n", (long long)counts.mContended);
+}
+
+static void forceclear_(Thread& th, Prim* prim)
+{
+	listForceCountsReset();
+}
+
+static void workers_(Thread& th, Prim* prim)
+{
+	int64_t n = th.popInt("workers : n");
+	workPoolSetSize(th, (int)std::max((int64_t)0, std::min(n, (int64_t)kWorkPoolMaxWorkers)));
+}
+
+static void workstats_(Thread& th, Prim* prim)
+{
+	WorkPoolStats stats;
+	workPoolStats(stats);
+	post("work pool %d workers\n", workPoolSize());
+	post("  tasks submitted %lld\n", (long long)stats.mSubmitted);
+	post("  run by their worker %lld, stolen by another %lld\n", (long long)stats.mRun, (long long)stats.mStolen);
+	post("  run by the waiting thread %lld\n", (long long)stats.mWaited);
+}
+
+static void workclear_(Thread& th, Prim* prim)
+{
+	workPoolResetStats();
+}
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////////
 
@@ -1063,6 +1155,23 @@ static void inyq_(Thread& th, Prim* prim)
 	th.push(th.rate.invNyquistRate);
 }
 
+static void blockSize_(Thread& th, Prim* prim)
+{
+	th.push(th.rate.blockSize);
+}
+
+static void setBlockSize_(Thread& th, Prim* prim)
+{
+	int64_t n = th.popInt("setBlockSize : n");
+	if (n < kMinZBlockSize || n > kMaxZBlockSize) {
+		post("setBlockSize : n must be from %d to %d\n", kMinZBlockSize, kMaxZBlockSize);
+		throw errOutOfRange;
+	}
+	vm.setBlockSize((int)n);
+	vm.fixedBlockSize = true;
+	th.rate = vm.ar;
+}
+
 ////////////////////////////////////////////////////////////////////////////////////////////////////////
 
 #pragma mark HELP
@@ -1189,6 +1298,81 @@ static void trace_(Thread& th, Prim* prim)
 	vm.traceon = th.pop().isTrue();
 }
 
+static void profile_(Thread& th, Prim* prim)
+{
+	V fun = th.pop();
+	bool wasOn = vm.profileon;
+	profileReset();
+	vm.profileon = true;
+	try {
+		fun.apply(th);
+	} catch (...) {
+		vm.profileon = wasOn;
+		throw;
+	}
+	vm.profileon = wasOn;
+	profileReport(th);
+}
+
+static void profiling_(Thread& th, Prim* prim)
+{
+	vm.profileon = th.pop().isTrue();
+}
+
+static void profreport_(Thread& th, Prim* prim)
+{
+	profileReport(th);
+}
+
+static void profjson_(Thread& th, Prim* prim)
+{
+	P<String> path = th.popString("profjson : path");
+	if (!profileWriteJSON(th, path->s))
+		throw errFailed;
+}
+
+static void profclear_(Thread& th, Prim* prim)
+{
+	profileReset();
+}
+
+static void optimize_(Thread& th, Prim* prim)
+{
+	vm.optimizeon = th.pop().isTrue();
+}
+
+static void fuse_(Thread& th, Prim* prim)
+{
+	vm.fuseon = th.pop().isTrue();
+}
+
+static void autokr_(Thread& th, Prim* prim)
+{
+	int64_t n = th.popInt("autokr : n");
+	
+	if (n < 0 || n > kMaxZBlockSize) {
+		post("autokr : n must be from 0 to %d\n", kMaxZBlockSize);
+		throw errOutOfRange;
+	}
+	vm.autokr = (int)n;
+}
+
+static void optdump_(Thread& th, Prim* prim)
+{
+	vm.optdump = th.pop().isTrue();
+}
+
+static void optstats_(Thread& th, Prim* prim)
+{
+	post("bytecode optimizer %s\n", vm.optimizeon ? "on" : "off");
+	post("  code blocks         %10lld\n", (int64_t)vm.optCodeBlocks);
+	post("  opcodes in          %10lld\n", (int64_t)vm.optOpsIn);
+	post("  opcodes out         %10lld\n", (int64_t)vm.optOpsOut);
+	post("  constants folded    %10lld\n", (int64_t)vm.optFolded);
+	post("  opNone removed      %10lld\n", (int64_t)vm.optNonesRemoved);
+	post("  shared funs         %10lld\n", (int64_t)vm.optSharedFuns);
+}
+
 ////////////////////////////////////////////////////////////////////////////////////////////////////////
 
 #pragma mark PLUGS
@@ -1427,7 +1611,8 @@ void AddCoreOps()
 	DEF(equals, 2, "(a b --> bool) returns 1 if a and b are structurally equivalent. If the data structures are cyclic then this may never terminate.")
 	DEF(less, 2, "(a b --> bool) returns 1 if a is less than b structurally. If the data structures are cyclic then this may never terminate.")
 	DEF(greater, 2, "(a b --> bool) returns 1 if a is greater than b structurally. If the data structures are cyclic then this may never terminate.")
-	DEF2(if, 3, -1, "(A B C --> ..) if A is true then apply B else apply C.")
+	V ifPrim = DEF2(if, 3, -1, "(A B C --> ..) if A is true then apply B else apply C.")
+	((Prim*)ifPrim.o())->mTailFun = ifTail_; // the chosen branch can be a tail call
 
 	DEF(not, 1, "(A --> bool) returns 0 if A is true and 1 if A is false.")
 	//DEF2(dip, 1, -1, "(x A --> ..) pops x from stack, applies A, pushes x back on stack.")
@@ -1455,6 +1640,7 @@ void AddCoreOps()
 	DEFnoeach(set, 1, 0, "(a r -->) store the value a in the ref r.")
 	vm.def("R", 1, 1, ref_, "(a --> r) create a new Ref with the inital value a");
 	vm.def("ZR", 1, 1, zref_, "(z --> r) create a new ZRef with the inital value z. A ZRefs is a mutable reference to a real number.");
+	DEFnoeach(setBindWindow, 1, 0, "(seconds -->) when seconds is more than zero, an infinite signal bound at the top level is bound as a WindowRef that keeps only the last seconds of it reachable. see wref.")
 	vm.def("P", 1, 2, plug_, "(a --> out in) create a new stream plug pair with the inital value a");
 	vm.def("ZP", 1, 2, zplug_, "(a --> out in) create a new signal plug pair with the inital value a.");
 	
@@ -1482,9 +1668,15 @@ void AddCoreOps()
 	DEFnoeach(tab, 0, 0, "(-->) print a tab.")
 	DEFnoeach(prstk, 0, 0, "(-->) print the stack.")
 
-#if COLLECT_MINFO
-	DEFnoeach(minfo, 0, 0, "(-->) print memory management info.")
-#endif
+	DEFnoeach(minfo, 0, 0, "(-->) print memory management info: live, peak and allocated objects and bytes of each type.")
+	DEFnoeach(minfojson, 1, 0, "(path -->) write what minfo prints for each type to a JSON file.")
+	DEFnoeach(poolstats, 0, 0, "(-->) print the hits and misses of the block pool that lists and arrays are allocated from.")
+	DEFnoeach(poolclear, 0, 0, "(-->) start the block pool counters again from zero.")
+	DEFnoeach(pooltypes, 0, 0, "(-->) print the number of live objects of each type and the bytes they take.")
+	DEFnoeach(forcestats, 0, 0, "(-->) print how many times lists were forced without taking their lock, and how many times a thread waited for another to pull a list.")
+	DEFnoeach(forceclear, 0, 0, "(-->) start the list force counters again from zero.")
+	DEFnoeach(workstats, 0, 0, "(-->) print how many signals were pulled ahead on the work pool, and by which threads.")
+	DEFnoeach(workclear, 0, 0, "(-->) start the work pool counters again from zero.")
 	DEFnoeach(listdump, 1, 0, "(list -->) prints information about a list.");
 
 	vm.addBifHelp("\n*** string ops ***");
@@ -1500,6 +1692,8 @@ void AddCoreOps()
 	DEFnoeach(isr, 0, 1, "(--> 1/sampleRate) returns the inverse sample rate")
 	DEFnoeach(inyq, 0, 1, "(--> 2/sampleRate) returns the inverse nyquist rate.")
 	DEFnoeach(rps, 0, 1, "(--> 2pi/sampleRate) returns the radians per sample")
+	DEFnoeach(blockSize, 0, 1, "(--> n) returns the number of frames signals are computed in at a time.")
+	DEFnoeach(setBlockSize, 1, 0, "(n -->) set the number of frames signals made after this are computed in at a time. the audio device's buffer size is no longer adopted.")
 
 
 	vm.addBifHelp("\n*** help ops ***");
@@ -1513,13 +1707,25 @@ void AddCoreOps()
 	vm.addBifHelp("\n*** thread ops ***");
     DEFnoeach(go, 1, 0, "(fun -->) launches the function in a new thread.");
     DEFnoeach(sleep, 1, 0, "(seconds -->) sleeps the current thread for the time given.");
+    DEFnoeach(workers, 1, 0, "(n -->) start n worker threads that pull players and ola sources ahead of the audio thread, in parallel. 0 stops them. the output is the same as with none.");
 
 	vm.addBifHelp("\n*** misc ***");
 	DEF(type, 1, "(a --> symbol) return a symbol naming the type of the value a.")
 	DEFnoeach(trace, 1, 0, "(bool -->) turn tracing on/off in the interpreter.")
+	DEFnoeach(profile, 1, -1, "(A --> ..) clear the profile, apply function A with the profiler on, then print the profile. work done later by lazy results of A is not included.")
+	DEFnoeach(profiling, 1, 0, "(bool -->) turn the profiler on/off. it counts calls of each function and primitive, and their inclusive and exclusive time.")
+	DEFnoeach(profreport, 0, 0, "(-->) print the profile, the most expensive functions and primitives first.")
+	DEFnoeach(profjson, 1, 0, "(path -->) write the profile to a JSON file.")
+	DEFnoeach(profclear, 0, 0, "(-->) clear the profile.")
+	DEFnoeach(optimize, 1, 0, "(bool -->) turn the bytecode optimizer on/off for code compiled afterwards.")
+	DEFnoeach(optdump, 1, 0, "(bool -->) turn on/off printing each code block the bytecode optimizer changes, before and after.")
+	DEFnoeach(optstats, 0, 0, "(-->) print what the bytecode optimizer has done so far.")
+	DEFnoeach(fuse, 1, 0, "(bool -->) turn on/off fusing chains of signal math operators into one generator, for signals made afterwards.")
+	DEFnoeach(autokr, 1, 0, "(n -->) the freq and rq inputs of the lpf, hpf, rlpf and rhpf filters of every order, and the pos inputs of pan2, bal2 and rot2, made after this read one value every n frames and hold it, so that their coefficients are computed once every n frames. 0 reads every frame.")
 
 	vm.addBifHelp("\n*** text files ***");
 	DEFnoeach(load, 1, 0, "(filename -->) compiles and executes a text file.")	
+	DEFnoeach(cachestats, 0, 0, "(-->) print how often loaded files were found in the compiled code cache.")
 	DEFnoeach(prelude, 0, 0, "(-->) opens the prelude file in the default text editor.")
 	DEFnoeach(examples, 0, 0, "(-->) opens the examples file in the default text editor.")
 	DEFnoeach(logfile, 0, 0, "(-->) opens the log file in the default text editor.")
@@ -1449,7 +1449,7 @@ static void alpasc_(Thread& th, Prim* prim)
 ////////////////////////////////////////////////////////////////////////////////////////////////////////
 class FDN;
 
-class FDN_OutputChannel : public Gen
+class FDN_OutputChannel : public SiblingOut
 {
 	friend class FDN;
 	P<FDN> mFDN;
@@ -1483,6 +1483,7 @@ class FDN : public Object
 	Z scaleLoLPF, scaleLoHPF, scaleHiLPF, scaleHiHPF;
 	FDN_OutputChannel* mLeft;
 	FDN_OutputChannel* mRight;
+	friend class FDN_OutputChannel;
 	
 	static const int kNumDelays = 16;
 	
@@ -1530,6 +1531,7 @@ class FDN : public Object
 public:
 
 	FDNDelay mDelay[kNumDelays];
+	SpinLockType mPullLock = SPINLOCK_INIT; // see SiblingOut
 	
 	FDN(Thread& th, Arg in, Arg wet, Z mindelay, Z maxdelay, Z decayLo, Z decayMid, Z decayHi, Z seed)
 		: in_(in), wet_(wet),
@@ -1754,19 +1756,20 @@ public:
 };
 
 FDN_OutputChannel::FDN_OutputChannel(Thread& th, bool inFinite, FDN* inFDN)
-                                : Gen(th, itemTypeZ, inFinite), mFDN(inFDN)
+                                : SiblingOut(th, inFinite), mFDN(inFDN)
 {
 }
 
 void FDN_OutputChannel::pull(Thread& th)
 {
-	mFDN->pull(th);
+	pullShared(th, mFDN(), mFDN->mLeft);
 }
 
 P<List> FDN::createOutputs(Thread& th)
 {
 	mLeft = new FDN_OutputChannel(th, finite, this);
 	mRight = new FDN_OutputChannel(th, finite, this);
+	mLeft->mNextSibling = mRight;
 	
 	P<Gen> left = mLeft;
 	P<Gen> right = mRight;
@@ -1779,6 +1782,11 @@ P<List> FDN::createOutputs(Thread& th)
 	return s;
 }
 
+P<List> fdnOutputs(Thread& th, Arg in, Arg wet, Z mindelay, Z maxdelay, Z decayLo, Z decayMid, Z decayHi, Z seed)
+{
+	P<FDN> fdn = new FDN(th, in, wet, mindelay, maxdelay, decayLo, decayMid, decayHi, seed);
+	return fdn->createOutputs(th);
+}
 
 static void fdn_(Thread& th, Prim* prim)
 {
@@ -1791,11 +1799,7 @@ static void fdn_(Thread& th, Prim* prim)
 	V wet = th.popZIn("fdn : wet");
 	V in = th.popZIn("fdn : in");
     
-	P<FDN> fdn = new FDN(th, in, wet, mindelay, maxdelay, decayLo, decayMid, decayHi, seed);
-	
-	P<List> s = fdn->createOutputs(th);
-
-	th.push(s);
+	th.push(fdnOutputs(th, in, wet, mindelay, maxdelay, decayLo, decayMid, decayHi, seed));
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -23,6 +23,8 @@
 #include <float.h>
 #include <vector>
 #include <algorithm>
+#include <cstring>
+#include <initializer_list>
 #include "sapf/AccelerateCompat.hpp"
 #ifdef _WIN32
 #include "sapf/platform/WindowsCompat.hpp"
@@ -52,6 +54,35 @@ struct UnityHardClipFeedback : public Gen
 	}
 };
 
+// a filter fed silence computes its tail until every state variable is below this
+// level, then outputs silent blocks until its input sounds again. about -190 dB.
+const Z kFilterSilenceThreshold = 3e-10;
+
+static inline bool decayed(std::initializer_list<Z*> state)
+{
+	for (Z* z : state) {
+		// a nan has not decayed.
+		if (!(std::abs(*z) < kFilterSilenceThreshold)) return false;
+	}
+	return true;
+}
+
+// the run a filter skips: if its input is silent and its state has decayed, zeroes the
+// state, writes n frames of silence, advances out and the inputs past them, and
+// returns true.
+template <class... Ins>
+static inline bool skipSilentRun(int inStride, const Z* in, std::initializer_list<Z*> state,
+	int n, Z*& out, int& framesToFill, Ins&... ins)
+{
+	if (!ZIn::isSilent(inStride, in) || !decayed(state)) return false;
+	for (Z* z : state) *z = 0.;
+	memset(out, 0, n * sizeof(Z));
+	framesToFill -= n;
+	out += n;
+	(ins.advance(n), ...);
+	return true;
+}
+
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
 struct Lag : public Gen
@@ -591,6 +622,7 @@ struct FirstOrderLPF : public Gen
 		: Gen(th, itemTypeZ, mostFinite(in, freq)), _in(in), _freq(freq), 
 			_x1(0.), _y1(0.), _freqmul(th.rate.invNyquistRate * kFirstOrderCoeffScale)
 	{
+		_freq.setControlPeriod(vm.autokr);
 	}
 	
 	virtual const char* TypeName() const override { return "FirstOrderLPF"; }
@@ -603,6 +635,7 @@ struct FirstOrderLPF : public Gen
 		Z x1 = _x1;
 		Z y1 = _y1;
 		Z freqmul = _freqmul;
+		bool silent = true;
 		while (framesToFill) {
 			Z *in, *freq;
 			int n, inStride, freqStride;
@@ -612,6 +645,10 @@ struct FirstOrderLPF : public Gen
 				break;
 			}
 			
+			if (skipSilentRun(inStride, in, {&x1, &y1}, n, out, framesToFill, _in, _freq))
+				continue;
+			silent = false;
+			
 			if (freqStride == 0) {
 				Z a1 = t_firstOrderCoeff(*freq * freqmul);
 				Z scale = .5 * (1. - a1);
@@ -627,6 +664,7 @@ struct FirstOrderLPF : public Gen
 				}
 				
 				_in.advance(n);
+				_freq.advance(n);
 			} else {
 				for (int i = 0; i < n; ++i) {
 					Z a1 = t_firstOrderCoeff(*freq * freqmul);
@@ -652,6 +690,7 @@ struct FirstOrderLPF : public Gen
 		
 		_x1 = x1;
 		_y1 = y1;
+		if (silent) mOut->mArray->setSilent();
 		produce(framesToFill);
 	}
 	
@@ -668,6 +707,7 @@ struct FirstOrderHPF : public Gen
 		: Gen(th, itemTypeZ, mostFinite(in, freq)), _in(in), _freq(freq), 
 			_x1(0.), _y1(0.), _freqmul(th.rate.invNyquistRate * kFirstOrderCoeffScale)
 	{
+		_freq.setControlPeriod(vm.autokr);
 	}
 	
 	virtual const char* TypeName() const override { return "FirstOrderHPF"; }
@@ -680,6 +720,7 @@ struct FirstOrderHPF : public Gen
 		Z x1 = _x1;
 		Z y1 = _y1;
 		Z freqmul = _freqmul;
+		bool silent = true;
 		while (framesToFill) {
 			Z *in, *freq;
 			int n, inStride, freqStride;
@@ -689,6 +730,10 @@ struct FirstOrderHPF : public Gen
 				break;
 			}
 			
+			if (skipSilentRun(inStride, in, {&x1, &y1}, n, out, framesToFill, _in, _freq))
+				continue;
+			silent = false;
+			
 			if (freqStride == 0) {
 				Z a1 = t_firstOrderCoeff(*freq * freqmul);
 				Z scale = .5 * (1. + a1);
@@ -704,6 +749,7 @@ struct FirstOrderHPF : public Gen
 				}
 				
 				_in.advance(n);
+				_freq.advance(n);
 			} else {
 				for (int i = 0; i < n; ++i) {
 					Z a1 = t_firstOrderCoeff(*freq * freqmul);
@@ -729,6 +775,7 @@ struct FirstOrderHPF : public Gen
 		
 		_x1 = x1;
 		_y1 = y1;
+		if (silent) mOut->mArray->setSilent();
 		produce(framesToFill);
 	}
 };
@@ -765,6 +812,7 @@ struct LPF : public Gen
 		: Gen(th, itemTypeZ, mostFinite(in, freq)), _in(in), _freq(freq), 
 			_x1(0.), _x2(0.), _y1(0.), _y2(0.), _freqmul(th.rate.radiansPerSample * gInvSineTableOmega), _alphamul(.5 * M_SQRT2)
 	{
+		_freq.setControlPeriod(vm.autokr);
 	}
 	
 	virtual const char* TypeName() const override { return "LPF"; }
@@ -780,6 +828,7 @@ struct LPF : public Gen
 		Z y2 = _y2;
 		Z freqmul = _freqmul;
 		Z alphamul = _alphamul;
+		bool silent = true;
 		while (framesToFill) {
 			Z *in, *freq;
 			int n, inStride, freqStride;
@@ -789,6 +838,10 @@ struct LPF : public Gen
 				break;
 			}
 			
+			if (skipSilentRun(inStride, in, {&x1, &x2, &y1, &y2}, n, out, framesToFill, _in, _freq))
+				continue;
+			silent = false;
+			
 			if (freqStride == 0) {
 				Z w0 = std::max(1e-3, *freq) * freqmul;
 				Z sn, cs;
@@ -816,6 +869,7 @@ struct LPF : public Gen
 				}
 				
 				_in.advance(n);
+				_freq.advance(n);
 			} else {
 				for (int i = 0; i < n; ++i) {				
 					Z w0 = std::max(1e-3, *freq) * freqmul;
@@ -853,6 +907,7 @@ struct LPF : public Gen
 		_x2 = x2;
 		_y1 = y1;
 		_y2 = y2;
+		if (silent) mOut->mArray->setSilent();
 		produce(framesToFill);
 	}
 	
@@ -870,6 +925,7 @@ struct LPF2 : public Gen
 		: Gen(th, itemTypeZ, mostFinite(in, freq)), _in(in), _freq(freq), 
 			_x1(0.), _x2(0.), _y1(0.), _y2(0.), _z1(0.), _z2(0.), _freqmul(th.rate.radiansPerSample * gInvSineTableOmega), _alphamul(.5 * M_SQRT2)
 	{
+		_freq.setControlPeriod(vm.autokr);
 	}
 	
 	virtual const char* TypeName() const override { return "LPF"; }
@@ -888,6 +944,7 @@ struct LPF2 : public Gen
 		Z freqmul = _freqmul;
 		Z alphamul = _alphamul;
 				
+		bool silent = true;
 		while (framesToFill) {
 			Z *in, *freq;
 			int n, inStride, freqStride;
@@ -897,6 +954,10 @@ struct LPF2 : public Gen
 				break;
 			}
 			
+			if (skipSilentRun(inStride, in, {&x1, &x2, &y1, &y2, &z1, &z2}, n, out, framesToFill, _in, _freq))
+				continue;
+			silent = false;
+			
 			if (freqStride == 0) {
 				Z w0 = std::max(1e-3, *freq) * freqmul;
 				Z sn, cs;
@@ -930,6 +991,7 @@ struct LPF2 : public Gen
 				framesToFill -= n;
 				out += n;
 				_in.advance(n);
+				_freq.advance(n);
 			} else {
 				for (int i = 0; i < n; ++i) {
 					Z w0 = std::max(1e-3, *freq) * freqmul;
@@ -972,6 +1034,7 @@ struct LPF2 : public Gen
 		_y2 = y2;
 		_z1 = z1;
 		_z2 = z2;
+		if (silent) mOut->mArray->setSilent();
 		produce(framesToFill);
 	}
 	
@@ -991,6 +1054,7 @@ struct HPF : public Gen
 		: Gen(th, itemTypeZ, mostFinite(in, freq)), _in(in), _freq(freq), 
 			_x1(0.), _x2(0.), _y1(0.), _y2(0.), _freqmul(th.rate.radiansPerSample * gInvSineTableOmega), _alphamul(.5 * M_SQRT2)
 	{
+		_freq.setControlPeriod(vm.autokr);
 	}
 	
 	virtual const char* TypeName() const override { return "HPF"; }
@@ -1006,6 +1070,7 @@ struct HPF : public Gen
 		Z y2 = _y2;
 		Z freqmul = _freqmul;
 		Z alphamul = _alphamul;
+		bool silent = true;
 		while (framesToFill) {
 			Z *in, *freq;
 			int n, inStride, freqStride;
@@ -1015,6 +1080,10 @@ struct HPF : public Gen
 				break;
 			}
 			
+			if (skipSilentRun(inStride, in, {&x1, &x2, &y1, &y2}, n, out, framesToFill, _in, _freq))
+				continue;
+			silent = false;
+			
 			if (freqStride == 0) {
 				Z w0 = *freq * freqmul;
 				Z sn, cs;
@@ -1043,6 +1112,7 @@ struct HPF : public Gen
 				framesToFill -= n;
 				out += n;
 				_in.advance(n);
+				_freq.advance(n);
 			} else {
 				for (int i = 0; i < n; ++i) {				
 					Z w0 = *freq * freqmul;
@@ -1079,6 +1149,7 @@ struct HPF : public Gen
 		_x2 = x2;
 		_y1 = y1;
 		_y2 = y2;
+		if (silent) mOut->mArray->setSilent();
 		produce(framesToFill);
 	}
 	
@@ -1096,6 +1167,7 @@ struct HPF2 : public Gen
 		: Gen(th, itemTypeZ, mostFinite(in, freq)), _in(in), _freq(freq), 
 			_x1(0.), _x2(0.), _y1(0.), _y2(0.), _z1(0.), _z2(0.), _freqmul(th.rate.radiansPerSample * gInvSineTableOmega), _alphamul(.5 * M_SQRT2)
 	{
+		_freq.setControlPeriod(vm.autokr);
 	}
 	
 	virtual const char* TypeName() const override { return "HPF2"; }
@@ -1113,6 +1185,7 @@ struct HPF2 : public Gen
 		Z z2 = _z2;
 		Z freqmul = _freqmul;
 		Z alphamul = _alphamul;
+		bool silent = true;
 		while (framesToFill) {
 			Z *in, *freq;
 			int n, inStride, freqStride;
@@ -1122,6 +1195,10 @@ struct HPF2 : public Gen
 				break;
 			}
 			
+			if (skipSilentRun(inStride, in, {&x1, &x2, &y1, &y2, &z1, &z2}, n, out, framesToFill, _in, _freq))
+				continue;
+			silent = false;
+			
 			if (freqStride == 0) {
 				Z w0 = *freq * freqmul;
 				Z sn, cs;
@@ -1155,6 +1232,7 @@ struct HPF2 : public Gen
 				framesToFill -= n;
 				out += n;
 				_in.advance(n);
+				_freq.advance(n);
 			} else {
 				for (int i = 0; i < n; ++i) {				
 					Z w0 = *freq * freqmul;
@@ -1198,6 +1276,7 @@ struct HPF2 : public Gen
 		_y2 = y2;
 		_z1 = z1;
 		_z2 = z2;
+		if (silent) mOut->mArray->setSilent();
 		produce(framesToFill);
 	}
 	
@@ -1219,6 +1298,8 @@ struct RLPF : public Gen
 		: Gen(th, itemTypeZ, mostFinite(in, freq, rq)), _in(in), _freq(freq), _rq(rq),
 			_x1(0.), _x2(0.), _y1(0.), _y2(0.), _freqmul(th.rate.radiansPerSample * gInvSineTableOmega)
 	{
+		_freq.setControlPeriod(vm.autokr);
+		_rq.setControlPeriod(vm.autokr);
 	}
 	
 	virtual const char* TypeName() const override { return "RLPF"; }
@@ -1233,6 +1314,7 @@ struct RLPF : public Gen
 		Z y1 = _y1;
 		Z y2 = _y2;
 		Z freqmul = _freqmul;
+		bool silent = true;
 		while (framesToFill) {
 			Z *in, *freq, *rq;
 			int n, inStride, freqStride, rqStride;
@@ -1242,7 +1324,11 @@ struct RLPF : public Gen
 				break;
 			}
 			
-			for (int i = 0; i < n; ++i) {				
+			if (skipSilentRun(inStride, in, {&x1, &x2, &y1, &y2}, n, out, framesToFill, _in, _freq, _rq))
+				continue;
+			silent = false;
+			
+			if (freqStride == 0 && rqStride == 0) {
 				Z w0 = *freq * freqmul;
 				Z sn, cs;
 				tsincosx(w0, sn, cs);
@@ -1253,20 +1339,46 @@ struct RLPF : public Gen
 				Z b1 = 1. - cs;
 				Z b0 = .5 * b1;
 				Z b2 = b0;
+				for (int i = 0; i < n; ++i) {
+					Z x0 = *in;
+					Z y0 = (b0 * x0 + b1 * x1 + b2 * x2 - a1 * y1 - a2 * y2)/a0;
+					y0 = Feedback::feedback(y0);
+					
+					out[i] = y0;
+					y2 = y1;
+					y1 = y0;
+					x2 = x1;
+					x1 = x0;
+					
+					in += inStride;
+				}
+			} else {
+				for (int i = 0; i < n; ++i) {				
+					Z w0 = *freq * freqmul;
+					Z sn, cs;
+					tsincosx(w0, sn, cs);
+					Z alpha = sn * *rq * .5;
+					Z a0 = 1. + alpha;
+					Z a1 = -2. * cs;
+					Z a2 = 1. - alpha;
+					Z b1 = 1. - cs;
+					Z b0 = .5 * b1;
+					Z b2 = b0;
 			
-				Z x0 = *in;
-				Z y0 = (b0 * x0 + b1 * x1 + b2 * x2 - a1 * y1 - a2 * y2)/a0;
-				y0 = Feedback::feedback(y0);
+					Z x0 = *in;
+					Z y0 = (b0 * x0 + b1 * x1 + b2 * x2 - a1 * y1 - a2 * y2)/a0;
+					y0 = Feedback::feedback(y0);
 				
-				out[i] = y0;
-				y2 = y1;
-				y1 = y0;
-				x2 = x1;
-				x1 = x0;
+					out[i] = y0;
+					y2 = y1;
+					y1 = y0;
+					x2 = x1;
+					x1 = x0;
 				
-				in += inStride;
-				freq += freqStride;
-				rq += rqStride;
+					in += inStride;
+					freq += freqStride;
+					rq += rqStride;
+				}
 			}
 			
 			framesToFill -= n;
@@ -1280,6 +1392,7 @@ struct RLPF : public Gen
 		_x2 = x2;
 		_y1 = y1;
 		_y2 = y2;
+		if (silent) mOut->mArray->setSilent();
 		produce(framesToFill);
 	}
 	
@@ -1299,6 +1412,8 @@ struct RLPF2 : public Gen
 		: Gen(th, itemTypeZ, mostFinite(in, freq, rq)), _in(in), _freq(freq), _rq(rq),
 			_x1(0.), _x2(0.), _y1(0.), _y2(0.), _z1(0.), _z2(0.), _freqmul(th.rate.radiansPerSample * gInvSineTableOmega)
 	{
+		_freq.setControlPeriod(vm.autokr);
+		_rq.setControlPeriod(vm.autokr);
 	}
 	
 	virtual const char* TypeName() const override { return "RLPF"; }
@@ -1315,6 +1430,7 @@ struct RLPF2 : public Gen
 		Z z1 = _z1;
 		Z z2 = _z2;
 		Z freqmul = _freqmul;
+		bool silent = true;
 		while (framesToFill) {
 			Z *in, *freq, *rq;
 			int n, inStride, freqStride, rqStride;
@@ -1324,7 +1440,11 @@ struct RLPF2 : public Gen
 				break;
 			}
 			
-			for (int i = 0; i < n; ++i) {				
+			if (skipSilentRun(inStride, in, {&x1, &x2, &y1, &y2, &z1, &z2}, n, out, framesToFill, _in, _freq, _rq))
+				continue;
+			silent = false;
+			
+			if (freqStride == 0 && rqStride == 0) {
 				Z w0 = *freq * freqmul;
 				Z sn, cs;
 				tsincosx(w0, sn, cs);
@@ -1336,24 +1456,55 @@ struct RLPF2 : public Gen
 				Z b1 = 1. - cs;
 				Z b0 = .5 * b1;
 				Z b2 = b0;
+				for (int i = 0; i < n; ++i) {
+					Z x0 = *in;
+					Z y0 = (b0 * x0 + b1 * x1 + b2 * x2 - a1 * y1 - a2 * y2) * a0r;
+					y0 = Feedback::feedback(y0);
+					Z z0 = (b0 * y0 + b1 * y1 + b2 * y2 - a1 * z1 - a2 * z2) * a0r;
+					z0 = Feedback::feedback(z0);
+					
+					out[i] = z0;
+					z2 = z1;
+					z1 = z0;
+					y2 = y1;
+					y1 = y0;
+					x2 = x1;
+					x1 = x0;
+					
+					in += inStride;
+				}
+			} else {
+				for (int i = 0; i < n; ++i) {				
+					Z w0 = *freq * freqmul;
+					Z sn, cs;
+					tsincosx(w0, sn, cs);
+					Z alpha = sn * *rq * .5;
+					Z a0 = 1. + alpha;
+					Z a0r = 1./a0;
+					Z a1 = -2. * cs;
+					Z a2 = 1. - alpha;
+					Z b1 = 1. - cs;
+					Z b0 = .5 * b1;
+					Z b2 = b0;
 			
-				Z x0 = *in;
-				Z y0 = (b0 * x0 + b1 * x1 + b2 * x2 - a1 * y1 - a2 * y2) * a0r;
-				y0 = Feedback::feedback(y0);
-				Z z0 = (b0 * y0 + b1 * y1 + b2 * y2 - a1 * z1 - a2 * z2) * a0r;
-				z0 = Feedback::feedback(z0);
+					Z x0 = *in;
+					Z y0 = (b0 * x0 + b1 * x1 + b2 * x2 - a1 * y1 - a2 * y2) * a0r;
+					y0 = Feedback::feedback(y0);
+					Z z0 = (b0 * y0 + b1 * y1 + b2 * y2 - a1 * z1 - a2 * z2) * a0r;
+					z0 = Feedback::feedback(z0);
 				
-				out[i] = z0;
-				z2 = z1;
-				z1 = z0;
-				y2 = y1;
-				y1 = y0;
-				x2 = x1;
-				x1 = x0;
+					out[i] = z0;
+					z2 = z1;
+					z1 = z0;
+					y2 = y1;
+					y1 = y0;
+					x2 = x1;
+					x1 = x0;
 				
-				in += inStride;
-				freq += freqStride;
-				rq += rqStride;
+					in += inStride;
+					freq += freqStride;
+					rq += rqStride;
+				}
 			}
 			
 			framesToFill -= n;
@@ -1369,6 +1520,7 @@ struct RLPF2 : public Gen
 		_y2 = y2;
 		_z1 = z1;
 		_z2 = z2;
+		if (silent) mOut->mArray->setSilent();
 		produce(framesToFill);
 	}
 	
@@ -1389,6 +1541,8 @@ struct RHPF : public Gen
 		: Gen(th, itemTypeZ, mostFinite(in, freq, rq)), _in(in), _freq(freq), _rq(rq),
 			_x1(0.), _x2(0.), _y1(0.), _y2(0.), _freqmul(th.rate.radiansPerSample * gInvSineTableOmega)
 	{
+		_freq.setControlPeriod(vm.autokr);
+		_rq.setControlPeriod(vm.autokr);
 	}
 	
 	virtual const char* TypeName() const override { return "RHPF"; }
@@ -1403,6 +1557,7 @@ struct RHPF : public Gen
 		Z y1 = _y1;
 		Z y2 = _y2;
 		Z freqmul = _freqmul;
+		bool silent = true;
 		while (framesToFill) {
 			Z *in, *freq, *rq;
 			int n, inStride, freqStride, rqStride;
@@ -1412,7 +1567,11 @@ struct RHPF : public Gen
 				break;
 			}
 			
-			for (int i = 0; i < n; ++i) {				
+			if (skipSilentRun(inStride, in, {&x1, &x2, &y1, &y2}, n, out, framesToFill, _in, _freq, _rq))
+				continue;
+			silent = false;
+			
+			if (freqStride == 0 && rqStride == 0) {
 				Z w0 = *freq * freqmul;
 				Z sn, cs;
 				tsincosx(w0, sn, cs);
@@ -1423,20 +1582,46 @@ struct RHPF : public Gen
 				Z b1 = -1. - cs;
 				Z b0 = -.5 * b1;
 				Z b2 = b0;
+				for (int i = 0; i < n; ++i) {
+					Z x0 = *in;
+					Z y0 = (b0 * x0 + b1 * x1 + b2 * x2 - a1 * y1 - a2 * y2)/a0;
+					y0 = Feedback::feedback(y0);
+					
+					out[i] = y0;
+					y2 = y1;
+					y1 = y0;
+					x2 = x1;
+					x1 = x0;
+					
+					in += inStride;
+				}
+			} else {
+				for (int i = 0; i < n; ++i) {				
+					Z w0 = *freq * freqmul;
+					Z sn, cs;
+					tsincosx(w0, sn, cs);
+					Z alpha = sn * *rq * .5;
+					Z a0 = 1. + alpha;
+					Z a1 = -2. * cs;
+					Z a2 = 1. - alpha;
+					Z b1 = -1. - cs;
+					Z b0 = -.5 * b1;
+					Z b2 = b0;
 			
-				Z x0 = *in;
-				Z y0 = (b0 * x0 + b1 * x1 + b2 * x2 - a1 * y1 - a2 * y2)/a0;
-				y0 = Feedback::feedback(y0);
+					Z x0 = *in;
+					Z y0 = (b0 * x0 + b1 * x1 + b2 * x2 - a1 * y1 - a2 * y2)/a0;
+					y0 = Feedback::feedback(y0);
 				
-				out[i] = y0;
-				y2 = y1;
-				y1 = y0;
-				x2 = x1;
-				x1 = x0;
+					out[i] = y0;
+					y2 = y1;
+					y1 = y0;
+					x2 = x1;
+					x1 = x0;
 				
-				in += inStride;
-				freq += freqStride;
-				rq += rqStride;
+					in += inStride;
+					freq += freqStride;
+					rq += rqStride;
+				}
 			}
 			
 			framesToFill -= n;
@@ -1450,6 +1635,7 @@ struct RHPF : public Gen
 		_x2 = x2;
 		_y1 = y1;
 		_y2 = y2;
+		if (silent) mOut->mArray->setSilent();
 		produce(framesToFill);
 	}
 	
@@ -1469,6 +1655,8 @@ struct RHPF2 : public Gen
 		: Gen(th, itemTypeZ, mostFinite(in, freq, rq)), _in(in), _freq(freq), _rq(rq),
 			_x1(0.), _x2(0.), _y1(0.), _y2(0.), _z1(0.), _z2(0.), _freqmul(th.rate.radiansPerSample * gInvSineTableOmega)
 	{
+		_freq.setControlPeriod(vm.autokr);
+		_rq.setControlPeriod(vm.autokr);
 	}
 	
 	virtual const char* TypeName() const override { return "RHPF2"; }
@@ -1485,6 +1673,7 @@ struct RHPF2 : public Gen
 		Z z1 = _z1;
 		Z z2 = _z2;
 		Z freqmul = _freqmul;
+		bool silent = true;
 		while (framesToFill) {
 			Z *in, *freq, *rq;
 			int n, inStride, freqStride, rqStride;
@@ -1494,7 +1683,11 @@ struct RHPF2 : public Gen
 				break;
 			}
 			
-			for (int i = 0; i < n; ++i) {				
+			if (skipSilentRun(inStride, in, {&x1, &x2, &y1, &y2, &z1, &z2}, n, out, framesToFill, _in, _freq, _rq))
+				continue;
+			silent = false;
+			
+			if (freqStride == 0 && rqStride == 0) {
 				Z w0 = *freq * freqmul;
 				Z sn, cs;
 				tsincosx(w0, sn, cs);
@@ -1506,24 +1699,55 @@ struct RHPF2 : public Gen
 				Z b1 = -1. - cs;
 				Z b0 = -.5 * b1;
 				Z b2 = b0;
+				for (int i = 0; i < n; ++i) {
+					Z x0 = *in;
+					Z y0 = (b0 * x0 + b1 * x1 + b2 * x2 - a1 * y1 - a2 * y2) * a0r;
+					y0 = Feedback::feedback(y0);
+					Z z0 = (b0 * y0 + b1 * y1 + b2 * y2 - a1 * z1 - a2 * z2) * a0r;
+					z0 = Feedback::feedback(z0);
+					
+					out[i] = z0;
+					z2 = z1;
+					z1 = z0;
+					y2 = y1;
+					y1 = y0;
+					x2 = x1;
+					x1 = x0;
+					
+					in += inStride;
+				}
+			} else {
+				for (int i = 0; i < n; ++i) {				
+					Z w0 = *freq * freqmul;
+					Z sn, cs;
+					tsincosx(w0, sn, cs);
+					Z alpha = sn * *rq * .5;
+					Z a0 = 1. + alpha;
+					Z a0r = 1./a0;
+					Z a1 = -2. * cs;
+					Z a2 = 1. - alpha;
+					Z b1 = -1. - cs;
+					Z b0 = -.5 * b1;
+					Z b2 = b0;
 			
-				Z x0 = *in;
-				Z y0 = (b0 * x0 + b1 * x1 + b2 * x2 - a1 * y1 - a2 * y2) * a0r;
-				y0 = Feedback::feedback(y0);
-				Z z0 = (b0 * y0 + b1 * y1 + b2 * y2 - a1 * z1 - a2 * z2) * a0r;
-				z0 = Feedback::feedback(z0);
+					Z x0 = *in;
+					Z y0 = (b0 * x0 + b1 * x1 + b2 * x2 - a1 * y1 - a2 * y2) * a0r;
+					y0 = Feedback::feedback(y0);
+					Z z0 = (b0 * y0 + b1 * y1 + b2 * y2 - a1 * z1 - a2 * z2) * a0r;
+					z0 = Feedback::feedback(z0);
 				
-				out[i] = z0;
-				z2 = z1;
-				z1 = z0;
-				y2 = y1;
-				y1 = y0;
-				x2 = x1;
-				x1 = x0;
+					out[i] = z0;
+					z2 = z1;
+					z1 = z0;
+					y2 = y1;
+					y1 = y0;
+					x2 = x1;
+					x1 = x0;
 				
-				in += inStride;
-				freq += freqStride;
-				rq += rqStride;
+					in += inStride;
+					freq += freqStride;
+					rq += rqStride;
+				}
 			}
 			
 			framesToFill -= n;
@@ -1539,6 +1763,7 @@ struct RHPF2 : public Gen
 		_y2 = y2;
 		_z1 = z1;
 		_z2 = z2;
+		if (silent) mOut->mArray->setSilent();
 		produce(framesToFill);
 	}
 	
@@ -1573,6 +1798,7 @@ struct BPF : public Gen
 		Z y1 = _y1;
 		Z y2 = _y2;
 		Z freqmul = _freqmul;
+		bool silent = true;
 		while (framesToFill) {
 			Z *in, *freq, *bw;
 			int n, inStride, freqStride, bwStride;
@@ -1582,6 +1808,10 @@ struct BPF : public Gen
 				break;
 			}
 			
+			if (skipSilentRun(inStride, in, {&x1, &x2, &y1, &y2}, n, out, framesToFill, _in, _freq, _bw))
+				continue;
+			silent = false;
+			
 			for (int i = 0; i < n; ++i) {				
 				Z w0 = *freq * freqmul;
 				Z sn, cs;
@@ -1621,6 +1851,7 @@ struct BPF : public Gen
 		_x2 = x2;
 		_y1 = y1;
 		_y2 = y2;
+		if (silent) mOut->mArray->setSilent();
 		produce(framesToFill);
 	}
 	
@@ -1653,6 +1884,7 @@ struct BSF : public Gen
 		Z y1 = _y1;
 		Z y2 = _y2;
 		Z freqmul = _freqmul;
+		bool silent = true;
 		while (framesToFill) {
 			Z *in, *freq, *bw;
 			int n, inStride, freqStride, bwStride;
@@ -1662,6 +1894,10 @@ struct BSF : public Gen
 				break;
 			}
 			
+			if (skipSilentRun(inStride, in, {&x1, &x2, &y1, &y2}, n, out, framesToFill, _in, _freq, _bw))
+				continue;
+			silent = false;
+			
 			for (int i = 0; i < n; ++i) {				
 				Z w0 = *freq * freqmul;
 				Z sn, cs;
@@ -1701,6 +1937,7 @@ struct BSF : public Gen
 		_x2 = x2;
 		_y1 = y1;
 		_y2 = y2;
+		if (silent) mOut->mArray->setSilent();
 		produce(framesToFill);
 	}
 	
@@ -1735,6 +1972,7 @@ struct APF : public Gen
 		Z y1 = _y1;
 		Z y2 = _y2;
 		Z freqmul = _freqmul;
+		bool silent = true;
 		while (framesToFill) {
 			Z *in, *freq, *bw;
 			int n, inStride, freqStride, bwStride;
@@ -1744,6 +1982,10 @@ struct APF : public Gen
 				break;
 			}
 			
+			if (skipSilentRun(inStride, in, {&x1, &x2, &y1, &y2}, n, out, framesToFill, _in, _freq, _bw))
+				continue;
+			silent = false;
+			
 			for (int i = 0; i < n; ++i) {				
 				Z w0 = *freq * freqmul;
 				Z sn, cs;
@@ -1783,6 +2025,7 @@ struct APF : public Gen
 		_x2 = x2;
 		_y1 = y1;
 		_y2 = y2;
+		if (silent) mOut->mArray->setSilent();
 		produce(framesToFill);
 	}
 	
@@ -1817,6 +2060,7 @@ struct PEQ : public Gen
 		Z y1 = _y1;
 		Z y2 = _y2;
 		Z freqmul = _freqmul;
+		bool silent = true;
 		while (framesToFill) {
 			Z *in, *freq, *bw, *gain;
 			int n, inStride, freqStride, bwStride, gainStride;
@@ -1826,6 +2070,10 @@ struct PEQ : public Gen
 				break;
 			}
 			
+			if (skipSilentRun(inStride, in, {&x1, &x2, &y1, &y2}, n, out, framesToFill, _in, _freq, _bw, _gain))
+				continue;
+			silent = false;
+			
 			for (int i = 0; i < n; ++i) {	
 				Z A = t_dbamp(.5 * *gain);
 				Z w0 = *freq * freqmul;
@@ -1872,6 +2120,7 @@ struct PEQ : public Gen
 		_x2 = x2;
 		_y1 = y1;
 		_y2 = y2;
+		if (silent) mOut->mArray->setSilent();
 		produce(framesToFill);
 	}
 	
@@ -1907,6 +2156,7 @@ struct LowShelf : public Gen
 		Z y2 = _y2;
 		Z freqmul = _freqmul;
 		Z alphamul = _alphamul;
+		bool silent = true;
 		while (framesToFill) {
 			Z *in, *freq, *gain;
 			int n, inStride, freqStride, gainStride;
@@ -1916,6 +2166,10 @@ struct LowShelf : public Gen
 				break;
 			}
 			
+			if (skipSilentRun(inStride, in, {&x1, &x2, &y1, &y2}, n, out, framesToFill, _in, _freq, _gain))
+				continue;
+			silent = false;
+			
 			for (int i = 0; i < n; ++i) {	
 				Z A = t_dbamp(.5 * *gain);
 				Z Ap1 = A + 1.;
@@ -1961,6 +2215,7 @@ struct LowShelf : public Gen
 		_x2 = x2;
 		_y1 = y1;
 		_y2 = y2;
+		if (silent) mOut->mArray->setSilent();
 		produce(framesToFill);
 	}
 	
@@ -1996,6 +2251,7 @@ struct HighShelf : public Gen
 		Z y2 = _y2;
 		Z freqmul = _freqmul;
 		Z alphamul = _alphamul;
+		bool silent = true;
 		while (framesToFill) {
 			Z *in, *freq, *gain;
 			int n, inStride, freqStride, gainStride;
@@ -2005,6 +2261,10 @@ struct HighShelf : public Gen
 				break;
 			}
 			
+			if (skipSilentRun(inStride, in, {&x1, &x2, &y1, &y2}, n, out, framesToFill, _in, _freq, _gain))
+				continue;
+			silent = false;
+			
 			for (int i = 0; i < n; ++i) {	
 				Z A = t_dbamp(.5 * *gain);
 				Z Ap1 = A + 1.;
@@ -2050,6 +2310,7 @@ struct HighShelf : public Gen
 		_x2 = x2;
 		_y1 = y1;
 		_y2 = y2;
+		if (silent) mOut->mArray->setSilent();
 		produce(framesToFill);
 	}
 	
@@ -2420,6 +2681,7 @@ struct Resonz : public Gen
 		Z y1 = _y1;
 		Z y2 = _y2;
 		Z freqmul = _freqmul;
+		bool silent = true;
 		while (framesToFill) {
 			Z *in, *freq, *rq;
 			int n, inStride, freqStride, rqStride;
@@ -2429,6 +2691,10 @@ struct Resonz : public Gen
 				break;
 			}
 			
+			if (skipSilentRun(inStride, in, {&x1, &x2, &y1, &y2}, n, out, framesToFill, _in, _freq, _rq))
+				continue;
+			silent = false;
+			
 			for (int i = 0; i < n; ++i) {				
 				Z w0 = *freq * freqmul;
 				Z R = 1. - .5 * w0 * *rq;
@@ -2462,6 +2728,7 @@ struct Resonz : public Gen
 		_x2 = x2;
 		_y1 = y1;
 		_y2 = y2;
+		if (silent) mOut->mArray->setSilent();
 		produce(framesToFill);
 	}
 };
@@ -2496,6 +2763,7 @@ struct Ringz : public Gen
 		Z freqmul = _freqmul;
 		Z K = _K;
 		
+		bool silent = true;
 		while (framesToFill) {
 			Z *in, *freq, *ringTime;
 			int n, inStride, freqStride, ringTimeStride;
@@ -2505,6 +2773,10 @@ struct Ringz : public Gen
 				break;
 			}
 			
+			if (skipSilentRun(inStride, in, {&x1, &x2, &y1, &y2}, n, out, framesToFill, _in, _freq, _ringTime))
+				continue;
+			silent = false;
+			
 			
 			for (int i = 0; i < n; ++i) {				
 				Z w0 = *freq * freqmul;
@@ -2539,6 +2811,7 @@ struct Ringz : public Gen
 		_x2 = x2;
 		_y1 = y1;
 		_y2 = y2;
+		if (silent) mOut->mArray->setSilent();
 		produce(framesToFill);
 	}
 };
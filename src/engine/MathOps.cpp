@@ -20,6 +20,7 @@
 #include "sapf/platform/WindowsCompat.hpp"
 #endif
 #include <ctype.h>
+#include <cstring>
 #include "primes.hpp"
 #include "sapf/AccelerateCompat.hpp"
 
@@ -32,7 +33,7 @@ V BinaryOp::makeVList(Thread& th, Arg a, Arg b)
 
 V BinaryOp::makeZList(Thread& th, Arg a, Arg b)
 {
-	return new List(new BinaryOpZGen(th, this, a, b));
+	return makeBinaryOpZList(th, this, a, b);
 }
 
 V BinaryOpLink::makeVList(Thread& th, Arg a, Arg b)
@@ -117,9 +118,36 @@ void BinaryOp::reduce(Thread& th, int n, V& z, V *a, int astride)
 }
 
 
+// what is known of a run of an op's input: whether it is silent, and whether it is
+// finite, which only a stride 0 run can be known to be.
+struct RunInfo
+{
+	bool mSilent;
+	bool mFinite;
+};
+
+static RunInfo runInfo(int stride, const Z* buf)
+{
+	return { ZIn::isSilent(stride, buf), stride == 0 && std::isfinite(*buf) };
+}
+
+// whether a run that was computed is all zeros. a product of silence with a factor
+// that is not known to be finite is computed, and is usually silent still.
+static bool isZeros(int n, const Z* out)
+{
+	for (int i = 0; i < n; ++i) {
+		if (out[i] != 0.) return false;
+	}
+	return true;
+}
+
+static bool silentResult(UnaryOp* op, RunInfo a);
+static bool silentResult(BinaryOp* op, RunInfo a, RunInfo b);
+
 void UnaryOpZGen::pull(Thread& th) {
 	int framesToFill = mBlockSize;
 	Z* out = mOut->fulfillz(framesToFill);
+	bool silent = true;
 	while (framesToFill) {
 		int n = framesToFill;
 		int astride;
@@ -128,12 +156,18 @@ void UnaryOpZGen::pull(Thread& th) {
 			setDone();
 			break;
 		} else {
-			op->loopz(n, a, astride, out);
+			if (silentResult(op, runInfo(astride, a))) {
+				memset(out, 0, n * sizeof(Z));
+			} else {
+				op->loopz(n, a, astride, out);
+				silent = silent && isZeros(n, out);
+			}
 			_a.advance(n);
 			framesToFill -= n;
 			out += n;
 		}
 	}
+	if (silent) mOut->mArray->setSilent();
 	produce(framesToFill);
 }
 
@@ -142,6 +176,7 @@ void BinaryOpZGen::pull(Thread& th)
 {
 	int framesToFill = mBlockSize;
 	Z* out = mOut->fulfillz(framesToFill);
+	bool silent = true;
 	while (framesToFill) {
 		int n = framesToFill;
 		int astride, bstride;
@@ -150,13 +185,19 @@ void BinaryOpZGen::pull(Thread& th)
 			setDone();
 			break;
 		} else {
-			op->loopz(n, a, astride, b, bstride, out);
+			if (silentResult(op, runInfo(astride, a), runInfo(bstride, b))) {
+				memset(out, 0, n * sizeof(Z));
+			} else {
+				op->loopz(n, a, astride, b, bstride, out);
+				silent = silent && isZeros(n, out);
+			}
 			_a.advance(n);
 			_b.advance(n);
 			framesToFill -= n;
 			out += n;
 		}
 	}
+	if (silent) mOut->mArray->setSilent();
 	produce(framesToFill);
 }
 
@@ -189,6 +230,197 @@ void BinaryOpLinkZGen::pull(Thread& th)
 	produce(framesToFill);
 }
 
+#pragma mark FUSED OPS
+
+static bool anyFinite(std::vector<V> const& inValues)
+{
+	for (Arg v : inValues) {
+		if (v.isFinite()) return true;
+	}
+	return false;
+}
+
+FusedOpZGen::FusedOpZGen(Thread& th, std::vector<V> const& inSources, std::vector<Step> const& inSteps)
+	: Gen(th, itemTypeZ, anyFinite(inSources)), mSteps(inSteps)
+{
+	for (Arg source : inSources)
+		mInputs.push_back(ZIn(source));
+}
+
+void FusedOpZGen::pull(Thread& th)
+{
+	int framesToFill = mBlockSize;
+	Z* out = mOut->fulfillz(framesToFill);
+	Z* in[kMaxInputs];
+	int stride[kMaxInputs];
+	bool silent = true;
+	while (framesToFill) {
+		int n = framesToFill;
+		bool done = false;
+		for (size_t i = 0; i < mInputs.size() && !done; ++i)
+			done = mInputs[i](th, n, stride[i], in[i]);
+		if (done) {
+			setDone();
+			break;
+		}
+		if (isSilent(in, stride)) {
+			memset(out, 0, n * sizeof(Z));
+		} else {
+			run(n, in, stride, out);
+			silent = silent && isZeros(n, out);
+		}
+		for (ZIn& input : mInputs)
+			input.advance(n);
+		framesToFill -= n;
+		out += n;
+	}
+	if (silent) mOut->mArray->setSilent();
+	produce(framesToFill);
+}
+
+bool FusedOpZGen::isSilent(Z* const* in, const int* stride) const
+{
+	// an intermediate result is known to be finite only when it is silent.
+	RunInfo info[kMaxDepth];
+	int sp = 0;
+	for (Step const& step : mSteps) {
+		if (step.mInput >= 0) {
+			info[sp++] = runInfo(stride[step.mInput], in[step.mInput]);
+		} else if (step.mBinary) {
+			--sp;
+			bool silent = silentResult(step.mBinary, info[sp-1], info[sp]);
+			info[sp-1] = { silent, silent };
+		} else {
+			bool silent = silentResult(step.mUnary, info[sp-1]);
+			info[sp-1] = { silent, silent };
+		}
+	}
+	return info[0].mSilent;
+}
+
+void FusedOpZGen::run(int n, Z* const* in, const int* stride, Z* out)
+{
+	Z temp[kMaxDepth][2][kTileSize];
+	const Z* operand[kMaxDepth];
+	int operandStride[kMaxDepth];
+	size_t last = mSteps.size() - 1;
+
+	for (int offset = 0; offset < n; offset += kTileSize) {
+		int m = std::min(n - offset, (int)kTileSize);
+		int sp = 0;
+		for (size_t k = 0; k <= last; ++k) {
+			Step const& step = mSteps[k];
+			if (step.mInput >= 0) {
+				operand[sp] = in[step.mInput] + offset * stride[step.mInput];
+				operandStride[sp] = stride[step.mInput];
+				++sp;
+				continue;
+			}
+			int level = step.mBinary ? sp - 2 : sp - 1;
+			// results go to the buffer the operand at this level is not in, so no op runs in place.
+			Z* result = k == last ? out + offset : temp[level][operand[level] == temp[level][0]];
+			if (step.mBinary) {
+				step.mBinary->loopz(m, operand[level], operandStride[level], operand[level+1], operandStride[level+1], result);
+				--sp;
+			} else {
+				step.mUnary->loopz(m, operand[level], operandStride[level], result);
+			}
+			operand[level] = result;
+			operandStride[level] = 1;
+		}
+	}
+}
+
+struct FusedProgram
+{
+	std::vector<V> mSources;
+	std::vector<FusedOpZGen::Step> mSteps;
+	bool mFused = false;
+
+	void addInput(Arg v)
+	{
+		int index = -1;
+		for (size_t i = 0; i < mSources.size(); ++i) {
+			if (mSources[i].Identical(v)) index = (int)i;
+		}
+		if (index < 0) {
+			index = (int)mSources.size();
+			mSources.push_back(v);
+		}
+		mSteps.push_back({ nullptr, nullptr, index });
+	}
+	void addOperand(Arg v);
+	bool fits() const;
+};
+
+// the value an input was made from. only valid before the input is first read.
+static V sourceOf(ZIn const& in)
+{
+	return in.mIsConstant ? in.mConstant : V(in.mList);
+}
+
+// a signal is taken apart into its inputs and ops only if nothing has read it yet.
+void FusedProgram::addOperand(Arg v)
+{
+	Gen* gen = nullptr;
+	if (vm.fuseon && v.isZList()) {
+		List* list = (List*)v.o();
+		if (list->isThunk() && !list->isFilled()) gen = list->mGen();
+	}
+
+	if (FusedOpZGen* fused = dynamic_cast<FusedOpZGen*>(gen)) {
+		for (FusedOpZGen::Step const& step : fused->mSteps) {
+			if (step.mInput >= 0) addInput(sourceOf(fused->mInputs[step.mInput]));
+			else mSteps.push_back(step);
+		}
+		mFused = true;
+	} else if (BinaryOpZGen* binary = dynamic_cast<BinaryOpZGen*>(gen)) {
+		addInput(sourceOf(binary->_a));
+		addInput(sourceOf(binary->_b));
+		mSteps.push_back({ nullptr, binary->op, -1 });
+		mFused = true;
+	} else if (UnaryOpZGen* unary = dynamic_cast<UnaryOpZGen*>(gen)) {
+		addInput(sourceOf(unary->_a));
+		mSteps.push_back({ unary->op, nullptr, -1 });
+		mFused = true;
+	} else {
+		addInput(v);
+	}
+}
+
+bool FusedProgram::fits() const
+{
+	if (mSources.size() > FusedOpZGen::kMaxInputs || mSteps.size() > FusedOpZGen::kMaxSteps)
+		return false;
+	int depth = 0, maxDepth = 0;
+	for (FusedOpZGen::Step const& step : mSteps) {
+		if (step.mInput >= 0) maxDepth = std::max(maxDepth, ++depth);
+		else if (step.mBinary) --depth;
+	}
+	return maxDepth <= FusedOpZGen::kMaxDepth;
+}
+
+V makeUnaryOpZList(Thread& th, UnaryOp* op, Arg a)
+{
+	FusedProgram program;
+	program.addOperand(a);
+	program.mSteps.push_back({ op, nullptr, -1 });
+	if (program.mFused && program.fits())
+		return new List(new FusedOpZGen(th, program.mSources, program.mSteps));
+	return new List(new UnaryOpZGen(th, op, a));
+}
+
+V makeBinaryOpZList(Thread& th, BinaryOp* op, Arg a, Arg b)
+{
+	FusedProgram program;
+	program.addOperand(a);
+	program.addOperand(b);
+	program.mSteps.push_back({ nullptr, op, -1 });
+	if (program.mFused && program.fits())
+		return new List(new FusedOpZGen(th, program.mSources, program.mSteps));
+	return new List(new BinaryOpZGen(th, op, a, b));
+}
+
 
 static void DoPairwise(Thread& th, BinaryOp* op)
 {
@@ -710,6 +942,23 @@ struct UnaryOp_ToZero : public UnaryOp {
 };
 UnaryOp_ToZero gUnaryOp_ToZero; 
 
+extern BinaryOp* gBinaryOpPtr_mul;
+
+// whether an op's output is all zeros, given what is known of its inputs: a product
+// of a silent input and a finite one, ToZero of anything, or any other op that maps
+// zeros to zero. 0 * inf and 0 * nan are nan, so silence times a factor that is not
+// known to be finite is computed.
+static bool silentResult(UnaryOp* op, RunInfo a)
+{
+	return op == &gUnaryOp_ToZero || (a.mSilent && op->op(0.) == 0.);
+}
+
+static bool silentResult(BinaryOp* op, RunInfo a, RunInfo b)
+{
+	if (op == gBinaryOpPtr_mul) return (a.mSilent && b.mFinite) || (b.mSilent && a.mFinite);
+	return a.mSilent && b.mSilent && op->op(0., 0.) == 0.;
+}
+
 DEFINE_UNOP_FLOATVV2(neg, -a, vDSP_vnegD(const_cast<Z*>(aa), astride, out, 1, n))
 DEFINE_UNOP_FLOAT(sgn, sc_sgn(a))
 DEFINE_UNOP_FLOATVV(abs, fabs(a), vvfabs)
@@ -896,7 +1145,7 @@ DEFINE_BINOP_FLOATVV1(nextafter, nextafter(a, b), vvnextafter(out, const_cast<Z*
 		{
 			if (a.isReal() && a.f == 0.) return b;
 			if (b.isReal() && b.f == 0.) return a;
-			return new List(new BinaryOpZGen(th, this, a, b));
+			return makeBinaryOpZList(th, this, a, b);
 		}
 	};
 	BinaryOp_plus gBinaryOp_plus;
@@ -1009,9 +1258,9 @@ DEFINE_BINOP_FLOATVV1(nextafter, nextafter(a, b), vvnextafter(out, const_cast<Z*
 
 		virtual V makeZList(Thread& th, Arg a, Arg b)
 		{
-			if (a.isReal() && a.f == 0.) return new List(new UnaryOpZGen(th, &gUnaryOp_neg, b));
+			if (a.isReal() && a.f == 0.) return makeUnaryOpZList(th, &gUnaryOp_neg, b);
 			if (b.isReal() && b.f == 0.) return a;
-			return new List(new BinaryOpZGen(th, this, a, b));
+			return makeBinaryOpZList(th, this, a, b);
 		}
 	};
 	BinaryOp_minus gBinaryOp_minus;
@@ -1024,19 +1273,16 @@ DEFINE_BINOP_FLOATVV1(nextafter, nextafter(a, b), vvnextafter(out, const_cast<Z*
 		virtual const char *Name() { return "mul"; }
 		virtual double op(double a, double b) { return a * b; }
 		virtual void loopz(int n, const Z *aa, int astride, const Z *bb, int bstride, Z *out) {
+			// a zero factor is multiplied too, so that 0 * inf and 0 * nan are nan.
 			if (astride == 0) {
 				if (*aa == 1.) {
 					LOOP(i,n) { out[i] = *bb; bb += bstride; }
-				} else if (*aa == 0.) {
-					LOOP(i,n) { out[i] = 0.; }
 				} else {
 					vDSP_vsmulD(bb, bstride, aa, out, 1, n);
 				}
 			} else if (bstride == 0) {
 				if (*bb == 1.) {
 					LOOP(i,n) { out[i] = *aa; aa += astride; }
-				} else if (*bb == 0.) {
-					LOOP(i,n) { out[i] = 0.; }
 				} else {
 					vDSP_vsmulD(aa, astride, bb, out, 1, n);
 				}
@@ -1065,12 +1311,10 @@ DEFINE_BINOP_FLOATVV1(nextafter, nextafter(a, b), vvnextafter(out, const_cast<Z*
 		{
 			if (a.isReal()) {
 				if (a.f == 1.) return b;
-				if (a.f == 0.) return new List(new UnaryOpGen(th, &gUnaryOp_ToZero, b));
 				if (a.f == -1.) return new List(new UnaryOpGen(th, &gUnaryOp_neg, b));
 			}
 			if (b.isReal()) {
 				if (b.f == 1.) return a;
-				if (b.f == 0.) return new List(new UnaryOpGen(th, &gUnaryOp_ToZero, a));
 				if (b.f == -1.) return new List(new UnaryOpGen(th, &gUnaryOp_neg, a));
 			}
 			return new List(new BinaryOpGen(th, this, a, b));
@@ -1078,17 +1322,16 @@ DEFINE_BINOP_FLOATVV1(nextafter, nextafter(a, b), vvnextafter(out, const_cast<Z*
 
 		virtual V makeZList(Thread& th, Arg a, Arg b)
 		{
+			// a literal 0 is multiplied like any other factor, and is silent.
 			if (a.isReal()) {
 				if (a.f == 1.) return b;
-				if (a.f == 0.) return new List(new UnaryOpZGen(th, &gUnaryOp_ToZero, b));
-				if (a.f == -1.) return new List(new UnaryOpZGen(th, &gUnaryOp_neg, b));
+				if (a.f == -1.) return makeUnaryOpZList(th, &gUnaryOp_neg, b);
 			}
 			if (b.isReal()) {
 				if (b.f == 1.) return a;
-				if (b.f == 0.) return new List(new UnaryOpZGen(th, &gUnaryOp_ToZero, a));
-				if (b.f == -1.) return new List(new UnaryOpZGen(th, &gUnaryOp_neg, a));
+				if (b.f == -1.) return makeUnaryOpZList(th, &gUnaryOp_neg, a);
 			}
-			return new List(new BinaryOpZGen(th, this, a, b));
+			return makeBinaryOpZList(th, this, a, b);
 		}
 	};
 	BinaryOp_mul gBinaryOp_mul;
@@ -1100,11 +1343,10 @@ DEFINE_BINOP_FLOATVV1(nextafter, nextafter(a, b), vvnextafter(out, const_cast<Z*
 		virtual const char *Name() { return "div"; }
 		virtual double op(double a, double b) { return a / b; }
 		virtual void loopz(int n, const Z *aa, int astride, const Z *bb, int bstride, Z *out) {
-			if (astride == 0 && *aa == 0.) {
-				LOOP(i,n) { out[i] = 0.; }
-			} else if (bstride == 0) {
+			// a zero numerator is divided too, so that 0 / 0 and 0 / nan are nan.
+			if (bstride == 0) {
 				if (*bb == 1.) {
-					LOOP(i,n) { out[i] = *aa; aa += bstride; }
+					LOOP(i,n) { out[i] = *aa; aa += astride; }
 				} else {
 					Z rb = 1. / *bb;
 					vDSP_vsmulD(const_cast<Z*>(aa), astride, &rb, out, 1, n);
@@ -1131,16 +1373,15 @@ DEFINE_BINOP_FLOATVV1(nextafter, nextafter(a, b), vvnextafter(out, const_cast<Z*
 		}
 		virtual V makeVList(Thread& th, Arg a, Arg b)
 		{
-			if (a.isReal() && a.f == 0.) return new List(new UnaryOpGen(th, &gUnaryOp_ToZero, b));
 			if (b.isReal() && b.f == 1.) return a;
 			return new List(new BinaryOpGen(th, this, a, b));
 		}
 
 		virtual V makeZList(Thread& th, Arg a, Arg b)
 		{
-			if (a.isReal() && a.f == 0.) return new List(new UnaryOpZGen(th, &gUnaryOp_ToZero, b));
+			// a literal 0 is divided like any other numerator.
 			if (b.isReal() && b.f == 1.) return a;
-			return new List(new BinaryOpZGen(th, this, a, b));
+			return makeBinaryOpZList(th, this, a, b);
 		}
 	};
 	BinaryOp_div gBinaryOp_div;
@@ -1201,12 +1442,13 @@ DEFINE_BINOP_FLOAT(roundUp, sc_roundUp(a, b))
 DEFINE_BINOP_FLOAT(trunc, sc_trunc(a, b))
 
 
-#define DEFN(FUNNAME, OPNAME, HELP) 	vm.def(OPNAME, 1, 1, FUNNAME##_, "(x --> z) " HELP);
+// the plain unary and binary ops are marked pure so that the bytecode optimizer may fold them.
+#define DEFN(FUNNAME, OPNAME, HELP) 	vm.def(OPNAME, 1, 1, FUNNAME##_, "(x --> z) " HELP).SetPure();
 #define DEFNa(FUNNAME, OPNAME, HELP) 	DEFN(FUNNAME, #OPNAME, HELP)
 #define DEF(NAME, HELP) 	DEFNa(NAME, NAME, HELP); 
 
 #define DEFNa2(FUNNAME, OPNAME, HELP) 	\
-	(vm.def(#OPNAME, 2, 1, FUNNAME##_, "(x y --> z) " HELP), \
+	(vm.def(#OPNAME, 2, 1, FUNNAME##_, "(x y --> z) " HELP).SetPure(), \
 	vm.def(#OPNAME "/", 1, 1, FUNNAME##_reduce_, nullptr), \
 	vm.def(#OPNAME "\\", 1, 1, FUNNAME##_scan_, nullptr), \
 	vm.def(#OPNAME "^", 1, 1, FUNNAME##_pairs_, nullptr), \
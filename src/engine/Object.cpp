@@ -19,8 +19,13 @@
 #include "clz.hpp"
 #include "MathOps.hpp"
 #include "Opcode.hpp"
+#include "Profiler.hpp"
+#include "sapf/AccelerateCompat.hpp"
 #include <algorithm>
 #include <cstdarg>
+#include <mutex>
+#include <thread>
+#include <vector>
 
 void post(const char* fmt, ...)
 {
@@ -73,7 +78,7 @@ Thread gDummyThread;
 
 
 Object::Object()
-	: scratch(0), elemType(0), finite(false), flags(0)
+	: scratch(0), elemType(0), finite(false), flags(poolTakeNewObject(this) ? flag_Pooled : 0)
 {
 #if COLLECT_MINFO
 	++vm.totalObjectsAllocated;
@@ -82,11 +87,21 @@ Object::Object()
 
 Object::~Object()
 {
+	if (flags & flag_Counted)
+		poolUncountObject(scratch, poolObjectSize(this));
 #if COLLECT_MINFO
 	++vm.totalObjectsFreed;
 #endif
 }
 
+void Object::firstRetain() const
+{
+	if ((flags & (flag_Pooled | flag_Counted)) != flag_Pooled) return;
+	Object* self = const_cast<Object*>(this);
+	self->scratch = poolCountObject(TypeName(), poolObjectSize(this));
+	self->flags |= flag_Counted;
+}
+
 void Ref::set(Arg inV)
 {
 	O oldval = nullptr;
@@ -122,10 +137,7 @@ V Ref::deref() const
 	V out;
 	{
 		SpinLocker lock(mSpinLock);
-		if (o) {
-			out = o;
-			if (o) o->retain();
-		}
+		if (o) out = o;
 		else out = z;
 	}
 	return out;
@@ -154,15 +166,22 @@ Form::Form(P<Table> const& inTable, P<Form> const& inNext)
 
 volatile int64_t gTreeNodeSerialNumber;
 
+std::atomic<uint64_t> gWorkspaceVersion{1};
+std::atomic<int32_t> gLiveEachOps{0};
+
+// a new GForm may reuse the address of a freed one, so creating one must
+// invalidate the workspace inline caches, which compare GForm pointers.
 GForm::GForm(P<GTable> const& inTable, P<GForm> const& inNext)
 	: Object(), mTable(inTable), mNextForm(inNext)
 {
+	++gWorkspaceVersion;
 }
 
 GForm::GForm(P<GForm> const& inNext)
 	: Object(), mNextForm(inNext)
 { 
 	mTable = new GTable();
+	++gWorkspaceVersion;
 }
 
 P<GForm> consForm(P<GTable> const& inTable, P<GForm> const& inNext) { return new GForm(inTable, inNext); }
@@ -176,16 +195,18 @@ class PushFunContext
 {
 	Thread& th;
 	P<Fun> fun;
-	size_t stackBase, localBase;
+	size_t stackBase, localBase, localTop;
 public:
 	PushFunContext(Thread& inThread, P<Fun> const& inFun)
 		: th(inThread), fun(th.fun),
-		stackBase(th.stackBase), localBase(th.localBase)
+		stackBase(th.stackBase), localBase(th.localBase), localTop(th.local.size())
 	{
+		th.enterCall();
 	}
 	~PushFunContext()
 	{
-		th.popLocals();
+		th.popLocalsTo(localTop);
+		th.leaveCall();
 		th.fun = fun;
 		th.setStackBaseTo(stackBase);
 		th.setLocalBase(localBase);
@@ -196,16 +217,18 @@ class PushREPLFunContext
 {
 	Thread& th;
 	P<Fun> fun;
-	size_t stackBase, localBase;
+	size_t stackBase, localBase, localTop;
 public:
 	PushREPLFunContext(Thread& inThread, P<Fun> const& inFun)
 		: th(inThread), fun(th.fun),
-		stackBase(th.stackBase), localBase(th.localBase)
+		stackBase(th.stackBase), localBase(th.localBase), localTop(th.local.size())
 	{
+		th.enterCall();
 	}
 	~PushREPLFunContext()
 	{
-		th.popLocals();
+		th.popLocalsTo(localTop);
+		th.leaveCall();
 		th.fun = fun;
 		th.setStackBaseTo(stackBase);
 		th.setLocalBase(localBase);
@@ -223,15 +246,8 @@ void Fun::runREPL(Thread& th)
 
 	th.setLocalBase();
 
-	if (NumArgs()) {
-		th.local.insert(th.local.end(), th.stack.end() - NumArgs(), th.stack.end());
-		th.stack.erase(th.stack.end() - NumArgs(), th.stack.end());
-	}
-	size_t numLocalVars = NumLocals() - NumArgs();
-	if (numLocalVars) {
-		V v;
-		th.local.insert(th.local.end(), numLocalVars, v);
-	}
+	th.local.moveFrom(th.stack, NumArgs());
+	th.local.pushNils(NumLocals() - NumArgs());
 	
 	th.fun = this;
 	
@@ -246,18 +262,12 @@ void Fun::run(Thread& th)
 	}
 
 	PushFunContext pfc(th, this);
+	ProfileScope ps(th, this);
 
 	th.setLocalBase();
 
-	if (NumArgs()) {
-		th.local.insert(th.local.end(), th.stack.end() - NumArgs(), th.stack.end());
-		th.stack.erase(th.stack.end() - NumArgs(), th.stack.end());
-	}
-	size_t numLocalVars = NumLocals() - NumArgs();
-	if (numLocalVars) {
-		V v;
-		th.local.insert(th.local.end(), numLocalVars, v);
-	}
+	th.local.moveFrom(th.stack, NumArgs());
+	th.local.pushNils(NumLocals() - NumArgs());
 	
 	th.setStackBase();
 
@@ -266,6 +276,20 @@ void Fun::run(Thread& th)
 	th.run(mDef->mCode->getOps());
 }
 
+// runs this function in the current frame, for a call in tail position. the
+// caller's locals are replaced by this function's. values the caller left on the
+// stack below the arguments stay there as part of the result. the context saved
+// by the Fun::run that made the frame restores everything when this returns.
+void Fun::enterTailCall(Thread& th)
+{
+	if (vm.profileon) profileTailCall(th, this);
+	th.local.popTo(th.localBase);
+	th.local.moveFrom(th.stack, NumArgs());
+	th.local.pushNils(NumLocals() - NumArgs());
+	th.setStackBase();
+	th.fun = this;
+}
+
 void Fun::apply(Thread& th) 
 { 
 	int numArgs = NumArgs();
@@ -274,29 +298,11 @@ void Fun::apply(Thread& th)
 		throw errStackUnderflow;
 	}
 
-	if (NoEachOps()) {
-		run(th);
+	if (!NoEachOps() && numArgs && hasEachOps(&th.top() - numArgs + 1, numArgs)) {
+		List* s = handleEachOps(th, numArgs, this);
+		th.push(s);
 	} else {
-		if (th.stackDepth()) {
-			bool haveEachOps = false;
-			V* args = &th.top() - numArgs + 1;
-
-			for (int i = 0; i < numArgs; ++i) {
-				if (args[i].isEachOp()) {
-					haveEachOps = true;
-					break;
-				}
-			}
-
-			if (haveEachOps) {
-				List* s = handleEachOps(th, numArgs, this);
-				th.push(s);
-			} else {
-				run(th);
-			}
-		} else {
-			run(th);
-		}
+		run(th);
 	}
 }
 
@@ -305,7 +311,7 @@ Fun::Fun(Thread& th, FunDef* def)
 {
 	if (NumVars()) {
 		mVars.insert(mVars.end(), th.stack.end() - NumVars(), th.stack.end());
-		th.stack.erase(th.stack.end() - NumVars(), th.stack.end());
+		th.stack.popn(NumVars());
 	}
 }
 
@@ -330,30 +336,13 @@ void Prim::apply_n(Thread& th, size_t n)
 	if (th.stackDepth() < n)
 		throw errStackUnderflow;
 	
-	if (NoEachOps()) {
-		prim(th, this); 
+	ProfileScope ps(th, this);
+
+	if (!NoEachOps() && n && hasEachOps(&th.top() - n + 1, n)) {
+		List* s = handleEachOps(th, (int)n, this);
+		th.push(s);
 	} else {
-	
-		if (n) {
-			V* args = &th.top() - n + 1;
-
-			bool haveEachOps = false;
-			for (size_t i = 0; i < n; ++i) {
-				if (args[i].isEachOp()) {
-					haveEachOps = true;
-					break;
-				}
-			}
-			
-			if (haveEachOps) {
-				List* s = handleEachOps(th, (int)n, this);
-				th.push(s);
-			} else {
-				prim(th, this); 
-			}
-		} else {
-			prim(th, this); 
-		}
+		prim(th, this); 
 	}
 }
 
@@ -513,7 +502,7 @@ bool GTable::get(Thread& th, Arg inKey, V& outValue) const
 	TreeNode* tree = mTree.load();
 	while (1) {
 		if (tree == nullptr) return false;
-		int32_t treeKeyHash = tree->mKey.Hash();
+		int32_t treeKeyHash = (int32_t)tree->mHash;
 		if (inKeyHash == treeKeyHash) {
 			outValue = tree->mValue;
 			return true;
@@ -531,7 +520,7 @@ bool GTable::getInner(Arg inKey, V& outValue) const
 	TreeNode* tree = mTree.load();
 	while (1) {
 		if (tree == nullptr) return false;
-		int32_t treeKeyHash = tree->mKey.Hash();
+		int32_t treeKeyHash = (int32_t)tree->mHash;
 		if (inKeyHash == treeKeyHash) {
 			outValue = tree->mValue;
 			return true;
@@ -563,6 +552,7 @@ bool GTable::putImpure(Arg inKey, Arg inValue)
 			newNode->retain();
             TreeNode* nullNode = nullptr;
             if (treeNodePtr->compare_exchange_weak(nullNode, newNode)) {
+                ++gWorkspaceVersion; // the new key may shadow one in an outer workspace.
                 break;
             }
             newNode->release();
@@ -616,7 +606,7 @@ V List::unaryOp(Thread& th, UnaryOp* op)
 	if (isVList())
 		return new List(new UnaryOpGen(th, op, this));
 	else
-		return new List(new UnaryOpZGen(th, op, this));
+		return makeUnaryOpZList(th, op, this);
 		
 }
 
@@ -891,7 +881,7 @@ void List::print(Thread& th, std::string& out, int depth)
 				a->v()[j].print(th, out, depth+1);
 			} else {
 			
-				zprintf(out, "%g", a->z()[j]);
+				zprintf(out, "%g", a->_atz(j));
 			}
 		}
 		if (i >= vm.printLength) {
@@ -1049,6 +1039,16 @@ Z* List::fulfillz(P<Array> const& inArray)
 	return mArray->z();
 }
 
+float* List::fulfillf(int n)
+{
+	assert(mGen);
+	mArray = new Array(elemType, n, true);
+	mArray->setSize(n);
+	mNext = new List(mGen);
+	mGen = nullptr;
+	return mArray->f();
+}
+
 void List::link(Thread& th, List* inList)
 {
 	assert(mGen);
@@ -1059,18 +1059,122 @@ void List::link(Thread& th, List* inList)
 	mGen = nullptr;
 }
 
+// each thread counts its own forces, so that counting does not share a cache line.
+struct ListForceThreadCounts
+{
+	std::atomic<int64_t> mForced{0};
+	std::atomic<int64_t> mClaimed{0};
+	std::atomic<int64_t> mContended{0};
+
+	ListForceThreadCounts();
+	~ListForceThreadCounts();
+};
+
+struct ListForceRegistry
+{
+	std::mutex mMutex;
+	std::vector<ListForceThreadCounts*> mThreads;
+	ListForceCounts mRetired;
+	ListForceCounts mBaseline;
+};
+
+static ListForceRegistry& listForceRegistry()
+{
+	static ListForceRegistry* sRegistry = new ListForceRegistry;
+	return *sRegistry;
+}
+
+ListForceThreadCounts::ListForceThreadCounts()
+{
+	ListForceRegistry& reg = listForceRegistry();
+	std::lock_guard<std::mutex> lock(reg.mMutex);
+	reg.mThreads.push_back(this);
+}
+
+ListForceThreadCounts::~ListForceThreadCounts()
+{
+	ListForceRegistry& reg = listForceRegistry();
+	std::lock_guard<std::mutex> lock(reg.mMutex);
+	reg.mThreads.erase(std::find(reg.mThreads.begin(), reg.mThreads.end(), this));
+	reg.mRetired.mForced += mForced.load(std::memory_order_relaxed);
+	reg.mRetired.mClaimed += mClaimed.load(std::memory_order_relaxed);
+	reg.mRetired.mContended += mContended.load(std::memory_order_relaxed);
+}
+
+static thread_local ListForceThreadCounts tListForceCounts;
+
+// only the owning thread writes its counts, so no locked add is needed.
+static inline void countForce(std::atomic<int64_t>& counter)
+{
+	counter.store(counter.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+}
+
+static void listForceTotals(ListForceRegistry& reg, ListForceCounts& outCounts)
+{
+	outCounts = reg.mRetired;
+	for (ListForceThreadCounts* counts : reg.mThreads) {
+		outCounts.mForced += counts->mForced.load(std::memory_order_relaxed);
+		outCounts.mClaimed += counts->mClaimed.load(std::memory_order_relaxed);
+		outCounts.mContended += counts->mContended.load(std::memory_order_relaxed);
+	}
+}
+
+void listForceCounts(ListForceCounts& outCounts)
+{
+	ListForceRegistry& reg = listForceRegistry();
+	std::lock_guard<std::mutex> lock(reg.mMutex);
+	listForceTotals(reg, outCounts);
+	outCounts.mForced -= reg.mBaseline.mForced;
+	outCounts.mClaimed -= reg.mBaseline.mClaimed;
+	outCounts.mContended -= reg.mBaseline.mContended;
+}
+
+void listForceCountsReset()
+{
+	ListForceRegistry& reg = listForceRegistry();
+	std::lock_guard<std::mutex> lock(reg.mMutex);
+	listForceTotals(reg, reg.mBaseline);
+}
+
 void List::force(Thread& th)
-{	
-	SpinLocker lock(mSpinLock);
-	if (mGen) {
-		P<Gen> gen = mGen; // keep the gen from being destroyed out from under pull().
-		if (gen->done()) {
-			gen->end();
-		} else {
-			gen->pull(th);
+{
+	uint8_t state = mForceState.load(std::memory_order_acquire);
+	if (state == kListForced) {
+		countForce(tListForceCounts.mForced);
+		return;
+	}
+	bool contended = false;
+	for (;;) {
+		if (state == kListUnforced && mForceState.compare_exchange_strong(state, kListForcing, std::memory_order_acquire)) {
+			// this thread alone pulls the gen, so no lock is needed.
+			if (mGen) {
+				P<Gen> gen = mGen; // keep the gen from being destroyed out from under pull().
+				try {
+					if (gen->done()) {
+						gen->end();
+					} else {
+						gen->pull(th);
+					}
+				} catch (...) {
+					// leave it for the next force to try again.
+					mForceState.store(kListUnforced, std::memory_order_release);
+					throw;
+				}
+				// mGen should be NULL at this point because one of the following should have been called: fulfill, link, end.
+			}
+			mForceState.store(kListForced, std::memory_order_release);
+			countForce(contended ? tListForceCounts.mContended : tListForceCounts.mClaimed);
+			return;
 		}
-		// mGen should be NULL at this point because one of the following should have been called: fulfill, link, end.
+		if (state == kListForced) break;
+		// another thread is pulling. waiters queue on the lock rather than all spinning on the state.
+		contended = true;
+		RCParkScope parked;
+		SpinLocker lock(mSpinLock);
+		while ((state = mForceState.load(std::memory_order_acquire)) == kListForcing)
+			std::this_thread::yield();
 	}
+	countForce(contended ? tListForceCounts.mContended : tListForceCounts.mForced);
 }
 
 int64_t List::length(Thread& th)
@@ -1094,32 +1198,47 @@ int64_t List::length(Thread& th)
 Array::~Array()
 {
 	if (isV()) {
-		delete [] vv;
-	} else {
-		free(p);
+		for (int64_t i = 0; i < mCap; ++i)
+			vv[i].~V();
 	}
+	poolFree(p, mCap * elemSize());
 }
 
 void Array::alloc(int64_t inCap)
 {
 	if (mCap >= inCap) return;
-	mCap = inCap;
+	size_t oldBytes = mCap * elemSize();
+	// use all of the block the pool gives.
+	size_t bytes = poolRoundSize(inCap * elemSize());
+	int64_t newCap = bytes / elemSize();
 	if (isV()) {
 		V* oldv = vv;
-		vv = new V[mCap];
-		for (int64_t i = 0; i < size(); ++i) 
-			vv[i] = oldv[i];
-		delete [] oldv;
+		vv = (V*)poolAlloc(bytes);
+		for (int64_t i = 0; i < size(); ++i)
+			new (vv + i) V(std::move(oldv[i]));
+		for (int64_t i = size(); i < newCap; ++i)
+			new (vv + i) V();
+		for (int64_t i = 0; i < mCap; ++i)
+			oldv[i].~V();
+		poolFree(oldv, oldBytes);
+	} else if (oldBytes > kPoolMaxSize) {
+		p = realloc(p, bytes);
 	} else {
-		p = realloc(p, mCap * elemSize());
+		void* oldp = p;
+		p = poolAlloc(bytes);
+		if (oldp) memcpy(p, oldp, size() * elemSize());
+		poolFree(oldp, oldBytes);
 	}
+	mCap = newCap;
 }
 
 void Array::add(Arg inItem)
 {
+	flags &= ~(flag_Constant | flag_Silent);
 	if (mSize >= mCap)
 		alloc(2 * mCap);
 	if (isV()) vv[mSize++] = inItem;
+	else if (isF()) ff[mSize++] = (float)inItem.asFloat();
 	else zz[mSize++] = inItem.asFloat();
 }
 
@@ -1127,6 +1246,7 @@ void Array::addAll(Array* a)
 {
 	if (!a->mSize)
 		return;
+	flags &= ~(flag_Constant | flag_Silent);
 		
 	int64_t newSize = mSize + a->size();
 	if (newSize > mCap)
@@ -1142,11 +1262,23 @@ void Array::addAll(Array* a)
 			Z* y = a->zz;
 			for (int64_t i = 0; i < a->size(); ++i) x[i] = y[i];
 		}
+	} else if (isF()) {
+		if (a->isV()) {
+			float* x = ff + size();
+			V* y = a->vv;
+			for (int64_t i = 0; i < a->size(); ++i) x[i] = (float)y[i].asFloat();
+		} else if (a->isF()) {
+			memcpy(ff + mSize, a->ff, a->mSize * sizeof(float));
+		} else {
+			vDSP_vdpsp(a->zz, 1, ff + mSize, 1, (int)a->mSize);
+		}
 	} else {
 		if (a->isV()) {
 			Z* x = zz + size();
 			V* y = a->vv;
 			for (int64_t i = 0; i < a->size(); ++i) x[i] = y[i].asFloat();
+		} else if (a->isF()) {
+			vDSP_vspdp(a->ff, 1, zz + mSize, 1, (int)a->mSize);
 		} else {
 			memcpy(zz + mSize, a->zz, a->mSize * sizeof(Z));
 		}
@@ -1156,21 +1288,27 @@ void Array::addAll(Array* a)
 
 void Array::addz(Z inItem)
 {
+	flags &= ~(flag_Constant | flag_Silent);
 	if (mSize >= mCap)
 		alloc(2 * mCap);
 	if (isV()) vv[mSize++] = V(inItem);
+	else if (isF()) ff[mSize++] = (float)inItem;
 	else zz[mSize++] = inItem;
 }
 
 void Array::put(int64_t inIndex, Arg inItem)
 {
+	flags &= ~(flag_Constant | flag_Silent);
 	if (isV()) vv[inIndex] = inItem;
+	else if (isF()) ff[inIndex] = (float)inItem.asFloat();
 	else zz[inIndex] = inItem.asFloat();
 }
 
 void Array::putz(int64_t inIndex, Z inItem)
 {
+	flags &= ~(flag_Constant | flag_Silent);
 	if (isV()) vv[inIndex] = V(inItem);
+	else if (isF()) ff[inIndex] = (float)inItem;
 	else zz[inIndex] = inItem;
 }
 
@@ -1324,7 +1462,27 @@ bool ZIn::operator()(Thread& th, int& ioNum, int& outStride, Z*& outBuffer)
 			int num = (int)(mList->mArray->size() - mOffset);
             if (num) {
                 ioNum = std::min(ioNum, num);
-                outBuffer = mList->mArray->z() + mOffset;
+                Array* a = mList->mArray();
+                if (a->isConstant() || mControlPeriod > 1) {
+                    // one value for the whole block, or for the rest of this control
+                    // period: hand it out as a scalar.
+                    if (!a->isConstant())
+                        ioNum = std::min(ioNum, mControlPeriod - mOffset % mControlPeriod);
+                    if (a->isF()) {
+                        mConstant = (Z)a->f()[mOffset];
+                        outBuffer = &mConstant.f;
+                    } else {
+                        outBuffer = a->z() + mOffset;
+                    }
+                    outStride = 0;
+                    return false;
+                }
+                if (a->isF()) {
+                    ioNum = std::min(ioNum, kFloat32WidenSize);
+                    outBuffer = widen(a->f() + mOffset, ioNum);
+                } else {
+                    outBuffer = a->z() + mOffset;
+                }
                 outStride = 1;
                 return false;
             } else if (mList->next()) {
@@ -1340,6 +1498,15 @@ bool ZIn::operator()(Thread& th, int& ioNum, int& outStride, Z*& outBuffer)
 	return true;
 }
 
+Z* ZIn::widen(const float* in, int n)
+{
+	if (!mWiden)
+		mWiden = new Array(itemTypeZ, kFloat32WidenSize);
+	Z* out = mWiden->z();
+	vDSP_vspdp(in, 1, out, 1, n);
+	return out;
+}
+
 void dumpList(List const* list)
 {
 	for (int i = 0; list; ++i, list = list->nextp()) {
@@ -1389,8 +1556,11 @@ bool ZIn::link(Thread& th, List* inList)
 			int n = (int)(mList->mArray->size() - mOffset);
 			if (n) {
 				Z* out = inList->fulfillz_link(n, mList->next());
-				Z* in = mList->mArray->z() + mOffset;
-				memcpy(out, in, n * sizeof(Z));
+				Array* a = mList->mArray();
+				if (a->isF())
+					vDSP_vspdp(a->f() + mOffset, 1, out, 1, n);
+				else
+					memcpy(out, a->z() + mOffset, n * sizeof(Z));
 
 				mList = nullptr;
 				mDone = true;
@@ -1458,7 +1628,7 @@ bool ZIn::onez(Thread& th, Z& z)
             mList = mList->next();
             mOffset = 0;
         } else {
-			z = mList->mArray->z()[mOffset++];
+			z = mList->mArray->_atz(mOffset++);
 			if (mOffset == mList->mArray->size()) {
 				mList = mList->next();
 				mOffset = 0;
@@ -1484,7 +1654,7 @@ bool ZIn::peek(Thread& th, Z& z)
             mList = mList->next();
             mOffset = 0;
         } else {
-			z = mList->mArray->z()[mOffset];
+			z = mList->mArray->_atz(mOffset);
 			return false;
 		}
     }
@@ -1506,10 +1676,7 @@ bool BothIn::one(Thread& th, V& v)
 			mList = mList->next();
             mOffset = 0;
         } else {
-			if (mList->isV())
-				v = mList->mArray->v()[mOffset++];
-			else
-				v = mList->mArray->z()[mOffset++];
+			v = mList->mArray->_at(mOffset++);
 				
 			if (mOffset == mList->mArray->size()) {
 				mList = mList->next();
@@ -1536,10 +1703,7 @@ bool BothIn::onez(Thread& th, Z& z)
 			mList = mList->next();
             mOffset = 0;
         } else {
-			if (mList->isV())
-				z = mList->mArray->v()[mOffset++].asFloat();
-			else
-				z = mList->mArray->z()[mOffset++];
+			z = mList->mArray->_atz(mOffset++);
 				
 			if (mOffset == mList->mArray->size()) {
 				mList = mList->next();
@@ -1610,6 +1774,29 @@ bool ZIn::fill(Thread& th, int& ioNum, Z* outBuffer, int outStride)
 	return false;
 }
 
+// the loops for contiguous input are kept separate so that the compiler vectorizes them.
+static void storeFloats(const Z* a, int astride, float* out, int outStride, int n)
+{
+	if (astride == 1 && outStride == 1) {
+		for (int i = 0; i < n; ++i) out[i] = (float)a[i];
+	} else if (astride == 1) {
+		for (int i = 0; i < n; ++i) out[i * outStride] = (float)a[i];
+	} else {
+		for (int i = 0; i < n; ++i) out[i * outStride] = (float)a[i * astride];
+	}
+}
+
+static void addFloats(const Z* a, int astride, float* out, int outStride, int n)
+{
+	if (astride == 1 && outStride == 1) {
+		for (int i = 0; i < n; ++i) out[i] += (float)a[i];
+	} else if (astride == 1) {
+		for (int i = 0; i < n; ++i) out[i * outStride] += (float)a[i];
+	} else {
+		for (int i = 0; i < n; ++i) out[i * outStride] += (float)a[i * astride];
+	}
+}
+
 bool ZIn::fill(Thread& th, int& ioNum, float* outBuffer, int outStride)
 {
 	int framesToFill = ioNum;
@@ -1626,11 +1813,7 @@ bool ZIn::fill(Thread& th, int& ioNum, float* outBuffer, int outStride)
 			ioNum = framesFilled;
 			return true;
 		}
-		for (int i = 0, j = 0, k = 0; i < n; ++i)	{
-			outBuffer[k] = a[j];
-			j += astride;
-			k += outStride;
-		}
+		storeFloats(a, astride, outBuffer, outStride, n);
 		framesToFill -= n;
 		framesFilled += n;
 		advance(n);
@@ -1664,6 +1847,20 @@ void ZIn::hop(Thread& th, int framesToAdvance)
 	}
 }
 
+void ZIn::pullAhead(Thread& th, int inNum) const
+{
+	if (mIsConstant) return;
+	// the ZIn's own list keeps the rest of the chain alive.
+	List* list = mList();
+	int offset = mOffset;
+	while (list && inNum > 0) {
+		list->force(th);
+		inNum -= (int)(list->mArray->size() - offset);
+		offset = 0;
+		list = list->nextp();
+	}
+}
+
 bool ZIn::fillSegment(Thread& th, int inNum, Z* outBuffer)
 {
 	int framesToFill = inNum;
@@ -1684,8 +1881,11 @@ bool ZIn::fillSegment(Thread& th, int inNum, Z* outBuffer)
 		int numToFill = std::min(framesToFill, avail);
 
 		// copy
-		Z* in = list->mArray->z() + offset;
-		memcpy(out, in, numToFill * sizeof(Z));
+		Array* a = list->mArray();
+		if (a->isF())
+			vDSP_vspdp(a->f() + offset, 1, out, 1, numToFill);
+		else
+			memcpy(out, a->z() + offset, numToFill * sizeof(Z));
 		out += numToFill;
 		framesToFill -= numToFill;
 		
@@ -1705,6 +1905,12 @@ bool ZIn::fillSegment(Thread& th, int inNum, Z* outBuffer)
 
 
 bool ZIn::mix(Thread& th, int& ioNum, Z* outBuffer)
+{
+	bool silent = true;
+	return mix(th, ioNum, outBuffer, silent);
+}
+
+bool ZIn::mix(Thread& th, int& ioNum, Z* outBuffer, bool& ioSilent)
 {
 	int framesToFill = ioNum;
 	int framesFilled = 0;
@@ -1716,9 +1922,12 @@ bool ZIn::mix(Thread& th, int& ioNum, Z* outBuffer)
 			ioNum = framesFilled;
 			return true;
 		}
-		for (int i = 0; i < n; ++i)	{
-			outBuffer[i] += *a;
-			a += astride;
+		if (!isSilent(astride, a)) {
+			ioSilent = false;
+			for (int i = 0; i < n; ++i)	{
+				outBuffer[i] += *a;
+				a += astride;
+			}
 		}
 		framesToFill -= n;
 		framesFilled += n;
@@ -1729,6 +1938,29 @@ bool ZIn::mix(Thread& th, int& ioNum, Z* outBuffer)
 	return false;
 }
 
+bool ZIn::mix(Thread& th, int& ioNum, float* outBuffer, int outStride)
+{
+	int framesToFill = ioNum;
+	int framesFilled = 0;
+	while (framesToFill) {
+		int n = framesToFill;
+		int astride;
+		Z* a;
+		if (operator()(th, n, astride, a)) {
+			ioNum = framesFilled;
+			return true;
+		}
+		if (!isSilent(astride, a))
+			addFloats(a, astride, outBuffer, outStride, n);
+		framesToFill -= n;
+		framesFilled += n;
+		advance(n);
+		outBuffer += n * outStride;
+	}
+	ioNum = framesFilled;
+	return false;
+}
+
 class Comma : public Gen
 {
 	VIn _a;
@@ -1900,7 +2132,7 @@ List::List(int inItemType, int64_t inCap) // construct nil
 
 
 List::List(P<Gen> const& inGen) 
-	: mNext(nullptr), mGen(inGen), mArray(0)
+	: mNext(nullptr), mForceState(kListUnforced), mGen(inGen), mArray(0)
 {
 	elemType = inGen->elemType;
 	setFinite(inGen->isFinite());
@@ -1927,8 +2159,19 @@ List::~List()
 	// free as much tail as possible at once in order to prevent stack overflow.
 	P<List> list = mNext;
 	mNext = nullptr;
+	int64_t freed = 0;
 	while (list) {
 		if (list->getRefcount() > 1) break;
+		if (++freed > kListFreedInline && poolIsRenderThread()) {
+			// a render thread leaves the rest of a long chain to the reclaimer.
+			List* rest = list();
+			rest->retain();
+			if (poolDeferRelease(rest)) {
+				list = nullptr;
+				break;
+			}
+			rest->release();
+		}
 		P<List> next = list->mNext;
 		list->mNext = nullptr;
 		list = next;
@@ -1955,7 +2198,7 @@ int64_t List::fillz(Thread& th, int64_t n, Z* z)
 List* List::pack(Thread& th)
 {
     force(th);
-	if (isPacked())
+	if (isPackedWide())
 		return this;
 		
 	int cap = 0;
@@ -1982,7 +2225,7 @@ List* List::pack(Thread& th)
 List* List::packz(Thread& th)
 {
     force(th);
-	if (isPacked() && isZ())
+	if (isPackedWide() && isZ())
 		return this;
 		
 	int cap = 0;
@@ -2006,10 +2249,37 @@ List* List::packz(Thread& th)
 	return new List(a);
 }
 
+List* List::packf(Thread& th)
+{
+    force(th);
+	if (isPacked() && mArray->isF())
+		return this;
+		
+	int64_t cap = 0;
+	P<List> list = this;
+	while(list) {
+		list->force(th);
+			
+		cap += list->mArray->size();	
+		
+		list = list->mNext;
+	}
+
+	P<Array> a = new Array(itemTypeZ, cap, true);
+	
+	list = this;
+	while(list) {
+		a->addAll(list->mArray());
+		list = list->mNext;
+	}
+	
+	return new List(a);
+}
+
 List* List::pack(Thread& th, int limit)
 {
     force(th);
-	if (isPacked())
+	if (isPackedWide())
 		return this;
 		
 	int cap = 0;
@@ -2038,7 +2308,7 @@ List* List::pack(Thread& th, int limit)
 List* List::packSome(Thread& th, int64_t& limit)
 {
     force(th);
-	if (isPacked()) {
+	if (isPackedWide()) {
 		limit = std::min(limit, length(th));
 		return this;
 	}
@@ -2256,10 +2526,10 @@ static P<List> chase_z(Thread& th, P<List> list, int64_t n)
 		int64_t asize = a->size();
 		if (asize > n) {
 			int64_t remain = asize - n;
-			Array* a2 = new Array(list->elemType, remain);
+			Array* a2 = new Array(list->elemType, remain, a->isF());
 			a2->setSize(remain);
 
-			memcpy(a2->z(), a->z() + n, remain * a->elemSize());
+			memcpy(a2->data(), (char*)a->data() + n * a->elemSize(), remain * a->elemSize());
 
 			return new List(a2, list->next());
 		}
@@ -16,6 +16,8 @@
 
 #include "Opcode.hpp"
 #include "clz.hpp"
+#include "Profiler.hpp"
+#include <mutex>
 
 const char* opcode_name[kNumOpcodes] = 
 {
@@ -46,15 +48,55 @@ const char* opcode_name[kNumOpcodes] =
 	"opNewForm",
 	"opInherit",
 	"opEach",
-	"opReturn"
+	"opReturn",
+
+	"opTailCallImmediate",
+	"opTailCallLocalVar",
+	"opTailCallFunVar",
+	"opTailCallWorkspaceVar",
+
+	"opPushLocalVarCallImmediate",
+	"opPushImmediateCallImmediate",
+	"opCallLocalVarCallImmediate",
+	"opCallLocalVarCallLocalVar"
 };
 
+int baseOpcode(int op)
+{
+	switch (op) {
+		case opPushLocalVarCallImmediate :
+			return opPushLocalVar;
+		case opPushImmediateCallImmediate :
+			return opPushImmediate;
+		case opCallLocalVarCallImmediate :
+		case opCallLocalVarCallLocalVar :
+			return opCallLocalVar;
+		case opTailCallImmediate :
+			return opCallImmediate;
+		case opTailCallLocalVar :
+			return opCallLocalVar;
+		case opTailCallFunVar :
+			return opCallFunVar;
+		case opTailCallWorkspaceVar :
+			return opCallWorkspaceVar;
+		default :
+			return op;
+	}
+}
+
+// superinstructions are traced as their two halves. tail calls are traced as themselves.
+static int tracedOpcode(int op)
+{
+	return op >= opPushLocalVarCallImmediate ? baseOpcode(op) : op;
+}
+
 
 static void printOpcode(Thread& th, Opcode* c)
 {
 	V& v = c->v;
-	post("%p %s ", c, opcode_name[c->op]);
-	switch (c->op) {
+	int op = baseOpcode(c->op);
+	post("%p %s ", c, opcode_name[tracedOpcode(c->op)]);
+	switch (op) {
 		case opPushImmediate :
 		case opPushWorkspaceVar :
 		case opPushFun : 
@@ -94,202 +136,473 @@ static void printOpcode(Thread& th, Opcode* c)
 	post("\n");
 }
 
-void Thread::run(Opcode* opc)
+// Thread::run dispatches through a table of label addresses when the compiler
+// supports it (GCC and Clang). Each handler jumps directly to the next one, which
+// gives the branch predictor one indirect branch per handler instead of the single
+// shared branch of a switch. Other compilers get an equivalent switch loop.
+#if defined(__GNUC__) || defined(__clang__)
+#define THREADED_DISPATCH 1
+#else
+#define THREADED_DISPATCH 0
+#endif
+
+static void bindWorkspaceVar(Thread& th, Arg v, Arg inValue)
 {
-	Thread& th = *this;
-	try {
-		for (;;++opc) {
+	V value = inValue;
+	if (value.isZList() && !value.isFinite() && vm.bindWindow > 0.) {
+		// bound through a WindowRef, so only the most recent samples stay reachable.
+		value = new WindowRef(th, value, (int64_t)ceil(vm.bindWindow * th.rate.sampleRate));
+	} else if (value.isList() && !value.isFinite()) {
+		post("WARNING: binding a possibly infinite list at the top level can leak unbounded memory!\n");
+	} else if (value.isFun()) {
+		const char* mask = value.GetAutoMapMask();
+		const char* help = value.OneLineHelp();
+		if (mask || help) {
+			char* name = ((String*)v.o())->s;
+			vm.addUdfHelp(name, mask, help);
+		}
+	}
+	th.fun->Workspace() = th.fun->Workspace()->putImpure(v, value); // workspace mutation
+	th.mWorkspace = th.mWorkspace->putImpure(v, value); // workspace mutation
+}
 
-			V& v = opc->v;
+bool WorkspaceCache::lookup(GForm* form, V& outValue)
+{
+	// mSeq is odd while an entry is being filled. a reader that sees it odd, or sees it
+	// change, may have read a mix of two entries.
+	uint32_t seq = mSeq.load(std::memory_order_acquire);
+	if (seq & 1) return false;
+	uint64_t stamp = mStamp.load(std::memory_order_relaxed);
+	GForm* entryForm = mForm.load(std::memory_order_relaxed);
+	Object* o = mObj.load(std::memory_order_relaxed);
+	double f = mReal.load(std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_acquire);
+	if (mSeq.load(std::memory_order_relaxed) != seq) return false;
+	if (stamp != gWorkspaceVersion.load(std::memory_order_acquire)) return false;
+	if (entryForm != form) return false;
+	if (o) outValue = V(o);
+	else outValue = V(f);
+	return true;
+}
 
-			if (vm.traceon) {
-				post("stack : "); th.printStack(); post("\n");
-				printOpcode(th, opc);
-			}
+void WorkspaceCache::fill(GForm* form, uint64_t stamp, Arg value)
+{
+	// if another thread is filling this entry, just let it win.
+	if (mFilling.test_and_set(std::memory_order_acquire)) return;
+	uint32_t seq = mSeq.load(std::memory_order_relaxed);
+	mSeq.store(seq + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+	mStamp.store(stamp, std::memory_order_relaxed);
+	mForm.store(form, std::memory_order_relaxed);
+	mObj.store(value.o(), std::memory_order_relaxed);
+	mReal.store(value.f, std::memory_order_relaxed);
+	mSeq.store(seq + 2, std::memory_order_release);
+	mFilling.clear(std::memory_order_release);
+}
+
+#ifdef SAPF_NAN_BOXING
+
+// the inline caches of all Code, so that an opcode can name its cache with a 32 bit
+// index. chunks are never freed, and a slot is filled before the opcode that names it
+// is run, so slots are read without the lock.
+const int kCacheChunkBits = 12;
+const size_t kCacheChunkSize = (size_t)1 << kCacheChunkBits;
+const size_t kMaxCacheChunks = 4096;
+
+struct WorkspaceCacheTable
+{
+	std::mutex mMutex;
+	WorkspaceCache** mChunks[kMaxCacheChunks] = {};
+	uint32_t mSize = 1; // slot 0 means no cache
+	std::vector<uint32_t> mFree;
+};
+
+static WorkspaceCacheTable* gCacheTable = new WorkspaceCacheTable;
+
+static uint32_t cacheSlotAlloc(WorkspaceCache* cache)
+{
+	WorkspaceCacheTable& table = *gCacheTable;
+	std::lock_guard<std::mutex> lock(table.mMutex);
+	uint32_t slot;
+	if (!table.mFree.empty()) {
+		slot = table.mFree.back();
+		table.mFree.pop_back();
+	} else {
+		slot = table.mSize;
+		if (slot >> kCacheChunkBits >= kMaxCacheChunks) return 0; // the op just goes uncached.
+		++table.mSize;
+		WorkspaceCache**& chunk = table.mChunks[slot >> kCacheChunkBits];
+		if (!chunk) chunk = new WorkspaceCache*[kCacheChunkSize];
+	}
+	table.mChunks[slot >> kCacheChunkBits][slot & (kCacheChunkSize - 1)] = cache;
+	return slot;
+}
+
+static void cacheSlotFree(uint32_t slot)
+{
+	WorkspaceCacheTable& table = *gCacheTable;
+	std::lock_guard<std::mutex> lock(table.mMutex);
+	table.mFree.push_back(slot);
+}
+
+static WorkspaceCache* opcodeCache(Opcode* opc)
+{
+	uint32_t slot = opc->mCache;
+	if (!slot) return nullptr;
+	return gCacheTable->mChunks[slot >> kCacheChunkBits][slot & (kCacheChunkSize - 1)];
+}
+
+#else
+
+static WorkspaceCache* opcodeCache(Opcode* opc)
+{
+	return (WorkspaceCache*)opc->v.i;
+}
 
-			switch (opc->op) {
-				case opNone :
-					break;
-					
-				case opPushImmediate :
-					push(v);
-					break;
-					
-				case opPushLocalVar :
-					push(getLocal(v.i));
-					break;
-					
-				case opPushFunVar :
-					push(fun->mVars[v.i]);
-					break;
-					
-				case opPushWorkspaceVar :
-					push(fun->Workspace()->mustGet(th, v));
-					break;
-					
-				case opPushFun : {
-						push(new Fun(th, (FunDef*)v.o()));
-					} break;
-					
-				case opCallImmediate :
-					v.apply(th);
-					break;
-					
-				case opCallLocalVar :
-					getLocal(v.i).apply(th);
-					break;
-					
-				case opCallFunVar :
-					fun->mVars[v.i].apply(th);
-					break;
-					
-				case opCallWorkspaceVar :
-					fun->Workspace()->mustGet(th, v).apply(th);
-					break;
-
-				case opDot : {
-					V ioValue;
-					if (!pop().dot(th, v, ioValue))
-						notFound(v);
-					push(ioValue);
-					break;
+#endif
+
+static V getWorkspaceVar(Thread& th, Opcode* opc)
+{
+	GForm* form = th.fun->Workspace()();
+	WorkspaceCache* cache = opcodeCache(opc);
+	V value;
+	if (cache && cache->lookup(form, value))
+		return value;
+
+	// read the stamp before looking up so that a binding made during the lookup
+	// leaves the entry already out of date.
+	uint64_t stamp = gWorkspaceVersion.load(std::memory_order_acquire);
+	value = form->mustGet(th, opc->v);
+	if (cache) cache->fill(form, stamp, value);
+	return value;
+}
+
+static void traceOpcode(Thread& th, Opcode* opc)
+{
+	post("stack : "); th.printStack(); post("\n");
+	printOpcode(th, opc);
+}
+
+static bool canEnter(Thread& th, Object* callee, size_t numArgs)
+{
+	if (th.stackDepth() < numArgs)
+		return false; // let apply report the underflow.
+	if (callee->NoEachOps() || numArgs == 0)
+		return true;
+	return !hasEachOps(&th.top() - numArgs + 1, numArgs);
+}
+
+// makes a call in tail position. a Prim with a tail variant returns the value it
+// would have applied, which is then called in tail position itself. returns true if
+// the chain ended at a Fun that now occupies the current frame, in which case the
+// interpreter continues in that Fun's code. otherwise the call has been completed
+// normally and returns false.
+static bool resolveTailCall(Thread& th, V& callee)
+{
+	for (;;) {
+		Object* o = callee.o();
+		if (!o) break;
+		if (o->isFun()) {
+			Fun* fun = (Fun*)o;
+			if (!canEnter(th, fun, fun->NumArgs())) break;
+			fun->enterTailCall(th);
+			return true;
+		}
+		if (!o->isPrim()) break;
+		Prim* prim = (Prim*)o;
+		if (!prim->mTailFun || !canEnter(th, prim, prim->mTakes)) break;
+		if (vm.profileon) profileTailCall(th, prim);
+		callee = prim->mTailFun(th, prim);
+	}
+	callee.apply(th);
+	return false;
+}
+
+// kTrace selects the traced interpreter. The traced version prints the stack and
+// every opcode, and it executes superinstructions one half at a time so that the
+// trace reads the same as the unfused code. The untraced version has no per-opcode
+// test of vm.traceon.
+template <bool kTrace>
+static void runOpcodes(Thread& th, Opcode*& opc)
+{
+	V callee; // the target of a tail call
+#if THREADED_DISPATCH
+	static void* const sDispatch[kNumOpcodes] = {
+		&&do_BAD_OPCODE,
+		&&do_opNone,
+		&&do_opPushImmediate,
+		&&do_opPushLocalVar,
+		&&do_opPushFunVar,
+		&&do_opPushWorkspaceVar,
+		&&do_opPushFun,
+		&&do_opCallImmediate,
+		&&do_opCallLocalVar,
+		&&do_opCallFunVar,
+		&&do_opCallWorkspaceVar,
+		&&do_opDot,
+		&&do_opComma,
+		&&do_opBindLocal,
+		&&do_opBindLocalFromList,
+		&&do_opBindWorkspaceVar,
+		&&do_opBindWorkspaceVarFromList,
+		&&do_opParens,
+		&&do_opNewVList,
+		&&do_opNewZList,
+		&&do_opNewForm,
+		&&do_opInherit,
+		&&do_opEach,
+		&&do_opReturn,
+		&&do_opTailCallImmediate,
+		&&do_opTailCallLocalVar,
+		&&do_opTailCallFunVar,
+		&&do_opTailCallWorkspaceVar,
+		&&do_opPushLocalVarCallImmediate,
+		&&do_opPushImmediateCallImmediate,
+		&&do_opCallLocalVarCallImmediate,
+		&&do_opCallLocalVarCallLocalVar
+	};
+	#define OP(NAME) do_##NAME:
+	#define DISPATCH() do { \
+			if (kTrace) { traceOpcode(th, opc); goto *sDispatch[tracedOpcode(opc->op)]; } \
+			goto *sDispatch[opc->op]; \
+		} while (0)
+	#define NEXT(N) do { opc += (N); DISPATCH(); } while (0)
+
+	DISPATCH();
+	{
+#else
+	#define OP(NAME) case NAME:
+	#define NEXT(N) do { opc += (N); continue; } while (0)
+
+	for (;;) {
+		if (kTrace) traceOpcode(th, opc);
+		switch (kTrace ? tracedOpcode(opc->op) : opc->op) {
+#endif
+			OP(opNone)
+				NEXT(1);
+				
+			OP(opPushImmediate)
+				th.push(opc->v);
+				NEXT(1);
+				
+			OP(opPushLocalVar)
+				th.push(th.getLocal(opc->v.i));
+				NEXT(1);
+				
+			OP(opPushFunVar)
+				th.push(th.fun->mVars[opc->v.i]);
+				NEXT(1);
+				
+			OP(opPushWorkspaceVar)
+				th.push(getWorkspaceVar(th, opc));
+				NEXT(1);
+				
+			OP(opPushFun)
+				th.push(new Fun(th, (FunDef*)opc->v.o()));
+				NEXT(1);
+				
+			OP(opCallImmediate)
+				opc->v.apply(th);
+				NEXT(1);
+				
+			OP(opCallLocalVar)
+				th.getLocal(opc->v.i).apply(th);
+				NEXT(1);
+				
+			OP(opCallFunVar)
+				th.fun->mVars[opc->v.i].apply(th);
+				NEXT(1);
+				
+			OP(opCallWorkspaceVar)
+				getWorkspaceVar(th, opc).apply(th);
+				NEXT(1);
+
+			OP(opDot) {
+				V ioValue;
+				if (!th.pop().dot(th, opc->v, ioValue))
+					notFound(opc->v);
+				th.push(ioValue);
+				NEXT(1);
+			}
+			OP(opComma)
+				th.push(th.pop().comma(th, opc->v));
+				NEXT(1);
+				
+			OP(opBindLocal)
+				th.getLocal(opc->v.i) = th.pop();
+				NEXT(1);
+				
+			OP(opBindWorkspaceVar) {
+				V value = th.pop();
+				bindWorkspaceVar(th, opc->v, value);
+				NEXT(1);
+			}
+                
+			OP(opBindLocalFromList)
+			OP(opBindWorkspaceVarFromList)
+			{
+				V list = th.pop();
+				BothIn in(list);
+				while (opc->op != opNone) {
+					V value;
+					if (in.one(th, value)) {
+						post("not enough items in list for = [..]\n");
+						throw errFailed;
+					}
+					if (opc->op == opBindLocalFromList) {
+						th.getLocal(opc->v.i) = value;
+					} else {
+						bindWorkspaceVar(th, opc->v, value);
+					}
+					++opc;
+				}
+				NEXT(1);
+			}
+			OP(opParens) {
+				{
+					ParenStack ss(th);
+					th.run(((Code*)opc->v.o())->getOps());
+				}
+				NEXT(1);
+			}
+			OP(opNewVList) {
+				V x;
+				{
+					SaveStack ss(th);
+					th.run(((Code*)opc->v.o())->getOps());
+					size_t len = th.stackDepth();
+					vm.newVList->apply_n(th, len);
+					x = th.pop();
 				}
-				case opComma :
-					push(pop().comma(th, v));
-					break;
-					
-				case opBindLocal :
-					getLocal(v.i) = pop();
-					break;
-				case opBindWorkspaceVar : {
-                    V value = pop();
-                    if (value.isList() && !value.isFinite()) {
-                        post("WARNING: binding a possibly infinite list at the top level can leak unbounded memory!\n");
-                    } else if (value.isFun()) {
-						const char* mask = value.GetAutoMapMask();
-						const char* help = value.OneLineHelp();
-						if (mask || help) {
-							char* name = ((String*)v.o())->s;
-							vm.addUdfHelp(name, mask, help);
-						}
+				th.push(x);
+				NEXT(1);
+			}
+			OP(opNewZList) {
+				V x;
+				{
+					SaveStack ss(th);
+					th.run(((Code*)opc->v.o())->getOps());
+					size_t len = th.stackDepth();
+					vm.newZList->apply_n(th, len);
+					x = th.pop();
+				}
+				th.push(x);
+				NEXT(1);
+			}
+			OP(opInherit) {
+				V result;
+				{
+					SaveStack ss(th);
+					th.run(((Code*)opc->v.o())->getOps());
+					size_t depth = th.stackDepth();
+					if (depth < 1) {
+						result = vm._ee;
+					} else if (depth > 1) {
+						fprintf(stderr, "more arguments than keys for form.\n");
+						throw errFailed;
+					} else {
+						vm.inherit->apply_n(th, 1);
+						result = th.pop();
 					}
-					fun->Workspace() = fun->Workspace()->putImpure(v, value); // workspace mutation
-					th.mWorkspace = th.mWorkspace->putImpure(v, value); // workspace mutation
-                } break;
-                
-				case opBindLocalFromList :
-				case opBindWorkspaceVarFromList :
+				}
+				th.push(result);
+				NEXT(1);
+			}
+			OP(opNewForm) {
+				V result;
 				{
-					V list = pop();
-					BothIn in(list);
-					while (1) {
-						if (opc->op == opNone) {
-							break;
-						} else {
-							V value;
-							if (in.one(th, value)) {
-								post("not enough items in list for = [..]\n");
-								throw errFailed;
-							}
-							if (opc->op == opBindLocalFromList) {
-								getLocal(opc->v.i) = value;
-							} else if (opc->op == opBindWorkspaceVarFromList) {
-								v = opc->v;
-								if (value.isList() && !value.isFinite()) {
-									post("WARNING: binding a possibly infinite list at the top level can leak unbounded memory!\n");
-								} else if (value.isFun()) {
-									const char* mask = value.GetAutoMapMask();
-									const char* help = value.OneLineHelp();
-									if (mask || help) {
-										char* name = ((String*)v.o())->s;
-										vm.addUdfHelp(name, mask, help);
-									}
-								}
-								fun->Workspace() = fun->Workspace()->putImpure(v, value); // workspace mutation
-								th.mWorkspace = th.mWorkspace->putImpure(v, value); // workspace mutation
-							}
-						}
-						++opc;
+					SaveStack ss(th);
+					th.run(((Code*)opc->v.o())->getOps());
+					size_t depth = th.stackDepth();
+					TableMap* tmap = (TableMap*)th.top().o();
+					size_t numArgs = tmap->mSize;
+					if (depth == numArgs+1) {
+						// no inheritance, must insert zero for parent.
+						th.tuck(numArgs+1, V(0.));
+					} else if (depth < numArgs+1) {
+						fprintf(stderr, "fewer arguments than keys for form.\n");
+						throw errStackUnderflow;
+					} else if (depth > numArgs+2) {
+						fprintf(stderr, "more arguments than keys for form.\n");
+						throw errFailed;
 					}
-				} break;
-				case opParens : {
-						ParenStack ss(th);
-						run(((Code*)v.o())->getOps());
-					} break;
-				case opNewVList : {
-						V x;
-						{
-							SaveStack ss(th);
-							run(((Code*)v.o())->getOps());
-							size_t len = stackDepth();
-							vm.newVList->apply_n(th, len);
-							x = th.pop();
-						}
-						th.push(x);
-					} break;
-				case opNewZList : {
-						V x;
-						{
-							SaveStack ss(th);
-							run(((Code*)v.o())->getOps());
-							size_t len = stackDepth();
-							vm.newZList->apply_n(th, len);
-							x = th.pop();
-						}
-						th.push(x);
-					} break;
-				case opInherit : {
-						V result;
-						{
-							SaveStack ss(th);
-							run(((Code*)v.o())->getOps());
-							size_t depth = stackDepth();
-							if (depth < 1) {
-								result = vm._ee;
-							} else if (depth > 1) {
-								fprintf(stderr, "more arguments than keys for form.\n");
-								throw errFailed;
-							} else {
-								vm.inherit->apply_n(th, 1);
-								result = th.pop();
-							}
-						}
-						th.push(result);
-					} break;
-				case opNewForm : {
-						V result;
-						{
-							SaveStack ss(th);
-							run(((Code*)v.o())->getOps());
-							size_t depth = stackDepth();
-							TableMap* tmap = (TableMap*)th.top().o();
-							size_t numArgs = tmap->mSize;
-							if (depth == numArgs+1) {
-								// no inheritance, must insert zero for parent.
-								th.tuck(numArgs+1, V(0.));
-							} else if (depth < numArgs+1) {
-								fprintf(stderr, "fewer arguments than keys for form.\n");
-								throw errStackUnderflow;
-							} else if (depth > numArgs+2) {
-								fprintf(stderr, "more arguments than keys for form.\n");
-								throw errFailed;
-							}
-							vm.newForm->apply_n(th, numArgs+2);
-							result = th.pop();
-						}
-						th.push(result);
-					} break;
-				case opEach :
-					push(new EachOp(pop(), (int)v.i));
-					break;
-				
-				case opReturn : return;
-				
-				default :
-					post("BAD OPCODE\n");
-					throw errInternalError;
+					vm.newForm->apply_n(th, numArgs+2);
+					result = th.pop();
+				}
+				th.push(result);
+				NEXT(1);
 			}
+			OP(opEach)
+				th.push(new EachOp(th.pop(), (int)opc->v.i));
+				NEXT(1);
+			
+			OP(opReturn)
+				return;
+
+			OP(opTailCallImmediate)
+				callee = opc->v;
+				goto tailCall;
+
+			OP(opTailCallLocalVar)
+				callee = th.getLocal(opc->v.i);
+				goto tailCall;
+
+			OP(opTailCallFunVar)
+				callee = th.fun->mVars[opc->v.i];
+				goto tailCall;
+
+			OP(opTailCallWorkspaceVar)
+				callee = getWorkspaceVar(th, opc);
+				goto tailCall;
+
+			tailCall:
+				if (!resolveTailCall(th, callee))
+					return;
+				opc = th.fun->mDef->mCode->getOps();
+				NEXT(0);
+
+			OP(opPushLocalVarCallImmediate)
+				th.push(th.getLocal(opc->v.i));
+				opc[1].v.apply(th);
+				NEXT(2);
+
+			OP(opPushImmediateCallImmediate)
+				th.push(opc->v);
+				opc[1].v.apply(th);
+				NEXT(2);
+
+			OP(opCallLocalVarCallImmediate)
+				th.getLocal(opc->v.i).apply(th);
+				opc[1].v.apply(th);
+				NEXT(2);
+
+			OP(opCallLocalVarCallLocalVar)
+				th.getLocal(opc->v.i).apply(th);
+				th.getLocal(opc[1].v.i).apply(th);
+				NEXT(2);
+			
+			OP(BAD_OPCODE)
+#if !THREADED_DISPATCH
+			default :
+#endif
+				post("BAD OPCODE\n");
+				throw errInternalError;
 		}
+#if !THREADED_DISPATCH
+	}
+#endif
+
+	#undef OP
+	#undef NEXT
+	#undef DISPATCH
+}
+
+void Thread::run(Opcode* opc)
+{
+	Thread& th = *this;
+	try {
+		if (vm.traceon) runOpcodes<true>(th, opc);
+		else runOpcodes<false>(th, opc);
 	} catch (...) {
 		post("backtrace: %s ", opcode_name[opc->op]);
 		opc->v.printShort(th);
@@ -298,13 +611,184 @@ void Thread::run(Opcode* opc)
 	}
 }
 
-Code::~Code() { }
+Code::~Code()
+{
+#ifdef SAPF_NAN_BOXING
+	for (Opcode& c : ops) {
+		if (c.mCache) cacheSlotFree(c.mCache);
+	}
+#endif
+}
 
 void Code::shrinkToFit()
 {
 	std::vector<Opcode>(ops.begin(), ops.end()).swap(ops);
 }
 
+#pragma mark OPTIMIZER
+
+static bool isRealPush(Opcode const& c)
+{
+	return c.op == opPushImmediate && c.v.isReal();
+}
+
+// applies a pure prim to literal arguments at compile time.
+// returns false if the prim failed or did not produce a single real.
+static bool foldConstant(Thread& th, Prim* prim, Opcode const* args, V& outResult)
+{
+	try {
+		SaveStack ss(th);
+		for (int i = 0; i < prim->mTakes; ++i)
+			th.push(args[i].v);
+		prim->apply_n(th, prim->mTakes);
+		if (th.stackDepth() != 1) return false;
+		outResult = th.pop();
+	} catch (...) {
+		return false;
+	}
+	return outResult.isReal();
+}
+
+static void dumpOps(Thread& th, const char* label, std::vector<Opcode> const& ops)
+{
+	post("%s\n", label);
+	for (size_t i = 0; i < ops.size(); ++i) {
+		post("%4d   %s ", (int)i, opcode_name[ops[i].op]);
+		V v = ops[i].v;
+		v.printShort(th);
+		post("\n");
+	}
+}
+
+// peephole optimization of a finished code block, done before tail calls are
+// marked and before superinstructions are fused.
+//  - a pure numeric prim called on literal reals is replaced by its result.
+//    chains such as 2 pi * 3 / fold completely.
+//  - opNone padding is removed. an opNone that terminates a run of
+//    bind-from-list opcodes is required by that handler and is kept.
+//  - a lambda with no captured variables is pushed as one shared Fun that is
+//    made here, instead of making a new Fun every time the code runs.
+void Code::optimize(Thread& th)
+{
+	if (!vm.optimizeon) return;
+
+	std::vector<Opcode> in;
+	if (vm.optdump) in = ops;
+
+	int64_t numFolded = 0, numNonesRemoved = 0, numSharedFuns = 0;
+	size_t numIn = ops.size();
+	size_t n = 0; // ops are compacted in place. n is the output size.
+	for (size_t i = 0; i < numIn; ++i) {
+		Opcode c = ops[i];
+		if (c.op == opNone) {
+			int prev = n ? ops[n-1].op : opNone;
+			if (prev != opBindLocalFromList && prev != opBindWorkspaceVarFromList) {
+				++numNonesRemoved;
+				continue;
+			}
+		} else if (c.op == opCallImmediate && c.v.isObject() && c.v.o()->isPrim() && c.v.o()->IsPure()) {
+			Prim* prim = (Prim*)c.v.o();
+			size_t takes = prim->mTakes;
+			bool literalArgs = takes > 0 && takes <= n;
+			for (size_t j = n - std::min(takes, n); literalArgs && j < n; ++j)
+				literalArgs = isRealPush(ops[j]);
+			V result;
+			if (literalArgs && prim->mLeaves == 1 && foldConstant(th, prim, &ops[n - takes], result)) {
+				n -= takes;
+				c.op = opPushImmediate;
+				c.v = result;
+				++numFolded;
+			}
+		} else if (c.op == opPushFun && ((FunDef*)c.v.o())->mNumVars == 0) {
+			c.op = opPushImmediate;
+			c.v = new Fun(th, (FunDef*)c.v.o());
+			++numSharedFuns;
+		}
+		ops[n++] = c;
+	}
+	ops.resize(n);
+
+	vm.optCodeBlocks += 1;
+	vm.optOpsIn += numIn;
+	vm.optOpsOut += n;
+	vm.optFolded += numFolded;
+	vm.optNonesRemoved += numNonesRemoved;
+	vm.optSharedFuns += numSharedFuns;
+
+	if (vm.optdump && (numFolded || numNonesRemoved || numSharedFuns)) {
+		post("optimized code: %d -> %d ops. %lld folded, %lld opNone removed, %lld shared funs\n",
+			(int)numIn, (int)n, numFolded, numNonesRemoved, numSharedFuns);
+		dumpOps(th, "before:", in);
+		dumpOps(th, "after:", ops);
+	}
+}
+
+#pragma mark TAIL CALLS AND SUPERINSTRUCTIONS
+
+// a call that ends a function body can reuse the function's frame.
+// must be called before the opReturn is added.
+void Code::markTailCall()
+{
+	if (ops.empty()) return;
+	Opcode& last = ops.back();
+	switch (last.op) {
+		case opCallImmediate : last.op = opTailCallImmediate; break;
+		case opCallLocalVar : last.op = opTailCallLocalVar; break;
+		case opCallFunVar : last.op = opTailCallFunVar; break;
+		case opCallWorkspaceVar : last.op = opTailCallWorkspaceVar; break;
+	}
+}
+
+// Rewrite common adjacent opcode pairs as superinstructions. This must run after
+// the code is complete, since the operand of the second half is read from opc[1].
+// The bytecode has no branches, so the second half of a pair is never entered
+// directly. Opcodes in a bind-from-list run are never fused because that handler
+// walks the following opcodes itself.
+void Code::fuseSuperinstructions()
+{
+	size_t n = ops.size();
+	for (size_t i = 0; i + 1 < n; ) {
+		int a = ops[i].op;
+		int b = ops[i+1].op;
+		int fused = opNone;
+		if (b == opCallImmediate) {
+			if (a == opPushLocalVar) fused = opPushLocalVarCallImmediate;
+			else if (a == opPushImmediate) fused = opPushImmediateCallImmediate;
+			else if (a == opCallLocalVar) fused = opCallLocalVarCallImmediate;
+		} else if (a == opCallLocalVar && b == opCallLocalVar) {
+			fused = opCallLocalVarCallLocalVar;
+		}
+		if (fused != opNone) {
+			ops[i].op = fused;
+			i += 2;
+		} else {
+			++i;
+		}
+	}
+}
+
+void Code::allocInlineCaches()
+{
+	size_t numCaches = 0;
+	for (Opcode& c : ops) {
+		if (baseOpcode(c.op) == opPushWorkspaceVar || baseOpcode(c.op) == opCallWorkspaceVar)
+			++numCaches;
+	}
+	if (!numCaches) return;
+
+	mInlineCaches.reset(new WorkspaceCache[numCaches]);
+	WorkspaceCache* cache = mInlineCaches.get();
+	for (Opcode& c : ops) {
+		if (baseOpcode(c.op) == opPushWorkspaceVar || baseOpcode(c.op) == opCallWorkspaceVar) {
+#ifdef SAPF_NAN_BOXING
+			c.mCache = cacheSlotAlloc(cache++);
+#else
+			c.v.i = (int64_t)cache++;
+#endif
+		}
+	}
+}
+
 void Code::add(int _op, Arg v)
 {
 	ops.push_back(Opcode(_op, v));
@@ -319,6 +803,14 @@ void Code::addAll(const P<Code> &that)
 {
 	for (Opcode& op : that->ops) {
 		ops.push_back(op);
+		// inline caches belong to the code they were allocated for.
+		if (baseOpcode(op.op) == opPushWorkspaceVar || baseOpcode(op.op) == opCallWorkspaceVar) {
+#ifdef SAPF_NAN_BOXING
+			ops.back().mCache = 0;
+#else
+			ops.back().v.i = 0;
+#endif
+		}
 	}
 }
 
@@ -326,7 +818,7 @@ void Code::decompile(Thread& th, std::string& out)
 {
 	for (Opcode& c : ops) {
 		V& v = c.v;
-		switch (c.op) {
+		switch (baseOpcode(c.op)) {
 			case opPushImmediate : {
 				std::string s;
 				v.printShort(th, s);
@@ -19,6 +19,7 @@
 #include "UGen.hpp"
 
 #include "VM.hpp"
+#include "Snapshot.hpp"
 #include "clz.hpp"
 #include "dsp.hpp"
 #include <cmath>
@@ -179,7 +180,18 @@ P<List> gTriangleTable;
 P<List> gSquareTable;
 P<List> gSawtoothTable;
 
-static void makeClassicWavetables()
+// the classic tables take longer to compute than everything else in the builtins,
+// so they are taken from the startup snapshot when one is open.
+static bool loadClassicWavetables()
+{
+	gParabolicTable = snapshotBuiltinSignal("parTbl", kWaveTableTotalSize);
+	gTriangleTable = snapshotBuiltinSignal("triTbl", kWaveTableTotalSize);
+	gSquareTable = snapshotBuiltinSignal("sqrTbl", kWaveTableTotalSize);
+	gSawtoothTable = snapshotBuiltinSignal("sawTbl", kWaveTableTotalSize);
+	return gParabolicTable() && gTriangleTable() && gSquareTable() && gSawtoothTable();
+}
+
+static void computeClassicWavetables()
 {
 	Z amps[kMaxHarmonics+1];
 	Z phases[kMaxHarmonics+1];
@@ -216,6 +228,12 @@ static void makeClassicWavetables()
 		phases[i] = .5;		++i;
 	}
 	gSawtoothTable = makeWavetable(kMaxHarmonics, amps+1, 1, phases+1, 1, smooth);
+}
+
+static void makeClassicWavetables()
+{
+	if (!loadClassicWavetables())
+		computeClassicWavetables();
 
 	vm.addBifHelp("\n*** classic wave tables ***");
 	vm.def("parTbl", gParabolicTable);		vm.addBifHelp("parTbl - parabolic wave table.");
@@ -449,6 +467,8 @@ static void osc_(Thread& th, Prim* prim)
 		post("osc : tables is not a wave table. must be a signal of %d x %d samples.", kNumTables, kWaveTableSize);
 		throw errWrongType;
 	}
+	// the oscillators read the table through z(), so a table packed as floats is widened.
+	tables = tables->packz(th);
 
 	newOsc(th, freq, phase, tables);
 }
@@ -626,6 +646,7 @@ static void oscp_(Thread& th, Prim* prim)
 		post("oscp : tables is not a wave table. must be a signal of %d x %d samples.", kNumTables, kWaveTableSize);
 		throw errWrongType;
 	}
+	tables = tables->packz(th);
 
 	th.push(new List(new OscPWM(th, tables->mArray, freq, phase, duty)));
 }
@@ -770,6 +791,7 @@ static void sosc_(Thread& th, Prim* prim)
 		post("sosc : tables is not a wave table. must be a signal of %d x %d samples.", kNumTables, kWaveTableSize);
 		throw errWrongType;
 	}
+	tables = tables->packz(th);
 
 	th.push(new List(new SyncOsc(th, tables->mArray, freq1, freq2)));
 }
@@ -33,6 +33,18 @@ bool parseElem(Thread& th, P<Code>& code);
 bool parseWord(Thread& th, P<Code>& code);
 static void bindVar(Thread& th, P<String> const& name, P<Code>& code);
 
+// terminate a finished code block and prepare it for execution.
+// inFunBody is true for code that runs in its own Fun frame.
+static void endCode(Thread& th, P<Code>& code, bool inFunBody = false)
+{
+	code->optimize(th);
+	if (inFunBody) code->markTailCall();
+	code->add(opReturn, 0.);
+	code->shrinkToFit();
+	code->fuseSuperinstructions();
+	code->allocInlineCaches();
+}
+
 class ParsingWhat
 {
 	Thread& th;
@@ -375,13 +387,11 @@ static bool parseNewForm(Thread& th, P<Code>& code)
 
 		code2->keys.clear();
 		code2->add(opPushImmediate, V(tmap));
-		code2->add(opReturn, 0.);
-		code2->shrinkToFit();
+		endCode(th, code2);
 
 		code->add(opNewForm, V(code2));
 	} else {
-		code2->add(opReturn, 0.);
-		code2->shrinkToFit();
+		endCode(th, code2);
 		code->add(opInherit, V(code2));
 	}
 			
@@ -457,8 +467,7 @@ static bool parseLambda(Thread& th, P<Code>& code)
 	P<Code> code2 = new Code(8);	
 	parseItemList(th, code2, ']');
 
-	code2->add(opReturn, 0.);
-	code2->shrinkToFit();
+	endCode(th, code2, true);
 	
 		
 	// compile code to push all fun vars
@@ -497,8 +506,7 @@ static bool parseParens(Thread& th, P<Code>& code)
 	P<Code> code2 = new Code(8);
 	parseItemList(th, code2, ')');
 
-	code2->add(opReturn, 0.);
-	code2->shrinkToFit();
+	endCode(th, code2);
 	code->add(opParens, V(code2));
 #else
 	parseItemList(th, code, ')');
@@ -516,8 +524,7 @@ static bool parseArray(Thread& th, P<Code>& code)
 	parseItemList(th, code2, ']');
 
 	if (code2->size()) {
-		code2->add(opReturn, 0.);
-		code2->shrinkToFit();
+		endCode(th, code2);
 		code->add(opNewVList, V(code2));
 	} else {
 		code->add(opPushImmediate, V(vm._nilv));
@@ -536,8 +543,7 @@ static bool parseZArray(Thread& th, P<Code>& code)
 	parseItemList(th, code2, ']');
 
 	if (code2->size()) {
-		code2->add(opReturn, 0.);
-		code2->shrinkToFit();
+		endCode(th, code2);
 		code->add(opNewZList, V(code2));
 	} else {
 		code->add(opPushImmediate, V(vm._nilz));
@@ -828,8 +834,7 @@ bool parseElems(Thread& th, P<Code>& code)
 		if (!parseElem(th, code)) break;
 	}
 	
-	code->add(opReturn, 0.);
-	code->shrinkToFit();
+	endCode(th, code, true);
 		
 	return true;
 }
@@ -0,0 +1,1209 @@
+//    SAPF - Sound As Pure Form
+//    Copyright (C) 2019 James McCartney
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "Pool.hpp"
+#include "VM.hpp"
+#include "clz.hpp"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <new>
+#include <thread>
+#if defined(__APPLE__)
+#include <dispatch/dispatch.h>
+#elif defined(_WIN32)
+#include <windows.h>
+#else
+#include <errno.h>
+#include <semaphore.h>
+#endif
+
+enum {
+	kNumSmallClasses = 16, // 16 to 256 bytes in steps of 16
+	kNumClasses = kNumSmallClasses + 9, // then 512 to kPoolMaxSize
+	kSlabBytes = 65536,
+	kSlabHeader = 64, // the start of each slab holds a PoolSlabHeader
+	kMagazineBytes = 131072, // bytes of blocks one magazine holds, within its limits
+	kMinRounds = 4,
+	kMaxRounds = 64,
+	kRenderSpares = 4, // full magazines a render thread keeps beyond its prefill
+	kMaxPoolTypes = 256,
+	kOtherTypes = kMaxPoolTypes - 1,
+	kTypeCells = 1024 // of each table in PoolTypeTable, a power of two
+};
+
+static inline int sizeClass(size_t inSize)
+{
+	if (inSize <= 256) return inSize ? int((inSize - 1) >> 4) : 0;
+	return kNumSmallClasses + int(LOG2CEIL((int64_t)inSize)) - 9;
+}
+
+static inline size_t classSize(int index)
+{
+	if (index < kNumSmallClasses) return size_t(index + 1) << 4;
+	return size_t(512) << (index - kNumSmallClasses);
+}
+
+size_t poolRoundSize(size_t inSize)
+{
+	return inSize > kPoolMaxSize ? inSize : classSize(sizeClass(inSize));
+}
+
+static void* mallocBlock(size_t inSize)
+{
+	void* p = malloc(inSize);
+	if (!p) throw std::bad_alloc();
+	return p;
+}
+
+#pragma mark SLABS
+
+struct PoolSlabHeader
+{
+	size_t mSize; // of each block in the slab, or of the large object it holds
+};
+
+static void* allocSlab(size_t inSize)
+{
+#if defined(_WIN32)
+	void* p = _aligned_malloc(inSize, kSlabBytes);
+#else
+	void* p = nullptr;
+	if (posix_memalign(&p, kSlabBytes, inSize)) p = nullptr;
+#endif
+	if (!p) throw std::bad_alloc();
+	return p;
+}
+
+static void freeSlab(void* p)
+{
+#if defined(_WIN32)
+	_aligned_free(p);
+#else
+	free(p);
+#endif
+}
+
+static inline PoolSlabHeader* slabHeader(const void* p)
+{
+	return (PoolSlabHeader*)((uintptr_t)p & ~(uintptr_t)(kSlabBytes - 1));
+}
+
+#pragma mark MAGAZINES
+
+struct PoolBlock
+{
+	PoolBlock* mNext;
+};
+
+struct PoolMagazine
+{
+	PoolMagazine* mNext;
+	int32_t mCount;
+	void* mRounds[kMaxRounds];
+};
+
+static PoolMagazine* newMagazine()
+{
+	PoolMagazine* m = (PoolMagazine*)mallocBlock(sizeof(PoolMagazine));
+	m->mNext = nullptr;
+	m->mCount = 0;
+	return m;
+}
+
+struct PoolDepot
+{
+	std::mutex mMutex;
+	PoolMagazine* mFull = nullptr; // may be partly filled
+	PoolMagazine* mEmpty = nullptr;
+	PoolBlock* mLoose = nullptr; // freed on threads whose cache is gone
+	char* mSlabNext = nullptr;
+	char* mSlabEnd = nullptr;
+	int64_t mCached = 0;
+	int64_t mSlabs = 0;
+};
+
+// never destroyed, because blocks may be freed during static destruction.
+static PoolDepot* depots()
+{
+	static PoolDepot* sDepots = new PoolDepot[kNumClasses];
+	return sDepots;
+}
+
+// cuts up to n blocks of a slab class into outBlocks. the depot must be locked.
+static int carve(PoolDepot& depot, int index, void** outBlocks, int n)
+{
+	size_t size = classSize(index);
+	int count = 0;
+	while (count < n) {
+		if (depot.mSlabNext + size > depot.mSlabEnd) {
+			if (count) break;
+			char* slab = (char*)allocSlab(kSlabBytes);
+			((PoolSlabHeader*)slab)->mSize = size;
+			depot.mSlabNext = slab + kSlabHeader;
+			depot.mSlabEnd = slab + kSlabBytes;
+			++depot.mSlabs;
+		}
+		outBlocks[count++] = depot.mSlabNext;
+		depot.mSlabNext += size;
+	}
+	return count;
+}
+
+// counters are only written by the thread that owns them, so they need no atomic
+// read-modify-write. reports read them from other threads.
+static inline void add(std::atomic<int64_t>& counter, int64_t n)
+{
+	counter.store(counter.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+}
+
+static inline void bump(std::atomic<int64_t>& counter)
+{
+	add(counter, 1);
+}
+
+struct PoolCounts
+{
+	std::atomic<int64_t> mHits{0};
+	std::atomic<int64_t> mRefills{0};
+	std::atomic<int64_t> mMisses{0};
+	std::atomic<int64_t> mFrees{0};
+};
+
+// mPrevious is always either full or empty.
+// a render thread is given mSpareLimit empty magazines, and keeps at most that many
+// full ones, so it always has an empty one to load while it may keep another full one.
+struct PoolBin
+{
+	PoolMagazine* mLoaded = nullptr;
+	PoolMagazine* mPrevious = nullptr;
+	PoolMagazine* mFull = nullptr; // spares of a render thread
+	PoolMagazine* mEmpty = nullptr;
+	int32_t mCapacity = 0;
+	int32_t mFullCount = 0;
+	int32_t mSpareLimit = 0;
+	std::atomic<int64_t> mCached{0};
+};
+
+struct PoolTypeCounts
+{
+	std::atomic<int64_t> mLive{0};
+	std::atomic<int64_t> mBytes{0};
+	std::atomic<int64_t> mAllocs{0}; // never goes down
+	std::atomic<int64_t> mAllocBytes{0};
+};
+
+struct PoolTypeTotals
+{
+	int64_t mLive = 0;
+	int64_t mBytes = 0;
+	int64_t mAllocs = 0;
+	int64_t mAllocBytes = 0;
+
+	void add(PoolTypeCounts const& counts)
+	{
+		mLive += counts.mLive.load(std::memory_order_relaxed);
+		mBytes += counts.mBytes.load(std::memory_order_relaxed);
+		mAllocs += counts.mAllocs.load(std::memory_order_relaxed);
+		mAllocBytes += counts.mAllocBytes.load(std::memory_order_relaxed);
+	}
+};
+
+struct PoolCache
+{
+	PoolBin mBins[kNumClasses];
+	PoolCounts mCounts[kNumClasses];
+	PoolTypeCounts mTypes[kMaxPoolTypes];
+	std::atomic<int64_t> mLargeAllocs{0};
+	bool mRender = false;
+
+	PoolCache();
+	~PoolCache();
+};
+
+struct PoolTotals
+{
+	int64_t mHits[kNumClasses] = {};
+	int64_t mRefills[kNumClasses] = {};
+	int64_t mMisses[kNumClasses] = {};
+	int64_t mFrees[kNumClasses] = {};
+	int64_t mLargeAllocs = 0;
+	int64_t mRenderMisses = 0;
+
+	void add(PoolCache const& cache);
+};
+
+void PoolTotals::add(PoolCache const& cache)
+{
+	for (int i = 0; i < kNumClasses; ++i) {
+		PoolCounts const& counts = cache.mCounts[i];
+		mHits[i] += counts.mHits.load(std::memory_order_relaxed);
+		mRefills[i] += counts.mRefills.load(std::memory_order_relaxed);
+		mMisses[i] += counts.mMisses.load(std::memory_order_relaxed);
+		mFrees[i] += counts.mFrees.load(std::memory_order_relaxed);
+		if (cache.mRender)
+			mRenderMisses += counts.mMisses.load(std::memory_order_relaxed);
+	}
+	mLargeAllocs += cache.mLargeAllocs.load(std::memory_order_relaxed);
+}
+
+struct PoolRegistry
+{
+	std::mutex mMutex;
+	std::vector<PoolCache*> mCaches;
+	PoolTotals mRetired; // from threads that have exited
+	PoolTotals mBaseline; // subtracted from reports. see poolResetStats.
+
+	PoolTypeTotals mRetiredTypes[kMaxPoolTypes];
+	PoolTypeTotals mBaselineTypes[kMaxPoolTypes]; // only the allocation counts are used
+	int64_t mPeakLive[kMaxPoolTypes] = {};
+	int64_t mPeakBytes[kMaxPoolTypes] = {};
+	int64_t mPeakTotalBytes = 0;
+	std::chrono::steady_clock::time_point mBaselineTime = std::chrono::steady_clock::now();
+};
+
+static PoolRegistry& registry()
+{
+	static PoolRegistry* sRegistry = new PoolRegistry;
+	return *sRegistry;
+}
+
+PoolCache::PoolCache()
+{
+	for (int i = 0; i < kNumClasses; ++i) {
+		PoolBin& bin = mBins[i];
+		bin.mCapacity = (int32_t)std::clamp(kMagazineBytes / classSize(i), (size_t)kMinRounds, (size_t)kMaxRounds);
+		bin.mLoaded = newMagazine();
+		bin.mPrevious = newMagazine();
+	}
+	PoolRegistry& reg = registry();
+	std::lock_guard<std::mutex> lock(reg.mMutex);
+	reg.mCaches.push_back(this);
+}
+
+PoolCache::~PoolCache()
+{
+	for (int i = 0; i < kNumClasses; ++i) {
+		PoolBin& bin = mBins[i];
+		PoolDepot& depot = depots()[i];
+		std::lock_guard<std::mutex> lock(depot.mMutex);
+		auto giveAll = [&](PoolMagazine* m) {
+			while (m) {
+				PoolMagazine* next = m->mNext;
+				if (m->mCount) {
+					m->mNext = depot.mFull;
+					depot.mFull = m;
+					depot.mCached += m->mCount;
+				} else {
+					m->mNext = depot.mEmpty;
+					depot.mEmpty = m;
+				}
+				m = next;
+			}
+		};
+		bin.mLoaded->mNext = nullptr;
+		bin.mPrevious->mNext = nullptr;
+		giveAll(bin.mLoaded);
+		giveAll(bin.mPrevious);
+		giveAll(bin.mFull);
+		giveAll(bin.mEmpty);
+	}
+	PoolRegistry& reg = registry();
+	std::lock_guard<std::mutex> lock(reg.mMutex);
+	reg.mCaches.erase(std::find(reg.mCaches.begin(), reg.mCaches.end(), this));
+	reg.mRetired.add(*this);
+	for (int i = 0; i < kMaxPoolTypes; ++i)
+		reg.mRetiredTypes[i].add(mTypes[i]);
+}
+
+static thread_local PoolCache* tCache = nullptr;
+static thread_local bool tCacheGone = false;
+
+struct PoolCacheOwner
+{
+	PoolCache mCache;
+	~PoolCacheOwner()
+	{
+		// blocks freed on this thread from now on go to the depot.
+		tCache = nullptr;
+		tCacheGone = true;
+	}
+};
+
+static inline PoolCache* threadCache()
+{
+	PoolCache* cache = tCache;
+	if (cache || tCacheGone) return cache;
+	static thread_local PoolCacheOwner sOwner;
+	tCache = &sOwner.mCache;
+	return tCache;
+}
+
+#pragma mark ALLOCATION
+
+// for threads without a cache.
+static void* depotAlloc(int index)
+{
+	PoolDepot& depot = depots()[index];
+	std::lock_guard<std::mutex> lock(depot.mMutex);
+	if (depot.mLoose) {
+		PoolBlock* block = depot.mLoose;
+		depot.mLoose = block->mNext;
+		--depot.mCached;
+		return block;
+	}
+	if (depot.mFull) {
+		PoolMagazine* m = depot.mFull;
+		void* p = m->mRounds[--m->mCount];
+		--depot.mCached;
+		if (!m->mCount) {
+			depot.mFull = m->mNext;
+			m->mNext = depot.mEmpty;
+			depot.mEmpty = m;
+		}
+		return p;
+	}
+	if (classSize(index) > kPoolSlabMaxSize)
+		return mallocBlock(classSize(index));
+	void* p;
+	carve(depot, index, &p, 1);
+	return p;
+}
+
+static void depotFree(int index, void* p)
+{
+	PoolDepot& depot = depots()[index];
+	std::lock_guard<std::mutex> lock(depot.mMutex);
+	PoolBlock* block = (PoolBlock*)p;
+	block->mNext = depot.mLoose;
+	depot.mLoose = block;
+	++depot.mCached;
+}
+
+// swaps the empty loaded magazine for a full one from the depot, or fills it with
+// loose blocks.
+static bool refill(PoolBin& bin, int index)
+{
+	PoolDepot& depot = depots()[index];
+	std::lock_guard<std::mutex> lock(depot.mMutex);
+	if (depot.mFull) {
+		PoolMagazine* full = depot.mFull;
+		depot.mFull = full->mNext;
+		depot.mCached -= full->mCount;
+		add(bin.mCached, full->mCount);
+		bin.mLoaded->mNext = depot.mEmpty;
+		depot.mEmpty = bin.mLoaded;
+		full->mNext = nullptr;
+		bin.mLoaded = full;
+		return true;
+	}
+	if (depot.mLoose) {
+		PoolMagazine* m = bin.mLoaded;
+		while (depot.mLoose && m->mCount < bin.mCapacity) {
+			PoolBlock* block = depot.mLoose;
+			depot.mLoose = block->mNext;
+			m->mRounds[m->mCount++] = block;
+		}
+		depot.mCached -= m->mCount;
+		add(bin.mCached, m->mCount);
+		return true;
+	}
+	return false;
+}
+
+// the loaded magazine is empty.
+static void* allocSlow(PoolCache& cache, PoolBin& bin, int index)
+{
+#ifdef SAPF_BIASED_RC
+	// a thread that allocates is running, so it is a good time to merge what other
+	// threads queued to it. the objects it frees may load the magazine again.
+	rcDrainQueue();
+#endif
+	PoolCounts& counts = cache.mCounts[index];
+	if (bin.mLoaded->mCount) {
+		bump(counts.mHits);
+	} else if (bin.mPrevious->mCount) {
+		std::swap(bin.mLoaded, bin.mPrevious);
+		bump(counts.mHits);
+	} else if (bin.mFull) {
+		PoolMagazine* full = bin.mFull;
+		bin.mFull = full->mNext;
+		--bin.mFullCount;
+		bin.mLoaded->mNext = bin.mEmpty;
+		bin.mEmpty = bin.mLoaded;
+		full->mNext = nullptr;
+		bin.mLoaded = full;
+		bump(counts.mHits);
+	} else if (refill(bin, index)) {
+		bump(counts.mRefills);
+	} else {
+		bump(counts.mMisses);
+		// the pool is growing, so the live counts may be at a peak.
+		if (!cache.mRender)
+			poolSampleTypes();
+		if (classSize(index) > kPoolSlabMaxSize)
+			return mallocBlock(classSize(index));
+		PoolDepot& depot = depots()[index];
+		std::lock_guard<std::mutex> lock(depot.mMutex);
+		PoolMagazine* m = bin.mLoaded;
+		m->mCount = carve(depot, index, m->mRounds, bin.mCapacity);
+		add(bin.mCached, m->mCount);
+	}
+	PoolMagazine* m = bin.mLoaded;
+	add(bin.mCached, -1);
+	return m->mRounds[--m->mCount];
+}
+
+void* poolAlloc(size_t inSize)
+{
+	PoolCache* cache = threadCache();
+	if (inSize > kPoolMaxSize) {
+		if (cache) bump(cache->mLargeAllocs);
+		return mallocBlock(inSize);
+	}
+	int index = sizeClass(inSize);
+	if (!cache) return depotAlloc(index);
+
+	PoolBin& bin = cache->mBins[index];
+	PoolMagazine* m = bin.mLoaded;
+	if (!m->mCount)
+		return allocSlow(*cache, bin, index);
+	bump(cache->mCounts[index].mHits);
+	add(bin.mCached, -1);
+	return m->mRounds[--m->mCount];
+}
+
+// the blocks of a magazine a render thread cannot keep, chained through their first
+// word. the first block also holds the chain's class and length.
+struct PoolSpill : PoolBlock
+{
+	int32_t mIndex;
+	int32_t mCount;
+};
+
+static void giveSpill(void* inArg)
+{
+	PoolSpill* spill = (PoolSpill*)inArg;
+	PoolDepot& depot = depots()[spill->mIndex];
+	std::lock_guard<std::mutex> lock(depot.mMutex);
+	depot.mCached += spill->mCount;
+	PoolBlock* last = spill;
+	while (last->mNext) last = last->mNext;
+	last->mNext = depot.mLoose;
+	depot.mLoose = spill;
+}
+
+// empties a full magazine of a render thread into the depot, by way of the reclaimer.
+static void spillMagazine(PoolBin& bin, int index, PoolMagazine* m)
+{
+	PoolBlock* chain = nullptr;
+	for (int i = 1; i < m->mCount; ++i) {
+		PoolBlock* block = (PoolBlock*)m->mRounds[i];
+		block->mNext = chain;
+		chain = block;
+	}
+	PoolSpill* spill = (PoolSpill*)m->mRounds[0];
+	spill->mNext = chain;
+	spill->mIndex = index;
+	spill->mCount = m->mCount;
+	add(bin.mCached, -m->mCount);
+	m->mCount = 0;
+	// if the reclaimer is that far behind, the depot's lock is the lesser evil.
+	if (!poolDefer(giveSpill, spill))
+		giveSpill(spill);
+}
+
+// the loaded magazine is full.
+static void freeSlow(PoolCache& cache, PoolBin& bin, int index)
+{
+	if (!bin.mPrevious->mCount) {
+		std::swap(bin.mLoaded, bin.mPrevious);
+		return;
+	}
+	PoolMagazine* full = bin.mPrevious;
+	bin.mPrevious = bin.mLoaded;
+	PoolMagazine* empty = nullptr;
+	if (cache.mRender) {
+		if (bin.mFullCount < bin.mSpareLimit) empty = bin.mEmpty;
+		if (empty) {
+			bin.mEmpty = empty->mNext;
+			full->mNext = bin.mFull;
+			bin.mFull = full;
+			++bin.mFullCount;
+		} else {
+			spillMagazine(bin, index, full);
+			empty = full;
+		}
+	} else {
+		PoolDepot& depot = depots()[index];
+		std::lock_guard<std::mutex> lock(depot.mMutex);
+		full->mNext = depot.mFull;
+		depot.mFull = full;
+		depot.mCached += full->mCount;
+		add(bin.mCached, -full->mCount);
+		empty = depot.mEmpty;
+		if (empty) depot.mEmpty = empty->mNext;
+	}
+	if (!empty) empty = newMagazine();
+	empty->mNext = nullptr;
+	bin.mLoaded = empty;
+}
+
+static inline void pushBlock(PoolCache& cache, PoolBin& bin, int index, void* p)
+{
+	if (bin.mLoaded->mCount == bin.mCapacity)
+		freeSlow(cache, bin, index);
+	PoolMagazine* m = bin.mLoaded;
+	m->mRounds[m->mCount++] = p;
+	add(bin.mCached, 1);
+}
+
+void poolFree(void* p, size_t inSize)
+{
+	if (!p) return;
+	if (inSize > kPoolMaxSize) {
+		free(p);
+		return;
+	}
+	int index = sizeClass(inSize);
+	PoolCache* cache = threadCache();
+	if (!cache) {
+		depotFree(index, p);
+		return;
+	}
+	PoolBin& bin = cache->mBins[index];
+	bump(cache->mCounts[index].mFrees);
+	pushBlock(*cache, bin, index, p);
+}
+
+#pragma mark OBJECTS
+
+static thread_local const void* tNewObject = nullptr;
+
+void* poolAllocObject(size_t inSize)
+{
+	void* p;
+	if (inSize <= kPoolSlabMaxSize) {
+		p = poolAlloc(inSize);
+	} else {
+		// a render thread would call posix_memalign here. see Pool.hpp.
+		assert(!poolIsRenderThread());
+		poolSampleTypes();
+		// a slab of its own, so that poolObjectSize can find its header.
+		size_t size = (inSize + kSlabHeader + kSlabBytes - 1) & ~(size_t)(kSlabBytes - 1);
+		char* slab = (char*)allocSlab(size);
+		((PoolSlabHeader*)slab)->mSize = inSize;
+		p = slab + kSlabHeader;
+	}
+	tNewObject = p;
+	return p;
+}
+
+void poolFreeObject(void* p, size_t inSize)
+{
+	if (inSize <= kPoolSlabMaxSize)
+		poolFree(p, inSize);
+	else
+		freeSlab(slabHeader(p));
+}
+
+size_t poolObjectSize(const void* p)
+{
+	return slabHeader(p)->mSize;
+}
+
+bool poolTakeNewObject(const void* p)
+{
+	if (tNewObject != p) return false;
+	tNewObject = nullptr;
+	return true;
+}
+
+// Type slots are found from the TypeName() pointer, and then from the name, since
+// two pointers can hold the same name. Both are open addressed tables of cells that
+// are only ever added, so a lookup takes no lock, and neither does adding a type: a
+// thread claims an empty cell with a compare and swap. A render thread can therefore
+// count a type it has not seen before without locking or allocating.
+struct PoolTypeCell
+{
+	std::atomic<const char*> mKey{nullptr};
+	std::atomic<int> mSlot{-1}; // -1 until the thread that claimed the cell assigns it
+};
+
+struct PoolTypeTable
+{
+	PoolTypeCell mByPointer[kTypeCells];
+	PoolTypeCell mByName[kTypeCells];
+	std::atomic<const char*> mNames[kOtherTypes] = {};
+	std::atomic<int> mNumSlots{0}; // may pass kOtherTypes, once the named slots run out
+};
+
+static PoolTypeTable& typeTable()
+{
+	static PoolTypeTable* sTable = new PoolTypeTable;
+	return *sTable;
+}
+
+static size_t pointerHash(const char* inKey)
+{
+	return (size_t)(((uint64_t)(uintptr_t)inKey * 0x9E3779B97F4A7C15ULL) >> 32);
+}
+
+static size_t nameHash(const char* inKey)
+{
+	uint32_t hash = 2166136261u;
+	for (const char* c = inKey; *c; ++c)
+		hash = (hash ^ (uint8_t)*c) * 16777619u;
+	return hash;
+}
+
+// finds the cell of inKey, or claims an empty one, in which case outClaimed is set and
+// the caller must store the slot. returns null if the table is full.
+static PoolTypeCell* findTypeCell(PoolTypeCell* inCells, size_t inHash, const char* inKey, bool inByName, bool& outClaimed)
+{
+	outClaimed = false;
+	for (size_t i = 0; i < kTypeCells; ++i) {
+		PoolTypeCell& cell = inCells[(inHash + i) & (kTypeCells - 1)];
+		const char* key = cell.mKey.load(std::memory_order_acquire);
+		if (!key && cell.mKey.compare_exchange_strong(key, inKey, std::memory_order_acq_rel)) {
+			outClaimed = true;
+			return &cell;
+		}
+		if (key == inKey || (inByName && strcmp(key, inKey) == 0)) return &cell;
+	}
+	return nullptr;
+}
+
+static uint8_t typeCellSlot(PoolTypeCell& cell)
+{
+	int slot;
+	// only while another thread is between claiming the cell and assigning it.
+	while ((slot = cell.mSlot.load(std::memory_order_acquire)) < 0)
+		std::this_thread::yield();
+	return (uint8_t)slot;
+}
+
+static uint8_t typeSlot(const char* inTypeName)
+{
+	PoolTypeTable& table = typeTable();
+	bool claimed;
+	PoolTypeCell* byPointer = findTypeCell(table.mByPointer, pointerHash(inTypeName), inTypeName, false, claimed);
+	if (!byPointer) return kOtherTypes;
+	if (!claimed) return typeCellSlot(*byPointer);
+
+	int slot = kOtherTypes;
+	PoolTypeCell* byName = findTypeCell(table.mByName, nameHash(inTypeName), inTypeName, true, claimed);
+	if (byName && !claimed) {
+		slot = typeCellSlot(*byName);
+	} else if (byName) {
+		int next = table.mNumSlots.fetch_add(1, std::memory_order_relaxed);
+		if (next < kOtherTypes) {
+			slot = next;
+			table.mNames[slot].store(inTypeName, std::memory_order_release);
+		}
+		byName->mSlot.store(slot, std::memory_order_release);
+	}
+	byPointer->mSlot.store(slot, std::memory_order_release);
+	return (uint8_t)slot;
+}
+
+uint8_t poolCountObject(const char* inTypeName, size_t inSize)
+{
+	PoolCache* cache = threadCache();
+	if (!cache) {
+		PoolRegistry& reg = registry();
+		uint8_t slot = typeSlot(inTypeName);
+		std::lock_guard<std::mutex> lock(reg.mMutex);
+		PoolTypeTotals& totals = reg.mRetiredTypes[slot];
+		++totals.mLive;
+		totals.mBytes += inSize;
+		++totals.mAllocs;
+		totals.mAllocBytes += inSize;
+		return slot;
+	}
+	uint8_t slot = typeSlot(inTypeName);
+	PoolTypeCounts& counts = cache->mTypes[slot];
+	bump(counts.mLive);
+	add(counts.mBytes, inSize);
+	bump(counts.mAllocs);
+	add(counts.mAllocBytes, inSize);
+	return slot;
+}
+
+void poolUncountObject(uint8_t inSlot, size_t inSize)
+{
+	PoolCache* cache = threadCache();
+	if (!cache) {
+		PoolRegistry& reg = registry();
+		std::lock_guard<std::mutex> lock(reg.mMutex);
+		--reg.mRetiredTypes[inSlot].mLive;
+		reg.mRetiredTypes[inSlot].mBytes -= inSize;
+		return;
+	}
+	// counts of objects freed on another thread than they were made on go below zero
+	// there. only the sum over all threads means anything.
+	PoolTypeCounts& counts = cache->mTypes[inSlot];
+	add(counts.mLive, -1);
+	add(counts.mBytes, -(int64_t)inSize);
+}
+
+#pragma mark RECLAIMER
+
+// a counting semaphore. signal neither blocks nor allocates, so a render thread may call it.
+class PoolSemaphore
+{
+#if defined(__APPLE__)
+	dispatch_semaphore_t mSem = dispatch_semaphore_create(0);
+public:
+	~PoolSemaphore() { dispatch_release(mSem); }
+	void signal() { dispatch_semaphore_signal(mSem); }
+	void wait() { dispatch_semaphore_wait(mSem, DISPATCH_TIME_FOREVER); }
+#elif defined(_WIN32)
+	HANDLE mSem = CreateSemaphoreA(nullptr, 0, LONG_MAX, nullptr);
+public:
+	~PoolSemaphore() { CloseHandle(mSem); }
+	void signal() { ReleaseSemaphore(mSem, 1, nullptr); }
+	void wait() { WaitForSingleObject(mSem, INFINITE); }
+#else
+	sem_t mSem;
+public:
+	PoolSemaphore() { sem_init(&mSem, 0, 0); }
+	~PoolSemaphore() { sem_destroy(&mSem); }
+	void signal() { sem_post(&mSem); }
+	void wait() { while (sem_wait(&mSem) != 0 && errno == EINTR) {} }
+#endif
+};
+
+// a bounded queue with a sequence number per cell (Vyukov), so that several render
+// threads can push without a lock. the reclaimer is its only consumer, but
+// poolReclaim may also be called, so popping takes mPopMutex.
+struct PoolDeferredCell
+{
+	std::atomic<size_t> mSeq;
+	void (*mFun)(void*);
+	void* mArg;
+};
+
+struct PoolDeferredQueue
+{
+	PoolDeferredCell mCells[kPoolDeferredSize];
+	std::atomic<size_t> mTail{0};
+	size_t mHead = 0;
+	std::mutex mPopMutex;
+	std::atomic<int64_t> mDeferred{0};
+	std::atomic<int64_t> mDeferFull{0};
+
+	// the reclaimer sets mSleeping before it waits on mWake. whoever clears it signals.
+	PoolSemaphore mWake;
+	std::atomic<bool> mSleeping{false};
+	std::atomic<bool> mStop{false};
+	std::mutex mControlMutex; // held while the reclaimer starts and stops
+	std::thread mReclaimer;
+
+	PoolDeferredQueue()
+	{
+		for (size_t i = 0; i < kPoolDeferredSize; ++i)
+			mCells[i].mSeq.store(i, std::memory_order_relaxed);
+	}
+};
+
+static PoolDeferredQueue& deferredQueue()
+{
+	static PoolDeferredQueue* sQueue = new PoolDeferredQueue;
+	return *sQueue;
+}
+
+bool poolDefer(void (*inFun)(void*), void* inArg)
+{
+	PoolDeferredQueue& q = deferredQueue();
+	size_t pos = q.mTail.load(std::memory_order_relaxed);
+	for (;;) {
+		PoolDeferredCell& cell = q.mCells[pos & (kPoolDeferredSize - 1)];
+		size_t seq = cell.mSeq.load(std::memory_order_acquire);
+		intptr_t dif = (intptr_t)seq - (intptr_t)pos;
+		if (dif == 0) {
+			if (q.mTail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+				cell.mFun = inFun;
+				cell.mArg = inArg;
+				cell.mSeq.store(pos + 1, std::memory_order_release);
+				q.mDeferred.fetch_add(1, std::memory_order_relaxed);
+				// pairs with the fence in reclaimerLoop: either it sees the cell, or this sees it asleep.
+				std::atomic_thread_fence(std::memory_order_seq_cst);
+				if (q.mSleeping.load(std::memory_order_relaxed) && q.mSleeping.exchange(false))
+					q.mWake.signal();
+				return true;
+			}
+		} else if (dif < 0) {
+			q.mDeferFull.fetch_add(1, std::memory_order_relaxed);
+			return false;
+		} else {
+			pos = q.mTail.load(std::memory_order_relaxed);
+		}
+	}
+}
+
+static void releaseDeferred(void* inArg)
+{
+	((RCObj*)inArg)->release();
+}
+
+bool poolDeferRelease(RCObj* obj)
+{
+	return poolDefer(releaseDeferred, obj);
+}
+
+size_t poolReclaim()
+{
+	PoolDeferredQueue& q = deferredQueue();
+	std::lock_guard<std::mutex> lock(q.mPopMutex);
+	size_t count = 0;
+	for (;;) {
+		PoolDeferredCell& cell = q.mCells[q.mHead & (kPoolDeferredSize - 1)];
+		if (cell.mSeq.load(std::memory_order_acquire) != q.mHead + 1) break;
+		void (*fun)(void*) = cell.mFun;
+		void* arg = cell.mArg;
+		cell.mSeq.store(q.mHead + kPoolDeferredSize, std::memory_order_release);
+		++q.mHead;
+		// the work may defer more, and the cell is free again already.
+		fun(arg);
+		++count;
+	}
+	return count;
+}
+
+static bool deferredEmpty(PoolDeferredQueue& q)
+{
+	std::lock_guard<std::mutex> lock(q.mPopMutex);
+	return q.mCells[q.mHead & (kPoolDeferredSize - 1)].mSeq.load(std::memory_order_acquire) != q.mHead + 1;
+}
+
+static void reclaimerLoop()
+{
+	PoolDeferredQueue& q = deferredQueue();
+	for (;;) {
+		poolReclaim();
+		q.mSleeping.store(true, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		if (q.mStop.load(std::memory_order_relaxed) || !deferredEmpty(q)) {
+			// if a deferrer cleared the flag first, its signal is on the way. take it.
+			if (!q.mSleeping.exchange(false))
+				q.mWake.wait();
+		} else {
+			q.mWake.wait();
+		}
+		if (q.mStop.load(std::memory_order_acquire)) return;
+	}
+}
+
+void poolStartReclaimer()
+{
+	PoolDeferredQueue& q = deferredQueue();
+	std::lock_guard<std::mutex> lock(q.mControlMutex);
+	if (q.mReclaimer.joinable()) return;
+	static bool sAtExit = (std::atexit(poolStopReclaimer), true);
+	(void)sAtExit;
+	q.mStop.store(false, std::memory_order_relaxed);
+	q.mReclaimer = std::thread(reclaimerLoop);
+}
+
+void poolStopReclaimer()
+{
+	PoolDeferredQueue& q = deferredQueue();
+	std::lock_guard<std::mutex> lock(q.mControlMutex);
+	if (!q.mReclaimer.joinable()) return;
+	q.mStop.store(true, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	if (q.mSleeping.exchange(false))
+		q.mWake.signal();
+	q.mReclaimer.join();
+}
+
+#pragma mark RENDER THREADS
+
+static void addSpares(PoolBin& bin, int n)
+{
+	bin.mSpareLimit += n;
+	for (int i = 0; i < n; ++i) {
+		PoolMagazine* m = newMagazine();
+		m->mNext = bin.mEmpty;
+		bin.mEmpty = m;
+	}
+}
+
+void poolEnterRenderThread()
+{
+	// a render thread may not allocate past its magazines for a long time.
+	rcDrainQueue();
+	PoolCache* cache = threadCache();
+	if (!cache || cache->mRender) return;
+	cache->mRender = true;
+	poolStartReclaimer();
+	// what a render thread makes is mostly released on other threads.
+	rcUnbiasThread();
+	// the magazines it will ever have, so that freeing never calls malloc.
+	for (PoolBin& bin : cache->mBins)
+		addSpares(bin, kRenderSpares);
+
+	// the three blocks a generator allocates for each block it fills.
+	size_t sizes[] = {
+		sizeof(List), sizeof(Array),
+		vm.ar.blockSize * sizeof(Z), vm.VblockSize * sizeof(V)
+	};
+	for (size_t size : sizes) {
+		if (size > kPoolMaxSize) continue;
+		int index = sizeClass(size);
+		PoolBin& bin = cache->mBins[index];
+		int64_t toFill = vm.poolPrefill - bin.mCached.load(std::memory_order_relaxed);
+		if (toFill > 0)
+			addSpares(bin, (int)((toFill + bin.mCapacity - 1) / bin.mCapacity));
+		while (bin.mCached.load(std::memory_order_relaxed) < vm.poolPrefill) {
+			void* p;
+			if (classSize(index) > kPoolSlabMaxSize) {
+				p = mallocBlock(classSize(index));
+			} else {
+				PoolDepot& depot = depots()[index];
+				std::lock_guard<std::mutex> lock(depot.mMutex);
+				carve(depot, index, &p, 1);
+			}
+			pushBlock(*cache, bin, index, p);
+		}
+	}
+}
+
+bool poolIsRenderThread()
+{
+	PoolCache* cache = tCache;
+	return cache && cache->mRender;
+}
+
+#pragma mark STATS
+
+static void currentTotals(PoolRegistry& reg, PoolTotals& totals)
+{
+	totals = reg.mRetired;
+	for (PoolCache* cache : reg.mCaches)
+		totals.add(*cache);
+}
+
+void poolGetStats(PoolStats& outStats)
+{
+	PoolRegistry& reg = registry();
+	std::lock_guard<std::mutex> lock(reg.mMutex);
+	PoolTotals totals;
+	currentTotals(reg, totals);
+	PoolTotals const& base = reg.mBaseline;
+
+	outStats = PoolStats();
+	for (int i = 0; i < kNumClasses; ++i) {
+		PoolClassStats stats;
+		stats.mSize = classSize(i);
+		stats.mHits = totals.mHits[i] - base.mHits[i];
+		stats.mRefills = totals.mRefills[i] - base.mRefills[i];
+		stats.mMisses = totals.mMisses[i] - base.mMisses[i];
+		stats.mFrees = totals.mFrees[i] - base.mFrees[i];
+		stats.mCached = 0;
+		for (PoolCache* cache : reg.mCaches)
+			stats.mCached += cache->mBins[i].mCached.load(std::memory_order_relaxed);
+		{
+			PoolDepot& depot = depots()[i];
+			std::lock_guard<std::mutex> depotLock(depot.mMutex);
+			stats.mCached += depot.mCached;
+			outStats.mSlabs += depot.mSlabs;
+		}
+		outStats.mClasses.push_back(stats);
+		outStats.mHits += stats.mHits;
+		outStats.mRefills += stats.mRefills;
+		outStats.mMisses += stats.mMisses;
+	}
+	outStats.mLargeAllocs = totals.mLargeAllocs - base.mLargeAllocs;
+	outStats.mRenderMisses = totals.mRenderMisses - base.mRenderMisses;
+	PoolDeferredQueue& q = deferredQueue();
+	outStats.mDeferred = q.mDeferred.load(std::memory_order_relaxed);
+	outStats.mDeferFull = q.mDeferFull.load(std::memory_order_relaxed);
+}
+
+// sums the counts of type slot i over all threads. the registry must be locked.
+static PoolTypeTotals typeTotals(PoolRegistry& reg, int i)
+{
+	PoolTypeTotals totals = reg.mRetiredTypes[i];
+	for (PoolCache* cache : reg.mCaches)
+		totals.add(cache->mTypes[i]);
+	return totals;
+}
+
+static int usedTypeSlots(PoolRegistry&)
+{
+	// kOtherTypes is used once the named slots run out.
+	int used = typeTable().mNumSlots.load(std::memory_order_acquire);
+	return used >= kOtherTypes ? kMaxPoolTypes : used;
+}
+
+static std::string typeSlotName(int i)
+{
+	if (i == kOtherTypes) return "(other types)";
+	// null only before the slot is first counted.
+	const char* name = typeTable().mNames[i].load(std::memory_order_acquire);
+	return name ? name : "";
+}
+
+// the registry must be locked.
+static void sampleTypes(PoolRegistry& reg)
+{
+	int64_t totalBytes = 0;
+	for (int i = 0; i < usedTypeSlots(reg); ++i) {
+		PoolTypeTotals totals = typeTotals(reg, i);
+		reg.mPeakLive[i] = std::max(reg.mPeakLive[i], totals.mLive);
+		reg.mPeakBytes[i] = std::max(reg.mPeakBytes[i], totals.mBytes);
+		totalBytes += totals.mBytes;
+	}
+	reg.mPeakTotalBytes = std::max(reg.mPeakTotalBytes, totalBytes);
+}
+
+void poolSampleTypes()
+{
+	PoolRegistry& reg = registry();
+	std::lock_guard<std::mutex> lock(reg.mMutex);
+	sampleTypes(reg);
+}
+
+void poolGetTypeStats(std::vector<PoolTypeStats>& outStats)
+{
+	PoolTypeSummary summary;
+	poolGetTypeStats(outStats, summary);
+}
+
+void poolGetTypeStats(std::vector<PoolTypeStats>& outStats, PoolTypeSummary& outSummary)
+{
+	PoolRegistry& reg = registry();
+	std::lock_guard<std::mutex> lock(reg.mMutex);
+	sampleTypes(reg);
+	outStats.clear();
+	outSummary = PoolTypeSummary();
+	for (int i = 0; i < usedTypeSlots(reg); ++i) {
+		PoolTypeTotals totals = typeTotals(reg, i);
+		PoolTypeTotals const& base = reg.mBaselineTypes[i];
+		PoolTypeStats stats;
+		stats.mName = typeSlotName(i);
+		stats.mLive = totals.mLive;
+		stats.mBytes = totals.mBytes;
+		stats.mPeakLive = reg.mPeakLive[i];
+		stats.mPeakBytes = reg.mPeakBytes[i];
+		stats.mAllocs = totals.mAllocs - base.mAllocs;
+		stats.mAllocBytes = totals.mAllocBytes - base.mAllocBytes;
+		outSummary.mLive += stats.mLive;
+		outSummary.mBytes += stats.mBytes;
+		outSummary.mAllocs += stats.mAllocs;
+		outSummary.mAllocBytes += stats.mAllocBytes;
+		if (!stats.mLive && !stats.mBytes && !stats.mAllocs) continue;
+		outStats.push_back(stats);
+	}
+	outSummary.mPeakBytes = reg.mPeakTotalBytes;
+	outSummary.mSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - reg.mBaselineTime).count();
+	std::sort(outStats.begin(), outStats.end(), [](PoolTypeStats const& a, PoolTypeStats const& b) {
+		if (a.mBytes != b.mBytes) return a.mBytes > b.mBytes;
+		return a.mName < b.mName;
+	});
+}
+
+void poolResetStats()
+{
+	PoolRegistry& reg = registry();
+	std::lock_guard<std::mutex> lock(reg.mMutex);
+	currentTotals(reg, reg.mBaseline);
+	// peaks start again from what is live now.
+	reg.mPeakTotalBytes = 0;
+	for (int i = 0; i < usedTypeSlots(reg); ++i) {
+		PoolTypeTotals totals = typeTotals(reg, i);
+		reg.mBaselineTypes[i] = totals;
+		reg.mPeakLive[i] = totals.mLive;
+		reg.mPeakBytes[i] = totals.mBytes;
+		reg.mPeakTotalBytes += totals.mBytes;
+	}
+	reg.mBaselineTime = std::chrono::steady_clock::now();
+}
+
+void poolReport()
+{
+	PoolStats stats;
+	poolGetStats(stats);
+	int64_t requests = stats.mHits + stats.mRefills + stats.mMisses;
+	post("pool : %lld requests, %lld hits, %lld refills, %lld misses (%lld on render threads), %lld large, %lld slabs\n",
+		(long long)requests, (long long)stats.mHits, (long long)stats.mRefills, (long long)stats.mMisses,
+		(long long)stats.mRenderMisses, (long long)stats.mLargeAllocs, (long long)stats.mSlabs);
+	if (requests)
+		post("  hit rate %.1f%%\n", 100. * (stats.mHits + stats.mRefills) / requests);
+	if (stats.mDeferred || stats.mDeferFull)
+		post("  deferred to the reclaimer %lld, done in place %lld\n", (long long)stats.mDeferred, (long long)stats.mDeferFull);
+	post("     size         hits      refills       misses        frees   cached\n");
+	for (PoolClassStats const& c : stats.mClasses) {
+		if (!c.mHits && !c.mRefills && !c.mMisses && !c.mFrees && !c.mCached) continue;
+		post("  %7zu  %11lld  %11lld  %11lld  %11lld  %7lld\n", c.mSize,
+			(long long)c.mHits, (long long)c.mRefills, (long long)c.mMisses, (long long)c.mFrees, (long long)c.mCached);
+	}
+}
+
+void poolTypeReport(size_t maxEntries)
+{
+	std::vector<PoolTypeStats> stats;
+	PoolTypeSummary summary;
+	poolGetTypeStats(stats, summary);
+	if (maxEntries && stats.size() > maxEntries)
+		stats.resize(maxEntries);
+
+	double seconds = std::max(summary.mSeconds, 1e-3);
+	post("live objects : %lld, %lld bytes, peak %lld bytes\n",
+		(long long)summary.mLive, (long long)summary.mBytes, (long long)summary.mPeakBytes);
+	post("allocated : %lld objects, %lld bytes in %.1f s (%.0f per s)\n",
+		(long long)summary.mAllocs, (long long)summary.mAllocBytes, summary.mSeconds, summary.mAllocs / seconds);
+	post("         live        bytes   peak bytes       allocs    per s  type\n");
+	for (PoolTypeStats const& entry : stats) {
+		post("  %11lld  %11lld  %11lld  %11lld  %7.0f  %s\n", (long long)entry.mLive, (long long)entry.mBytes,
+			(long long)entry.mPeakBytes, (long long)entry.mAllocs, entry.mAllocs / seconds, entry.mName.c_str());
+	}
+}
+
+bool poolWriteTypeJSON(const char* path)
+{
+	std::vector<PoolTypeStats> stats;
+	PoolTypeSummary summary;
+	poolGetTypeStats(stats, summary);
+	PoolStats poolStats;
+	poolGetStats(poolStats);
+
+	FILE* f = fopen(path, "w");
+	if (!f) {
+		post("could not open '%s'\n", path);
+		return false;
+	}
+	// type names come from TypeName(), so they need no escaping.
+	fprintf(f, "{\n  \"seconds\": %.3f,\n  \"live\": %lld,\n  \"bytes\": %lld,\n  \"peak_bytes\": %lld,\n",
+		summary.mSeconds, (long long)summary.mLive, (long long)summary.mBytes, (long long)summary.mPeakBytes);
+	fprintf(f, "  \"allocs\": %lld,\n  \"alloc_bytes\": %lld,\n  \"slabs\": %lld,\n  \"types\": [",
+		(long long)summary.mAllocs, (long long)summary.mAllocBytes, (long long)poolStats.mSlabs);
+	for (size_t i = 0; i < stats.size(); ++i) {
+		PoolTypeStats const& entry = stats[i];
+		fprintf(f, "%s\n    { \"name\": \"%s\", \"live\": %lld, \"bytes\": %lld, \"peak_live\": %lld, \"peak_bytes\": %lld, \"allocs\": %lld, \"alloc_bytes\": %lld }",
+			i ? "," : "", entry.mName.c_str(), (long long)entry.mLive, (long long)entry.mBytes,
+			(long long)entry.mPeakLive, (long long)entry.mPeakBytes, (long long)entry.mAllocs, (long long)entry.mAllocBytes);
+	}
+	fprintf(f, "\n  ]\n}\n");
+	return fclose(f) == 0;
+}
@@ -0,0 +1,305 @@
+//    SAPF - Sound As Pure Form
+//    Copyright (C) 2019 James McCartney
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "Profiler.hpp"
+#include <stdio.h>
+#include <algorithm>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+struct ProfileCounts
+{
+	P<Object> mKey; // keeps the key alive so that its address is not reused.
+	int64_t mCalls = 0;
+	int64_t mInclusive = 0; // nanoseconds
+	int64_t mExclusive = 0;
+	int mActive = 0; // calls of mKey on this thread's stack
+};
+
+struct ProfileFrame
+{
+	ProfileCounts* mCounts;
+	Thread* mThread;
+	size_t mDepth; // th.callDepth of the frame, for matching tail calls
+	bool mIsFun;
+	int64_t mStart;
+	int64_t mChildren;
+};
+
+typedef std::unordered_map<Object*, ProfileCounts> ProfileCountsMap;
+
+// mMutex guards mCounts against reports from other threads. it is only ever
+// contended while a report is being made.
+struct ProfileTable
+{
+	std::mutex mMutex;
+	ProfileCountsMap mCounts;
+	std::vector<ProfileFrame> mFrames;
+
+	ProfileTable();
+	~ProfileTable();
+};
+
+static std::mutex gProfileTablesMutex;
+static std::vector<ProfileTable*> gProfileTables;
+static ProfileCountsMap gRetiredCounts; // from threads that have exited
+
+static void mergeCounts(ProfileCountsMap& dst, ProfileCountsMap const& src)
+{
+	for (auto const& entry : src) {
+		if (!entry.second.mCalls) continue;
+		ProfileCounts& counts = dst[entry.first];
+		counts.mKey = entry.second.mKey;
+		counts.mCalls += entry.second.mCalls;
+		counts.mInclusive += entry.second.mInclusive;
+		counts.mExclusive += entry.second.mExclusive;
+	}
+}
+
+ProfileTable::ProfileTable()
+{
+	mFrames.reserve(256);
+	std::lock_guard<std::mutex> lock(gProfileTablesMutex);
+	gProfileTables.push_back(this);
+}
+
+ProfileTable::~ProfileTable()
+{
+	std::lock_guard<std::mutex> lock(gProfileTablesMutex);
+	gProfileTables.erase(std::find(gProfileTables.begin(), gProfileTables.end(), this));
+	mergeCounts(gRetiredCounts, mCounts);
+}
+
+static ProfileTable& profileTable()
+{
+	static thread_local ProfileTable sTable;
+	return sTable;
+}
+
+static int64_t profileNow()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// closures of one FunDef are counted together.
+static Object* profileKey(Object* callee)
+{
+	return callee->isFun() ? ((Fun*)callee)->mDef() : callee;
+}
+
+void profileEnter(Thread& th, Object* callee)
+{
+	ProfileTable& table = profileTable();
+	Object* key = profileKey(callee);
+	ProfileCounts* counts;
+	{
+		std::lock_guard<std::mutex> lock(table.mMutex);
+		counts = &table.mCounts[key];
+		if (!counts->mKey) counts->mKey = key;
+		++counts->mCalls;
+		++counts->mActive;
+	}
+	table.mFrames.push_back({ counts, &th, th.callDepth, callee->isFun(), profileNow(), 0 });
+}
+
+void profileLeave()
+{
+	int64_t now = profileNow();
+	ProfileTable& table = profileTable();
+	ProfileFrame frame = table.mFrames.back();
+	table.mFrames.pop_back();
+
+	int64_t elapsed = now - frame.mStart;
+	{
+		std::lock_guard<std::mutex> lock(table.mMutex);
+		frame.mCounts->mExclusive += elapsed - frame.mChildren;
+		if (--frame.mCounts->mActive == 0)
+			frame.mCounts->mInclusive += elapsed;
+	}
+	if (!table.mFrames.empty())
+		table.mFrames.back().mChildren += elapsed;
+}
+
+void profileTailCall(Thread& th, Object* callee)
+{
+	ProfileTable& table = profileTable();
+	if (!callee->isFun()) {
+		// a Prim that hands its work on to a tail call does nothing worth timing itself.
+		std::lock_guard<std::mutex> lock(table.mMutex);
+		ProfileCounts& counts = table.mCounts[callee];
+		if (!counts.mKey) counts.mKey = callee;
+		++counts.mCalls;
+		return;
+	}
+	// the frame being replaced was entered before profiling started.
+	if (table.mFrames.empty()) return;
+	ProfileFrame const& top = table.mFrames.back();
+	if (!top.mIsFun || top.mThread != &th || top.mDepth != th.callDepth) return;
+
+	profileLeave();
+	profileEnter(th, callee);
+}
+
+void profileReset()
+{
+	std::lock_guard<std::mutex> lock(gProfileTablesMutex);
+	gRetiredCounts.clear();
+	for (ProfileTable* table : gProfileTables) {
+		std::lock_guard<std::mutex> tableLock(table->mMutex);
+		for (auto it = table->mCounts.begin(); it != table->mCounts.end(); ) {
+			ProfileCounts& counts = it->second;
+			if (counts.mActive) {
+				// still referred to by a frame.
+				counts.mCalls = counts.mInclusive = counts.mExclusive = 0;
+				++it;
+			} else {
+				it = table->mCounts.erase(it);
+			}
+		}
+	}
+}
+
+#pragma mark REPORTS
+
+struct ProfileEntry
+{
+	std::string mName;
+	const char* mKind;
+	int64_t mCalls;
+	int64_t mInclusive;
+	int64_t mExclusive;
+};
+
+static void nameFunDefs(GForm* form, std::unordered_map<Object*, std::string>& names)
+{
+	for (; form; form = form->mNextForm()) {
+		for (P<TreeNode> const& node : form->mTable->sorted()) {
+			V value = node->mValue;
+			if (!value.isFun() || !node->mKey.isString()) continue;
+			// inner forms shadow outer ones, so the first name found is kept.
+			names.emplace(((Fun*)value.o())->mDef(), ((String*)node->mKey.o())->s);
+		}
+	}
+}
+
+static std::string anonymousFunName(FunDef* def)
+{
+	std::string name = "\\";
+	for (P<String> const& argName : def->mArgNames) {
+		name += argName->s;
+		name += " ";
+	}
+	name += "[..]";
+	return name;
+}
+
+static std::vector<ProfileEntry> profileEntries(Thread& th, int64_t& outCalls, int64_t& outTime)
+{
+	ProfileCountsMap merged;
+	{
+		std::lock_guard<std::mutex> lock(gProfileTablesMutex);
+		mergeCounts(merged, gRetiredCounts);
+		for (ProfileTable* table : gProfileTables) {
+			std::lock_guard<std::mutex> tableLock(table->mMutex);
+			mergeCounts(merged, table->mCounts);
+		}
+	}
+
+	std::unordered_map<Object*, std::string> funNames;
+	nameFunDefs(th.mWorkspace(), funNames);
+
+	std::vector<ProfileEntry> entries;
+	outCalls = 0;
+	outTime = 0;
+	for (auto const& item : merged) {
+		ProfileCounts const& counts = item.second;
+		ProfileEntry entry;
+		if (counts.mKey->isPrim()) {
+			// the prims the interpreter makes for itself have no name.
+			const char* name = ((Prim*)counts.mKey())->mName;
+			entry.mName = name && *name ? name : "(unnamed)";
+			entry.mKind = "prim";
+		} else {
+			auto name = funNames.find(counts.mKey());
+			entry.mName = name != funNames.end() ? name->second : anonymousFunName((FunDef*)counts.mKey());
+			entry.mKind = "fun";
+		}
+		entry.mCalls = counts.mCalls;
+		entry.mInclusive = counts.mInclusive;
+		entry.mExclusive = counts.mExclusive;
+		entries.push_back(entry);
+		outCalls += counts.mCalls;
+		outTime += counts.mExclusive;
+	}
+	std::sort(entries.begin(), entries.end(), [](ProfileEntry const& a, ProfileEntry const& b) {
+		if (a.mExclusive != b.mExclusive) return a.mExclusive > b.mExclusive;
+		return a.mName < b.mName;
+	});
+	return entries;
+}
+
+void profileReport(Thread& th, size_t maxEntries)
+{
+	int64_t totalCalls, totalTime;
+	std::vector<ProfileEntry> entries = profileEntries(th, totalCalls, totalTime);
+	if (maxEntries && entries.size() > maxEntries)
+		entries.resize(maxEntries);
+
+	post("profile : %lld calls, %.3f ms\n", (long long)totalCalls, 1e-6 * totalTime);
+	post("        calls      incl ms      excl ms  excl %%  name\n");
+	for (ProfileEntry const& entry : entries) {
+		post("  %11lld  %11.3f  %11.3f  %5.1f%%  %s%s\n",
+			(long long)entry.mCalls, 1e-6 * entry.mInclusive, 1e-6 * entry.mExclusive,
+			totalTime ? 100. * entry.mExclusive / totalTime : 0.,
+			entry.mName.c_str(), entry.mKind[0] == 'p' ? " (prim)" : "");
+	}
+}
+
+static void putJSONString(FILE* f, std::string const& s)
+{
+	fputc('"', f);
+	for (unsigned char c : s) {
+		if (c == '"' || c == '\\') fprintf(f, "\\%c", c);
+		else if (c < 0x20) fprintf(f, "\\u%04x", c);
+		else fputc(c, f);
+	}
+	fputc('"', f);
+}
+
+bool profileWriteJSON(Thread& th, const char* path)
+{
+	int64_t totalCalls, totalTime;
+	std::vector<ProfileEntry> entries = profileEntries(th, totalCalls, totalTime);
+
+	FILE* f = fopen(path, "w");
+	if (!f) {
+		post("could not open '%s'\n", path);
+		return false;
+	}
+	fprintf(f, "{\n  \"calls\": %lld,\n  \"time_ns\": %lld,\n  \"entries\": [", (long long)totalCalls, (long long)totalTime);
+	for (size_t i = 0; i < entries.size(); ++i) {
+		ProfileEntry const& entry = entries[i];
+		fprintf(f, "%s\n    { \"name\": ", i ? "," : "");
+		putJSONString(f, entry.mName);
+		fprintf(f, ", \"kind\": \"%s\", \"calls\": %lld, \"inclusive_ns\": %lld, \"exclusive_ns\": %lld }",
+			entry.mKind, (long long)entry.mCalls, (long long)entry.mInclusive, (long long)entry.mExclusive);
+	}
+	fprintf(f, "\n  ]\n}\n");
+	return fclose(f) == 0;
+}
@@ -16,10 +16,19 @@
 
 #include "RCObj.hpp"
 #include "VM.hpp"
+#include <mutex>
+#include <new>
+#include <thread>
+#include <vector>
 
 
 RCObj::RCObj()
+#ifdef SAPF_BIASED_RC
+	: refcount(tRCThread.mUnbiased ? kRCMerged : 0)
+	, mBiased(0), mOwner(tRCThread.mUnbiased ? 0 : rcThreadId())
+#else
 	: refcount(0)
+#endif
 {
 #if COLLECT_MINFO
 	++vm.totalObjectsAllocated;
@@ -27,7 +36,12 @@ RCObj::RCObj()
 }
 
 RCObj::RCObj(RCObj const& that)
+#ifdef SAPF_BIASED_RC
+	: refcount(tRCThread.mUnbiased ? kRCMerged : 0)
+	, mBiased(0), mOwner(tRCThread.mUnbiased ? 0 : rcThreadId())
+#else
 	: refcount(0)
+#endif
 {
 #if COLLECT_MINFO
 	++vm.totalObjectsAllocated;
@@ -48,6 +62,10 @@ void RCObj::norefs()
 	delete this; 
 }
 
+void RCObj::firstRetain() const
+{
+}
+
 	
 void RCObj::negrefcount()
 {
@@ -57,3 +75,244 @@ void RCObj::alreadyDead()
 {
 	post("RETAINING ALREADY DEAD OBJECT %s %p\n", TypeName(), this);
 }
+
+#ifdef SAPF_BIASED_RC
+
+#pragma mark BIASED REFERENCE COUNTS
+
+// the objects other threads have handed a thread to merge, linked through
+// mNextQueued, and whether it is parked. a record is never freed, so a thread can
+// always find the record of an object's owner.
+// mPark holds kRCParked and, in units of kRCMerger, the threads merging the owner's
+// objects while it is parked. the owner does not unpark until they are done, so a
+// merge never races with the owner's own counting.
+enum {
+	kRCParked = 1,
+	kRCMerger = 2
+};
+
+struct RCThreadRecord
+{
+	std::atomic<RCObj*> mQueue{nullptr};
+	std::atomic<uint32_t> mPark{0};
+	RCThreadState* mState;
+};
+
+// records are found by id without a lock, in chunks that are never moved or freed.
+enum {
+	kRCRecordChunkSize = 256,
+	kRCMaxRecordChunks = 4096
+};
+
+// objects are made during static initialization, so the table is made on first use.
+struct RCThreadTable
+{
+	std::mutex mMutex; // held to register a thread and to count
+	std::vector<RCThreadRecord*> mRecords; // indexed by id - 1
+	std::atomic<std::atomic<RCThreadRecord*>*> mChunks[kRCMaxRecordChunks] = {};
+	int64_t mRetiredRetains = 0;
+	int64_t mRetiredReleases = 0;
+};
+
+static RCThreadTable& rcThreads()
+{
+	static RCThreadTable* sTable = new RCThreadTable;
+	return *sTable;
+}
+
+static RCThreadRecord* rcThreadRecord(uint32_t id)
+{
+	uint32_t index = id - 1;
+	std::atomic<RCThreadRecord*>* chunk = rcThreads().mChunks[index / kRCRecordChunkSize].load(std::memory_order_acquire);
+	return chunk[index % kRCRecordChunkSize].load(std::memory_order_acquire);
+}
+
+// merges a list taken from a queue.
+static void rcMergeList(RCObj* obj)
+{
+	while (obj) {
+		RCObj* next = obj->mNextQueued;
+		obj->mergeQueued();
+		obj = next;
+	}
+}
+
+static void rcDrain(RCThreadRecord* record)
+{
+	rcMergeList(record->mQueue.exchange(nullptr, std::memory_order_seq_cst));
+}
+
+// lets another thread merge the owner's objects. fails unless the owner is parked.
+static bool rcBeginMerge(RCThreadRecord* record)
+{
+	uint32_t park = record->mPark.load(std::memory_order_seq_cst);
+	while (park & kRCParked) {
+		if (record->mPark.compare_exchange_weak(park, park + kRCMerger, std::memory_order_seq_cst))
+			return true;
+	}
+	return false;
+}
+
+static void rcEndMerge(RCThreadRecord* record)
+{
+	record->mPark.fetch_sub(kRCMerger, std::memory_order_release);
+}
+
+// merges whatever was queued to a thread and parks it for good before it exits.
+struct RCThreadExit
+{
+	RCThreadRecord* mRecord = nullptr;
+	~RCThreadExit()
+	{
+		if (!mRecord) return;
+		rcPark();
+		RCThreadTable& table = rcThreads();
+		std::lock_guard<std::mutex> lock(table.mMutex);
+		table.mRetiredRetains += tRCThread.mRetains.load(std::memory_order_relaxed);
+		table.mRetiredReleases += tRCThread.mReleases.load(std::memory_order_relaxed);
+		mRecord->mState = nullptr;
+	}
+};
+
+static thread_local RCThreadExit tRCThreadExit;
+
+uint32_t rcRegisterThread()
+{
+	RCThreadRecord* record = new RCThreadRecord;
+	record->mState = &tRCThread;
+	{
+		RCThreadTable& table = rcThreads();
+		std::lock_guard<std::mutex> lock(table.mMutex);
+		uint32_t index = (uint32_t)table.mRecords.size();
+		if (index >= kRCRecordChunkSize * kRCMaxRecordChunks) throw std::bad_alloc();
+		std::atomic<std::atomic<RCThreadRecord*>*>& chunk = table.mChunks[index / kRCRecordChunkSize];
+		if (!chunk.load(std::memory_order_relaxed))
+			chunk.store(new std::atomic<RCThreadRecord*>[kRCRecordChunkSize](), std::memory_order_release);
+		chunk.load(std::memory_order_relaxed)[index % kRCRecordChunkSize].store(record, std::memory_order_release);
+		table.mRecords.push_back(record);
+		tRCThread.mId = index + 1;
+	}
+	tRCThreadExit.mRecord = record;
+	return tRCThread.mId;
+}
+
+void rcUnbiasThread()
+{
+	rcThreadId();
+	tRCThread.mUnbiased = true;
+}
+
+void rcDrainQueue()
+{
+	RCThreadRecord* record = tRCThreadExit.mRecord;
+	if (record && record->mQueue.load(std::memory_order_acquire))
+		rcDrain(record);
+}
+
+void rcPark()
+{
+	if (!tRCThread.mId) return;
+	RCThreadRecord* record = tRCThreadExit.mRecord;
+	// an object queued before other threads see the flag is merged here. one queued
+	// after it is merged by the thread that queued it.
+	record->mPark.fetch_or(kRCParked, std::memory_order_seq_cst);
+	rcDrain(record);
+}
+
+void rcUnpark()
+{
+	if (!tRCThread.mId) return;
+	RCThreadRecord* record = tRCThreadExit.mRecord;
+	uint32_t park = kRCParked;
+	while (!record->mPark.compare_exchange_weak(park, 0, std::memory_order_acquire)) {
+		park = kRCParked;
+		std::this_thread::yield();
+	}
+}
+
+void rcGetCounts(int64_t& outRetains, int64_t& outReleases)
+{
+	RCThreadTable& table = rcThreads();
+	std::lock_guard<std::mutex> lock(table.mMutex);
+	outRetains = table.mRetiredRetains;
+	outReleases = table.mRetiredReleases;
+	for (RCThreadRecord* record : table.mRecords) {
+		if (!record->mState) continue;
+		outRetains += record->mState->mRetains.load(std::memory_order_relaxed);
+		outReleases += record->mState->mReleases.load(std::memory_order_relaxed);
+	}
+}
+
+// takes no lock and does not allocate, so that a render thread can queue.
+static void rcEnqueue(uint32_t owner, RCObj* obj)
+{
+	RCThreadRecord* record = rcThreadRecord(owner);
+	// the owner is parked or gone, so its biased count cannot change until we are done.
+	if (rcBeginMerge(record)) {
+		obj->mergeQueued();
+		rcEndMerge(record);
+		return;
+	}
+	RCObj* head = record->mQueue.load(std::memory_order_relaxed);
+	do {
+		obj->mNextQueued = head;
+	} while (!record->mQueue.compare_exchange_weak(head, obj, std::memory_order_seq_cst, std::memory_order_relaxed));
+	// the owner may have parked after its last drain, before the object was queued.
+	if (rcBeginMerge(record)) {
+		rcDrain(record);
+		rcEndMerge(record);
+	}
+}
+
+void RCObj::releaseMerge()
+{
+	// the owner's references are all gone. from now on it counts in the shared count.
+	mOwner.store(0, std::memory_order_relaxed);
+	int32_t word = refcount.fetch_or(kRCMerged, std::memory_order_acq_rel);
+	if (word == 0)
+		norefs();
+}
+
+void RCObj::releaseShared(int32_t word)
+{
+	if (word & kRCMerged) {
+		if (word == kRCMerged)
+			norefs();
+		else if (word < 0)
+			negrefcount();
+		return;
+	}
+	uint32_t owner = mOwner.load(std::memory_order_acquire);
+	while (!(word & (kRCMerged | kRCQueued)) && word < kRCShared) {
+		if (refcount.compare_exchange_weak(word, word | kRCQueued, std::memory_order_acq_rel)) {
+			if (owner == 0) {
+				// the owner is merging in releaseMerge. its biased count is spent.
+				refcount.fetch_or(kRCMerged, std::memory_order_acq_rel);
+				if ((refcount.fetch_and(~kRCQueued, std::memory_order_acq_rel) & ~kRCQueued) == kRCMerged)
+					norefs();
+			} else if (owner == tRCThread.mId) {
+				mergeQueued();
+			} else {
+				rcEnqueue(owner, this);
+			}
+			return;
+		}
+	}
+}
+
+void RCObj::mergeQueued()
+{
+	if (mOwner.load(std::memory_order_relaxed)) {
+		int32_t biased = mBiased.load(std::memory_order_relaxed);
+		mBiased.store(0, std::memory_order_relaxed);
+		mOwner.store(0, std::memory_order_relaxed);
+		refcount.fetch_add(biased * kRCShared + kRCMerged, std::memory_order_acq_rel);
+	}
+	int32_t word = refcount.fetch_and(~kRCQueued, std::memory_order_acq_rel) & ~kRCQueued;
+	if (word == kRCMerged)
+		norefs();
+	else if (word < 0 && (word & kRCMerged))
+		negrefcount();
+}
+
+#endif
@@ -425,7 +425,12 @@ static void brand_(Thread& th, Prim* prim)
 static void newseed_(Thread& th, Prim* prim)
 {
 	V v;
+#ifdef SAPF_NAN_BOXING
+	// a clear sign bit keeps the seed a real in a NaN-boxed V.
+	v.i = timeseed() & INT64_MAX;
+#else
 	v.i = timeseed();
+#endif
 	th.push(v);
 }
 
@@ -2785,6 +2790,7 @@ static void gray64_(Thread& th, Prim* prim)
 struct PinkNoise : Gen
 {
 	ZIn _a;
+	RGen r;
 	uint64_t dice[16];
 	uint64_t total_;
 	
@@ -2792,7 +2798,7 @@ struct PinkNoise : Gen
     : Gen(th, itemTypeZ, a.isFinite()), _a(a) 
 	{
 		total_ = 0;
-		RGen& r = th.rgen;
+		r.init(th.rgen.trand());
 		for (int i = 0; i < 16; ++i) {
 			int64_t x = (uint64_t)r.trand() >> 16;
 			total_ += x;
@@ -2803,7 +2809,6 @@ struct PinkNoise : Gen
 	virtual const char* TypeName() const override { return "PinkNoise"; }
 	
 	virtual void pull(Thread& th) override {
-		RGen& r = th.rgen;
 		int framesToFill = mBlockSize;
 		Z* out = mOut->fulfillz(framesToFill);
 		uint64_t total = total_;
@@ -2842,12 +2847,14 @@ struct PinkNoise : Gen
 struct PinkNoise0 : Gen
 {
 	ZIn _a;
+	RGen r;
 	uint64_t dice[16];
 	uint64_t total_;
 	
 	PinkNoise0(Thread& th, Arg a)
     : Gen(th, itemTypeZ, a.isFinite()), _a(a) 
 	{
+		r.init(th.rgen.trand());
 		total_ = 0;
 		for (int i = 0; i < 16; ++i) {
 			dice[i] = 0;
@@ -2857,7 +2864,6 @@ struct PinkNoise0 : Gen
 	virtual const char* TypeName() const override { return "PinkNoise0"; }
 	
 	virtual void pull(Thread& th) override {
-		RGen& r = th.rgen;
 		int framesToFill = mBlockSize;
 		Z* out = mOut->fulfillz(framesToFill);
 		uint64_t total = total_;
@@ -2896,6 +2902,7 @@ struct PinkNoise0 : Gen
 struct BlueNoise : Gen
 {
 	ZIn _a;
+	RGen r;
 	uint64_t dice[16];
 	uint64_t total_;
 	Z prev;
@@ -2904,7 +2911,7 @@ struct BlueNoise : Gen
     : Gen(th, itemTypeZ, a.isFinite()), _a(a), prev(0.)
 	{
 		total_ = 0;
-		RGen& r = th.rgen;
+		r.init(th.rgen.trand());
 		for (int i = 0; i < 16; ++i) {
 			int64_t x = (uint64_t)r.trand() >> 16;
 			total_ += x;
@@ -2915,7 +2922,6 @@ struct BlueNoise : Gen
 	virtual const char* TypeName() const override { return "BlueNoise"; }
 	
 	virtual void pull(Thread& th) override {
-		RGen& r = th.rgen;
 		int framesToFill = mBlockSize;
 		Z* out = mOut->fulfillz(framesToFill);
 		uint64_t total = total_;
@@ -2978,13 +2984,14 @@ static void blue_(Thread& th, Prim* prim)
 struct BrownNoise : Gen
 {
 	ZIn _a;
+	RGen r;
 	Z total_;
 	
 	BrownNoise(Thread& th, Arg a)
     : Gen(th, itemTypeZ, a.isFinite()), _a(a) 
 	{
 		total_ = 0;
-		RGen& r = th.rgen;
+		r.init(th.rgen.trand());
 		total_ = r.drand2();
         
 	}
@@ -2992,7 +2999,6 @@ struct BrownNoise : Gen
 	virtual const char* TypeName() const override { return "BrownNoise"; }
 	
 	virtual void pull(Thread& th) override {
-		RGen& r = th.rgen;
 		int framesToFill = mBlockSize;
 		Z* out = mOut->fulfillz(framesToFill);
 		Z z = total_;
@@ -3034,18 +3040,20 @@ struct Dust : Gen
 	ZIn _density;
 	ZIn _amp;
 	Z _densmul;
+	RGen r;
 	
 	Dust(Thread& th, Arg density, Arg amp)
     : Gen(th, itemTypeZ, mostFinite(density, amp)), _density(density), _amp(amp), _densmul(th.rate.invSampleRate)
 	{
+		r.init(th.rgen.trand());
 	}
     
 	virtual const char* TypeName() const override { return "Dust"; }
 	
 	virtual void pull(Thread& th) override {
-		RGen& r = th.rgen;
 		int framesToFill = mBlockSize;
 		Z* out = mOut->fulfillz(framesToFill);
+		bool hits = false;
 		while (framesToFill) {
 			int n = framesToFill;
 			int densityStride, ampStride;
@@ -3057,7 +3065,9 @@ struct Dust : Gen
 				for (int i = 0; i < n; ++i) {
 					Z thresh = *density * _densmul;
 					Z z = r.drand();
-					out[i] = z < thresh ? *amp * z / thresh : 0.;
+					bool hit = z < thresh;
+					out[i] = hit ? *amp * z / thresh : 0.;
+					hits |= hit;
 					density += densityStride;
 					amp += ampStride;
 				}
@@ -3067,6 +3077,7 @@ struct Dust : Gen
 				out += n;
 			}
 		}
+		if (!hits) mOut->mArray->setSilent();
 		produce(framesToFill);
 	}
 };
@@ -3077,18 +3088,20 @@ struct Dust2 : Gen
 	ZIn _density;
 	ZIn _amp;
 	Z _densmul;
+	RGen r;
 	
 	Dust2(Thread& th, Arg density, Arg amp)
     : Gen(th, itemTypeZ, mostFinite(density, amp)), _density(density), _amp(amp), _densmul(th.rate.invSampleRate)
 	{
+		r.init(th.rgen.trand());
 	}
     
 	virtual const char* TypeName() const override { return "Dust2"; }
 	
 	virtual void pull(Thread& th) override {
-		RGen& r = th.rgen;
 		int framesToFill = mBlockSize;
 		Z* out = mOut->fulfillz(framesToFill);
+		bool hits = false;
 		while (framesToFill) {
 			int n = framesToFill;
 			int densityStride, ampStride;
@@ -3100,7 +3113,9 @@ struct Dust2 : Gen
 				for (int i = 0; i < n; ++i) {
 					Z thresh = *density * _densmul;
 					Z z = r.drand();
-					out[i] = z < thresh ? *amp * (2. * z / thresh - 1.) : 0.;
+					bool hit = z < thresh;
+					out[i] = hit ? *amp * (2. * z / thresh - 1.) : 0.;
+					hits |= hit;
 					density += densityStride;
 					amp += ampStride;
 				}
@@ -3110,6 +3125,7 @@ struct Dust2 : Gen
 				out += n;
 			}
 		}
+		if (!hits) mOut->mArray->setSilent();
 		produce(framesToFill);
 	}
 };
@@ -3119,18 +3135,20 @@ struct Velvet : Gen
 	ZIn _density;
 	ZIn _amp;
 	Z _densmul;
+	RGen r;
 	
 	Velvet(Thread& th, Arg density, Arg amp)
     : Gen(th, itemTypeZ, mostFinite(density, amp)), _density(density), _amp(amp), _densmul(th.rate.invSampleRate)
 	{
+		r.init(th.rgen.trand());
 	}
     
 	virtual const char* TypeName() const override { return "Velvet"; }
 	
 	virtual void pull(Thread& th) override {
-		RGen& r = th.rgen;
 		int framesToFill = mBlockSize;
 		Z* out = mOut->fulfillz(framesToFill);
+		bool hits = false;
 		while (framesToFill) {
 			int n = framesToFill;
 			int densityStride, ampStride;
@@ -3143,7 +3161,9 @@ struct Velvet : Gen
 					Z thresh = *density * _densmul;
 					Z thresh2 = .5 * thresh;
 					Z z = r.drand();
-					out[i] = z < thresh ? (z<thresh2 ? -*amp : *amp) : 0.;
+					bool hit = z < thresh;
+					out[i] = hit ? (z<thresh2 ? -*amp : *amp) : 0.;
+					hits |= hit;
 					density += densityStride;
 					amp += ampStride;
 				}
@@ -3153,6 +3173,7 @@ struct Velvet : Gen
 				out += n;
 			}
 		}
+		if (!hits) mOut->mArray->setSilent();
 		produce(framesToFill);
 	}
 };
@@ -15,6 +15,8 @@
 #endif
 
 #include "sapf/AudioBackend.hpp"
+#include "Snapshot.hpp"
+#include "Profiler.hpp"
 
 extern void AddCoreOps();
 extern void AddMathOps();
@@ -72,12 +74,28 @@ void SapfEngine::configure(const SapfEngineConfig& config)
 	if (config.sampleRate > 0.) {
 		vm.setSampleRate(config.sampleRate);
 	}
+	if (config.blockSize > 0) {
+		vm.setBlockSize(config.blockSize);
+		vm.fixedBlockSize = true;
+	}
 	if (config.preludeFile) {
 		vm.prelude_file = config.preludeFile;
 	}
 	if (config.logFile) {
 		vm.log_file = config.logFile;
 	}
+	if (config.maxCallDepth > 0) {
+		vm.maxCallDepth = config.maxCallDepth;
+	}
+	if (config.codeCacheDir) {
+		vm.code_cache_dir = config.codeCacheDir;
+	}
+	if (config.profile || config.profileFile) {
+		vm.profileon = true;
+	}
+	if (config.poolPrefill > 0) {
+		vm.poolPrefill = config.poolPrefill;
+	}
 }
 
 void SapfEngine::initialize()
@@ -85,8 +103,15 @@ void SapfEngine::initialize()
 	if (initialized_) {
 		return;
 	}
+	if (config_.snapshotFile) {
+		// mapped before the builtins are registered so that they can take their tables from it.
+		openSnapshot(config_.snapshotFile);
+	}
 	registerBuiltins();
 	configureLogFile();
+	if (!vm.code_cache_dir) {
+		vm.code_cache_dir = getenv("SAPF_CODE_CACHE");
+	}
 	EnsureDefaultAudioBackend();
 	initialized_ = true;
 }
@@ -149,14 +174,44 @@ void SapfEngine::startMantaEventLoop() const
 #endif // SAPF_USE_MANTA
 }
 
+static uint64_t hashPreludeFile(const char* filename)
+{
+	uint64_t hash = snapshotHash(nullptr, 0);
+	if (!filename) return hash;
+	FILE* f = fopen(filename, "rb");
+	if (!f) return hash;
+	char buf[16384];
+	size_t n;
+	while ((n = fread(buf, 1, sizeof(buf), f)) > 0) {
+		hash = snapshotHash(buf, n, hash);
+	}
+	fclose(f);
+	return hash;
+}
+
 void SapfEngine::loadPrelude(Thread& th) const
 {
 	if (!vm.prelude_file) {
 		vm.prelude_file = getenv("SAPF_PRELUDE");
 	}
-	if (vm.prelude_file) {
-		loadFile(th, vm.prelude_file);
+	if (!config_.snapshotFile) {
+		if (vm.prelude_file) {
+			loadFile(th, vm.prelude_file);
+		}
+		return;
+	}
+
+	uint64_t preludeHash = hashPreludeFile(vm.prelude_file);
+	if (loadSnapshotWorkspace(th, preludeHash)) {
+		post("loaded snapshot '%s'\n", config_.snapshotFile);
+	} else {
+		size_t udfHelpStart = vm.udfHelp.size();
+		bool loaded = !vm.prelude_file || loadFile(th, vm.prelude_file);
+		if (loaded && writeSnapshot(th, config_.snapshotFile, preludeHash, udfHelpStart)) {
+			post("wrote snapshot '%s'\n", config_.snapshotFile);
+		}
 	}
+	closeSnapshot();
 }
 
 const char* SapfEngine::versionString() const
@@ -164,6 +219,18 @@ const char* SapfEngine::versionString() const
 	return gVersionString;
 }
 
+// reports the profile collected since start when profiling was configured.
+void SapfEngine::finishProfile(Thread& th) const
+{
+	if (config_.profileFile) {
+		if (profileWriteJSON(th, config_.profileFile)) {
+			post("wrote profile '%s'\n", config_.profileFile);
+		}
+	} else if (config_.profile) {
+		profileReport(th);
+	}
+}
+
 const char* SapfEngine::logFile() const
 {
 	return vm.log_file;
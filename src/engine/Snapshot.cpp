@@ -0,0 +1,864 @@
+//    SAPF - Sound As Pure Form
+//    Copyright (C) 2019 James McCartney
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "Snapshot.hpp"
+#include "Opcode.hpp"
+#include "symbol.hpp"
+#include "ErrorCodes.hpp"
+#include "sapf/Engine.hpp"
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <unordered_set>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#else
+#include <direct.h>
+#endif
+
+// Two kinds of image share the value format below: startup snapshots and the entries
+// of the compiled code cache. all integers are native-endian.
+//
+// snapshot
+//   header    magic, format version, byte order mark, sizeof(V), kNumOpcodes,
+//             sapf version, builtins hash, prelude hash
+//   signals   count, then (name, size, samples) for each packed signal in the builtins
+//   workspace help lines, the root GForm, then the contents of every GForm in the
+//             order they were first referenced, then an end mark.
+//
+// code cache entry
+//   header    as above, with the hash of the source text in place of the prelude hash
+//   source    text length, whether the optimizer was on
+//   names     count, then (name, in workspace) for each ExternalName of the code
+//   code      the compiled top level Fun, GForm contents, end mark.
+//             the workspace the code was compiled in is written as snapWorkspace and
+//             read back as the workspace of the loading thread.
+//
+// Values are written depth first. Each object record gets the next id when it ends,
+// and later references to the same object are written as that id. GForms are the
+// only objects that can be reached from their own contents (through the workspace of
+// the Funs bound in them), so a GForm record is empty and its contents are written
+// after the root value, which keeps every other record free of cycles.
+
+enum {
+	snapReal,
+	snapRef,
+	snapBuiltin,
+	snapNilV,
+	snapNilZ,
+	snapSymbol,
+	snapString,
+	snapList,
+	snapTableMap,
+	snapTable,
+	snapForm,
+	snapGForm,
+	snapCode,
+	snapFunDef,
+	snapFun,
+	snapWorkspace
+};
+
+static const char kSnapshotMagic[8] = { 'S', 'A', 'P', 'F', 'S', 'N', 'A', 'P' };
+static const char kCodeCacheMagic[8] = { 'S', 'A', 'P', 'F', 'C', 'O', 'D', 'E' };
+const uint32_t kSnapshotByteOrder = 0x01020304;
+const uint32_t kSnapshotEndMark = 0x454e4421;
+
+uint64_t snapshotHash(const char* data, size_t size, uint64_t hash)
+{
+	// FNV-1a
+	for (size_t i = 0; i < size; ++i) {
+		hash ^= (uint8_t)data[i];
+		hash *= 1099511628211ULL;
+	}
+	return hash;
+}
+
+static uint64_t builtinsHash()
+{
+	uint64_t hash = snapshotHash(nullptr, 0);
+	for (P<TreeNode> const& node : vm.builtins->sorted()) {
+		String* name = (String*)node->mKey.o();
+		hash = snapshotHash(name->s, strlen(name->s) + 1, hash);
+	}
+	return hash;
+}
+
+#pragma mark WRITING
+
+class SnapshotWriter
+{
+public:
+	std::string out;
+
+	SnapshotWriter(GForm* inAmbient = nullptr, bool inQuiet = false) : mAmbient(inAmbient), mQuiet(inQuiet)
+	{
+		for (P<TreeNode> const& node : vm.builtins->sorted()) {
+			if (node->mValue.isObject())
+				mBuiltinNames.emplace(node->mValue.o(), (String*)node->mKey.o());
+		}
+	}
+
+	template <typename T>
+	void put(T x) { out.append((const char*)&x, sizeof(T)); }
+
+	void putString(const char* s)
+	{
+		uint32_t n = (uint32_t)strlen(s);
+		put(n);
+		out.append(s, n);
+	}
+
+	void putHeader(const char* magic, uint64_t key)
+	{
+		out.append(magic, 8);
+		put<uint32_t>(kSnapshotVersion);
+		put<uint32_t>(kSnapshotByteOrder);
+		put<uint32_t>(sizeof(V));
+		put<uint32_t>(kNumOpcodes);
+		putString(SapfGetVersionString());
+		put<uint64_t>(builtinsHash());
+		put<uint64_t>(key);
+	}
+
+	void putValue(Arg v)
+	{
+		if (v.isReal()) {
+			put<uint8_t>(snapReal);
+			put<int64_t>(v.i);
+		} else {
+			putObject(v.o());
+		}
+	}
+
+	void putForms()
+	{
+		// mForms grows as the contents of earlier forms are written.
+		for (size_t i = 0; i < mForms.size(); ++i) {
+			GForm* form = mForms[i];
+			putValue(V(form->mNextForm));
+			std::vector<P<TreeNode> > nodes = form->mTable->sorted();
+			put<uint32_t>((uint32_t)nodes.size());
+			for (P<TreeNode> const& node : nodes) {
+				putValue(node->mKey);
+				putValue(node->mValue);
+			}
+		}
+	}
+
+private:
+	GForm* mAmbient;
+	bool mQuiet;
+	std::unordered_map<Object*, uint32_t> mIds;
+	std::unordered_map<Object*, String*> mBuiltinNames;
+	std::unordered_set<Object*> mWriting;
+	std::vector<GForm*> mForms;
+
+	void begin(int tag, Object* o)
+	{
+		put<uint8_t>(tag);
+		put<uint8_t>(o->flags);
+	}
+
+	void putArray(Array* a)
+	{
+		put<int64_t>(a->size());
+		if (a->isF()) {
+			// saved widened, like pack would.
+			for (int64_t i = 0; i < a->size(); ++i)
+				put<Z>(a->_atz(i));
+		} else if (a->isZ()) {
+			out.append((const char*)a->z(), a->size() * sizeof(Z));
+		} else {
+			for (int64_t i = 0; i < a->size(); ++i)
+				putValue(a->v()[i]);
+		}
+	}
+
+	void putObject(Object* o);
+};
+
+void SnapshotWriter::putObject(Object* o)
+{
+	auto found = mIds.find(o);
+	if (found != mIds.end()) {
+		put<uint8_t>(snapRef);
+		put<uint32_t>(found->second);
+		return;
+	}
+
+	auto builtin = mBuiltinNames.find(o);
+	if (o == vm._nilv()) {
+		put<uint8_t>(snapNilV);
+	} else if (o == vm._nilz()) {
+		put<uint8_t>(snapNilZ);
+	} else if (o == mAmbient) {
+		put<uint8_t>(snapWorkspace);
+	} else if (builtin != mBuiltinNames.end()) {
+		put<uint8_t>(snapBuiltin);
+		putString(builtin->second->s);
+	} else {
+		if (!mWriting.insert(o).second) {
+			if (!mQuiet) post("snapshot : a %s refers to itself.\n", o->TypeName());
+			throw errWrongType;
+		}
+
+		Code* code;
+		FunDef* def;
+		if (o->isString()) {
+			String* s = (String*)o;
+			begin(isSymbol(s) ? snapSymbol : snapString, o);
+			putString(s->s);
+		} else if (o->isGForm()) {
+			begin(snapGForm, o);
+			mForms.push_back((GForm*)o);
+		} else if (o->isList()) {
+			List* list = (List*)o;
+			std::vector<Array*> segments;
+			for (List* l = list; l; l = l->nextp()) {
+				if (l->isThunk() || !l->isFilled()) {
+					if (!mQuiet) post("snapshot : can't save a list that has not been fully evaluated.\n");
+					throw errIndefiniteOperation;
+				}
+				segments.push_back(l->mArray());
+			}
+			begin(snapList, o);
+			put<uint8_t>(list->ItemType());
+			put<uint32_t>((uint32_t)segments.size());
+			for (Array* a : segments)
+				putArray(a);
+		} else if (o->isTableMap()) {
+			TableMap* map = (TableMap*)o;
+			begin(snapTableMap, o);
+			put<uint64_t>(map->mSize);
+			for (size_t i = 0; i < map->mSize; ++i)
+				putValue(map->mKeys[i]);
+		} else if (o->isTable()) {
+			Table* table = (Table*)o;
+			begin(snapTable, o);
+			putValue(V(table->mMap));
+			for (size_t i = 0; i < table->mMap->mSize; ++i)
+				putValue(table->mValues[i]);
+		} else if (o->isForm()) {
+			Form* form = (Form*)o;
+			begin(snapForm, o);
+			putValue(V(form->mTable));
+			putValue(V(form->mNextForm));
+		} else if ((code = dynamic_cast<Code*>(o))) {
+			begin(snapCode, o);
+			put<uint32_t>((uint32_t)code->ops.size());
+			for (Opcode& opc : code->ops) {
+				put<int32_t>(opc.op);
+				// an object operand's integer half holds the inline cache, which is
+				// reallocated on loading.
+				putValue(opc.v);
+			}
+		} else if ((def = dynamic_cast<FunDef*>(o))) {
+			begin(snapFunDef, o);
+			putValue(V(def->mCode));
+			put<uint16_t>(def->mNumArgs);
+			put<uint16_t>(def->mNumLocals);
+			put<uint16_t>(def->mNumVars);
+			put<uint16_t>(def->mLeaves);
+			put<uint32_t>((uint32_t)def->mArgNames.size());
+			for (P<String> const& name : def->mArgNames)
+				putValue(V(name));
+			putValue(V(def->mWorkspace));
+			putValue(V(def->mHelp));
+		} else if (o->isFun()) {
+			Fun* fun = (Fun*)o;
+			begin(snapFun, o);
+			putValue(V(fun->mDef));
+			put<uint32_t>((uint32_t)fun->mVars.size());
+			for (Arg v : fun->mVars)
+				putValue(v);
+			putValue(V(fun->mWorkspace));
+		} else {
+			if (!mQuiet) post("snapshot : can't save a %s.\n", o->TypeName());
+			throw errWrongType;
+		}
+		mWriting.erase(o);
+	}
+	uint32_t id = (uint32_t)mIds.size();
+	mIds.emplace(o, id);
+}
+
+// writes beside the image and renames it into place, so that other processes
+// starting at the same time never map a partly written file.
+static bool writeImageFile(const char* path, std::string const& data)
+{
+	char tempPath[PATH_MAX];
+	snprintf(tempPath, PATH_MAX, "%s.%llx.tmp", path, (unsigned long long)timeseed());
+	FILE* f = fopen(tempPath, "wb");
+	if (!f) return false;
+	bool ok = fwrite(data.data(), 1, data.size(), f) == data.size();
+	ok = fclose(f) == 0 && ok;
+#ifdef _WIN32
+	if (ok) remove(path);
+#endif
+	if (!ok || rename(tempPath, path) != 0) {
+		remove(tempPath);
+		return false;
+	}
+	return true;
+}
+
+bool writeSnapshot(Thread& th, const char* path, uint64_t preludeHash, size_t udfHelpStart)
+{
+	SnapshotWriter w;
+	try {
+		w.putHeader(kSnapshotMagic, preludeHash);
+
+		std::vector<P<TreeNode> > signals;
+		for (P<TreeNode> const& node : vm.builtins->sorted()) {
+			V value = node->mValue;
+			if (value.isZList() && ((List*)value.o())->isPackedWide())
+				signals.push_back(node);
+		}
+		w.put<uint32_t>((uint32_t)signals.size());
+		for (P<TreeNode> const& node : signals) {
+			Array* a = ((List*)node->mValue.o())->mArray();
+			w.putString(((String*)node->mKey.o())->s);
+			w.put<int64_t>(a->size());
+			w.out.append((const char*)a->z(), a->size() * sizeof(Z));
+		}
+
+		size_t udfHelpEnd = vm.udfHelp.size();
+		w.put<uint32_t>((uint32_t)(udfHelpEnd - udfHelpStart));
+		for (size_t i = udfHelpStart; i < udfHelpEnd; ++i)
+			w.putString(vm.udfHelp[i].c_str());
+
+		w.putValue(V(th.mWorkspace));
+		w.putForms();
+		w.put<uint32_t>(kSnapshotEndMark);
+	} catch (int err) {
+		post("could not write snapshot '%s'\n", path);
+		return false;
+	}
+
+	if (!writeImageFile(path, w.out)) {
+		post("could not write snapshot '%s'\n", path);
+		return false;
+	}
+	return true;
+}
+
+#pragma mark READING
+
+struct SnapshotSignal
+{
+	std::string mName;
+	int64_t mSize;
+	const uint8_t* mData;
+};
+
+class MappedFile
+{
+public:
+	const uint8_t* mBase = nullptr;
+	size_t mSize = 0;
+
+	MappedFile() {}
+	MappedFile(MappedFile const&) = delete;
+	MappedFile& operator=(MappedFile const&) = delete;
+	~MappedFile() { unmap(); }
+
+	const uint8_t* end() const { return mBase + mSize; }
+
+	bool map(const char* path);
+	void unmap();
+};
+
+bool MappedFile::map(const char* path)
+{
+	unmap();
+#ifdef _WIN32
+	FILE* f = fopen(path, "rb");
+	if (!f) return false;
+	fseek(f, 0, SEEK_END);
+	long size = ftell(f);
+	fseek(f, 0, SEEK_SET);
+	uint8_t* data = size > 0 ? (uint8_t*)malloc(size) : nullptr;
+	bool ok = data && fread(data, 1, size, f) == (size_t)size;
+	fclose(f);
+	if (!ok) {
+		free(data);
+		return false;
+	}
+	mBase = data;
+	mSize = size;
+#else
+	int fd = open(path, O_RDONLY);
+	if (fd < 0) return false;
+	struct stat st;
+	if (fstat(fd, &st) != 0 || st.st_size == 0) {
+		close(fd);
+		return false;
+	}
+	void* data = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (data == MAP_FAILED) return false;
+	mBase = (const uint8_t*)data;
+	mSize = st.st_size;
+#endif
+	return true;
+}
+
+void MappedFile::unmap()
+{
+	if (mBase) {
+#ifdef _WIN32
+		free((void*)mBase);
+#else
+		munmap((void*)mBase, mSize);
+#endif
+	}
+	mBase = nullptr;
+	mSize = 0;
+}
+
+struct SnapshotImage
+{
+	MappedFile mFile;
+	uint64_t mBuiltinsHash = 0;
+	uint64_t mPreludeHash = 0;
+	std::vector<SnapshotSignal> mSignals;
+	const uint8_t* mWorkspace = nullptr;
+};
+
+static SnapshotImage gSnapshot;
+
+class SnapshotReader
+{
+public:
+	SnapshotReader(Thread& inThread, const uint8_t* begin, const uint8_t* end, P<GForm> const& inAmbient = nullptr)
+		: th(inThread), p(begin), mEnd(end), mAmbient(inAmbient) {}
+
+	const uint8_t* position() const { return p; }
+
+	template <typename T>
+	T get()
+	{
+		need(sizeof(T));
+		T x;
+		memcpy(&x, p, sizeof(T));
+		p += sizeof(T);
+		return x;
+	}
+
+	std::string getString()
+	{
+		uint32_t n = get<uint32_t>();
+		need(n);
+		std::string s((const char*)p, n);
+		p += n;
+		return s;
+	}
+
+	const uint8_t* skip(size_t n)
+	{
+		need(n);
+		const uint8_t* q = p;
+		p += n;
+		return q;
+	}
+
+	V getValue();
+
+	template <typename T>
+	P<T> getObject()
+	{
+		V v = getValue();
+		if (v.isReal()) return nullptr;
+		T* o = dynamic_cast<T*>(v.o());
+		if (!o) throw errWrongType;
+		return o;
+	}
+
+	void getForms()
+	{
+		for (size_t i = 0; i < mForms.size(); ++i) {
+			P<GForm> form = mForms[i];
+			form->mNextForm = getObject<GForm>();
+			uint32_t n = get<uint32_t>();
+			for (uint32_t j = 0; j < n; ++j) {
+				V key = getValue();
+				V value = getValue();
+				form->mTable->putImpure(key, value);
+			}
+		}
+	}
+
+	// reads the header written by SnapshotWriter::putHeader. false if another build wrote it.
+	bool getHeader(const char* magic, uint64_t& outBuiltinsHash, uint64_t& outKey)
+	{
+		if (memcmp(skip(8), magic, 8) != 0
+			|| get<uint32_t>() != kSnapshotVersion
+			|| get<uint32_t>() != kSnapshotByteOrder
+			|| get<uint32_t>() != sizeof(V)
+			|| get<uint32_t>() != kNumOpcodes
+			|| getString() != SapfGetVersionString())
+			return false;
+		outBuiltinsHash = get<uint64_t>();
+		outKey = get<uint64_t>();
+		return true;
+	}
+
+private:
+	Thread& th;
+	const uint8_t* p;
+	const uint8_t* mEnd;
+	P<GForm> mAmbient;
+	std::vector<V> mObjects;
+	std::vector<P<GForm> > mForms;
+
+	void need(size_t n)
+	{
+		if ((size_t)(mEnd - p) < n) throw errFailed;
+	}
+
+	P<Array> getArray(int itemType)
+	{
+		int64_t n = get<int64_t>();
+		if (n < 0) throw errFailed;
+		P<Array> a = new Array(itemType, n);
+		if (itemType == itemTypeZ) {
+			memcpy(a->z(), skip(n * sizeof(Z)), n * sizeof(Z));
+			a->setSize(n);
+		} else {
+			for (int64_t i = 0; i < n; ++i)
+				a->add(getValue());
+		}
+		return a;
+	}
+
+	V getRecord(int tag);
+};
+
+V SnapshotReader::getValue()
+{
+	int tag = get<uint8_t>();
+	V v;
+	switch (tag) {
+		case snapReal :
+			v.i = get<int64_t>();
+			return v;
+		case snapRef : {
+			uint32_t id = get<uint32_t>();
+			if (id >= mObjects.size()) throw errFailed;
+			return mObjects[id];
+		}
+		case snapBuiltin : {
+			std::string name = getString();
+			if (!vm.builtins->getInner(V(getsym(name.c_str())), v) || !v.isObject()) {
+				post("snapshot : builtin '%s' not found.\n", name.c_str());
+				throw errNotFound;
+			}
+		} break;
+		case snapNilV :
+			v = vm._nilv;
+			break;
+		case snapNilZ :
+			v = vm._nilz;
+			break;
+		case snapWorkspace :
+			if (!mAmbient) throw errFailed;
+			v = mAmbient;
+			break;
+		default : {
+			uint8_t flags = get<uint8_t>();
+			v = getRecord(tag);
+			v.o()->flags = flags;
+		} break;
+	}
+	mObjects.push_back(v);
+	return v;
+}
+
+V SnapshotReader::getRecord(int tag)
+{
+	switch (tag) {
+		case snapSymbol :
+			return getsym(getString().c_str());
+		case snapString :
+			return new String(getString().c_str());
+		case snapGForm : {
+			P<GForm> form = new GForm();
+			mForms.push_back(form);
+			return form;
+		}
+		case snapList : {
+			int itemType = get<uint8_t>();
+			if (itemType != itemTypeV && itemType != itemTypeZ) throw errFailed;
+			uint32_t numSegments = get<uint32_t>();
+			if (numSegments == 0) throw errFailed;
+			std::vector<P<Array> > segments;
+			for (uint32_t i = 0; i < numSegments; ++i)
+				segments.push_back(getArray(itemType));
+			P<List> list;
+			for (size_t i = numSegments; i-- > 0; )
+				list = new List(segments[i], list);
+			return list;
+		}
+		case snapTableMap : {
+			uint64_t n = get<uint64_t>();
+			P<TableMap> map = new TableMap(n);
+			for (uint64_t i = 0; i < n; ++i) {
+				V key = getValue();
+				map->put(i, key, key.Hash());
+			}
+			return map;
+		}
+		case snapTable : {
+			P<TableMap> map = getObject<TableMap>();
+			if (!map) throw errFailed;
+			P<Table> table = new Table(map);
+			for (size_t i = 0; i < map->mSize; ++i)
+				table->put(i, getValue());
+			return table;
+		}
+		case snapForm : {
+			P<Table> table = getObject<Table>();
+			P<Form> next = getObject<Form>();
+			return new Form(table, next);
+		}
+		case snapCode : {
+			uint32_t n = get<uint32_t>();
+			P<Code> code = new Code(n);
+			for (uint32_t i = 0; i < n; ++i) {
+				int op = get<int32_t>();
+				if (op <= BAD_OPCODE || op >= kNumOpcodes) throw errFailed;
+				code->add(op, getValue());
+			}
+			code->allocInlineCaches();
+			return code;
+		}
+		case snapFunDef : {
+			P<Code> code = getObject<Code>();
+			if (!code) throw errFailed;
+			uint16_t numArgs = get<uint16_t>();
+			uint16_t numLocals = get<uint16_t>();
+			uint16_t numVars = get<uint16_t>();
+			uint16_t leaves = get<uint16_t>();
+			std::vector<P<String> > argNames;
+			uint32_t n = get<uint32_t>();
+			for (uint32_t i = 0; i < n; ++i)
+				argNames.push_back(getObject<String>());
+			P<GForm> workspace = getObject<GForm>();
+			P<String> help = getObject<String>();
+			P<FunDef> def = new FunDef(th, code, numArgs, numLocals, numVars, help);
+			def->mLeaves = leaves;
+			def->mArgNames = argNames;
+			def->mWorkspace = workspace;
+			return def;
+		}
+		case snapFun : {
+			P<FunDef> def = getObject<FunDef>();
+			if (!def) throw errFailed;
+			uint32_t n = get<uint32_t>();
+			if (n != def->mNumVars) throw errFailed;
+			std::vector<V> vars;
+			for (uint32_t i = 0; i < n; ++i)
+				vars.push_back(getValue());
+			for (Arg v : vars)
+				th.push(v);
+			P<Fun> fun = new Fun(th, def());
+			fun->mWorkspace = getObject<GForm>();
+			return fun;
+		}
+	}
+	throw errFailed;
+}
+
+void closeSnapshot()
+{
+	gSnapshot.mFile.unmap();
+	gSnapshot.mBuiltinsHash = 0;
+	gSnapshot.mPreludeHash = 0;
+	gSnapshot.mSignals.clear();
+	gSnapshot.mWorkspace = nullptr;
+}
+
+bool openSnapshot(const char* path)
+{
+	closeSnapshot();
+	if (!gSnapshot.mFile.map(path)) return false;
+
+	Thread th;
+	SnapshotReader r(th, gSnapshot.mFile.mBase, gSnapshot.mFile.end());
+	try {
+		if (!r.getHeader(kSnapshotMagic, gSnapshot.mBuiltinsHash, gSnapshot.mPreludeHash)) {
+			closeSnapshot();
+			return false;
+		}
+
+		uint32_t numSignals = r.get<uint32_t>();
+		for (uint32_t i = 0; i < numSignals; ++i) {
+			SnapshotSignal signal;
+			signal.mName = r.getString();
+			signal.mSize = r.get<int64_t>();
+			if (signal.mSize < 0) throw errFailed;
+			signal.mData = r.skip(signal.mSize * sizeof(Z));
+			gSnapshot.mSignals.push_back(signal);
+		}
+		gSnapshot.mWorkspace = r.position();
+	} catch (int err) {
+		closeSnapshot();
+		return false;
+	}
+	return true;
+}
+
+P<List> snapshotBuiltinSignal(const char* name, int64_t size)
+{
+	for (SnapshotSignal const& signal : gSnapshot.mSignals) {
+		if (signal.mName == name && signal.mSize == size) {
+			P<List> list = new List(itemTypeZ, size);
+			memcpy(list->mArray->z(), signal.mData, size * sizeof(Z));
+			list->mArray->setSize(size);
+			return list;
+		}
+	}
+	return nullptr;
+}
+
+bool loadSnapshotWorkspace(Thread& th, uint64_t preludeHash)
+{
+	if (!gSnapshot.mWorkspace || gSnapshot.mPreludeHash != preludeHash || gSnapshot.mBuiltinsHash != builtinsHash())
+		return false;
+
+	SnapshotReader r(th, gSnapshot.mWorkspace, gSnapshot.mFile.end());
+	try {
+		std::vector<std::string> helpLines;
+		uint32_t numHelpLines = r.get<uint32_t>();
+		for (uint32_t i = 0; i < numHelpLines; ++i)
+			helpLines.push_back(r.getString());
+
+		P<GForm> workspace = r.getObject<GForm>();
+		if (!workspace) throw errFailed;
+		r.getForms();
+		if (r.get<uint32_t>() != kSnapshotEndMark) throw errFailed;
+
+		th.mWorkspace = workspace;
+		for (std::string const& line : helpLines)
+			vm.addUdfHelp(line);
+	} catch (int err) {
+		return false;
+	}
+	return true;
+}
+
+#pragma mark CODE CACHE
+
+static void codeCachePath(const char* dir, uint64_t textHash, char* outPath)
+{
+	snprintf(outPath, PATH_MAX, "%s/%016llx.sapfc", dir, (unsigned long long)textHash);
+}
+
+bool loadCachedCode(Thread& th, const char* text, P<Fun>& outFun)
+{
+	if (!vm.code_cache_dir) return false;
+
+	size_t textSize = strlen(text);
+	uint64_t textHash = snapshotHash(text, textSize);
+	char path[PATH_MAX];
+	codeCachePath(vm.code_cache_dir, textHash, path);
+
+	MappedFile file;
+	if (!file.map(path)) {
+		++vm.codeCacheMisses;
+		return false;
+	}
+
+	SnapshotReader r(th, file.mBase, file.end(), th.mWorkspace);
+	try {
+		uint64_t entryBuiltinsHash, entryTextHash;
+		if (!r.getHeader(kCodeCacheMagic, entryBuiltinsHash, entryTextHash)
+			|| entryBuiltinsHash != builtinsHash()
+			|| entryTextHash != textHash
+			|| r.get<uint64_t>() != textSize
+			|| r.get<uint8_t>() != (uint8_t)vm.optimizeon)
+			throw errFailed;
+
+		// the code is only valid if every name it took from outside still resolves
+		// the same way: a builtin that is now shadowed by a workspace variable, or
+		// a workspace variable that no longer exists, would compile differently.
+		uint32_t numNames = r.get<uint32_t>();
+		for (uint32_t i = 0; i < numNames; ++i) {
+			std::string name = r.getString();
+			bool inWorkspace = r.get<uint8_t>() != 0;
+			V value;
+			if (th.mWorkspace->get(th, V(getsym(name.c_str())), value) != inWorkspace)
+				throw errFailed;
+		}
+
+		P<Fun> fun = r.getObject<Fun>();
+		if (!fun) throw errFailed;
+		r.getForms();
+		if (r.get<uint32_t>() != kSnapshotEndMark) throw errFailed;
+		outFun = fun;
+	} catch (int err) {
+		++vm.codeCacheStale;
+		return false;
+	}
+	++vm.codeCacheHits;
+	return true;
+}
+
+void saveCachedCode(Thread& th, const char* text, P<Fun> const& fun, std::vector<ExternalName> const& names)
+{
+	if (!vm.code_cache_dir) return;
+
+	size_t textSize = strlen(text);
+	uint64_t textHash = snapshotHash(text, textSize);
+
+	SnapshotWriter w(th.mWorkspace(), true);
+	try {
+		w.putHeader(kCodeCacheMagic, textHash);
+		w.put<uint64_t>(textSize);
+		w.put<uint8_t>(vm.optimizeon);
+		w.put<uint32_t>((uint32_t)names.size());
+		for (ExternalName const& name : names) {
+			w.putString(name.mName->s);
+			w.put<uint8_t>(name.mInWorkspace);
+		}
+		w.putValue(fun);
+		w.putForms();
+		w.put<uint32_t>(kSnapshotEndMark);
+	} catch (int err) {
+		// code holding values that have no image form, e.g. a list made by a prim
+		// during parsing, is just not cached.
+		return;
+	}
+
+#ifdef _WIN32
+	_mkdir(vm.code_cache_dir);
+#else
+	mkdir(vm.code_cache_dir, 0777);
+#endif
+	char path[PATH_MAX];
+	codeCachePath(vm.code_cache_dir, textHash, path);
+	if (writeImageFile(path, w.out))
+		++vm.codeCacheWrites;
+}
@@ -15,6 +15,7 @@
 //    along with this program.  If not, see <https://www.gnu.org/licenses/>.
 
 #include "SoundFiles.hpp"
+#include "UGen.hpp"
 #include <valarray>
 #include <atomic>
 #include <filesystem>
@@ -46,6 +47,7 @@ class SFReader : public Object
 	ExtAudioFileRef mXAF;
 	int64_t mFramesRemaining;
 	SFReaderOutputChannel* mOutputs;
+	friend class SFReaderOutputChannel;
 	int mNumChannels;
 	AudioBufferList* mABL;
 	bool mFinished = false;
@@ -56,6 +58,8 @@ public:
 
 	~SFReader();
 
+	SpinLockType mPullLock = SPINLOCK_INIT; // see SiblingOut
+
 	virtual const char* TypeName() const override { return "SFReader"; }
 
 	P<List> createOutputs(Thread& th);
@@ -65,16 +69,15 @@ public:
 	void produceOutputs(int shrinkBy);
 };
 
-class SFReaderOutputChannel : public Gen
+class SFReaderOutputChannel : public SiblingOut
 {
 	friend class SFReader;
 	P<SFReader> mSFReader;
-	SFReaderOutputChannel* mNextOutput = nullptr;
 	Z* mDummy = nullptr;
 
 public:
 	SFReaderOutputChannel(Thread& th, SFReader* inSFReader)
-        : Gen(th, itemTypeZ, true), mSFReader(inSFReader)
+        : SiblingOut(th, true), mSFReader(inSFReader)
 	{
 	}
 
@@ -91,9 +94,11 @@ public:
 
 	virtual const char* TypeName() const override { return "SFReaderOutputChannel"; }
 
+	SFReaderOutputChannel* nextOutput() const { return static_cast<SFReaderOutputChannel*>(mNextSibling); }
+
 	virtual void pull(Thread& th) override
 	{
-		if (mSFReader->pull(th)) {
+		if (pullShared(th, mSFReader(), mSFReader->mOutputs)) {
 			end();
 		}
 	}
@@ -111,7 +116,7 @@ SFReader::~SFReader()
 	ExtAudioFileDispose(mXAF); free(mABL);
 	SFReaderOutputChannel* output = mOutputs;
 	do {
-		SFReaderOutputChannel* next = output->mNextOutput;
+		SFReaderOutputChannel* next = output->nextOutput();
 		delete output;
 		output = next;
 	} while (output);
@@ -122,7 +127,7 @@ void SFReader::fulfillOutputs(int blockSize)
 	mABL->mNumberBuffers = mNumChannels;
 	SFReaderOutputChannel* output = mOutputs;
 	size_t bufSize = blockSize * sizeof(Z);
-	for (int i = 0; output; ++i, output = output->mNextOutput){
+	for (int i = 0; output; ++i, output = output->nextOutput()){
 		Z* out;
 		if (output->mOut)
 			out = output->mOut->fulfillz(blockSize);
@@ -146,7 +151,7 @@ void SFReader::produceOutputs(int shrinkBy)
 	do {
 		if (output->mOut)
 			output->produce(shrinkBy);
-		output = output->mNextOutput;
+		output = output->nextOutput();
 	} while (output);
 }
 
@@ -159,7 +164,7 @@ P<List> SFReader::createOutputs(Thread& th)
 	P<Array> a = s->mArray;
 	for (int i = 0; i < mNumChannels; ++i) {
         SFReaderOutputChannel* c = new SFReaderOutputChannel(th, this);
-        if (last) last->mNextOutput = c;
+        if (last) last->mNextSibling = c;
         else mOutputs = c;
         last = c;
 		a->add(new List(c));
@@ -425,14 +430,19 @@ class SFReader : public Object
 	SF_INFO mSFInfo;
 	int64_t mFramesRemaining;
 	SFReaderOutputChannel* mOutputs;
+	friend class SFReaderOutputChannel;
 	int mNumChannels;
 	std::vector<double> mInterleavedBuffer;
+	std::vector<float> mInterleavedFloats;
+	bool mFloat32; // the file's samples fit in a float, so the outputs store floats.
 	bool mFinished = false;
 
 public:
 	SFReader(SNDFILE* inSF, SF_INFO& inInfo, int64_t inDuration);
 	~SFReader();
 
+	SpinLockType mPullLock = SPINLOCK_INIT; // see SiblingOut
+
 	virtual const char* TypeName() const override { return "SFReader"; }
 
 	P<List> createOutputs(Thread& th);
@@ -441,17 +451,17 @@ public:
 	void produceOutputs(int shrinkBy);
 };
 
-class SFReaderOutputChannel : public Gen
+class SFReaderOutputChannel : public SiblingOut
 {
 	friend class SFReader;
 	P<SFReader> mSFReader;
-	SFReaderOutputChannel* mNextOutput = nullptr;
 	Z* mDummy = nullptr;
 	Z* mOutBuffer = nullptr;
+	float* mOutFloats = nullptr;
 
 public:
 	SFReaderOutputChannel(Thread& th, SFReader* inSFReader)
-		: Gen(th, itemTypeZ, true), mSFReader(inSFReader)
+		: SiblingOut(th, true), mSFReader(inSFReader)
 	{
 	}
 
@@ -468,16 +478,31 @@ public:
 
 	virtual const char* TypeName() const override { return "SFReaderOutputChannel"; }
 
+	SFReaderOutputChannel* nextOutput() const { return static_cast<SFReaderOutputChannel*>(mNextSibling); }
+
 	virtual void pull(Thread& th) override
 	{
-		if (mSFReader->pull(th)) {
+		if (pullShared(th, mSFReader(), mSFReader->mOutputs)) {
 			end();
 		}
 	}
 };
 
+// formats whose samples a float holds exactly.
+static bool sfFitsFloat32(int format)
+{
+	switch (format & SF_FORMAT_SUBMASK) {
+		case SF_FORMAT_DOUBLE :
+		case SF_FORMAT_PCM_32 :
+			return false;
+		default :
+			return true;
+	}
+}
+
 SFReader::SFReader(SNDFILE* inSF, SF_INFO& inInfo, int64_t inDuration)
-	: mSF(inSF), mSFInfo(inInfo), mNumChannels(inInfo.channels), mFramesRemaining(inDuration)
+	: mSF(inSF), mSFInfo(inInfo), mNumChannels(inInfo.channels), mFramesRemaining(inDuration),
+	  mFloat32(sfFitsFloat32(inInfo.format))
 {
 }
 
@@ -486,7 +511,7 @@ SFReader::~SFReader()
 	if (mSF) sf_close(mSF);
 	SFReaderOutputChannel* output = mOutputs;
 	while (output) {
-		SFReaderOutputChannel* next = output->mNextOutput;
+		SFReaderOutputChannel* next = output->nextOutput();
 		delete output;
 		output = next;
 	}
@@ -494,17 +519,21 @@ SFReader::~SFReader()
 
 void SFReader::fulfillOutputs(int blockSize)
 {
-	mInterleavedBuffer.resize(blockSize * mNumChannels);
+	if (mFloat32)
+		mInterleavedFloats.resize(blockSize * mNumChannels);
+	else
+		mInterleavedBuffer.resize(blockSize * mNumChannels);
 	SFReaderOutputChannel* output = mOutputs;
-	for (int i = 0; output; ++i, output = output->mNextOutput) {
-		if (output->mOut) {
-			output->mOutBuffer = output->mOut->fulfillz(blockSize);
+	for (int i = 0; output; ++i, output = output->nextOutput()) {
+		if (!output->mOut && !output->mDummy)
+			output->mDummy = (Z*)calloc(output->mBlockSize, sizeof(Z));
+		if (mFloat32) {
+			output->mOutFloats = output->mOut ? output->mOut->fulfillf(blockSize) : (float*)output->mDummy;
+			memset(output->mOutFloats, 0, blockSize * sizeof(float));
 		} else {
-			if (!output->mDummy)
-				output->mDummy = (Z*)calloc(output->mBlockSize, sizeof(Z));
-			output->mOutBuffer = output->mDummy;
+			output->mOutBuffer = output->mOut ? output->mOut->fulfillz(blockSize) : output->mDummy;
+			memset(output->mOutBuffer, 0, blockSize * sizeof(Z));
 		}
-		memset(output->mOutBuffer, 0, blockSize * sizeof(Z));
 	}
 }
 
@@ -514,7 +543,7 @@ void SFReader::produceOutputs(int shrinkBy)
 	while (output) {
 		if (output->mOut)
 			output->produce(shrinkBy);
-		output = output->mNextOutput;
+		output = output->nextOutput();
 	}
 }
 
@@ -526,7 +555,7 @@ P<List> SFReader::createOutputs(Thread& th)
 	P<Array> a = s->mArray;
 	for (int i = 0; i < mNumChannels; ++i) {
 		SFReaderOutputChannel* c = new SFReaderOutputChannel(th, this);
-		if (last) last->mNextOutput = c;
+		if (last) last->mNextSibling = c;
 		else mOutputs = c;
 		last = c;
 		a->add(new List(c));
@@ -551,17 +580,23 @@ bool SFReader::pull(Thread& th)
 	fulfillOutputs(blockSize);
 
 	// Read interleaved data from file
-	sf_count_t framesRead = sf_readf_double(mSF, mInterleavedBuffer.data(), blockSize);
+	sf_count_t framesRead = mFloat32
+		? sf_readf_float(mSF, mInterleavedFloats.data(), blockSize)
+		: sf_readf_double(mSF, mInterleavedBuffer.data(), blockSize);
 
 	if (framesRead == 0) {
 		mFinished = true;
 	}
 
 	// Deinterleave into output channels
-	for (sf_count_t frame = 0; frame < framesRead; ++frame) {
-		SFReaderOutputChannel* out = mOutputs;
-		for (int ch = 0; ch < mNumChannels && out; ++ch, out = out->mNextOutput) {
-			out->mOutBuffer[frame] = mInterleavedBuffer[frame * mNumChannels + ch];
+	SFReaderOutputChannel* out = mOutputs;
+	for (int ch = 0; ch < mNumChannels && out; ++ch, out = out->nextOutput()) {
+		if (mFloat32) {
+			for (sf_count_t frame = 0; frame < framesRead; ++frame)
+				out->mOutFloats[frame] = mInterleavedFloats[frame * mNumChannels + ch];
+		} else {
+			for (sf_count_t frame = 0; frame < framesRead; ++frame)
+				out->mOutBuffer[frame] = mInterleavedBuffer[frame * mNumChannels + ch];
 		}
 	}
 
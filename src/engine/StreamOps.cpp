@@ -1629,6 +1629,7 @@ struct Everz : public Gen
 		for (int i = 0; i < n; ++i) {
 			out[i] = z;
 		}
+		mOut->mArray->setConstant();
 		mOut = mOut->nextp();
 	}
 };
@@ -3227,6 +3228,7 @@ struct Silence : Gen
             Z* out = mOut->fulfillz(n);
 			memset(out, 0, n * sizeof(Z));
             _m -= n;
+			mOut->mArray->setSilent();
 			mOut = mOut->nextp();
         }
     }
@@ -3283,6 +3285,112 @@ static void rcyc_(Thread& th, Prim* prim)
 	th.push(new List(g));
 }
 
+// passes the blocks of a list through unchanged, and tells its WindowRef how many
+// items each block has so that it can drop the ones it no longer needs.
+class WindowGen : public Gen
+{
+	P<List> _a;
+	WindowRef* mRef; // cleared by the Ref when it lets go of this.
+	mutable SpinLockType mRefLock = SPINLOCK_INIT;
+
+public:
+	WindowGen(Thread& th, P<List> const& a, WindowRef* inRef)
+		: Gen(th, a->elemType, a->isFinite()), _a(a), mRef(inRef) {}
+
+	virtual const char* TypeName() const override { return "WindowGen"; }
+
+	void detach()
+	{
+		SpinLocker lock(mRefLock);
+		mRef = nullptr;
+	}
+
+	virtual void pull(Thread& th) override
+	{
+		_a->force(th);
+		if (_a->isEnd()) {
+			end();
+			return;
+		}
+		mOut->fulfill(_a->mArray);
+		int64_t n = _a->mArray->size();
+		_a = _a->next();
+		mOut = mOut->nextp();
+
+		O old = nullptr;
+		{
+			SpinLocker lock(mRefLock);
+			if (mRef) old = mRef->produced(this, n);
+		}
+		if (old) old->release();
+	}
+};
+
+WindowRef::WindowRef(Thread& th, Arg inV, int64_t inWindow)
+	: Ref(V(0.)), mWindow(std::max(inWindow, (int64_t)1))
+{
+	set(th, inV);
+}
+
+WindowRef::~WindowRef()
+{
+	if (mGen) mGen->detach();
+}
+
+void WindowRef::set(Thread& th, Arg inV)
+{
+	V value = inV;
+	P<WindowGen> gen;
+	if (inV.isList()) {
+		gen = new WindowGen(th, (List*)inV.o(), this);
+		value = new List(gen());
+	}
+
+	if (value.isObject()) value.o()->retain();
+	O oldval;
+	P<WindowGen> oldgen;
+	{
+		SpinLocker lock(mSpinLock);
+		oldval = o;
+		if (value.isObject()) {
+			o = value.o();
+		} else {
+			o = nullptr;
+			z = value.f;
+		}
+		oldgen = mGen;
+		mGen = gen;
+		mHeld = 0;
+	}
+	if (oldgen) oldgen->detach();
+	if (oldval) oldval->release();
+}
+
+O WindowRef::produced(WindowGen* inGen, int64_t n)
+{
+	SpinLocker lock(mSpinLock);
+	if (inGen != mGen()) return nullptr;
+	mHeld += n;
+	// every block from the head up to the one just produced is filled.
+	List* oldHead = (List*)o;
+	List* head = oldHead;
+	while (head->mArray && head->nextp() && mHeld - head->mArray->size() >= mWindow) {
+		mHeld -= head->mArray->size();
+		head = head->nextp();
+	}
+	if (head == oldHead) return nullptr;
+	head->retain();
+	o = head;
+	return oldHead;
+}
+
+static void wref_(Thread& th, Prim* prim)
+{
+	int64_t n = th.popInt("wref : n");
+	V list = th.pop();
+	th.push(new WindowRef(th, list, n));
+}
+
 
 static void ncyc_(Thread& th, Prim* prim)
 {
@@ -3448,7 +3556,8 @@ struct CatZ : Gen
 				}
 			}
 			for (int i = 0; i < n; ++i) {
-				out[i] = a[i];
+				out[i] = *a;
+				a += astride;
 			}
 			_a.advance(n);
 			framesToFill -= n;
@@ -3951,14 +4060,14 @@ static void skip_positive_(Thread& th, P<List>& list, int64_t n)
 		int64_t asize = a->size();
 		if (asize > n) {
 			int64_t remain = asize - n;
-			Array* a2 = new Array(list->elemType, remain);
+			Array* a2 = new Array(list->elemType, remain, a->isF());
 			a2->setSize(remain);
 			if (list->isVList()) {
 				for (int64_t i = 0, j = n; i < remain; ++i, ++j) {
 					a2->v()[i] = a->v()[j];
 				}
 			} else {
-				memcpy(a2->z(), a->z() + n, remain * a->elemSize());
+				memcpy(a2->data(), (char*)a->data() + n * a->elemSize(), remain * a->elemSize());
 			}
 			list = new List(a2, list->next());
 			return;
@@ -4586,7 +4695,7 @@ struct Hangz : Gen
 				goto ended;
 			mOut->fulfillz(_a->mArray);
 			if (_a->mArray->size()) {
-				_b = _a->mArray->z()[_a->mArray->size() - 1];
+				_b = _a->mArray->_atz(_a->mArray->size() - 1);
 			}
 			_a = _a->next();
 		} else {
@@ -4596,6 +4705,7 @@ ended:
 			for (int i = 0; i < mBlockSize; ++i) {
 				out[i] = _b;
 			}
+			mOut->mArray->setConstant();
 		}
 		mOut = mOut->nextp();
 	}
@@ -5684,6 +5794,105 @@ static void bench_(Thread& th, Prim* prim)
 	
 }
 
+// seconds of CPU per callback of a graph built with the given block size,
+// pulled by callbacks of the given number of frames the way RtAudioBackend::render does.
+static double benchCallbacks(Thread& th, V fun, int blockSize, int frames, int64_t totalFrames)
+{
+	V v;
+	{
+		SaveStack ss(th);
+		UseRate ur(th, Rate(th.rate.sampleRate, blockSize));
+		fun.apply(th);
+		v = th.pop();
+	}
+	if (!v.isList()) wrongType("benchbs : fun result", "List", v);
+
+	std::vector<ZIn> in;
+	if (v.isZList()) {
+		in.emplace_back(v);
+	} else {
+		if (!v.isFinite()) indefiniteOp("benchbs : fun result - indefinite number of channels", "");
+		P<List> s = ((List*)v.o())->pack(th, kMaxSFChannels);
+		if (!s()) throw errOutOfRange;
+		Array* a = s->mArray();
+		for (int64_t i = 0; i < a->size(); ++i)
+			in.emplace_back(a->at(i));
+	}
+	v = 0.;
+
+	int numChannels = (int)in.size();
+	std::vector<float> scratch(frames);
+	std::vector<float> mix((size_t)frames * numChannels);
+	int64_t callbacks = 0;
+	double t0 = elapsedTime();
+	for (int64_t framesDone = 0; framesDone < totalFrames; framesDone += frames) {
+		std::fill(mix.begin(), mix.end(), 0.f);
+		for (int ch = 0; ch < numChannels; ++ch) {
+			int n = frames;
+			in[ch].fill(th, n, scratch.data(), 1);
+			for (int i = 0; i < n; ++i)
+				mix[(size_t)i * numChannels + ch] += scratch[i];
+		}
+		++callbacks;
+	}
+	double t1 = elapsedTime();
+	return (t1 - t0) / (double)callbacks;
+}
+
+static void benchbs_(Thread& th, Prim* prim)
+{
+	Z seconds = th.popFloat("benchbs : seconds");
+	V fun = th.pop();
+
+	const int kDeviceFrames = 256;
+	int64_t totalFrames = std::max((int64_t)1, (int64_t)(seconds * th.rate.sampleRate));
+
+	post("benchbs: %g seconds of audio at each block size.\n", seconds);
+	post("  block  callback us  %% real time   us with %d frame callbacks\n", kDeviceFrames);
+	for (int blockSize = 64; blockSize <= 1024; blockSize *= 2) {
+		double aligned = benchCallbacks(th, fun, blockSize, blockSize, totalFrames);
+		double fixed = benchCallbacks(th, fun, blockSize, kDeviceFrames, totalFrames);
+		double percentOfRealtime = 100. * aligned * th.rate.sampleRate / blockSize;
+		post("  %5d  %11.2f  %11.2f   %11.2f\n", blockSize, 1e6 * aligned, percentOfRealtime, 1e6 * fixed);
+	}
+}
+
+static void benchkr_(Thread& th, Prim* prim)
+{
+	Z seconds = th.popFloat("benchkr : seconds");
+	int64_t period = th.popInt("benchkr : n");
+	V fun = th.pop();
+
+	if (period < 1 || period > kMaxZBlockSize) {
+		post("benchkr : n must be from 1 to %d\n", kMaxZBlockSize);
+		throw errOutOfRange;
+	}
+
+	int blockSize = th.rate.blockSize;
+	int64_t totalFrames = std::max((int64_t)1, (int64_t)(seconds * th.rate.sampleRate));
+
+	// the graph is built once with its parameters at audio rate, and once at control rate.
+	int saveAutokr = vm.autokr;
+	double audioRate, controlRate;
+	try {
+		vm.autokr = 0;
+		audioRate = benchCallbacks(th, fun, blockSize, blockSize, totalFrames);
+		vm.autokr = (int)period;
+		controlRate = benchCallbacks(th, fun, blockSize, blockSize, totalFrames);
+	} catch (...) {
+		vm.autokr = saveAutokr;
+		throw;
+	}
+	vm.autokr = saveAutokr;
+
+	double scale = 100. * th.rate.sampleRate / blockSize;
+	post("benchkr: %g seconds of audio, parameters read every %d frames.\n", seconds, (int)period);
+	post("                callback us  %% real time\n");
+	post("  audio rate    %11.2f  %11.2f\n", 1e6 * audioRate, scale * audioRate);
+	post("  control rate  %11.2f  %11.2f\n", 1e6 * controlRate, scale * controlRate);
+	post("  %.1f %% of the CPU saved.\n", audioRate > 0. ? 100. * (audioRate - controlRate) / audioRate : 0.);
+}
+
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
 
@@ -6248,6 +6457,14 @@ static void pack_(Thread& th, Prim* prim)
 	th.push(list->pack(th));
 }
 
+static void packf_(Thread& th, Prim* prim)
+{
+	P<List> list = th.popZList("packf : signal");
+	if (!list->isFinite())
+		indefiniteOp("packf : signal", "");
+	th.push(list->packf(th));
+}
+
 static void packed_(Thread& th, Prim* prim)
 {
 	P<List> list = th.popList("packed : list");
@@ -7541,7 +7758,6 @@ static void grade_gt_(Thread& th, Prim* prim)
 void AddStreamOps();
 void AddStreamOps()
 {
-	initFFT();
 	s_dt  = getsym("dt");
 	s_out = getsym("out");
 	s_dur = getsym("dur");
@@ -7573,6 +7789,7 @@ void AddStreamOps()
 	DEF(cons, 2, 1, "(list item --> list) returns a new list with the item added to the front.")	
 	DEF(uncons, 1, 2, "(list --> tail head) returns the tail and head of a list. fails if list is empty.")
 	DEF(pack, 1, 1, "(list --> list) returns a packed version of the list.");
+	DEFAM(packf, z, "(signal --> signal) returns the signal packed with its samples stored as 32 bit floats, in half the memory. readers widen them back to 64 bits. other packing widens them too.");
 	DEF(packed, 1, 1, "(list --> bool) returns whether the list is packed.");
 
 	vm.addBifHelp("\n*** list generation ***");
@@ -7642,6 +7859,7 @@ void AddStreamOps()
 	DEF(cyc, 1, 1, "(list --> list) makes a finite list become cyclic.")
 	DEFAM(ncyc, ak, "(n list --> list) concatenates n copies of a finite list.")
 	DEF(rcyc, 1, 1, "(ref --> list) gets a new list from ref each time list is exhausted.")
+	DEF(wref, 2, 1, "(list n --> ref) returns a Ref to list that keeps only about the last n items of it reachable, so that a running infinite list can be named without holding all of it. setting the ref to a list windows that list.")
 
 	vm.defautomap("X", "ak", repeat_, "(value n --> stream) makes a list containing n copies of value. If value is a function, then the results of applying the function with an integer count argument is used as the contents of the output list.");
 	vm.defmcx("XZ", 2, repeatz_, "(value n --> signal) returns a signal with value repeated n times.");
@@ -7794,6 +8012,8 @@ void AddStreamOps()
 	vm.def(">sfo", 2, 0, sfwriteopen_, "(channels filename -->) writes the audio to a file and opens it in the default application.");
 	//vm.def("sf>", 2, sfread_);
 	DEF(bench, 1, 0, "(channels -->) prints the amount of CPU required to compute a segment of audio. audio must be of finite duration.")	
+	DEFnoeach(benchbs, 2, 0, "(fun seconds -->) builds the channels returned by fun at signal block sizes from 64 to 1024 and prints the CPU each audio callback takes, for callbacks of one block and of 256 frames.")
+	DEFnoeach(benchkr, 3, 0, "(fun n seconds -->) builds the channels returned by fun with their parameter inputs at audio rate, then read every n frames as autokr does, and prints the CPU each audio callback takes and how much of it was saved.")
 	vm.def("sgram", 3, 0, sgram_, "(signal dBfloor filename -->) writes a spectrogram to a file and opens it.");
 
 	setSessionTime();
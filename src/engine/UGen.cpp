@@ -18,6 +18,7 @@
 
 #include "VM.hpp"
 #include "MultichannelExpansion.hpp"
+#include "WorkPool.hpp"
 #include "clz.hpp"
 #include <cmath>
 #include <float.h>
@@ -363,6 +364,7 @@ struct Imps : public Gen
 	{	
 		Z* out = mOut->fulfillz(mBlockSize);
 		int framesToFill = mBlockSize;
+		bool hits = false;
 		
 		while (framesToFill) {
 			Z* rate;
@@ -387,6 +389,7 @@ struct Imps : public Gen
 				if (once) {
 					out[i] = val_;
 					once = false;
+					hits = true;
 				} else {
 					out[i] = 0.;
 				}
@@ -395,9 +398,10 @@ struct Imps : public Gen
 				--framesToFill;
 			}
 			out += n;
-			
+			rate_.advance(n);
 		}
 leave:
+		if (!hits) mOut->mArray->setSilent();
 		produce(framesToFill);
 	}
 };
@@ -536,6 +540,8 @@ struct Lines : public Gen
 		}
 		Z* out = mOut->fulfillz(mBlockSize);
 		int framesToFill = mBlockSize;
+		// a block whose segments all have equal ends is flat.
+		bool flat = phase_ >= dur_ || newval_ == oldval_;
 		while (framesToFill) {
 			Z* rate;
 			int n = framesToFill;
@@ -556,6 +562,7 @@ struct Lines : public Gen
 						}
 					} while (dur_ <= 0.);
 					slope_ = (newval_ - oldval_) / dur_;
+					flat = flat && newval_ == oldval_;
 				}
 
 				out[i] = oldval_ + slope_ * phase_;
@@ -568,6 +575,7 @@ struct Lines : public Gen
 			rate_.advance(n);
 		}
 leave:
+		if (flat) mOut->mArray->setConstant();
 		produce(framesToFill);
 	}
 };
@@ -1442,6 +1450,7 @@ struct K2A : public Gen
 		}
 		Z* out = mOut->fulfillz(mBlockSize);
 		int framesToFill = mBlockSize;
+		bool hold = true;
 		
 		while (framesToFill) {
 			if (remain_ == 0) {
@@ -1452,6 +1461,7 @@ struct K2A : public Gen
 				slope_ = slopeFactor_ * (newval_ - oldval_);
 				remain_ = n_;
 			}
+			hold = hold && slope_ == 0.;
 			int n = std::min(remain_, framesToFill);
 			for (int i = 0; i < n; ++i) {
 				out[i] = oldval_;
@@ -1462,6 +1472,7 @@ struct K2A : public Gen
 			out += n;
 		}
 leave:
+		if (hold) mOut->mArray->setConstant();
 		produce(framesToFill);
 	}
 };
@@ -1625,11 +1636,32 @@ static void krc_(Thread& th, Prim* prim)
 	th.push(result);
 }
 
+static void withBlockSize_(Thread& th, Prim* prim)
+{
+	int64_t n = th.popInt("withBlockSize : n");
+	V fun = th.pop();
+	
+	if (n < kMinZBlockSize || n > kMaxZBlockSize) {
+		post("withBlockSize : n must be from %d to %d\n", kMinZBlockSize, kMaxZBlockSize);
+		throw errOutOfRange;
+	}
+	
+	V result;
+	{
+		SaveStack ss(th);
+		UseRate ur(th, Rate(th.rate.sampleRate, (int)n));
+		fun.apply(th);
+		result = th.pop();
+	}
+	th.push(result);
+}
+
 ////////////////////////////////////////////////////////////////////////////////////////////////////////
 
 struct LFNoise0 : public Gen
 {
 	ZIn rate_;
+	RGen r; // its own, so that the values do not depend on the thread that pulls it.
 	Z val_;
 	Z phase_;
 	Z freqmul_;
@@ -1637,13 +1669,13 @@ struct LFNoise0 : public Gen
 	LFNoise0(Thread& th, Arg rate) : Gen(th, itemTypeZ, true), rate_(rate),
 		phase_(1.), freqmul_(th.rate.invSampleRate)
 	{
+		r.init(th.rgen.trand());
 	}
 
 	virtual const char* TypeName() const override { return "LFNoise0"; }
 
 	virtual void pull(Thread& th) override
 	{	
-		RGen& r = th.rgen;
 		Z* out = mOut->fulfillz(mBlockSize);
 		int framesToFill = mBlockSize;
 		Z x = phase_;
@@ -1679,6 +1711,7 @@ struct LFNoise0 : public Gen
 struct LFNoise1 : public Gen
 {
 	ZIn rate_;
+	RGen r;
 	Z oldval_, newval_;
 	Z slope_;
 	Z phase_;
@@ -1687,7 +1720,7 @@ struct LFNoise1 : public Gen
 	LFNoise1(Thread& th, Arg rate) : Gen(th, itemTypeZ, true), rate_(rate),
 		phase_(1.), freqmul_(th.rate.invSampleRate)
 	{
-		RGen& r = th.rgen;
+		r.init(th.rgen.trand());
 		newval_ = oldval_ = r.drand2();
 	}
 
@@ -1695,7 +1728,6 @@ struct LFNoise1 : public Gen
 
 	virtual void pull(Thread& th) override
 	{	
-		RGen& r = th.rgen;
 		Z* out = mOut->fulfillz(mBlockSize);
 		int framesToFill = mBlockSize;
 		Z x = phase_;
@@ -1733,6 +1765,7 @@ struct LFNoise1 : public Gen
 struct LFNoise3 : public Gen
 {
 	ZIn rate_;
+	RGen r;
 	Z y0, y1, y2, y3;
 	Z c0, c1, c2, c3;
 	Z phase_;
@@ -1741,7 +1774,7 @@ struct LFNoise3 : public Gen
 	LFNoise3(Thread& th, Arg rate) : Gen(th, itemTypeZ, true), rate_(rate),
 		phase_(1.), freqmul_(th.rate.invSampleRate)
 	{
-		RGen& r = th.rgen;
+		r.init(th.rgen.trand());
 		y1 = r.drand2();
 		y2 = r.drand2();
 		y3 = r.drand2();
@@ -1751,7 +1784,6 @@ struct LFNoise3 : public Gen
 
 	virtual void pull(Thread& th) override
 	{	
-		RGen& r = th.rgen;
 		Z* out = mOut->fulfillz(mBlockSize);
 		int framesToFill = mBlockSize;
 		Z x = phase_;
@@ -2644,6 +2676,7 @@ class OverlapAddOutputChannel;
 
 class OverlapAddBase : public Object
 {
+	friend class OverlapAddOutputChannel;
 protected:
 	OverlapAddOutputChannel* mOutputs = nullptr;
 	P<OverlapAddInputSource> mActiveSources;
@@ -2651,6 +2684,8 @@ protected:
 	bool mNoMoreSources = false;
 	int mNumChannels;
 public:
+	SpinLockType mPullLock = SPINLOCK_INIT; // see SiblingOut
+
     OverlapAddBase(int numChannels);
     virtual ~OverlapAddBase();
 
@@ -2698,10 +2733,13 @@ public:
 	std::vector<ZIn> mInputs;
 	int mOffset;
 	bool mSourceDone;
+	PullAheadTask mPullAhead; // see renderActiveSources
+	RGen mRGen; // the source is always pulled with this, on whichever thread
 	
 	OverlapAddInputSource(Thread& th, List* channels, int inOffset, P<OverlapAddInputSource> const& inNextSource) 
 		: mNextSource(inNextSource), mOffset(inOffset), mSourceDone(false)
 	{
+		mRGen.init(th.rgen.trand());
 		if (channels->isVList()) {
 			P<List> packedChannels = channels->pack(th);
 			Array* a = packedChannels->mArray();
@@ -2721,18 +2759,20 @@ public:
 	virtual const char* TypeName() const override { return "OverlapAdd"; }
 };
 
-class OverlapAddOutputChannel : public Gen
+class OverlapAddOutputChannel : public SiblingOut
 {
 	friend class OverlapAddBase;
 	P<OverlapAddBase> mOverlapAddBase;
-	OverlapAddOutputChannel* mNextOutput;
+	bool mSilent = true; // nothing but zeros has been mixed into this block
 	
 public:	
 	OverlapAddOutputChannel(Thread& th, OverlapAddBase* inOverlapAdd)
-        : Gen(th, itemTypeZ, false), mOverlapAddBase(inOverlapAdd), mNextOutput(nullptr)
+        : SiblingOut(th, false), mOverlapAddBase(inOverlapAdd)
 	{
 	}
 
+	OverlapAddOutputChannel* nextOutput() const { return static_cast<OverlapAddOutputChannel*>(mNextSibling); }
+
 	
 	virtual void norefs() override
 	{
@@ -2744,7 +2784,7 @@ public:
 	
 	virtual void pull(Thread& th) override
 	{
-		if (mOverlapAddBase->pull(th)) {
+		if (pullShared(th, mOverlapAddBase(), mOverlapAddBase->mOutputs)) {
 			end();
 		}
 	}
@@ -2760,7 +2800,7 @@ OverlapAddBase::~OverlapAddBase()
 {
 	OverlapAddOutputChannel* output = mOutputs;
 	do {
-		OverlapAddOutputChannel* next = output->mNextOutput;
+		OverlapAddOutputChannel* next = output->nextOutput();
 		delete output;
 		output = next;
 	} while (output);
@@ -2784,7 +2824,7 @@ P<List> OverlapAddBase::createOutputs(Thread& th)
 	P<Array> a = s->mArray;
 	for (int i = 0; i < mNumChannels; ++i) {
         OverlapAddOutputChannel* c = new OverlapAddOutputChannel(th, this);
-        if (last) last->mNextOutput = c;
+        if (last) last->mNextSibling = c;
         else mOutputs = c;
         last = c;
 		a->add(new List(c));
@@ -2877,22 +2917,40 @@ void OverlapAddBase::fulfillOutputs(int blockSize)
 		if (output->mOut) {
 			Z* out = output->mOut->fulfillz(blockSize);
 			memset(out, 0, output->mBlockSize * sizeof(Z));
+			output->mSilent = true;
 		}
-		output = output->mNextOutput;
+		output = output->nextOutput();
 	} while (output);
 }
 
 int OverlapAddBase::renderActiveSources(Thread& th, int blockSize, bool& anyDone)
 {
 	int maxProduced = 0;
+	// with workers, every source is pulled ahead on the work pool, and mixed below in
+	// the same order as without them.
+	bool pullAhead = workPoolSize() && mActiveSources() && mActiveSources->mNextSource();
+	if (pullAhead) {
+		for (OverlapAddInputSource* source = mActiveSources(); source; source = source->mNextSource()) {
+			PullAheadTask& task = source->mPullAhead;
+			task.mInputs = source->mInputs.data();
+			task.mNumInputs = std::min(source->mInputs.size(), (size_t)mNumChannels);
+			task.mFrames = blockSize - source->mOffset;
+			task.mRGen = &source->mRGen;
+			workSubmit(th, &task);
+		}
+	}
 	OverlapAddInputSource* source = mActiveSources();
+	try {
 	while (source) {
 		int offset = source->mOffset;
 		int pullSize = blockSize - offset;
 		std::vector<ZIn>& sourceChannels = source->mInputs;
+		if (pullAhead)
+			workWait(th, &source->mPullAhead);
+		SaveRGen saveRGen(th, source->mRGen);
 		bool allOutputsDone = true; // initial value for reduction on &&
 		OverlapAddOutputChannel* output = mOutputs;
-		for (size_t j = 0; j < sourceChannels.size() && output; ++j, output = output->mNextOutput) {
+		for (size_t j = 0; j < sourceChannels.size() && output; ++j, output = output->nextOutput()) {
 			if (output->mOut) {
 				ZIn& zin = sourceChannels[j];
 				if (zin.mIsConstant && zin.mConstant.f == 0.)
@@ -2900,7 +2958,7 @@ int OverlapAddBase::renderActiveSources(Thread& th, int blockSize, bool& anyDone
 
 				int n = pullSize;
 				Z* out = output->mOut->mArray->z() + offset;
-				if (!zin.mix(th, n, out)) {
+				if (!zin.mix(th, n, out, output->mSilent)) {
 					allOutputsDone = false;
 				}
 				maxProduced = std::max(maxProduced, n);
@@ -2914,6 +2972,14 @@ int OverlapAddBase::renderActiveSources(Thread& th, int blockSize, bool& anyDone
 		}
 		source = source->mNextSource();
 	}
+	} catch (...) {
+		// no worker may still be reading a source when it goes away.
+		if (pullAhead) {
+			for (; source; source = source->mNextSource())
+				workCancel(&source->mPullAhead);
+		}
+		throw;
+	}
 	return maxProduced;
 }
 
@@ -2939,9 +3005,12 @@ void OverlapAddBase::produceOutputs(int shrinkBy)
 {
 	OverlapAddOutputChannel* output = mOutputs;
 	do {
-		if (output->mOut)
+		if (output->mOut) {
+			if (output->mSilent)
+				output->mOut->mArray->setSilent();
 			output->produce(shrinkBy);
-		output = output->mNextOutput;
+		}
+		output = output->nextOutput();
 	} while (output);
 }
 
@@ -3013,7 +3082,7 @@ static void ola_(Thread& th, Prim* prim)
 
 class ITD;
 
-class ITD_OutputChannel : public Gen
+class ITD_OutputChannel : public SiblingOut
 {
 	friend class ITD;
 	P<ITD> mITD;
@@ -3045,6 +3114,7 @@ struct ITD : public Gen
 	Z sr;
 	ITD_OutputChannel* mLeft;
 	ITD_OutputChannel* mRight;
+	SpinLockType mPullLock = SPINLOCK_INIT; // see SiblingOut
 	
 	ITD(Thread& th, Arg in, Arg pan, Z maxdelay) : Gen(th, itemTypeZ, false), in_(in), pan_(pan), maxdelay_(maxdelay)
 	{
@@ -3135,19 +3205,20 @@ struct ITD : public Gen
 	}
 };
 
-ITD_OutputChannel::ITD_OutputChannel(Thread& th, bool inFinite, ITD* inITD) : Gen(th, itemTypeZ, inFinite), mITD(inITD)
+ITD_OutputChannel::ITD_OutputChannel(Thread& th, bool inFinite, ITD* inITD) : SiblingOut(th, inFinite), mITD(inITD)
 {
 }
 
 void ITD_OutputChannel::pull(Thread& th)
 {
-	mITD->pull(th);
+	pullShared(th, mITD(), mITD->mLeft);
 }
 
 P<List> ITD::createOutputs(Thread& th)
 {
 	mLeft = new ITD_OutputChannel(th, finite, this);
 	mRight = new ITD_OutputChannel(th, finite, this);
+	mLeft->mNextSibling = mRight;
 	
 	P<Gen> left = mLeft;
 	P<Gen> right = mRight;
@@ -3191,6 +3262,8 @@ inline Z fast_cos1(Z x)
 	return fast_sin1(x + .25);
 }
 
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
 inline Z fast_pan(Z x)
 {
 	Z y = .75 + x * (.5 - .25 * x);
@@ -3208,11 +3281,13 @@ struct Pan2 : public Object
 	
 	Pan2Out* mLeft;
 	Pan2Out* mRight;
+	SpinLockType mPullLock = SPINLOCK_INIT; // see SiblingOut
 		
 	Pan2(Thread& th, Arg inIn, Arg inPos)
 		: _in(inIn), _pos(inPos)
 	{
 		finite = mostFinite(inIn, inPos);
+		_pos.setControlPeriod(vm.autokr);
 	}
 
 	P<List> createOutputs(Thread& th);
@@ -3222,11 +3297,11 @@ struct Pan2 : public Object
 	virtual void pull(Thread& th);
 };
 
-struct Pan2Out : public Gen
+struct Pan2Out : public SiblingOut
 {
 	P<Pan2> mPan2;
 	
-	Pan2Out(Thread& th, bool inFinite, P<Pan2> const& inPan2) : Gen(th, itemTypeZ, inFinite), mPan2(inPan2)
+	Pan2Out(Thread& th, bool inFinite, P<Pan2> const& inPan2) : SiblingOut(th, inFinite), mPan2(inPan2)
 	{
 	}
 
@@ -3240,7 +3315,7 @@ struct Pan2Out : public Gen
 	
 	virtual void pull(Thread& th) override
 	{
-		mPan2->pull(th);
+		pullShared(th, mPan2(), mPan2->mLeft);
 	}
 	
 };
@@ -3269,6 +3344,7 @@ void Pan2::pull(Thread& th)
 		Routstride = 0;
 	}
 	
+	bool silent = true;
 	while (framesToFill) {
 		Z *a, *b;
 		int n, aStride, bStride;
@@ -3279,7 +3355,16 @@ void Pan2::pull(Thread& th)
 			break;
 		}
 		
-		if (bStride == 0) {
+		// silence panned by a nan is nan, so the position must be known finite.
+		if (ZIn::isSilent(aStride, a) && bStride == 0 && std::isfinite(*b)) {
+			for (int i = 0; i < n; ++i) {
+				*Lout = 0.;
+				*Rout = 0.;
+				Lout += Loutstride;
+				Rout += Routstride;
+			}
+		} else if (bStride == 0) {
+			silent = false;
 			Z x = std::clamp(*b, -1., 1.);
 			Z Lpan = fast_pan(-x);
 			Z Rpan = fast_pan(x);
@@ -3292,6 +3377,7 @@ void Pan2::pull(Thread& th)
 				Rout += Routstride;
 			}
 		} else {
+			silent = false;
 			for (int i = 0; i < n; ++i) {
 				Z x = std::clamp(*b, -1., 1.);
 				Z z = *a;
@@ -3307,6 +3393,10 @@ void Pan2::pull(Thread& th)
 		_in.advance(n);
 		_pos.advance(n);
 	}
+	if (silent) {
+		if (mLeft->mOut) mLeft->mOut->mArray->setSilent();
+		if (mRight->mOut) mRight->mOut->mArray->setSilent();
+	}
 	if (mLeft->mOut) mLeft->produce(framesToFill);
 	if (mRight->mOut) mRight->produce(framesToFill);
 }
@@ -3316,6 +3406,7 @@ P<List> Pan2::createOutputs(Thread& th)
 {
 	mLeft = new Pan2Out(th, finite, this);
 	mRight = new Pan2Out(th, finite, this);
+	mLeft->mNextSibling = mRight;
 	
 	P<Gen> left = mLeft;
 	P<Gen> right = mRight;
@@ -3353,11 +3444,13 @@ struct Balance2 : public Object
 	
 	P<Balance2Out> mLeft;
 	P<Balance2Out> mRight;
+	SpinLockType mPullLock = SPINLOCK_INIT; // see SiblingOut
 		
 	Balance2(Thread& th, Arg inL, Arg inR, Arg inPos)
 		: _L(inL), _R(inR), _pos(inPos)
 	{
 		finite = mostFinite(inL, inR, inPos);
+		_pos.setControlPeriod(vm.autokr);
 	}
 
 	P<List> createOutputs(Thread& th);
@@ -3367,11 +3460,11 @@ struct Balance2 : public Object
 	virtual void pull(Thread& th);
 };
 
-struct Balance2Out : public Gen
+struct Balance2Out : public SiblingOut
 {
 	P<Balance2> mBalance2;
 	
-	Balance2Out(Thread& th, bool inFinite, P<Balance2> const& inBalance2) : Gen(th, itemTypeZ, inFinite), mBalance2(inBalance2)
+	Balance2Out(Thread& th, bool inFinite, P<Balance2> const& inBalance2) : SiblingOut(th, inFinite), mBalance2(inBalance2)
 	{
 	}
 
@@ -3385,7 +3478,7 @@ struct Balance2Out : public Gen
 	
 	virtual void pull(Thread& th) override
 	{
-		mBalance2->pull(th);
+		pullShared(th, mBalance2(), mBalance2->mLeft());
 	}
 	
 };
@@ -3414,6 +3507,8 @@ void Balance2::pull(Thread& th)
 		Routstride = 0;
 	}
 	
+	bool leftSilent = true;
+	bool rightSilent = true;
 	while (framesToFill) {
 		Z *a, *b, *c;
 		int n, aStride, bStride, cStride;
@@ -3423,6 +3518,10 @@ void Balance2::pull(Thread& th)
 			mRight->setDone();
 			break;
 		}
+		// silence balanced by a nan is nan, so the position must be known finite.
+		bool posFinite = cStride == 0 && std::isfinite(*c);
+		leftSilent = leftSilent && posFinite && ZIn::isSilent(aStride, a);
+		rightSilent = rightSilent && posFinite && ZIn::isSilent(bStride, b);
 		
 		if (cStride == 0) {
 			Z x = std::clamp(*c, -1., 1.);
@@ -3453,6 +3552,8 @@ void Balance2::pull(Thread& th)
 		_R.advance(n);
 		_pos.advance(n);
 	}
+	if (leftSilent && mLeft->mOut) mLeft->mOut->mArray->setSilent();
+	if (rightSilent && mRight->mOut) mRight->mOut->mArray->setSilent();
 	if (mLeft->mOut) mLeft->produce(framesToFill);
 	if (mRight->mOut) mRight->produce(framesToFill);
 }
@@ -3462,6 +3563,7 @@ P<List> Balance2::createOutputs(Thread& th)
 {
 	mLeft = new Balance2Out(th, finite, this);
 	mRight = new Balance2Out(th, finite, this);
+	mLeft->mNextSibling = mRight();
 	
 	P<Gen> left = mLeft;
 	P<Gen> right = mRight;
@@ -3501,11 +3603,13 @@ struct Rot2 : public Object
 	
 	P<Rot2Out> mLeft;
 	P<Rot2Out> mRight;
+	SpinLockType mPullLock = SPINLOCK_INIT; // see SiblingOut
 		
 	Rot2(Thread& th, Arg inL, Arg inR, Arg inPos)
 		: _L(inL), _R(inR), _pos(inPos)
 	{
 		finite = mostFinite(inL, inR, inPos);
+		_pos.setControlPeriod(vm.autokr);
 	}
 
 	P<List> createOutputs(Thread& th);
@@ -3515,11 +3619,11 @@ struct Rot2 : public Object
 	virtual void pull(Thread& th);
 };
 
-struct Rot2Out : public Gen
+struct Rot2Out : public SiblingOut
 {
 	P<Rot2> mRot2;
 	
-	Rot2Out(Thread& th, bool inFinite, P<Rot2> const& inRot2) : Gen(th, itemTypeZ, inFinite), mRot2(inRot2)
+	Rot2Out(Thread& th, bool inFinite, P<Rot2> const& inRot2) : SiblingOut(th, inFinite), mRot2(inRot2)
 	{
 	}
 
@@ -3534,7 +3638,7 @@ struct Rot2Out : public Gen
 	
 	virtual void pull(Thread& th) override
 	{
-		mRot2->pull(th);
+		pullShared(th, mRot2(), mRot2->mLeft());
 	}
 	
 };
@@ -3643,6 +3747,7 @@ P<List> Rot2::createOutputs(Thread& th)
 {
 	mLeft = new Rot2Out(th, finite, this);
 	mRight = new Rot2Out(th, finite, this);
+	mLeft->mNextSibling = mRight();
 	
 	P<Gen> left = mLeft;
 	P<Gen> right = mRight;
@@ -4562,6 +4667,7 @@ void AddUGenOps()
 	gK2AC = automap("zk", 2, new Prim(k2ac_, V(0.), 2, 1, "", ""), "", "");
 	DEF(kr, 2, "(fun n --> out) evaluates fun with the current sample rate divided by n, then linearly upsamples all returned signals by n.")
 	DEF(krc, 2, "(fun n --> out) evaluates fun with the current sample rate divided by n, then cubically upsamples all returned signals by n.")
+	DEF(withBlockSize, 2, "(fun n --> out) evaluates fun with a signal block size of n, so that the signals it makes are computed n frames at a time. e.g. to match a graph to a device buffer of n frames.")
 	
 	vm.addBifHelp("\n*** control function unit generators ***");
 	DEFAM(imps, aaz, "(values durs rate --> out) single sample impulses.");
@@ -19,6 +19,7 @@
 #include "Parser.hpp"
 #include "MultichannelExpansion.hpp"
 #include "elapsedTime.hpp"
+#include "Snapshot.hpp"
 #include <stdexcept>
 #include <limits.h>
 #include <chrono>
@@ -50,7 +51,8 @@ uint64_t timeseed()
 
 
 Thread::Thread()
-    :rate(vm.ar), stackBase(0), localBase(0),
+    :rate(vm.ar), stackBase(0), localBase(0), callDepth(0),
+    stack(kStackSize), local(kStackSize),
 	mWorkspace(new GForm()),
     parsingWhat(parsingWords),
     fromString(false),
@@ -64,7 +66,8 @@ Thread::Thread()
 }
 
 Thread::Thread(const Thread& inParent)
-    :rate(inParent.rate), stackBase(0), localBase(0),
+    :rate(inParent.rate), stackBase(0), localBase(0), callDepth(0),
+    stack(kStackSize), local(kStackSize),
     mWorkspace(inParent.mWorkspace),
     parsingWhat(parsingWords),
     fromString(false),
@@ -78,7 +81,8 @@ Thread::Thread(const Thread& inParent)
 }
 
 Thread::Thread(const Thread& inParent, P<Fun> const& inFun)
-    :rate(vm.ar), stackBase(0), localBase(0),
+    :rate(vm.ar), stackBase(0), localBase(0), callDepth(0),
+    stack(kStackSize), local(kStackSize),
     fun(inFun),
     mWorkspace(inParent.mWorkspace),
     parsingWhat(parsingWords),
@@ -94,6 +98,20 @@ Thread::Thread(const Thread& inParent, P<Fun> const& inFun)
 
 Thread::~Thread() {}
 
+VStack::VStack(size_t inCapacity)
+{
+	// raw storage. slots are constructed as they are pushed.
+	mBase = static_cast<V*>(::operator new(inCapacity * sizeof(V)));
+	mTop = mBase;
+	mEnd = mBase + inCapacity;
+}
+
+VStack::~VStack()
+{
+	popTo(0);
+	::operator delete(mBase);
+}
+
 //////////////////////
 
 static void inherit_(Thread& th, Prim* prim)
@@ -181,6 +199,7 @@ VM::VM()
 	:
 	prelude_file(NULL),
 	log_file(NULL),
+	code_cache_dir(NULL),
 	_ee(0),
 
 	printLength(20),
@@ -251,7 +270,11 @@ void Thread::getLine()
 	}
 
 	const char* prompt = getPrompt(parsingWhat);
-	const char* input = replxx_input(replxx, prompt);
+	const char* input;
+	{
+		RCParkScope parked;
+		input = replxx_input(replxx, prompt);
+	}
 
 	if (!input || strncmp(input, "quit", 4)==0 || strncmp(input, "..", 2)==0) {
 		line = NULL;
@@ -287,7 +310,12 @@ void Thread::getLine()
 	static char inputBuffer[4096];
 	printf("%s", parsingWhat == parsingWords ? "sapf> " : "...> ");
 	fflush(stdout);
-	if (!fgets(inputBuffer, sizeof(inputBuffer), stdin)) {
+	char* input;
+	{
+		RCParkScope parked;
+		input = fgets(inputBuffer, sizeof(inputBuffer), stdin);
+	}
+	if (!input) {
 		line = NULL;
 		throw errUserQuit;
 	}
@@ -457,13 +485,13 @@ public:
 	T* operator->() { return p; }
 };
 
-void loadFile(Thread& th, const char* filename)
+bool loadFile(Thread& th, const char* filename)
 {
     post("loading file '%s'\n", filename);
 	FILE* f = fopen(filename, "r");
 	if (!f) {
 		post("could not open '%s'\n", filename);
-		return;
+		return false;
 	}
 
 	fseek(f, 0, SEEK_END);
@@ -478,10 +506,17 @@ void loadFile(Thread& th, const char* filename)
 	try {
 		{
 			P<Fun> compiledFun;
-			if (th.compile(p, compiledFun, true)) {
+			bool compiled = loadCachedCode(th, p, compiledFun);
+			if (!compiled) {
+				std::vector<ExternalName> externalNames;
+				compiled = th.compile(p, compiledFun, true, vm.code_cache_dir ? &externalNames : nullptr);
+				if (compiled) saveCachedCode(th, p, compiledFun, externalNames);
+			}
+			if (compiled) {
 				post("compiled OK.\n");
 				compiledFun->run(th);
 				post("done loading file\n");
+				return true;
 			}
 		}
     } catch (V& v) {
@@ -499,6 +534,7 @@ void loadFile(Thread& th, const char* filename)
 	} catch (...) {
 		post("unknown error\n");
 	}
+	return false;
 }
 
 void Thread::printStack()
@@ -535,6 +571,26 @@ void VM::setSampleRate(double inSampleRate)
 	kr = Rate(ar, kDefaultControlBlockSize);
 }
 
+void VM::setBlockSize(int inBlockSize)
+{
+	ar = Rate(ar.sampleRate, inBlockSize);
+	kr = Rate(ar, kDefaultControlBlockSize);
+}
+
+void VM::useDeviceBlockSize(Thread& th, int inFrames)
+{
+	if (inFrames == ar.blockSize) return;
+	if (fixedBlockSize || inFrames < kMinZBlockSize || inFrames > kMaxZBlockSize) {
+		post("audio device buffer is %d frames. signals are computed in blocks of %d.\n", inFrames, ar.blockSize);
+		return;
+	}
+	// the calling thread follows unless it is inside a UseRate.
+	bool followEngine = th.rate == ar;
+	setBlockSize(inFrames);
+	if (followEngine) th.rate = ar;
+	post("signal block size is now %d frames, the audio device buffer size.\n", inFrames);
+}
+
 V VM::def(Arg key, Arg value)
 {
 	builtins->putImpure(key, value); 
@@ -713,14 +769,15 @@ void Thread::tuck(size_t n, Arg v)
 
 ///////////////////////////////////////
 
-bool Thread::compile(const char* inString, P<Fun>& compiledFun, bool inTopLevel)
+bool Thread::compile(const char* inString, P<Fun>& compiledFun, bool inTopLevel, std::vector<ExternalName>* outExternalNames)
 {	
 	Thread& th = *this;
 	SaveCompileScope scs(th);
+	P<TopCompileScope> topScope = new TopCompileScope();
 	if (inTopLevel) {
-		mCompileScope = new TopCompileScope();
+		mCompileScope = topScope;
 	} else {
-		mCompileScope = new InnerCompileScope(new TopCompileScope());
+		mCompileScope = new InnerCompileScope(topScope);
 	}
 	
 	P<Code> code;
@@ -733,10 +790,21 @@ bool Thread::compile(const char* inString, P<Fun>& compiledFun, bool inTopLevel)
 	}
 		
 	compiledFun = new Fun(*this, new FunDef(*this, code, 0, th.mCompileScope->numLocals(), th.mCompileScope->numVars(), NULL));
+	if (outExternalNames) {
+		*outExternalNames = topScope->mExternalNames;
+	}
 	
 	return true;
 }
 
+void TopCompileScope::noteExternalName(P<String> const& inName, bool inWorkspace)
+{
+	for (ExternalName const& name : mExternalNames) {
+		if (name.mName() == inName()) return;
+	}
+	mExternalNames.push_back({ inName, inWorkspace });
+}
+
 int TopCompileScope::directLookup(Thread& th, P<String> const& inName, size_t& outIndex, V& outBuiltIn)
 {
 	int scope = CompileScope::directLookup(th, inName, outIndex, outBuiltIn);
@@ -750,8 +818,10 @@ int TopCompileScope::directLookup(Thread& th, P<String> const& inName, size_t& o
 	
 	V value;
 	if (th.mWorkspace->get(th, inName(), value)) {
+		noteExternalName(inName, true);
 		return scopeWorkspace;
 	} else if (vm.builtins->get(th, inName, value)) {
+		noteExternalName(inName, false);
 		outBuiltIn = value;
 		return scopeBuiltIn;
 	}
@@ -0,0 +1,289 @@
+//    SAPF - Sound As Pure Form
+//    Copyright (C) 2019 James McCartney
+//
+//    This program is free software: you can redistribute it and/or modify
+//    it under the terms of the GNU General Public License as published by
+//    the Free Software Foundation, either version 3 of the License, or
+//    (at your option) any later version.
+//
+//    This program is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//    GNU General Public License for more details.
+//
+//    You should have received a copy of the GNU General Public License
+//    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "WorkPool.hpp"
+#include "Pool.hpp"
+#include "PlatformLock.hpp"
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// WorkTask::mState
+enum {
+	kWorkIdle = 0, // not queued. workWait runs it.
+	kWorkQueued = 1,
+	kWorkRunning = 2,
+	kWorkDone = 3
+};
+
+struct WorkQueue
+{
+	SpinLockType mLock = SPINLOCK_INIT;
+	WorkTask* mTasks[kWorkQueueSize];
+	int mHead = 0;
+	int mCount = 0;
+
+	WorkTask*& at(int i) { return mTasks[(mHead + i) & (kWorkQueueSize - 1)]; }
+
+	// these are called with mLock held.
+	bool push(WorkTask* task)
+	{
+		if (mCount == kWorkQueueSize) return false;
+		at(mCount++) = task;
+		return true;
+	}
+	WorkTask* popFront()
+	{
+		if (!mCount) return nullptr;
+		WorkTask* task = at(0);
+		mHead = (mHead + 1) & (kWorkQueueSize - 1);
+		--mCount;
+		return task;
+	}
+	WorkTask* popBack()
+	{
+		if (!mCount) return nullptr;
+		return at(--mCount);
+	}
+	bool remove(WorkTask* task)
+	{
+		for (int i = 0; i < mCount; ++i) {
+			if (at(i) == task) {
+				for (int j = i + 1; j < mCount; ++j)
+					at(j - 1) = at(j);
+				--mCount;
+				return true;
+			}
+		}
+		return false;
+	}
+};
+
+struct WorkPool
+{
+	WorkQueue mQueues[kWorkPoolMaxWorkers];
+	std::atomic<int> mNumWorkers{0}; // queues that new tasks go to
+	std::atomic<int> mNext{0};
+	std::atomic<int> mPending{0}; // tasks in the queues
+	std::atomic<bool> mStop{false};
+
+	std::mutex mSleepMutex;
+	std::condition_variable mSleep;
+
+	std::mutex mControlMutex; // held while workers start and stop
+	std::vector<std::thread> mWorkers;
+	std::vector<std::unique_ptr<Thread>> mThreads;
+
+	std::atomic<int64_t> mSubmitted{0};
+	std::atomic<int64_t> mRun{0};
+	std::atomic<int64_t> mStolen{0};
+	std::atomic<int64_t> mWaited{0};
+
+	static void runTask(Thread& th, WorkTask* task)
+	{
+		Thread& taskThread = task->mThread ? *task->mThread : th;
+		try {
+			task->run(taskThread);
+		} catch (...) {
+			// the consumer meets it again when it pulls the same list.
+		}
+	}
+
+	WorkTask* take(int index, int numQueues)
+	{
+		{
+			WorkQueue& q = mQueues[index];
+			SpinLocker lock(q.mLock);
+			if (WorkTask* task = q.popFront()) {
+				task->mState.store(kWorkRunning, std::memory_order_relaxed);
+				mRun.fetch_add(1, std::memory_order_relaxed);
+				return task;
+			}
+		}
+		for (int i = 1; i < numQueues; ++i) {
+			WorkQueue& q = mQueues[(index + i) % numQueues];
+			SpinLocker lock(q.mLock);
+			if (WorkTask* task = q.popBack()) {
+				task->mState.store(kWorkRunning, std::memory_order_relaxed);
+				mStolen.fetch_add(1, std::memory_order_relaxed);
+				return task;
+			}
+		}
+		return nullptr;
+	}
+
+	void workerLoop(int index, Thread* th, int numQueues)
+	{
+		for (;;) {
+			// also merges what other threads have released of ours.
+			poolEnterRenderThread();
+			if (mStop.load(std::memory_order_acquire)) return;
+			WorkTask* task = take(index, numQueues);
+			if (task) {
+				mPending.fetch_sub(1, std::memory_order_relaxed);
+				th->rate = *task->mRate;
+				runTask(*th, task);
+				task->mState.store(kWorkDone, std::memory_order_release);
+				continue;
+			}
+			// a submitter does not lock to wake a worker, so a wake up can be missed.
+			// the worker then looks again shortly, and meanwhile workWait runs the task.
+			RCParkScope park;
+			std::unique_lock<std::mutex> lock(mSleepMutex);
+			mSleep.wait_for(lock, std::chrono::milliseconds(2), [this]() {
+				return mPending.load(std::memory_order_relaxed) > 0 || mStop.load(std::memory_order_relaxed);
+			});
+		}
+	}
+
+	// takes the task back if it is still queued. returns false if a worker has it.
+	bool reclaim(WorkTask* task)
+	{
+		int state = task->mState.load(std::memory_order_acquire);
+		if (state == kWorkQueued) {
+			WorkQueue& q = mQueues[task->mQueue];
+			SpinLocker lock(q.mLock);
+			if (q.remove(task)) {
+				mPending.fetch_sub(1, std::memory_order_relaxed);
+				task->mState.store(kWorkIdle, std::memory_order_relaxed);
+			}
+			state = task->mState.load(std::memory_order_acquire);
+		}
+		if (state == kWorkIdle) return true;
+		RCParkScope parked;
+		while (task->mState.load(std::memory_order_acquire) != kWorkDone)
+			std::this_thread::yield();
+		task->mState.store(kWorkIdle, std::memory_order_relaxed);
+		return false;
+	}
+
+	void submit(Thread& th, WorkTask* task)
+	{
+		task->mState.store(kWorkIdle, std::memory_order_relaxed);
+		int numWorkers = mNumWorkers.load(std::memory_order_acquire);
+		if (!numWorkers) return;
+		task->mRate = &th.rate;
+		int index = (int)((unsigned)mNext.fetch_add(1, std::memory_order_relaxed) % (unsigned)numWorkers);
+		WorkQueue& q = mQueues[index];
+		{
+			SpinLocker lock(q.mLock);
+			if (!q.push(task)) return;
+			task->mQueue = index;
+			task->mState.store(kWorkQueued, std::memory_order_relaxed);
+		}
+		mSubmitted.fetch_add(1, std::memory_order_relaxed);
+		mPending.fetch_add(1, std::memory_order_relaxed);
+		mSleep.notify_one();
+	}
+
+	void stopWorkers()
+	{
+		mNumWorkers.store(0, std::memory_order_release);
+		{
+			std::lock_guard<std::mutex> lock(mSleepMutex);
+			mStop.store(true, std::memory_order_release);
+		}
+		mSleep.notify_all();
+		for (std::thread& worker : mWorkers)
+			worker.join();
+		mWorkers.clear();
+		mThreads.clear();
+		mStop.store(false, std::memory_order_release);
+	}
+};
+
+static WorkPool& workPool()
+{
+	static WorkPool* pool = new WorkPool(); // never destroyed. tasks may still be queued at exit.
+	return *pool;
+}
+
+void workPoolSetSize(Thread& th, int numWorkers)
+{
+	WorkPool& pool = workPool();
+	numWorkers = std::max(0, std::min(numWorkers, kWorkPoolMaxWorkers));
+	std::lock_guard<std::mutex> lock(pool.mControlMutex);
+	if ((int)pool.mWorkers.size() == numWorkers) return;
+	// tasks left in the queues of stopped workers are run by whoever waits for them.
+	pool.stopWorkers();
+	for (int i = 0; i < numWorkers; ++i)
+		pool.mThreads.emplace_back(new Thread(th));
+	for (int i = 0; i < numWorkers; ++i) {
+		Thread* workerThread = pool.mThreads[i].get();
+		pool.mWorkers.emplace_back([&pool, i, workerThread, numWorkers]() {
+			pool.workerLoop(i, workerThread, numWorkers);
+		});
+	}
+	pool.mNumWorkers.store(numWorkers, std::memory_order_release);
+}
+
+int workPoolSize()
+{
+	return workPool().mNumWorkers.load(std::memory_order_acquire);
+}
+
+void workSubmit(Thread& th, WorkTask* task)
+{
+	workPool().submit(th, task);
+}
+
+void workWait(Thread& th, WorkTask* task)
+{
+	WorkPool& pool = workPool();
+	if (pool.reclaim(task)) {
+		pool.mWaited.fetch_add(1, std::memory_order_relaxed);
+		WorkPool::runTask(th, task);
+	}
+}
+
+void workCancel(WorkTask* task)
+{
+	workPool().reclaim(task);
+}
+
+void workPoolStats(WorkPoolStats& outStats)
+{
+	WorkPool& pool = workPool();
+	outStats.mSubmitted = pool.mSubmitted.load(std::memory_order_relaxed);
+	outStats.mRun = pool.mRun.load(std::memory_order_relaxed);
+	outStats.mStolen = pool.mStolen.load(std::memory_order_relaxed);
+	outStats.mWaited = pool.mWaited.load(std::memory_order_relaxed);
+}
+
+void workPoolResetStats()
+{
+	WorkPool& pool = workPool();
+	pool.mSubmitted.store(0, std::memory_order_relaxed);
+	pool.mRun.store(0, std::memory_order_relaxed);
+	pool.mStolen.store(0, std::memory_order_relaxed);
+	pool.mWaited.store(0, std::memory_order_relaxed);
+}
+
+void PullAheadTask::run(Thread& th)
+{
+	if (mRGen) {
+		SaveRGen saveRGen(th, *mRGen);
+		for (size_t i = 0; i < mNumInputs; ++i)
+			mInputs[i].pullAhead(th, mFrames);
+	} else {
+		for (size_t i = 0; i < mNumInputs; ++i)
+			mInputs[i].pullAhead(th, mFrames);
+	}
+}
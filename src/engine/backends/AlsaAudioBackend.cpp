@@ -14,6 +14,7 @@
 #include <cstdio>
 
 #include "SoundFiles.hpp"
+#include "WorkPool.hpp"
 
 #if defined(SAPF_USE_LIBSNDFILE)
 #include <sndfile.h>
@@ -22,7 +23,6 @@
 namespace {
 
 const int kMaxChannels = 32;
-const unsigned int kFramesPerBuffer = 256;
 
 } // namespace
 
@@ -47,6 +47,7 @@ private:
 		int numChannels;
 		std::vector<ZIn> in;
 		bool done = false;
+		PullAheadTask pullAhead; // see audioThreadLoop
 #if defined(SAPF_USE_LIBSNDFILE)
 		SNDFILE* recordFile = nullptr;
 		std::string recordPath;
@@ -60,6 +61,7 @@ private:
 	void removeFinishedLocked();
 	void wakeThread();
 	std::unique_ptr<Player> createPlayer(Thread& th, V& v);
+	void addPlayer(Thread& th, std::unique_ptr<Player> player);
 	void finalizePlayer(std::unique_ptr<Player>& player);
 
 	std::mutex mutex_;
@@ -71,9 +73,10 @@ private:
 	snd_pcm_t* pcm_ = nullptr;
 	unsigned int sampleRate_ = 0;
 	int numChannels_ = 2;
+	size_t periodFrames_ = 0;
 
 	std::vector<float> mixBuffer_;
-	std::vector<float> scratch_;
+	std::vector<float> writeBuffer_;
 };
 
 AlsaAudioBackend::AlsaAudioBackend()
@@ -133,11 +136,25 @@ void AlsaAudioBackend::play(Thread& th, V& v)
 		return;
 	}
 
+	addPlayer(th, std::move(player));
+}
+
+void AlsaAudioBackend::addPlayer(Thread& th, std::unique_ptr<Player> player)
+{
+	// the device is opened here rather than on the audio thread, so that the
+	// period it grants can become the block size of the graphs built after this one.
+	bool opened = false;
+	size_t frames = 0;
 	{
 		std::lock_guard<std::mutex> lock(mutex_);
+		opened = !pcm_ && ensurePcmLocked();
+		frames = periodFrames_;
 		players_.push_back(std::move(player));
 	}
 	wakeThread();
+	if (opened) {
+		vm.useDeviceBlockSize(th, static_cast<int>(frames));
+	}
 }
 
 void AlsaAudioBackend::record(Thread& th, V& v, Arg filename)
@@ -158,11 +175,7 @@ void AlsaAudioBackend::record(Thread& th, V& v, Arg filename)
 	player->recordFile = sf;
 	player->recordPath = path;
 
-	{
-		std::lock_guard<std::mutex> lock(mutex_);
-		players_.push_back(std::move(player));
-	}
-	wakeThread();
+	addPlayer(th, std::move(player));
 	post("Recording to '%s'\n", path);
 #else
 	(void)th; (void)v; (void)filename;
@@ -195,28 +208,47 @@ void AlsaAudioBackend::stopFinished()
 
 void AlsaAudioBackend::audioThreadLoop()
 {
+	poolEnterRenderThread();
 	std::unique_lock<std::mutex> lock(mutex_);
 	while (running_) {
 		if (players_.empty()) {
+			RCParkScope parked;
 			cv_.wait(lock, [this]() { return !running_ || !players_.empty(); });
 			if (!running_) break;
 		}
 
 		if (!ensurePcmLocked()) {
 			players_.clear();
+			RCParkScope parked;
 			cv_.wait_for(lock, std::chrono::milliseconds(10));
 			continue;
 		}
 
-		size_t frames = kFramesPerBuffer;
+		size_t frames = periodFrames_;
 		size_t samples = frames * static_cast<size_t>(numChannels_);
 		mixBuffer_.assign(samples, 0.f);
-		scratch_.resize(frames);
+
+		// with workers, each player is pulled ahead on the work pool on its own thread,
+		// and mixed below in turn.
+		const bool pullAhead = players_.size() > 1 && workPoolSize();
+		if (pullAhead) {
+			for (auto& p : players_) {
+				Player& player = *p;
+				player.pullAhead.mThread = &player.th;
+				player.pullAhead.mInputs = player.in.data();
+				player.pullAhead.mNumInputs = std::min(player.numChannels, numChannels_);
+				player.pullAhead.mFrames = static_cast<int>(frames);
+				workSubmit(player.th, &player.pullAhead);
+			}
+		}
 
 		for (auto it = players_.begin(); it != players_.end();) {
 			Player& player = *(*it);
 			int channels = std::min(player.numChannels, numChannels_);
 			bool done = true;
+			if (pullAhead) {
+				workWait(player.th, &player.pullAhead);
+			}
 
 #if defined(SAPF_USE_LIBSNDFILE)
 			// Prepare record buffer if recording
@@ -227,24 +259,20 @@ void AlsaAudioBackend::audioThreadLoop()
 
 			for (int ch = 0; ch < channels; ++ch) {
 				int framesToFill = static_cast<int>(frames);
-				bool finished = player.in[ch].fill(player.th, framesToFill, scratch_.data(), 1);
-				for (int i = 0; i < framesToFill; ++i) {
-					size_t idx = static_cast<size_t>(i) * numChannels_ + ch;
-					mixBuffer_[idx] += scratch_[i];
-				}
+				bool finished;
 #if defined(SAPF_USE_LIBSNDFILE)
-				// Copy to record buffer (interleaved)
-				if (player.recordFile && ch < player.numChannels) {
-					for (int i = 0; i < framesToFill; ++i) {
-						player.recordBuffer[i * player.numChannels + ch] = scratch_[i];
+				// Fill the record buffer (interleaved), then add it to the mix
+				if (player.recordFile) {
+					float* rec = player.recordBuffer.data() + ch;
+					finished = player.in[ch].fill(player.th, framesToFill, rec, player.numChannels);
+					for (size_t i = 0; i < frames; ++i) {
+						mixBuffer_[i * numChannels_ + ch] += rec[i * player.numChannels];
 					}
-				}
+				} else
 #endif
-				if (framesToFill < static_cast<int>(frames)) {
-					for (size_t i = framesToFill; i < frames; ++i) {
-						size_t idx = i * numChannels_ + ch;
-						// already zero
-					}
+				{
+					// converted and added straight into the interleaved mix
+					finished = player.in[ch].mix(player.th, framesToFill, mixBuffer_.data() + ch, numChannels_);
 				}
 				done = done && finished;
 			}
@@ -268,11 +296,12 @@ void AlsaAudioBackend::audioThreadLoop()
 			}
 		}
 
-		std::vector<float> localBuffer = mixBuffer_;
+		// swapped rather than copied, so that no buffer is allocated while playing.
+		writeBuffer_.swap(mixBuffer_);
 		lock.unlock();
 
 		if (pcm_) {
-			const float* data = localBuffer.data();
+			const float* data = writeBuffer_.data();
 			size_t framesLeft = frames;
 			while (framesLeft > 0) {
 				snd_pcm_sframes_t written = snd_pcm_writei(pcm_, data, framesLeft);
@@ -319,7 +348,8 @@ bool AlsaAudioBackend::ensurePcmLocked()
 	snd_pcm_hw_params_set_channels(handle, params, numChannels_);
 	unsigned int rate = sampleRate_;
 	snd_pcm_hw_params_set_rate_near(handle, params, &rate, 0);
-	snd_pcm_uframes_t period = kFramesPerBuffer;
+	// ask for periods of one signal block, so that each write takes whole blocks.
+	snd_pcm_uframes_t period = static_cast<snd_pcm_uframes_t>(vm.ar.blockSize);
 	snd_pcm_hw_params_set_period_size_near(handle, params, &period, 0);
 
 	err = snd_pcm_hw_params(handle, params);
@@ -338,6 +368,7 @@ bool AlsaAudioBackend::ensurePcmLocked()
 	}
 
 	pcm_ = handle;
+	periodFrames_ = static_cast<size_t>(period);
 	return true;
 }
 
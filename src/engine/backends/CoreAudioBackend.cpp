@@ -187,6 +187,7 @@ static OSStatus inputCallback(	void *							inRefCon,
 {
 	
 	AUPlayer* player = (AUPlayer*)inRefCon;
+	poolEnterRenderThread();
 		
 	bool done = fillBufferList(player, inNumberFrames, ioData);
 	recordPlayer(player, inNumberFrames, ioData);
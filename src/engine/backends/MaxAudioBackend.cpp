@@ -94,6 +94,7 @@ void MaxAudioBackend::render(float** outputs, int numChannels, int numFrames)
 	}
 
 	scratch_.resize(numFrames);
+	poolEnterRenderThread();
 
 	Locker lock(&gMaxBackendMutex);
 	for (int c = 0; c < numChannels; ++c) {
@@ -8,11 +8,11 @@
 
 #include "RtAudio.h"
 #include "SoundFiles.hpp"
+#include "WorkPool.hpp"
 
 namespace {
 
 const int kMaxChannels = 32;
-const unsigned int kFramesPerBuffer = 256;
 
 class RtAudioBackend : public AudioBackend
 {
@@ -38,6 +38,7 @@ private:
 		int numChannels;
 		std::vector<ZIn> in;
 		bool done = false;
+		PullAheadTask pullAhead; // see render
 #if defined(__APPLE__)
 		ExtAudioFileRef recordFile = nullptr;
 		std::string recordPath;
@@ -51,17 +52,17 @@ private:
 
 	static int audioCallback(void* outputBuffer, void* inputBuffer, unsigned int nFrames, double streamTime, RtAudioStreamStatus status, void* userData);
 	int render(float* output, unsigned int frames);
-	bool ensureStreamLocked();
+	bool ensureStreamLocked(Thread& th);
 	void closeStreamLocked();
 	void removeFinishedLocked();
 	std::unique_ptr<Player> createPlayer(Thread& th, V& v);
-	void finalizePlayer(std::unique_ptr<Player>& player);
+	static bool isRecording(const Player& player);
+	static void finalizePlayer(std::unique_ptr<Player>& player);
+	static void reclaimPlayer(void* player);
 
 	RtAudio audio_;
 	std::mutex mutex_;
 	std::vector<std::unique_ptr<Player>> players_;
-	std::vector<float> scratch_;
-	std::vector<float> mix_;
 	bool streamOpen_ = false;
 	int streamChannels_ = 0;
 	unsigned int streamSampleRate_ = 0;
@@ -117,7 +118,7 @@ void RtAudioBackend::play(Thread& th, V& v)
 
 	std::lock_guard<std::mutex> lock(mutex_);
 	if (!streamOpen_) {
-		if (!ensureStreamLocked()) {
+		if (!ensureStreamLocked(th)) {
 			throw errFailed;
 		}
 	}
@@ -144,7 +145,7 @@ void RtAudioBackend::record(Thread& th, V& v, Arg filename)
 
 	std::lock_guard<std::mutex> lock(mutex_);
 	if (!streamOpen_) {
-		if (!ensureStreamLocked()) {
+		if (!ensureStreamLocked(th)) {
 			ExtAudioFileDispose(player->recordFile);
 			player->recordFile = nullptr;
 			throw errFailed;
@@ -169,7 +170,7 @@ void RtAudioBackend::record(Thread& th, V& v, Arg filename)
 
 	std::lock_guard<std::mutex> lock(mutex_);
 	if (!streamOpen_) {
-		if (!ensureStreamLocked()) {
+		if (!ensureStreamLocked(th)) {
 			sf_close(player->recordFile);
 			player->recordFile = nullptr;
 			throw errFailed;
@@ -211,6 +212,7 @@ int RtAudioBackend::audioCallback(void* outputBuffer, void*, unsigned int nFrame
 
 int RtAudioBackend::render(float* output, unsigned int frames)
 {
+	poolEnterRenderThread();
 	std::lock_guard<std::mutex> lock(mutex_);
 	const int numChannels = std::max(1, streamChannels_);
 	const size_t samples = static_cast<size_t>(frames) * numChannels;
@@ -227,49 +229,84 @@ int RtAudioBackend::render(float* output, unsigned int frames)
 		return 0;
 	}
 
-	mix_.assign(samples, 0.f);
-	scratch_.resize(frames);
+	// a single player that is not recording writes straight into the device buffer.
+	// otherwise each channel is converted and added into it in one pass.
+	const bool direct = players_.size() == 1 && !isRecording(*players_.front());
+	if (!direct) {
+		std::fill(output, output + samples, 0.f);
+	}
+
+	// with workers, each player is pulled ahead on the work pool on its own thread, and
+	// read below in turn.
+	const bool pullAhead = players_.size() > 1 && workPoolSize();
+	if (pullAhead) {
+		for (auto& p : players_) {
+			Player& player = *p;
+			player.pullAhead.mThread = &player.th;
+			player.pullAhead.mInputs = player.in.data();
+			player.pullAhead.mNumInputs = std::min(player.numChannels, numChannels);
+			player.pullAhead.mFrames = static_cast<int>(frames);
+			workSubmit(player.th, &player.pullAhead);
+		}
+	}
 
 	auto it = players_.begin();
 	while (it != players_.end()) {
 		Player& player = *(*it);
 		const int channels = std::min(player.numChannels, numChannels);
 		bool done = true;
+		if (pullAhead) {
+			workWait(player.th, &player.pullAhead);
+		}
 
 #if defined(SAPF_USE_LIBSNDFILE)
 		// Prepare record buffer if recording (libsndfile)
 		if (player.recordFile) {
-			player.recordBuffer.assign(frames * player.numChannels, 0.f);
+			player.recordBuffer.resize(frames * player.numChannels);
 		}
 #endif
 
 		for (int ch = 0; ch < channels; ++ch) {
 			int framesToFill = static_cast<int>(frames);
-			bool finished = player.in[ch].fill(player.th, framesToFill, scratch_.data(), 1);
-			for (int i = 0; i < framesToFill; ++i) {
-				const size_t idx = static_cast<size_t>(i) * numChannels + ch;
-				mix_[idx] += scratch_[i];
-			}
+			bool finished;
 #if defined(__APPLE__)
 			if (player.recordFile) {
 				if (player.recordChannels.size() < static_cast<size_t>(player.numChannels)) {
 					player.recordChannels.resize(player.numChannels);
 				}
 				auto& chanBuf = player.recordChannels[ch];
-				chanBuf.assign(frames, 0.f);
-				std::copy_n(scratch_.data(), framesToFill, chanBuf.data());
-			}
+				chanBuf.resize(frames);
+				finished = player.in[ch].fill(player.th, framesToFill, chanBuf.data(), 1);
+				for (unsigned int i = 0; i < frames; ++i) {
+					output[static_cast<size_t>(i) * numChannels + ch] += chanBuf[i];
+				}
+			} else
 #elif defined(SAPF_USE_LIBSNDFILE)
-			// Copy to record buffer (interleaved)
-			if (player.recordFile && ch < player.numChannels) {
-				for (int i = 0; i < framesToFill; ++i) {
-					player.recordBuffer[i * player.numChannels + ch] = scratch_[i];
+			// Fill the record buffer (interleaved), then add it to the output
+			if (player.recordFile) {
+				float* rec = player.recordBuffer.data() + ch;
+				finished = player.in[ch].fill(player.th, framesToFill, rec, player.numChannels);
+				for (unsigned int i = 0; i < frames; ++i) {
+					output[static_cast<size_t>(i) * numChannels + ch] += rec[static_cast<size_t>(i) * player.numChannels];
 				}
-			}
+			} else
 #endif
+			if (direct) {
+				finished = player.in[ch].fill(player.th, framesToFill, output + ch, numChannels);
+			} else {
+				finished = player.in[ch].mix(player.th, framesToFill, output + ch, numChannels);
+			}
 			done = done && finished;
 		}
 
+		if (direct) {
+			for (int ch = channels; ch < numChannels; ++ch) {
+				for (unsigned int i = 0; i < frames; ++i) {
+					output[static_cast<size_t>(i) * numChannels + ch] = 0.f;
+				}
+			}
+		}
+
 #if defined(__APPLE__)
 		if (player.recordFile) {
 			for (int ch = channels; ch < player.numChannels; ++ch) {
@@ -294,6 +331,11 @@ int RtAudioBackend::render(float* output, unsigned int frames)
 #elif defined(SAPF_USE_LIBSNDFILE)
 		// Write recorded frames to file (libsndfile)
 		if (player.recordFile) {
+			for (int ch = channels; ch < player.numChannels; ++ch) {
+				for (unsigned int i = 0; i < frames; ++i) {
+					player.recordBuffer[static_cast<size_t>(i) * player.numChannels + ch] = 0.f;
+				}
+			}
 			sf_count_t written = sf_writef_float(player.recordFile, player.recordBuffer.data(), frames);
 			if (written != static_cast<sf_count_t>(frames)) {
 				post("record: write error: %s\n", sf_strerror(player.recordFile));
@@ -303,15 +345,17 @@ int RtAudioBackend::render(float* output, unsigned int frames)
 
 		player.done = done;
 		if (player.done) {
-			finalizePlayer(*it);
+			// closing the file and dropping the player's lists is left to the reclaimer.
+			Player* finished = it->release();
 			it = players_.erase(it);
+			if (!poolDefer(&RtAudioBackend::reclaimPlayer, finished)) {
+				reclaimPlayer(finished);
+			}
 		} else {
 			++it;
 		}
 	}
 
-	std::copy(mix_.begin(), mix_.end(), output);
-
 	if (players_.empty()) {
 		closeStreamLocked();
 	}
@@ -319,7 +363,7 @@ int RtAudioBackend::render(float* output, unsigned int frames)
 	return 0;
 }
 
-bool RtAudioBackend::ensureStreamLocked()
+bool RtAudioBackend::ensureStreamLocked(Thread& th)
 {
 	if (streamOpen_) {
 		return true;
@@ -345,7 +389,8 @@ bool RtAudioBackend::ensureStreamLocked()
 	options.flags = 0;
 
 	streamSampleRate_ = static_cast<unsigned int>(vm.ar.sampleRate);
-	unsigned int frames = kFramesPerBuffer;
+	// ask for a buffer of one signal block, so that each callback takes whole blocks.
+	unsigned int frames = static_cast<unsigned int>(vm.ar.blockSize);
 
 	RtAudioErrorType err = audio_.openStream(&params, nullptr, RTAUDIO_FLOAT32, streamSampleRate_, &frames, &RtAudioBackend::audioCallback, this, &options);
 	if (err != RTAUDIO_NO_ERROR) {
@@ -363,6 +408,7 @@ bool RtAudioBackend::ensureStreamLocked()
 	}
 
 	streamOpen_ = true;
+	vm.useDeviceBlockSize(th, static_cast<int>(frames));
 	return true;
 }
 
@@ -394,6 +440,16 @@ void RtAudioBackend::removeFinishedLocked()
 	}
 }
 
+bool RtAudioBackend::isRecording(const Player& player)
+{
+#if defined(__APPLE__) || defined(SAPF_USE_LIBSNDFILE)
+	return player.recordFile != nullptr;
+#else
+	(void)player;
+	return false;
+#endif
+}
+
 void RtAudioBackend::finalizePlayer(std::unique_ptr<Player>& player)
 {
 #if defined(__APPLE__)
@@ -429,6 +485,12 @@ void RtAudioBackend::finalizePlayer(std::unique_ptr<Player>& player)
 #endif
 }
 
+void RtAudioBackend::reclaimPlayer(void* player)
+{
+	std::unique_ptr<Player> owned(static_cast<Player*>(player));
+	finalizePlayer(owned);
+}
+
 std::unique_ptr<AudioBackend> CreateRtAudioBackend()
 {
 	try {
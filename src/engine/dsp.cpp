@@ -18,6 +18,8 @@
 #include <string.h>
 #include <stdio.h>
 #include <cmath>
+#include <atomic>
+#include <mutex>
 
 // MSVC compatibility for __builtin_clzll (count leading zeros for 64-bit)
 #if defined(_MSC_VER)
@@ -270,49 +272,59 @@ void FFT::backward_real(double *inReal, double *inImag, double *outReal) {
 
 FFT ffts[kMaxFFTLogSize+1];
 
-void initFFT()
+// each size is set up the first time it is used. setting up every size when the
+// builtins were registered was the largest part of sapf's startup time.
+static std::atomic<bool> sFFTReady[kMaxFFTLogSize+1];
+static std::mutex sFFTInitMutex;
+
+static FFT& getFFT(int log2n)
 {
-	for (int i = kMinFFTLogSize; i <= kMaxFFTLogSize; ++i) {
-		ffts[i].init(i);
+	if (log2n >= kMinFFTLogSize && log2n <= kMaxFFTLogSize && !sFFTReady[log2n].load(std::memory_order_acquire)) {
+		std::lock_guard<std::mutex> lock(sFFTInitMutex);
+		if (!sFFTReady[log2n].load(std::memory_order_relaxed)) {
+			ffts[log2n].init(log2n);
+			sFFTReady[log2n].store(true, std::memory_order_release);
+		}
 	}
+	return ffts[log2n];
 }
 
 void fft(int n, double* inReal, double* inImag, double* outReal, double* outImag)
 {
 	int log2n = n == 0 ? 0 : 64 - __builtin_clzll(n - 1);
-	ffts[log2n].forward(inReal, inImag, outReal, outImag);
+	getFFT(log2n).forward(inReal, inImag, outReal, outImag);
 }
 
 void ifft(int n, double* inReal, double* inImag, double* outReal, double* outImag)
 {
 	int log2n = n == 0 ? 0 : 64 - __builtin_clzll(n - 1);
-	ffts[log2n].backward(inReal, inImag, outReal, outImag);
+	getFFT(log2n).backward(inReal, inImag, outReal, outImag);
 }
 
 void fft(int n, double* ioReal, double* ioImag)
 {
 	int log2n = n == 0 ? 0 : 64 - __builtin_clzll(n - 1);
-	ffts[log2n].forward_in_place(ioReal, ioImag);
+	getFFT(log2n).forward_in_place(ioReal, ioImag);
 }
 
 void ifft(int n, double* ioReal, double* ioImag)
 {
 	int log2n = n == 0 ? 0 : 64 - __builtin_clzll(n - 1);
-	ffts[log2n].backward_in_place(ioReal, ioImag);
+	getFFT(log2n).backward_in_place(ioReal, ioImag);
 }
 
 
 void rfft(int n, double* inReal, double* outReal, double* outImag)
 {
 	int log2n = n == 0 ? 0 : 64 - __builtin_clzll(n - 1);
-	ffts[log2n].forward_real(inReal, outReal, outImag);
+	getFFT(log2n).forward_real(inReal, outReal, outImag);
 }
 
 
 void rifft(int n, double* inReal, double* inImag, double* outReal)
 {
 	int log2n = n == 0 ? 0 : 64 - __builtin_clzll(n - 1);
-	ffts[log2n].backward_real(inReal, inImag, outReal);
+	getFFT(log2n).backward_real(inReal, inImag, outReal);
 }
 
 
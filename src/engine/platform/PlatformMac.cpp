@@ -17,6 +17,7 @@
 #if defined(__APPLE__)
 
 #include "sapf/platform/Platform.hpp"
+#include "RCObj.hpp"
 #include <CoreFoundation/CoreFoundation.h>
 #include <dispatch/dispatch.h>
 #include <stdlib.h>
@@ -47,6 +48,7 @@ void runAsync(std::function<void()> task, bool detach)
 
 void runEventLoop()
 {
+    RCParkScope parked;
     CFRunLoopRun();
 }
 
@@ -66,6 +68,9 @@ void runReplLoop(std::function<void()> task)
         exit(0);
     });
 
+    // what this thread made before the REPL started is released on the REPL's thread.
+    // nothing the main run loop runs touches sapf objects.
+    RCParkScope parked;
     CFRunLoopRun();
 }
 
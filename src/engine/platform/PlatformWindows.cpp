@@ -17,6 +17,7 @@
 #if defined(_WIN32)
 
 #include "sapf/platform/Platform.hpp"
+#include "RCObj.hpp"
 #include <thread>
 #include <mutex>
 #include <condition_variable>
@@ -48,6 +49,7 @@ void runAsync(std::function<void()> task, bool detach)
     if (detach) {
         t.detach();
     } else {
+        RCParkScope parked;
         t.join();
     }
 }
@@ -55,6 +57,7 @@ void runAsync(std::function<void()> task, bool detach)
 void runEventLoop()
 {
     gEventLoopRunning = true;
+    RCParkScope parked;
     std::unique_lock<std::mutex> lock(gEventLoopMutex);
     gEventLoopCV.wait(lock, []{ return !gEventLoopRunning.load(); });
 }
@@ -84,6 +87,8 @@ void runReplLoop(std::function<void()> task)
     });
 
     {
+        // what this thread made before the REPL started is released on the REPL's thread.
+        RCParkScope parked;
         std::unique_lock<std::mutex> lock(mtx);
         cv.wait(lock, [&]{ return done; });
     }
@@ -75,3 +75,8 @@ P<String> getsym(const char* name)
         delete newSymbol;
 	}	
 }
+
+bool isSymbol(String* s)
+{
+	return SymbolTable_lookup(s->s, s->hash) == s;
+}
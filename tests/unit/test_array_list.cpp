@@ -10,6 +10,10 @@
 #include "test_common.hpp"
 #include "VM.hpp"
 #include "ErrorCodes.hpp"
+#include "WorkPool.hpp"
+#include "DelayUGens.hpp"
+#include <thread>
+#include <string.h>
 
 // Test fixture for Array and List tests
 class ArrayListTest : public SapfTestBase {
@@ -283,3 +287,620 @@ TEST_F(ArrayListTest, ArrayGrowth) {
     EXPECT_DOUBLE_EQ(arr->at(99).f, 99.0);
 }
 
+
+TEST_F(ArrayListTest, ZArrayGrowthPastPoolSizes) {
+    P<Array> arr = new Array(itemTypeZ, 1);
+    for (int i = 0; i < 40000; i++) {
+        arr->addz((Z)i);
+    }
+    EXPECT_EQ(arr->size(), 40000);
+    EXPECT_DOUBLE_EQ(arr->atz(0), 0.0);
+    EXPECT_DOUBLE_EQ(arr->atz(39999), 39999.0);
+}
+
+TEST_F(ArrayListTest, Float32ArrayNarrowsAndWidens) {
+    P<Array> f = new Array(itemTypeZ, 4, true);
+    EXPECT_TRUE(f->isZ());
+    EXPECT_TRUE(f->isF());
+    EXPECT_EQ(f->elemSize(), sizeof(float));
+    f->addz(0.25);
+    f->addz(-3.0);
+    f->addz(0.1);
+    EXPECT_DOUBLE_EQ(f->atz(0), 0.25);
+    EXPECT_DOUBLE_EQ(f->at(1).f, -3.0);
+    EXPECT_DOUBLE_EQ(f->atz(2), (double)0.1f);
+
+    P<Array> z = new Array(itemTypeZ, 1);
+    z->addAll(f());
+    EXPECT_FALSE(z->isF());
+    EXPECT_EQ(z->size(), 3);
+    EXPECT_DOUBLE_EQ(z->z()[1], -3.0);
+}
+
+TEST_F(ArrayListTest, PackfIsReadThroughZIn) {
+    const int n = 1000;
+    P<List> list = new List(itemTypeZ, n);
+    for (int i = 0; i < n; ++i)
+        list->addz(i * 0.25);
+    P<List> packed = list->packf(th);
+    ASSERT_TRUE(packed->mArray->isF());
+    EXPECT_EQ(packed->mArray->size(), n);
+
+    ZIn in(packed);
+    std::vector<Z> out(n + 10, -1.);
+    int num = n + 10;
+    EXPECT_TRUE(in.fill(th, num, out.data(), 1));
+    EXPECT_EQ(num, n);
+    for (int i = 0; i < n; ++i)
+        ASSERT_DOUBLE_EQ(out[i], i * 0.25) << i;
+    EXPECT_DOUBLE_EQ(out[n], 0.);
+
+    // raw readers get a widened copy.
+    P<List> wide = packed->pack(th);
+    EXPECT_FALSE(wide->mArray->isF());
+    EXPECT_DOUBLE_EQ(wide->mArray->z()[n - 1], (n - 1) * 0.25);
+}
+
+TEST_F(ArrayListTest, ZInMixesIntoInterleavedFloats) {
+    // two channels of a stereo buffer: one mixed twice, one a constant, as the backends do.
+    V ramp = run("natz 1000 N");
+    ZIn left(ramp), left2(ramp), right(V(0.5));
+    const int frames = 700;
+    std::vector<float> out(2 * frames, 0.f);
+    int n = frames;
+    EXPECT_FALSE(left.mix(th, n, out.data(), 2));
+    EXPECT_EQ(n, frames);
+    n = frames;
+    EXPECT_FALSE(left2.mix(th, n, out.data(), 2));
+    n = frames;
+    EXPECT_FALSE(right.mix(th, n, out.data() + 1, 2));
+    for (int i = 0; i < frames; ++i) {
+        ASSERT_FLOAT_EQ(out[2 * i], 2.f * i) << i;
+        ASSERT_FLOAT_EQ(out[2 * i + 1], 0.5f) << i;
+    }
+
+    // the end of the signal adds nothing, and is reported.
+    n = frames;
+    EXPECT_TRUE(left.mix(th, n, out.data(), 2));
+    EXPECT_EQ(n, 300);
+    EXPECT_FLOAT_EQ(out[0], 700.f);
+    EXPECT_FLOAT_EQ(out[2 * 299], 2.f * 299 + 999.f);
+    EXPECT_FLOAT_EQ(out[2 * 300], 600.f);
+}
+
+TEST_F(ArrayListTest, PackfPrim) {
+    V result = run("[1 2.5 3] Z packf 1 at");
+    EXPECT_DOUBLE_EQ(result.f, 2.5);
+}
+
+//==============================================================================
+// Block pool
+//==============================================================================
+
+TEST_F(ArrayListTest, PoolRoundsToSizeClasses) {
+    EXPECT_EQ(poolRoundSize(1), 16u);
+    EXPECT_EQ(poolRoundSize(200), 208u);
+    EXPECT_EQ(poolRoundSize(257), 512u);
+    EXPECT_EQ(poolRoundSize(4096), 4096u);
+    EXPECT_EQ(poolRoundSize(kPoolMaxSize + 1), kPoolMaxSize + 1);
+}
+
+TEST_F(ArrayListTest, PoolReusesFreedBlocks) {
+    void* a = poolAlloc(100);
+    poolFree(a, 100);
+    poolResetStats();
+    void* b = poolAlloc(112);
+    EXPECT_EQ(a, b);
+    poolFree(b, 112);
+
+    PoolStats stats;
+    poolGetStats(stats);
+    EXPECT_EQ(stats.mHits, 1);
+    EXPECT_EQ(stats.mMisses, 0);
+}
+
+TEST_F(ArrayListTest, PoolRenderThreadDoesNotMissInSteadyState) {
+    P<List> s = (List*)run("300 0 sinosc 2 * 0.5 +").o();
+    int savePrefill = vm.poolPrefill;
+    vm.poolPrefill = 4;
+    PoolStats stats;
+    {
+        // the render thread frees the head of s, which this thread made. were this thread
+        // not parked yet, the head would wait in its queue and hold the whole chain.
+        RCParkScope parked;
+        std::thread render([&]() {
+            poolEnterRenderThread();
+            for (int i = 0; i < 64; ++i) {
+                s->force(th);
+                s = s->next();
+            }
+            poolResetStats();
+            for (int i = 0; i < 256; ++i) {
+                s->force(th);
+                s = s->next();
+            }
+            poolGetStats(stats);
+            s = nullptr;
+        });
+        render.join();
+    }
+    vm.poolPrefill = savePrefill;
+
+    EXPECT_GT(stats.mHits, 256);
+    EXPECT_EQ(stats.mRenderMisses, 0);
+}
+
+TEST_F(ArrayListTest, RenderThreadSpillsSurplusMagazines) {
+    // a render thread that frees far more than it allocates keeps a few magazines
+    // of the blocks and hands the rest back to the depot for other threads.
+    const int count = 4096;
+    std::vector<void*> blocks;
+    for (int i = 0; i < count; ++i)
+        blocks.push_back(poolAlloc(48));
+    std::atomic<bool> freed{false}, checked{false};
+    std::thread render([&]() {
+        poolEnterRenderThread();
+        for (void* p : blocks)
+            poolFree(p, 48);
+        freed = true;
+        while (!checked) std::this_thread::yield();
+    });
+    while (!freed) std::this_thread::yield();
+    poolReclaim();
+    poolResetStats();
+    for (int i = 0; i < count; ++i)
+        blocks[i] = poolAlloc(48);
+    PoolStats stats;
+    poolGetStats(stats);
+    checked = true;
+    render.join();
+    for (void* p : blocks)
+        poolFree(p, 48);
+
+    // a miss cuts a whole magazine from a slab, so keeping every block would cost
+    // one miss per magazine.
+    EXPECT_GT(stats.mRefills, 0);
+    EXPECT_LT(stats.mMisses, 16);
+}
+
+static int64_t liveZLists() {
+    std::vector<PoolTypeStats> stats;
+    poolGetTypeStats(stats);
+    for (PoolTypeStats const& entry : stats)
+        if (entry.mName == "ZList") return entry.mLive;
+    return 0;
+}
+
+TEST_F(ArrayListTest, RenderThreadDefersLongChains) {
+    int64_t before = liveZLists();
+    PoolStats stats;
+    poolGetStats(stats);
+    int64_t deferredBefore = stats.mDeferred;
+
+    std::thread render([]() {
+        poolEnterRenderThread();
+        P<Array> empty = new Array(itemTypeZ, 0);
+        P<List> chain;
+        for (int i = 0; i < 100000; ++i)
+            chain = new List(empty, chain);
+        chain = nullptr;
+    });
+    render.join();
+
+    // the reclaimer may be freeing the rest of the chain already.
+    for (int i = 0; i < 1000 && liveZLists() != before; ++i) {
+        if (!poolReclaim())
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    EXPECT_EQ(liveZLists(), before);
+    poolGetStats(stats);
+    EXPECT_GT(stats.mDeferred, deferredBefore);
+}
+
+TEST_F(ArrayListTest, ReclaimerWakesForDeferredWork) {
+    static std::atomic<int> ran{0};
+    auto count = [](void*) { ++ran; };
+    poolStartReclaimer();
+    ran = 0;
+    ASSERT_TRUE(poolDefer(count, nullptr));
+    for (int i = 0; i < 1000 && ran == 0; ++i)
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    EXPECT_EQ(ran, 1);
+
+    // a stopped reclaimer leaves the work for whoever reclaims.
+    poolStopReclaimer();
+    ASSERT_TRUE(poolDefer(count, nullptr));
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    EXPECT_EQ(ran, 1);
+    EXPECT_EQ(poolReclaim(), 1u);
+    EXPECT_EQ(ran, 2);
+    poolStartReclaimer();
+}
+
+TEST_F(ArrayListTest, WindowRefDropsOldBlocks) {
+    V ref = run("natz 1000 wref");
+    ASSERT_TRUE(ref.isRef());
+    int64_t before = liveZLists();
+
+    ZIn in(ref.deref());
+    std::vector<Z> out(4096);
+    for (int i = 0; i < 100000 / 4000; ++i) {
+        int n = 4000;
+        EXPECT_FALSE(in.fill(th, n, out.data(), 1));
+    }
+    EXPECT_DOUBLE_EQ(out[3999], 99999.);
+
+    // the ref's head is no more than a block behind the last 1000 samples forced.
+    Z forced = ceil(100000. / kDefaultZBlockSize) * kDefaultZBlockSize;
+    V head = ref.deref();
+    ASSERT_TRUE(head.isZList());
+    Z first = ((List*)head.o())->mArray->atz(0);
+    EXPECT_LE(first, forced - 1000.);
+    EXPECT_GE(first, forced - 1000. - kDefaultZBlockSize);
+    EXPECT_LT(liveZLists() - before, 8);
+}
+
+TEST_F(ArrayListTest, BindWindowWrapsInfiniteSignals) {
+    double saveWindow = vm.bindWindow;
+    vm.bindWindow = 1.;
+    V bound = run("natz = windowedSignal  windowedSignal");
+    vm.bindWindow = saveWindow;
+    ASSERT_TRUE(bound.isRef());
+    EXPECT_STREQ(bound.o()->TypeName(), "WindowRef");
+    EXPECT_EQ(((WindowRef*)bound.o())->window(), (int64_t)ceil(th.rate.sampleRate));
+}
+
+TEST_F(ArrayListTest, ListForceSkipsTheLock) {
+    listForceCountsReset();
+    V sig = run("natz 20000 N");
+    std::vector<Z> out(20000);
+    ZIn a(sig);
+    int n = 20000;
+    EXPECT_FALSE(a.fill(th, n, out.data(), 1));
+    ListForceCounts first;
+    listForceCounts(first);
+    EXPECT_GT(first.mClaimed, 0);
+
+    // a second reader finds every block forced already.
+    ZIn b(sig);
+    n = 20000;
+    EXPECT_FALSE(b.fill(th, n, out.data(), 1));
+    EXPECT_DOUBLE_EQ(out[19999], 19999.);
+    ListForceCounts second;
+    listForceCounts(second);
+    EXPECT_EQ(second.mClaimed, first.mClaimed);
+    EXPECT_GT(second.mForced, first.mForced);
+}
+
+TEST_F(ArrayListTest, ListForcedByTwoThreads) {
+    const int frames = 200000;
+    V sig = run("natz 0.001 * sin 200000 N");
+    std::vector<Z> left(frames), right(frames);
+    auto reader = [&](std::vector<Z>& out) {
+        Thread th2(th);
+        ZIn in(sig);
+        int n = frames;
+        in.fill(th2, n, out.data(), 1);
+    };
+    std::thread other([&]() { reader(right); });
+    reader(left);
+    other.join();
+    for (int i = 0; i < frames; i += 997)
+        ASSERT_DOUBLE_EQ(left[i], sin(i * 0.001)) << i;
+    EXPECT_EQ(left, right);
+}
+
+TEST_F(ArrayListTest, PanSiblingsForcedByTwoThreads) {
+    const int frames = 100000;
+    for (const char* code : { "natz .001 * sin 100000 N natz .0001 * sin pan2",
+                              "natz .001 * sin 100000 N natz .002 * sin natz .0001 * sin bal2",
+                              "natz .001 * sin 100000 N natz .002 * sin natz .0001 * sin rot2" }) {
+        auto render = [&](bool twoThreads) {
+            V sig = run(code);
+            Array* sides = ((List*)sig.o())->mArray();
+            std::vector<std::vector<Z>> out(2, std::vector<Z>(frames));
+            auto reader = [&](int i) {
+                Thread th2(th);
+                ZIn in(sides->at(i));
+                int n = frames;
+                in.fill(th2, n, out[i].data(), 1);
+            };
+            if (twoThreads) {
+                std::thread other([&]() { reader(1); });
+                reader(0);
+                other.join();
+            } else {
+                reader(0);
+                reader(1);
+            }
+            return out;
+        };
+        std::vector<std::vector<Z>> serial = render(false);
+        std::vector<std::vector<Z>> parallel = render(true);
+        EXPECT_NE(serial[1][frames / 2], 0.) << code;
+        EXPECT_EQ(serial, parallel) << code;
+    }
+}
+
+TEST_F(ArrayListTest, MultiOutputSiblingsForcedByThreads) {
+    // each output of fdn, itd and ola read on a thread of its own.
+    const int frames = 30000;
+    for (const char* code : { "fdn",
+                              "natz .001 * sin 30000 N natz .0001 * sin .001 itd",
+                              "[100 200 300 400 500 600] 0 sinosc 3000 N [-.5 .5 -.2 .2 0 .8] pan2 .001 1 2 ola" }) {
+        auto render = [&](bool threads) {
+            // fdn has no word, so it is made directly. it picks its delays with random().
+            srandom(1);
+            V sig = strcmp(code, "fdn") ? run(code)
+                : V(fdnOutputs(th, run("natz .001 * sin 30000 N"), .5, .01, .05, 2., 1.5, 1., 1.));
+            Array* sides = ((List*)sig.o())->mArray();
+            int numSides = (int)sides->size();
+            std::vector<std::vector<Z>> out(numSides, std::vector<Z>(frames));
+            auto reader = [&](int i) {
+                Thread th2(th);
+                ZIn in(sides->at(i));
+                int n = frames;
+                in.fill(th2, n, out[i].data(), 1);
+            };
+            if (threads) {
+                std::vector<std::thread> others;
+                for (int i = 1; i < numSides; ++i)
+                    others.emplace_back([&, i]() { reader(i); });
+                reader(0);
+                for (std::thread& other : others) other.join();
+            } else {
+                for (int i = 0; i < numSides; ++i) reader(i);
+            }
+            return out;
+        };
+        std::vector<std::vector<Z>> serial = render(false);
+        std::vector<std::vector<Z>> parallel = render(true);
+        ASSERT_EQ(serial.size(), 2u) << code;
+        EXPECT_NE(serial[1][frames / 2], 0.) << code;
+        EXPECT_EQ(serial, parallel) << code;
+    }
+}
+
+TEST_F(ArrayListTest, ConstantBlocksReadAsScalars) {
+    V sig = run("3 everz");
+    ZIn a(sig);
+    int n = kDefaultZBlockSize, stride = 1;
+    Z* buf;
+    EXPECT_FALSE(a(th, n, stride, buf));
+    EXPECT_EQ(stride, 0);
+    EXPECT_DOUBLE_EQ(*buf, 3.);
+    ASSERT_TRUE(sig.isZList());
+    EXPECT_TRUE(((List*)sig.o())->mArray->isConstant());
+
+    // hangz is constant only past the end of its input.
+    V hung = run("natz 10 N hangz");
+    ZIn h(hung);
+    n = 10;
+    EXPECT_FALSE(h(th, n, stride, buf));
+    EXPECT_EQ(stride, 1);
+    h.advance(n);
+    n = kDefaultZBlockSize;
+    EXPECT_FALSE(h(th, n, stride, buf));
+    EXPECT_EQ(stride, 0);
+    EXPECT_DOUBLE_EQ(*buf, 9.);
+
+    V flat = run("[2 2] [1] 1 lines");
+    ZIn l(flat);
+    n = kDefaultZBlockSize;
+    EXPECT_FALSE(l(th, n, stride, buf));
+    EXPECT_EQ(stride, 0);
+    EXPECT_DOUBLE_EQ(*buf, 2.);
+}
+
+TEST_F(ArrayListTest, ConstantBlocksKeepFilterOutput) {
+    const int frames = 4000;
+    std::vector<Z> scalar(frames), block(frames);
+    V a = run("natz 0.3 * sin 800 lpf 4000 N");
+    V b = run("natz 0.3 * sin 800 everz lpf 4000 N");
+    int n = frames;
+    ZIn(a).fill(th, n, scalar.data(), 1);
+    n = frames;
+    ZIn(b).fill(th, n, block.data(), 1);
+    for (int i = 0; i < frames; ++i)
+        ASSERT_DOUBLE_EQ(scalar[i], block[i]) << i;
+
+    // a frequency that is flat for some blocks and then moves.
+    a = run("natz 0.3 * sin [400 400 1000] [0.01 0.05] 1 lines 2 * lpf1 4000 N");
+    b = run("natz 0.3 * sin [800 800 2000] [0.01 0.05] 1 lines lpf1 4000 N");
+    n = frames;
+    ZIn(a).fill(th, n, scalar.data(), 1);
+    n = frames;
+    ZIn(b).fill(th, n, block.data(), 1);
+    for (int i = 0; i < frames; ++i)
+        ASSERT_NEAR(scalar[i], block[i], 1e-12) << i;
+
+    // writing into a constant array makes it an ordinary one.
+    P<Array> arr = new Array(itemTypeZ, 4);
+    arr->addz(1.);
+    arr->setConstant();
+    arr->addz(2.);
+    EXPECT_FALSE(arr->isConstant());
+}
+
+TEST_F(ArrayListTest, SilentBlocksPropagate) {
+    // a product with silence is silent, and so is its pan.
+    V prod = run("natz 1 mum *");
+    ASSERT_TRUE(prod.isZList());
+    List* list = (List*)prod.o();
+    list->force(th);
+    EXPECT_TRUE(list->mArray->isSilent());
+    EXPECT_DOUBLE_EQ(list->mArray->atz(100), 0.);
+
+    V panned = run("0 1 dust 0.5 pan2");
+    ASSERT_TRUE(panned.isVList());
+    for (int i = 0; i < 2; ++i) {
+        List* side = (List*)((List*)panned.o())->mArray->at(i).o();
+        side->force(th);
+        EXPECT_TRUE(side->mArray->isSilent()) << i;
+    }
+
+    // a sum is silent only when both inputs are.
+    V sum = run("natz 1 mum +");
+    list = (List*)sum.o();
+    list->force(th);
+    EXPECT_FALSE(list->mArray->isSilent());
+
+    // silence times inf is nan, fused or not.
+    bool saveFuseon = vm.fuseon;
+    for (int fuse = 0; fuse < 2; ++fuse) {
+        vm.fuseon = fuse;
+        for (const char* code : { "1 0 / everz 0 * 4 N", "1 0 / everz 0 1 dust * 4 N" }) {
+            Z out[4];
+            int n = 4;
+            ZIn(run(code)).fill(th, n, out, 1);
+            for (int i = 0; i < 4; ++i)
+                EXPECT_TRUE(std::isnan(out[i])) << code << " fuse " << fuse << " " << i;
+        }
+    }
+    vm.fuseon = saveFuseon;
+}
+
+TEST_F(ArrayListTest, ZeroTimesOrOverNonFiniteIsNaN) {
+    // a literal 0 takes no shortcut past a denominator or factor that is 0, inf or nan.
+    EXPECT_TRUE(std::isnan(run("0 0 /").f));
+    EXPECT_TRUE(std::isnan(run("0 1 0 / *").f));
+    EXPECT_TRUE(std::isnan(run("1 0 / 0 *").f));
+
+    V list = run("0 [0 1] /");
+    ASSERT_TRUE(list.isVList());
+    List* quotients = (List*)list.o();
+    quotients->force(th);
+    Array* items = quotients->mArray();
+    EXPECT_TRUE(std::isnan(items->at(0).f));
+    EXPECT_EQ(items->at(1).f, 0.);
+
+    for (const char* code : { "0 0 everz / 4 N", "0 everz 0 / 4 N", "0 everz 0 everz / 4 N",
+                              "0 1 0 / everz * 4 N", "0 everz 1 0 / * 4 N" }) {
+        Z out[4];
+        int n = 4;
+        ZIn(run(code)).fill(th, n, out, 1);
+        for (int i = 0; i < 4; ++i)
+            EXPECT_TRUE(std::isnan(out[i])) << code << " " << i;
+    }
+}
+
+TEST_F(ArrayListTest, NaNIsNotTakenForSilence) {
+    // a filter whose state went nan stays nan once its input falls silent.
+    Z out[1024];
+    int n = 1024;
+    ZIn(run("0 0 / everz 64 N 1 mum $ 2000 lpf")).fill(th, n, out, 1);
+    EXPECT_TRUE(std::isnan(out[1023]));
+
+    // silence panned or balanced by a nan position is nan.
+    for (const char* code : { "0 0 0 / pan2", "0 0 0 0 / bal2" }) {
+        V sides = run(code);
+        ASSERT_TRUE(sides.isVList()) << code;
+        for (int i = 0; i < 2; ++i) {
+            List* side = (List*)((List*)sides.o())->mArray->at(i).o();
+            side->force(th);
+            EXPECT_FALSE(side->mArray->isSilent()) << code << " " << i;
+            EXPECT_TRUE(std::isnan(side->mArray->atz(0))) << code << " " << i;
+        }
+    }
+}
+
+TEST_F(ArrayListTest, FilterTailDecaysToSilence) {
+    V out = run("natz 0.1 * sin 512 N 1 mum $ 2000 lpf");
+    List* list = (List*)out.o();
+    int block = 0;
+    Z tail = 0.;
+    for (; block < 200; ++block) {
+        list->force(th);
+        if (list->mArray->isSilent()) break;
+        Array* a = list->mArray();
+        tail = a->atz(a->size() - 1);
+        list = list->nextp();
+    }
+    // the filter rang on past its input before going silent.
+    EXPECT_GT(block, 1);
+    EXPECT_LT(block, 200);
+    EXPECT_LT(std::abs(tail), 1e-9);
+    EXPECT_DOUBLE_EQ(list->mArray->atz(0), 0.);
+}
+
+TEST_F(ArrayListTest, WorkPoolMatchesSerialOla) {
+    // overlapping sources, so that several are active in every block.
+    const char* code = "[100 200 300 400 500 600 700 800] 0 sinosc 3000 N 1000 lpf .001 1 1 ola";
+    const int frames = 30000;
+    auto render = [&]() {
+        std::vector<Z> out(frames);
+        V sig = run(code);
+        ZIn in(((List*)sig.o())->mArray->at(0));
+        int n = frames;
+        in.fill(th, n, out.data(), 1);
+        return out;
+    };
+    std::vector<Z> serial = render();
+
+    workPoolResetStats();
+    workPoolSetSize(th, 4);
+    std::vector<Z> parallel = render();
+    workPoolSetSize(th, 0);
+    EXPECT_EQ(workPoolSize(), 0);
+    WorkPoolStats stats;
+    workPoolStats(stats);
+    EXPECT_GT(stats.mSubmitted, 0);
+    EXPECT_EQ(stats.mRun + stats.mStolen + stats.mWaited, stats.mSubmitted);
+
+    EXPECT_NE(serial[frames / 2], 0.);
+    EXPECT_EQ(serial, parallel);
+
+    // sources that draw random numbers as they are pulled.
+    code = "[100 200 300 400 500 600 700 800] 1 dust 3000 N .001 1 1 ola";
+    th.rgen.init(1);
+    serial = render();
+    workPoolSetSize(th, 4);
+    th.rgen.init(1);
+    parallel = render();
+    workPoolSetSize(th, 0);
+    EXPECT_TRUE(std::any_of(serial.begin(), serial.end(), [](Z z) { return z != 0.; }));
+    EXPECT_EQ(serial, parallel);
+}
+
+TEST_F(ArrayListTest, ControlPeriodReadsHeldScalars) {
+    V sig = run("natz 1000 N");
+    ZIn a(sig);
+    a.setControlPeriod(16);
+    int n = 100, stride = 1;
+    Z* buf;
+    EXPECT_FALSE(a(th, n, stride, buf));
+    EXPECT_EQ(n, 16);
+    EXPECT_EQ(stride, 0);
+    EXPECT_DOUBLE_EQ(*buf, 0.);
+    a.advance(10);
+    n = 100;
+    EXPECT_FALSE(a(th, n, stride, buf));
+    EXPECT_EQ(n, 6);
+    EXPECT_DOUBLE_EQ(*buf, 10.);
+
+    // a resonant filter's scalar path computes what its per-frame path does.
+    const int frames = 4096;
+    auto render = [&](const char* code) {
+        std::vector<Z> out(frames);
+        ZIn in(run(code));
+        int remaining = frames;
+        in.fill(th, remaining, out.data(), 1);
+        return out;
+    };
+    std::vector<Z> perFrame = render("natz .01 * sin 1000 natz 1e-300 * + .5 rlpf");
+    std::vector<Z> scalar = render("natz .01 * sin 1000 .5 rlpf");
+    EXPECT_EQ(perFrame, scalar);
+
+    // a slow sweep read every 16 frames stays close to the sweep read every frame.
+    const char* sweep = "natz .01 * sin 2 0 sinosc 500 * 1000 + .5 rlpf";
+    std::vector<Z> audioRate = render(sweep);
+    int saveAutokr = vm.autokr;
+    vm.autokr = 16;
+    std::vector<Z> controlRate = render(sweep);
+    vm.autokr = saveAutokr;
+    Z maxDiff = 0.;
+    for (int i = 0; i < frames; ++i)
+        maxDiff = std::max(maxDiff, std::abs(audioRate[i] - controlRate[i]));
+    EXPECT_GT(maxDiff, 0.);
+    EXPECT_LT(maxDiff, 1e-3);
+}
@@ -8,6 +8,9 @@
 
 #include <gtest/gtest.h>
 #include "VM.hpp"  // Needed for RCObj::retain/release inline definitions
+#include "sapf/platform/Platform.hpp"
+#include <fstream>
+#include <thread>
 
 // Test fixture for reference counting tests
 class RefCountTest : public ::testing::Test {
@@ -235,3 +238,256 @@ TEST_F(RefCountTest, AtomicRefcountType) {
     EXPECT_TRUE(obj->refcount.is_lock_free());
     delete obj;
 }
+
+//==============================================================================
+// Pool allocation and live objects per type
+//==============================================================================
+
+class BigTestObject : public Object {
+public:
+    char mData[10000];
+    const char* TypeName() const override { return "BigTestObject"; }
+};
+
+static PoolTypeStats liveOfType(const char* name) {
+    std::vector<PoolTypeStats> stats;
+    poolGetTypeStats(stats);
+    for (PoolTypeStats const& entry : stats)
+        if (entry.mName == name) return entry;
+    return { name, 0, 0 };
+}
+
+TEST_F(RefCountTest, PooledObjectsAreCountedByType) {
+    PoolTypeStats before = liveOfType("TestObject");
+    {
+        P<TestObject> a = new TestObject();
+        P<TestObject> b = new TestObject();
+        EXPECT_EQ(poolObjectSize(a()), poolRoundSize(sizeof(TestObject)));
+
+        PoolTypeStats during = liveOfType("TestObject");
+        EXPECT_EQ(during.mLive, before.mLive + 2);
+        EXPECT_EQ(during.mBytes, before.mBytes + 2 * (int64_t)poolObjectSize(a()));
+    }
+    PoolTypeStats after = liveOfType("TestObject");
+    EXPECT_EQ(after.mLive, before.mLive);
+    EXPECT_EQ(after.mBytes, before.mBytes);
+}
+
+TEST_F(RefCountTest, LargeObjectsGetTheirOwnSlab) {
+    P<BigTestObject> big = new BigTestObject();
+    EXPECT_EQ(poolObjectSize(big()), sizeof(BigTestObject));
+    EXPECT_EQ(liveOfType("BigTestObject").mLive, 1);
+    big = nullptr;
+    EXPECT_EQ(liveOfType("BigTestObject").mLive, 0);
+}
+
+TEST_F(RefCountTest, NewTypeNamesShareASlotAcrossThreads) {
+    // each thread counts through its own copy of a name no thread has seen, as
+    // classes in different libraries can, and all of them must land in one slot.
+    const int numThreads = 4, perThread = 100;
+    std::vector<std::string> names(numThreads, "SharedNewTypeName");
+    std::vector<uint8_t> slots(numThreads * perThread);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < numThreads; ++t) {
+        threads.emplace_back([&, t]() {
+            for (int i = 0; i < perThread; ++i)
+                slots[t * perThread + i] = poolCountObject(names[t].c_str(), 32);
+        });
+    }
+    for (std::thread& thread : threads) thread.join();
+    for (uint8_t slot : slots) EXPECT_EQ(slot, slots[0]);
+
+    PoolTypeStats counted = liveOfType("SharedNewTypeName");
+    EXPECT_EQ(counted.mLive, numThreads * perThread);
+    EXPECT_EQ(counted.mBytes, numThreads * perThread * 32);
+    for (uint8_t slot : slots) poolUncountObject(slot, 32);
+    EXPECT_EQ(liveOfType("SharedNewTypeName").mLive, 0);
+}
+
+TEST_F(RefCountTest, UnpooledObjectsAreNotCounted) {
+    PoolTypeStats before = liveOfType("TestObject");
+    TestObject onStack;
+    onStack.retain();
+    EXPECT_EQ(liveOfType("TestObject").mLive, before.mLive);
+    onStack.refcount = 0;
+}
+
+TEST_F(RefCountTest, AllocationsAndPeaksAreCountedByType) {
+    poolResetStats();
+    PoolTypeStats before = liveOfType("TestObject");
+    {
+        std::vector<P<TestObject>> objects;
+        for (int i = 0; i < 10; ++i)
+            objects.push_back(new TestObject());
+        poolSampleTypes();
+    }
+    PoolTypeStats after = liveOfType("TestObject");
+    EXPECT_EQ(after.mLive, before.mLive);
+    EXPECT_EQ(after.mAllocs, before.mAllocs + 10);
+    EXPECT_GE(after.mPeakLive, before.mLive + 10);
+
+    poolResetStats();
+    PoolTypeStats reset = liveOfType("TestObject");
+    EXPECT_EQ(reset.mAllocs, 0);
+    EXPECT_EQ(reset.mPeakLive, reset.mLive);
+}
+
+TEST_F(RefCountTest, TypeStatsWrittenAsJSON) {
+    P<TestObject> a = new TestObject();
+    std::string path = ::testing::TempDir() + "sapf_test_minfo.json";
+    ASSERT_TRUE(poolWriteTypeJSON(path.c_str()));
+    std::ifstream in(path);
+    std::string json((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    remove(path.c_str());
+
+    EXPECT_NE(json.find("\"peak_bytes\": "), std::string::npos) << json;
+    EXPECT_NE(json.find("{ \"name\": \"TestObject\", \"live\": "), std::string::npos) << json;
+}
+
+TEST_F(RefCountTest, ObjectsFreedOnOtherThreads) {
+    PoolTypeStats before = liveOfType("TestObject");
+    std::vector<P<TestObject>> objects;
+    for (int i = 0; i < 1000; ++i)
+        objects.push_back(new TestObject());
+
+    // each thread frees a share of the objects made here, and makes and frees its own.
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; ++t) {
+        threads.emplace_back([&objects, t]() {
+            for (size_t i = t; i < objects.size(); i += 4)
+                objects[i] = nullptr;
+            for (int i = 0; i < 1000; ++i) {
+                P<TestObject> o = new TestObject();
+            }
+        });
+    }
+    for (std::thread& thread : threads)
+        thread.join();
+    rcDrainQueue();
+
+    PoolTypeStats after = liveOfType("TestObject");
+    EXPECT_EQ(after.mLive, before.mLive);
+    EXPECT_EQ(after.mBytes, before.mBytes);
+}
+
+TEST_F(RefCountTest, ReleasedOnOtherThreadIsFreedOnce) {
+    TestObject::resetCounters();
+    P<TestObject> obj = new TestObject();
+    P<TestObject> copy = obj;
+    std::thread([&obj]() {
+        // takes and drops references of its own, then drops one of the owner's.
+        for (int i = 0; i < 100; ++i) {
+            P<TestObject> local = obj;
+        }
+        obj = nullptr;
+    }).join();
+    rcDrainQueue();
+    EXPECT_EQ(TestObject::destructCount, 0);
+    EXPECT_EQ(copy->getRefcount(), 1);
+    copy = nullptr;
+    rcDrainQueue();
+    EXPECT_EQ(TestObject::destructCount, 1);
+}
+
+TEST_F(RefCountTest, LastReferenceDroppedOnOtherThread) {
+    TestObject::resetCounters();
+    P<TestObject> obj = new TestObject();
+    std::thread([&obj]() {
+        obj = nullptr;
+    }).join();
+    // the owner merges the queued object the next time it drains its queue.
+    rcDrainQueue();
+    EXPECT_EQ(TestObject::destructCount, 1);
+}
+
+TEST_F(RefCountTest, ParkedOwnerDoesNotDelayFrees) {
+    TestObject::resetCounters();
+    P<TestObject> obj = new TestObject();
+    std::thread other([&obj]() {
+        obj = nullptr;
+    });
+    {
+        RCParkScope parked;
+        other.join();
+        EXPECT_EQ(TestObject::destructCount, 1);
+    }
+}
+
+TEST_F(RefCountTest, OwnerWaitingForAHelperDoesNotDelayFrees) {
+    TestObject::resetCounters();
+    P<TestObject> obj = new TestObject();
+    // the owner does not park itself or drain its queue. waiting for the helper parks it.
+    sapf::platform::runAsync([&obj]() {
+        obj = nullptr;
+    }, false);
+    EXPECT_EQ(TestObject::destructCount, 1);
+}
+
+TEST_F(RefCountTest, OwnerUnparksWhileOthersMerge) {
+    TestObject::resetCounters();
+    const int count = 2000;
+    std::vector<P<TestObject>> mine, theirs;
+    for (int i = 0; i < count; ++i) {
+        mine.push_back(new TestObject());
+        theirs.push_back(mine.back());
+    }
+    std::atomic<bool> done{false};
+    std::thread other([&theirs, &done]() {
+        for (P<TestObject>& obj : theirs)
+            obj = nullptr;
+        done = true;
+    });
+    // the owner keeps counting its own references between parks.
+    while (!done) {
+        {
+            RCParkScope parked;
+        }
+        for (P<TestObject>& obj : mine) {
+            P<TestObject> local = obj;
+        }
+    }
+    other.join();
+    rcDrainQueue();
+    EXPECT_EQ(TestObject::destructCount, 0);
+    for (P<TestObject>& obj : mine)
+        EXPECT_EQ(obj->getRefcount(), 1);
+    mine.clear();
+    rcDrainQueue();
+    EXPECT_EQ(TestObject::destructCount, count);
+}
+
+TEST_F(RefCountTest, ObjectOutlivesTheThreadThatMadeIt) {
+    TestObject::resetCounters();
+    P<TestObject> obj;
+    std::thread([&obj]() {
+        obj = new TestObject();
+    }).join();
+    EXPECT_EQ(obj->getRefcount(), 1);
+    P<TestObject> copy = obj;
+    obj = nullptr;
+    EXPECT_EQ(TestObject::destructCount, 0);
+    copy = nullptr;
+    EXPECT_EQ(TestObject::destructCount, 1);
+}
+
+TEST_F(RefCountTest, ConcurrentRetainsAndReleases) {
+    TestObject::resetCounters();
+    P<TestObject> obj = new TestObject();
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; ++t) {
+        threads.emplace_back([&obj]() {
+            for (int i = 0; i < 10000; ++i) {
+                P<TestObject> local = obj;
+            }
+        });
+    }
+    for (int i = 0; i < 10000; ++i) {
+        P<TestObject> local = obj;
+    }
+    for (std::thread& thread : threads)
+        thread.join();
+    EXPECT_EQ(obj->getRefcount(), 1);
+    obj = nullptr;
+    rcDrainQueue();
+    EXPECT_EQ(TestObject::destructCount, 1);
+}
@@ -94,6 +94,23 @@ TEST_F(ValueTest, IsStringFalseForReal) {
     EXPECT_FALSE(v.isString());
 }
 
+TEST_F(ValueTest, IsEachOpForEachOpObject) {
+    int32_t live = gLiveEachOps.load();
+    V args[3] = { V(1.0), V(new String("a")), V(2.0) };
+    EXPECT_FALSE(hasEachOps(args, 3));
+    {
+        V each(new EachOp(V(3.0), 1));
+        EXPECT_TRUE(each.isEachOp());
+        EXPECT_FALSE(args[1].isEachOp());
+        EXPECT_EQ(gLiveEachOps.load(), live + 1);
+        args[2] = each;
+        EXPECT_TRUE(hasEachOps(args, 3));
+        EXPECT_FALSE(hasEachOps(args, 2));
+        args[2] = V(2.0);
+    }
+    EXPECT_EQ(gLiveEachOps.load(), live);
+}
+
 //==============================================================================
 // Type name tests
 //==============================================================================
@@ -294,3 +311,55 @@ TEST_F(ValueTest, ObjectReleasedOnValueDestruction) {
 
     EXPECT_EQ(str->getRefcount(), 1);
 }
+
+TEST_F(ValueTest, AssignedValueReleasesOldObject) {
+    P<String> a = new String("a");
+    P<String> b = new String("b");
+    V v(a);
+    v = V(b);
+    EXPECT_EQ(a->getRefcount(), 1);
+    EXPECT_EQ(b->getRefcount(), 2);
+    v = 2.5;
+    EXPECT_EQ(b->getRefcount(), 1);
+    EXPECT_DOUBLE_EQ(v.f, 2.5);
+}
+
+TEST_F(ValueTest, ClearingObjectMakesReal) {
+    P<String> str = new String("test");
+    V v(str);
+    v.o = nullptr;
+    EXPECT_TRUE(v.isReal());
+    EXPECT_EQ(str->getRefcount(), 1);
+
+    V r(1.5);
+    r.o = nullptr;
+    EXPECT_DOUBLE_EQ(r.f, 1.5);
+}
+
+//==============================================================================
+// Layout tests
+//==============================================================================
+
+TEST_F(ValueTest, AnyNaNIsReal) {
+    // a negative quiet NaN with bit 50 set, the form a NaN-boxed V gives objects.
+    int64_t bits = (int64_t)0xFFFC000012345678ULL;
+    double boxLike;
+    memcpy(&boxLike, &bits, sizeof(boxLike));
+    V v(boxLike);
+    EXPECT_TRUE(v.isReal());
+    EXPECT_TRUE(std::isnan(v.f));
+
+    V w(-std::numeric_limits<double>::quiet_NaN());
+    EXPECT_TRUE(w.isReal());
+    EXPECT_TRUE(std::isnan(w.f));
+}
+
+#ifdef SAPF_NAN_BOXING
+TEST_F(ValueTest, NaNBoxedValueIsEightBytes) {
+    EXPECT_EQ(sizeof(V), 8u);
+    P<String> str = new String("test");
+    V v(str);
+    EXPECT_TRUE(v.isObject());
+    EXPECT_EQ(v.o(), str());
+}
+#endif
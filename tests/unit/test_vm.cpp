@@ -10,8 +10,12 @@
 #include "test_common.hpp"
 #include "VM.hpp"
 #include "Opcode.hpp"
+#include "Snapshot.hpp"
+#include "Profiler.hpp"
 #include "ErrorCodes.hpp"
 #include <cmath>
+#include <filesystem>
+#include <fstream>
 
 // Test fixture for VM tests
 class VMTest : public SapfTestBase {
@@ -401,6 +405,441 @@ TEST_F(VMTest, FunctionApplyMultipleArgs) {
     EXPECT_DOUBLE_EQ(result.f, 7.0);
 }
 
+//==============================================================================
+// Superinstructions
+//==============================================================================
+
+TEST_F(VMTest, SuperinstructionsAreFused) {
+    P<Fun> fun;
+    ASSERT_TRUE(th.compile("\\x y [x y x sqrt +]", fun, true));
+    fun->apply(th);
+    V f = th.pop();
+    ASSERT_TRUE(f.isFun());
+    Code* code = ((Fun*)f.o())->mDef->mCode();
+    Opcode* ops = code->getOps();
+    // a reference to a local variable compiles to opCallLocalVar
+    EXPECT_EQ(ops[0].op, opCallLocalVarCallLocalVar);
+    EXPECT_EQ(ops[1].op, opCallLocalVar);
+    EXPECT_EQ(ops[2].op, opCallLocalVarCallImmediate);
+    EXPECT_EQ(ops[3].op, opCallImmediate);
+    EXPECT_EQ(ops[4].op, opTailCallImmediate);
+    EXPECT_EQ(ops[5].op, opReturn);
+    EXPECT_EQ(baseOpcode(ops[2].op), opCallLocalVar);
+}
+
+TEST_F(VMTest, SuperinstructionsExecute) {
+    V result = run("9 16 \\x y [x y x sqrt + +] !");
+    EXPECT_DOUBLE_EQ(result.f, 28.0);
+    result = run("\\n [n 2 -5 abs * +] = h  4 h");
+    EXPECT_DOUBLE_EQ(result.f, 14.0);
+    result = run("7 \\x [`x 3 +] !");
+    EXPECT_DOUBLE_EQ(result.f, 10.0);
+}
+
+TEST_F(VMTest, TracedInterpreterMatchesUntraced) {
+    vm.traceon = true;
+    V result = run("3 \\x [x 1 + x *] !");
+    vm.traceon = false;
+    EXPECT_DOUBLE_EQ(result.f, 12.0);
+}
+
+//==============================================================================
+// Frame arena
+//==============================================================================
+
+TEST_F(VMTest, OperandStackOverflowThrows) {
+    for (size_t i = 0; i < th.stack.capacity(); ++i)
+        th.push(1.);
+    try {
+        th.push(1.);
+        FAIL() << "expected errStackOverflow";
+    } catch (int err) {
+        EXPECT_EQ(err, errStackOverflow);
+    }
+    th.clearStack();
+    EXPECT_EQ(th.stack.size(), 0u);
+}
+
+TEST_F(VMTest, CallDepthLimit) {
+    size_t savedMaxCallDepth = vm.maxCallDepth;
+    vm.maxCallDepth = 64;
+    // the recursive call is not in tail position, so each level adds a frame
+    V f = run("\\n f [n 0 > \\[n 1 - f 1 +] \\[0] if] Y");
+    try {
+        th.push(1000.);
+        f.apply(th);
+        FAIL() << "expected errStackOverflow";
+    } catch (int err) {
+        EXPECT_EQ(err, errStackOverflow);
+    }
+    vm.maxCallDepth = savedMaxCallDepth;
+
+    // frames are unwound by the exception
+    EXPECT_EQ(th.callDepth, 0u);
+    EXPECT_EQ(th.local.size(), 0u);
+    th.clearStack();
+    th.push(10.);
+    f.apply(th);
+    EXPECT_DOUBLE_EQ(th.pop().f, 10.0);
+}
+
+//==============================================================================
+// Tail calls
+//==============================================================================
+
+TEST_F(VMTest, TailCallIsMarked) {
+    V f = run("\\x [x 1 + sqrt]");
+    Opcode* ops = ((Fun*)f.o())->mDef->mCode()->getOps();
+    EXPECT_EQ(ops[3].op, opTailCallImmediate);
+    EXPECT_EQ(ops[4].op, opReturn);
+    EXPECT_EQ(baseOpcode(opTailCallImmediate), opCallImmediate);
+
+    // code in parens runs in the enclosing frame, so its last call is not a tail call
+    f = run("\\x [(x 1 +) 2]");
+    Opcode* parenOps = ((Code*)((Fun*)f.o())->mDef->mCode()->getOps()[0].v.o())->getOps();
+    EXPECT_EQ(parenOps[2].op, opCallImmediate);
+    EXPECT_EQ(parenOps[3].op, opReturn);
+}
+
+TEST_F(VMTest, TailRecursionRunsInConstantDepth) {
+    size_t savedMaxCallDepth = vm.maxCallDepth;
+    vm.maxCallDepth = 64;
+    V f = run("\\n acc f [n 0 > \\[n 1 - acc n + f] \\[acc] if] Y");
+    th.push(10000.);
+    th.push(0.);
+    f.apply(th);
+    vm.maxCallDepth = savedMaxCallDepth;
+    EXPECT_DOUBLE_EQ(th.pop().f, 50005000.0);
+    EXPECT_EQ(th.callDepth, 0u);
+}
+
+TEST_F(VMTest, TailCallKeepsCallerResults) {
+    // the values pushed before the tail call stay below the callee's results
+    V result = run("\\[7] \\x [1 2 x] ! + +");
+    EXPECT_DOUBLE_EQ(result.f, 10.0);
+    // a tail call with each-op arguments is made normally
+    result = run("[1 2 3] \\x [x @ 2 *] ! 1 at");
+    EXPECT_DOUBLE_EQ(result.f, 4.0);
+}
+
+//==============================================================================
+// Bytecode optimizer
+//==============================================================================
+
+TEST_F(VMTest, OptimizerFoldsConstants) {
+    V f = run("\\x [2 3 + 4 * sqrt x *]");
+    Opcode* ops = ((Fun*)f.o())->mDef->mCode()->getOps();
+    EXPECT_EQ(ops[0].op, opPushImmediate);
+    EXPECT_DOUBLE_EQ(ops[0].v.f, sqrt(20.));
+    EXPECT_EQ(ops[1].op, opCallLocalVar);
+    EXPECT_EQ(ops[2].op, opTailCallImmediate);
+
+    V result = run("1 2 + 3 *");
+    EXPECT_DOUBLE_EQ(result.f, 9.0);
+    // lists and variables are not folded
+    result = run("[1 2] 3 + 1 at");
+    EXPECT_DOUBLE_EQ(result.f, 5.0);
+}
+
+TEST_F(VMTest, OptimizerRemovesOpNonePadding) {
+    V f = run("\\[1 2 = (a b) a b -]");
+    Code* code = ((Fun*)f.o())->mDef->mCode();
+    for (int64_t i = 0; i < code->size(); ++i)
+        EXPECT_NE(code->getOps()[i].op, opNone);
+    f.apply(th);
+    EXPECT_DOUBLE_EQ(th.pop().f, -1.0);
+
+    // the opNone ending a bind from list is kept
+    V result = run("[3 4] = [c d] c d -");
+    EXPECT_DOUBLE_EQ(result.f, -1.0);
+}
+
+TEST_F(VMTest, OptimizerSharesClosedFuns) {
+    V f = run("\\[\\x [x 1 +]]");
+    f.apply(th);
+    V g1 = th.pop();
+    f.apply(th);
+    V g2 = th.pop();
+    ASSERT_TRUE(g1.isFun());
+    EXPECT_EQ(g1.o(), g2.o());
+
+    // a lambda that captures a variable still makes a new Fun each time
+    f = run("\\y [\\x [x y +]]");
+    th.push(1.);
+    f.apply(th);
+    g1 = th.pop();
+    th.push(1.);
+    f.apply(th);
+    g2 = th.pop();
+    EXPECT_NE(g1.o(), g2.o());
+}
+
+TEST_F(VMTest, OptimizerCanBeTurnedOff) {
+    vm.optimizeon = false;
+    V f = run("\\x [2 3 + x *]");
+    vm.optimizeon = true;
+    Opcode* ops = ((Fun*)f.o())->mDef->mCode()->getOps();
+    EXPECT_EQ(ops[0].op, opPushImmediate);
+    EXPECT_EQ(ops[1].op, opPushImmediateCallImmediate);
+    th.push(4.);
+    f.apply(th);
+    EXPECT_DOUBLE_EQ(th.pop().f, 20.0);
+}
+
+//==============================================================================
+// Workspace inline caches
+//==============================================================================
+
+TEST_F(VMTest, WorkspaceOpsGetInlineCaches) {
+    V f = run("7 = wsCacheA  \\x [wsCacheA x +]");
+    ASSERT_TRUE(f.isFun());
+    Opcode* ops = ((Fun*)f.o())->mDef->mCode()->getOps();
+    ASSERT_EQ(ops[0].op, opCallWorkspaceVar);
+    EXPECT_NE(ops[0].v.i, 0);
+    // repeated calls go through the filled cache
+    for (int i = 0; i < 3; ++i) {
+        th.push(1.);
+        f.apply(th);
+        EXPECT_DOUBLE_EQ(th.pop().f, 8.0);
+    }
+}
+
+TEST_F(VMTest, WorkspaceCacheInvalidation) {
+    P<GForm> form = new GForm();
+    P<GForm> otherForm = new GForm();
+    WorkspaceCache cache;
+    V value;
+    EXPECT_FALSE(cache.lookup(form(), value));
+
+    cache.fill(form(), gWorkspaceVersion.load(), V(3.));
+    ASSERT_TRUE(cache.lookup(form(), value));
+    EXPECT_DOUBLE_EQ(value.f, 3.0);
+    EXPECT_FALSE(cache.lookup(otherForm(), value));
+
+    // any new binding anywhere invalidates every cache
+    form->putImpure(getsym("wsCacheB"), V(1.));
+    EXPECT_FALSE(cache.lookup(form(), value));
+}
+
+//==============================================================================
+// Startup snapshots
+//==============================================================================
+
+TEST_F(VMTest, SnapshotRestoresWorkspace) {
+    run("\\x [x 2 *] = dbl  [1 [2 3] 4] = lst  {:a 1 :b 2} = frm  \"hi\" = str  0");
+    std::string path = ::testing::TempDir() + "sapf_test_workspace.snapshot";
+    ASSERT_TRUE(writeSnapshot(th, path.c_str(), 42, vm.udfHelp.size()));
+    ASSERT_TRUE(openSnapshot(path.c_str()));
+
+    Thread th2;
+    EXPECT_FALSE(loadSnapshotWorkspace(th2, 43)); // written from a different prelude
+    bool loaded = loadSnapshotWorkspace(th2, 42);
+    closeSnapshot();
+    remove(path.c_str());
+    ASSERT_TRUE(loaded);
+
+    P<Fun> fun;
+    ASSERT_TRUE(th2.compile("5 dbl  lst 1 at 1 at +  frm.b +  str size +", fun, true));
+    fun->apply(th2);
+    EXPECT_DOUBLE_EQ(th2.pop().f, 17.0);
+}
+
+TEST_F(VMTest, SnapshotKeepsBuiltinSignals) {
+    V saw;
+    ASSERT_TRUE(vm.builtins->getInner(V(getsym("sawTbl")), saw));
+    Array* a = ((List*)saw.o())->mArray();
+    std::string path = ::testing::TempDir() + "sapf_test_signals.snapshot";
+    ASSERT_TRUE(writeSnapshot(th, path.c_str(), 0, vm.udfHelp.size()));
+    ASSERT_TRUE(openSnapshot(path.c_str()));
+
+    P<List> copy = snapshotBuiltinSignal("sawTbl", a->size());
+    EXPECT_FALSE(snapshotBuiltinSignal("sawTbl", a->size() + 1)());
+    closeSnapshot();
+    remove(path.c_str());
+
+    ASSERT_TRUE(copy());
+    ASSERT_EQ(copy->mArray->size(), a->size());
+    EXPECT_EQ(memcmp(copy->mArray->z(), a->z(), a->size() * sizeof(Z)), 0);
+    EXPECT_FALSE(openSnapshot(path.c_str()));
+}
+
+//==============================================================================
+// Compiled code cache
+//==============================================================================
+
+static std::string writeTestSource(const char* name, const char* text) {
+    std::string path = ::testing::TempDir() + name;
+    FILE* f = fopen(path.c_str(), "w");
+    fputs(text, f);
+    fputs("\n", f); // loadFile drops the last character
+    fclose(f);
+    return path;
+}
+
+static double workspaceReal(Thread& th, const char* name) {
+    V value;
+    if (!th.mWorkspace->get(th, V(getsym(name)), value) || !value.isReal()) return -1.;
+    return value.f;
+}
+
+TEST_F(VMTest, CodeCacheReusesCompiledFile) {
+    std::string dir = ::testing::TempDir() + "sapf_test_code_cache";
+    std::filesystem::remove_all(dir);
+    std::string path = writeTestSource("sapf_test_cached.txt", "\\x [x 3 *] = cachedTriple  7 cachedTriple = cachedResult");
+    vm.code_cache_dir = dir.c_str();
+    int64_t hits = vm.codeCacheHits, writes = vm.codeCacheWrites;
+
+    Thread th1;
+    ASSERT_TRUE(loadFile(th1, path.c_str()));
+    Thread th2;
+    ASSERT_TRUE(loadFile(th2, path.c_str()));
+    EXPECT_EQ(vm.codeCacheWrites - writes, 1);
+    EXPECT_EQ(vm.codeCacheHits - hits, 1);
+    EXPECT_DOUBLE_EQ(workspaceReal(th1, "cachedResult"), 21.);
+    EXPECT_DOUBLE_EQ(workspaceReal(th2, "cachedResult"), 21.);
+
+    // changed text is a different entry
+    writeTestSource("sapf_test_cached.txt", "\\x [x 4 *] = cachedTriple  7 cachedTriple = cachedResult");
+    Thread th3;
+    ASSERT_TRUE(loadFile(th3, path.c_str()));
+    EXPECT_EQ(vm.codeCacheHits - hits, 1);
+    EXPECT_DOUBLE_EQ(workspaceReal(th3, "cachedResult"), 28.);
+
+    vm.code_cache_dir = nullptr;
+    std::filesystem::remove_all(dir);
+    remove(path.c_str());
+}
+
+TEST_F(VMTest, CodeCacheRejectsShadowedBuiltin) {
+    std::string dir = ::testing::TempDir() + "sapf_test_code_cache";
+    std::filesystem::remove_all(dir);
+    std::string path = writeTestSource("sapf_test_shadow.txt", "9 sqrt = cachedRoot");
+    vm.code_cache_dir = dir.c_str();
+
+    Thread th1;
+    ASSERT_TRUE(loadFile(th1, path.c_str()));
+    int64_t stale = vm.codeCacheStale;
+
+    // sqrt was compiled as the builtin. here it is a workspace function.
+    Thread th2;
+    P<Fun> fun;
+    ASSERT_TRUE(th2.compile("\\x [x 2 *] = sqrt", fun, true));
+    fun->run(th2);
+    ASSERT_TRUE(loadFile(th2, path.c_str()));
+    EXPECT_EQ(vm.codeCacheStale - stale, 1);
+    EXPECT_DOUBLE_EQ(workspaceReal(th1, "cachedRoot"), 3.);
+    EXPECT_DOUBLE_EQ(workspaceReal(th2, "cachedRoot"), 18.);
+
+    vm.code_cache_dir = nullptr;
+    std::filesystem::remove_all(dir);
+    remove(path.c_str());
+}
+
+//==============================================================================
+// Profiler
+//==============================================================================
+
+TEST_F(VMTest, ProfilerCountsFunsAndPrims) {
+    P<Fun> fun;
+    ASSERT_TRUE(th.compile("\\x [x 1 +] = profInc  \\x [x profInc] = profTail", fun, true));
+    fun->run(th);
+
+    profileReset();
+    vm.profileon = true;
+    ASSERT_TRUE(th.compile("1 profInc profInc profInc profTail", fun, true));
+    fun->run(th);
+    vm.profileon = false;
+    EXPECT_DOUBLE_EQ(th.pop().f, 5.);
+
+    std::string path = ::testing::TempDir() + "sapf_test_profile.json";
+    ASSERT_TRUE(profileWriteJSON(th, path.c_str()));
+    std::ifstream in(path);
+    std::string json((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    remove(path.c_str());
+
+    // profTail's tail call to profInc takes over its record
+    EXPECT_NE(json.find("{ \"name\": \"profInc\", \"kind\": \"fun\", \"calls\": 4,"), std::string::npos) << json;
+    EXPECT_NE(json.find("{ \"name\": \"profTail\", \"kind\": \"fun\", \"calls\": 1,"), std::string::npos) << json;
+    EXPECT_NE(json.find("{ \"name\": \"+\", \"kind\": \"prim\", \"calls\": 4,"), std::string::npos) << json;
+    profileReset();
+}
+
+//==============================================================================
+// Signal fusion
+//==============================================================================
+
+static std::vector<Z> signalValues(V v, Thread& th) {
+    std::vector<Z> values;
+    P<List> packed = ((List*)v.o())->pack(th);
+    for (int64_t i = 0; i < packed->mArray->size(); ++i)
+        values.push_back(packed->mArray->z()[i]);
+    return values;
+}
+
+TEST_F(VMTest, FusedSignalMathMatchesUnfused) {
+    const char* exprs[] = {
+        "#[1 2 3 4 5] 2 * #[10 20 30 40] + sin 0.5 *",
+        // longer than one tile of the fused kernel
+        "300 0 sinosc 3 * 1 + abs sqrt 0.25 * 200 N",
+    };
+    for (const char* expr : exprs) {
+        vm.fuseon = false;
+        std::vector<Z> plain = signalValues(run(expr), th);
+        vm.fuseon = true;
+        std::vector<Z> fused = signalValues(run(expr), th);
+        ASSERT_EQ(plain.size(), fused.size()) << expr;
+        for (size_t i = 0; i < plain.size(); ++i)
+            EXPECT_DOUBLE_EQ(plain[i], fused[i]) << expr << " @ " << i;
+    }
+
+    V v = run("#[1 2 3] 2 * 1 + sqrt");
+    ASSERT_TRUE(v.isZList());
+    EXPECT_STREQ(((List*)v.o())->mGen->TypeName(), "FusedOpZGen");
+    vm.fuseon = false;
+    v = run("#[1 2 3] 2 * 1 + sqrt");
+    EXPECT_STREQ(((List*)v.o())->mGen->TypeName(), "UnaryOpZGen");
+    vm.fuseon = true;
+}
+
+TEST_F(VMTest, WithBlockSizeSetsGraphBlockSize) {
+    V v = run("\\[300 0 sinosc] 128 withBlockSize");
+    ASSERT_TRUE(v.isZList());
+    P<List> s = (List*)v.o();
+    s->force(th);
+    EXPECT_EQ(s->mArray->size(), 128);
+    EXPECT_EQ(th.rate.blockSize, vm.ar.blockSize);
+
+    std::vector<Z> plain = signalValues(run("300 0 sinosc 1000 N"), th);
+    std::vector<Z> small = signalValues(run("\\[300 0 sinosc 1000 N] 64 withBlockSize"), th);
+    ASSERT_EQ(plain.size(), small.size());
+    for (size_t i = 0; i < plain.size(); ++i)
+        EXPECT_DOUBLE_EQ(plain[i], small[i]) << i;
+
+    EXPECT_THROW(run("\\[300 0 sinosc] 4 withBlockSize"), int);
+}
+
+TEST_F(VMTest, EngineBlockSizeFollowsDevice) {
+    int saveBlockSize = vm.ar.blockSize;
+    bool saveFixed = vm.fixedBlockSize;
+
+    vm.fixedBlockSize = false;
+    vm.useDeviceBlockSize(th, 256);
+    EXPECT_EQ(vm.ar.blockSize, 256);
+    EXPECT_EQ(th.rate.blockSize, 256);
+    EXPECT_DOUBLE_EQ(run("blockSize").f, 256.);
+
+    // an explicit block size is kept whatever the device's buffer is.
+    EXPECT_DOUBLE_EQ(run("64 setBlockSize blockSize").f, 64.);
+    EXPECT_TRUE(vm.fixedBlockSize);
+    EXPECT_GE(vm.kr.blockSize, 1);
+    vm.useDeviceBlockSize(th, 1024);
+    EXPECT_EQ(vm.ar.blockSize, 64);
+
+    vm.setBlockSize(saveBlockSize);
+    vm.fixedBlockSize = saveFixed;
+    th.rate = vm.ar;
+}
+
 //==============================================================================
 // Type checking operations
 //==============================================================================